@@ -21,10 +21,7 @@
 #include "env_detail_controller.h"
 #include "tier0/icommandline.h"
 #include "c_world.h"
-
-#include "tier0/valve_minmax_off.h"
-#include <algorithm>
-#include "tier0/valve_minmax_on.h"
+#include "vstdlib/jobthread.h"
 
 #if defined(DOD_DLL) || defined(CSTRIKE_DLL)
 #define USE_DETAIL_SHAPES
@@ -50,6 +47,11 @@ struct model_t;
 
 ConVar cl_detaildist( "cl_detaildist", "1200", 0, "Distance at which detail props are no longer visible" );
 ConVar cl_detailfade( "cl_detailfade", "400", 0, "Distance across which detail props fade in" );
+static ConVar cl_threaded_detail_sprites( "cl_threaded_detail_sprites", "1", 0, "Build out and sort detail sprites for each leaf on the thread pool" );
+
+// Don't bother with the thread pool for fewer sprites than this
+#define DETAIL_SPRITE_THREAD_THRESHOLD	1024
+
 #if defined( USE_DETAIL_SHAPES ) 
 ConVar cl_detail_max_sway( "cl_detail_max_sway", "0", FCVAR_ARCHIVE, "Amplitude of the detail prop sway" );
 ConVar cl_detail_avoid_radius( "cl_detail_avoid_radius", "0", FCVAR_ARCHIVE, "radius around detail sprite to avoid players" );
@@ -407,6 +409,9 @@ public:
 	// Method of ISpatialLeafEnumerator
 	bool EnumerateLeaf( int leaf, int context );
 
+	// Times sprite build out and sorting along a fixed camera path
+	void RunBenchmark( int nFrames );
+
 	DetailPropLightstylesLump_t& DetailLighting( int i ) { return m_DetailLighting[i]; }
 	DetailPropSpriteDict_t& DetailSpriteDict( int i ) { return m_DetailSpriteDict[i]; }
 
@@ -428,12 +433,35 @@ private:
 		float m_flDistance;
 	};
 
+	// One leaf's worth of fast sprites being built out on the thread pool
+	struct FastSpriteBuildJob_t
+	{
+		CFastDetailLeafSpriteList *m_pData;
+		SortInfo_t *m_pSortInfo;
+		SortInfo_t *m_pSortTemp;
+		FastSpriteQuadBuildoutBufferX4_t *m_pQuadBuffer;
+		Vector m_vecViewOrigin;
+		Vector m_vecViewForward;
+		int m_nCount;
+	};
+
 	int BuildOutSortedSprites( CFastDetailLeafSpriteList *pData,
 							   Vector const &viewOrigin,
 							   Vector const &viewForward,
 							   Vector const &viewRight,
 							   Vector const &viewUp );
 
+	int BuildOutSortedSprites( CFastDetailLeafSpriteList *pData,
+							   Vector const &viewOrigin,
+							   Vector const &viewForward,
+							   SortInfo_t *pSortInfo,
+							   SortInfo_t *pSortTemp,
+							   FastSpriteQuadBuildoutBufferX4_t *pQuadBuffer );
+
+	// Builds out and sorts the sprites of every leaf in the list in parallel, into m_FastSpriteJobs
+	void BuildOutSortedSpritesThreaded( const Vector &viewOrigin, const Vector &viewForward, int nLeafCount, LeafIndex_t const *pLeafList );
+	void ProcessFastSpriteJob( FastSpriteBuildJob_t &job );
+
 	void RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList );
 
 	void UnserializeFastSprite( FastSpriteX4_t *pSpritex4, int nSubField, DetailObjectLump_t const &lump, bool bFlipped, Vector const &posOffset );
@@ -460,7 +488,7 @@ private:
 	void FreeSortBuffers( void );
 
 	// Sorts sprites in back-to-front order
-	static bool SortLessFunc( const SortInfo_t &left, const SortInfo_t &right );
+	static void RadixSortBackToFront( SortInfo_t *pSortInfo, SortInfo_t *pTemp, int nCount );
 	int SortSpritesBackToFront( int nLeaf, const Vector &viewOrigin, const Vector &viewForward, SortInfo_t *pSortInfo );
 
 	// For fast detail object insertion
@@ -484,8 +512,14 @@ private:
 	int m_nSortedFastLeaf;
 	SortInfo_t *m_pSortInfo;
 	SortInfo_t *m_pFastSortInfo;
+	SortInfo_t *m_pSortTemp;
 	FastSpriteQuadBuildoutBufferX4_t *m_pBuildoutBuffer;
 
+	// Per-leaf output of BuildOutSortedSpritesThreaded
+	CUtlVector<FastSpriteBuildJob_t> m_FastSpriteJobs;
+	CUtlVector<SortInfo_t> m_ThreadedSortInfo;
+	CUtlVector< FastSpriteQuadBuildoutBufferX4_t, CUtlMemoryAligned< FastSpriteQuadBuildoutBufferX4_t, 16 > > m_ThreadedBuildoutBuffer;
+
 	float m_flDefaultFadeStart;
 	float m_flDefaultFadeEnd;
 
@@ -1401,6 +1435,7 @@ CDetailObjectSystem::CDetailObjectSystem() : m_DetailSpriteDict( 0, 32 ), m_Deta
 	m_pFastSpriteData = NULL;
 	m_pSortInfo = NULL;
 	m_pFastSortInfo = NULL;
+	m_pSortTemp = NULL;
 	m_pBuildoutBuffer = NULL;
 }
 
@@ -1416,11 +1451,19 @@ void CDetailObjectSystem::FreeSortBuffers( void )
 		MemAlloc_FreeAligned(  m_pFastSortInfo );
 		m_pFastSortInfo = NULL;
 	}
+	if ( m_pSortTemp )
+	{
+		MemAlloc_FreeAligned(  m_pSortTemp );
+		m_pSortTemp = NULL;
+	}
 	if ( m_pBuildoutBuffer )
 	{
 		MemAlloc_FreeAligned(  m_pBuildoutBuffer );
 		m_pBuildoutBuffer = NULL;
 	}
+	m_FastSpriteJobs.Purge();
+	m_ThreadedSortInfo.Purge();
+	m_ThreadedBuildoutBuffer.Purge();
 }
 
 CDetailObjectSystem::~CDetailObjectSystem()
@@ -1748,6 +1791,11 @@ void CDetailObjectSystem::UnserializeModels( CUtlBuffer& buf )
 				( 1 + nMaxFastInLeaf / 4 ) * sizeof( FastSpriteQuadBuildoutBufferX4_t ),
 				sizeof( fltx4 ) ) );
 	}
+	if ( nMaxOldInLeaf || nMaxFastInLeaf )
+	{
+		m_pSortTemp = reinterpret_cast<SortInfo_t *> (
+			MemAlloc_AllocAligned( (3 + MAX( nMaxOldInLeaf, nMaxFastInLeaf ) ) * sizeof( SortInfo_t ), sizeof( fltx4 ) ) );
+	}
 
 	if ( nNumFastSpritesToAllocate )
 	{
@@ -2029,12 +2077,61 @@ int CDetailObjectSystem::CountSpriteQuadsInLeafList( int nLeafCount, LeafIndex_t
 #define TREATASINT(x) ( *(  ( (int32 const *)( &(x) ) ) ) )
 
 //-----------------------------------------------------------------------------
-// Sorts sprites in back-to-front order
+// Sorts sprites in back-to-front order. This is a radix sort on the distance
+// bits; the distances are squared, so they're never negative and compare the
+// same way as ints. pTemp must hold nCount entries.
 //-----------------------------------------------------------------------------
-inline bool CDetailObjectSystem::SortLessFunc( const CDetailObjectSystem::SortInfo_t &left, const CDetailObjectSystem::SortInfo_t &right )
+void CDetailObjectSystem::RadixSortBackToFront( SortInfo_t *pSortInfo, SortInfo_t *pTemp, int nCount )
 {
-	return TREATASINT( left.m_flDistance ) > TREATASINT( right.m_flDistance );
-//	return left.m_flDistance > right.m_flDistance;
+	if ( nCount <= 1 )
+		return;
+
+	int nHistogram[4][256];
+	memset( nHistogram, 0, sizeof( nHistogram ) );
+
+	// Keys are inverted so the farthest sprite sorts first
+	int i;
+	for ( i = 0; i < nCount; ++i )
+	{
+		uint32 nKey = ~(uint32)TREATASINT( pSortInfo[i].m_flDistance );
+		++nHistogram[0][ nKey & 0xFF ];
+		++nHistogram[1][ ( nKey >> 8 ) & 0xFF ];
+		++nHistogram[2][ ( nKey >> 16 ) & 0xFF ];
+		++nHistogram[3][ nKey >> 24 ];
+	}
+
+	SortInfo_t *pSrc = pSortInfo;
+	SortInfo_t *pDst = pTemp;
+	for ( int nPass = 0; nPass < 4; ++nPass )
+	{
+		int nShift = nPass * 8;
+
+		// Nothing to do if every key has the same digit
+		uint32 nFirstKey = ~(uint32)TREATASINT( pSrc[0].m_flDistance );
+		if ( nHistogram[nPass][ ( nFirstKey >> nShift ) & 0xFF ] == nCount )
+			continue;
+
+		int nOffset = 0;
+		for ( int nDigit = 0; nDigit < 256; ++nDigit )
+		{
+			int nDigitCount = nHistogram[nPass][nDigit];
+			nHistogram[nPass][nDigit] = nOffset;
+			nOffset += nDigitCount;
+		}
+
+		for ( i = 0; i < nCount; ++i )
+		{
+			uint32 nKey = ~(uint32)TREATASINT( pSrc[i].m_flDistance );
+			pDst[ nHistogram[nPass][ ( nKey >> nShift ) & 0xFF ]++ ] = pSrc[i];
+		}
+
+		V_swap( pSrc, pDst );
+	}
+
+	if ( pSrc != pSortInfo )
+	{
+		memcpy( pSortInfo, pSrc, nCount * sizeof( SortInfo_t ) );
+	}
 }
 
 
@@ -2108,8 +2205,7 @@ int CDetailObjectSystem::SortSpritesBackToFront( int nLeaf, const Vector &viewOr
 	if ( nCount )
 	{
 		VPROF( "CDetailObjectSystem::SortSpritesBackToFront -- Sort" );
-		std::make_heap( pSortInfo, pSortInfo + nCount, SortLessFunc ); 
-		std::sort_heap( pSortInfo, pSortInfo + nCount, SortLessFunc ); 
+		RadixSortBackToFront( pSortInfo, m_pSortTemp, nCount );
 	}
 
 	return nCount;
@@ -2133,12 +2229,27 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 												Vector const &viewForward,
 												Vector const &viewRight,
 												Vector const &viewUp )
+{
+	return BuildOutSortedSprites( pData, viewOrigin, viewForward, m_pFastSortInfo, m_pSortTemp, m_pBuildoutBuffer );
+}
+
+//-----------------------------------------------------------------------------
+// Does the vertex math and fading for a leaf's sprites into pQuadBuffer and
+// sorts them into pSortInfo. Only touches the buffers passed in, so this can
+// be run on several leaves at once.
+//-----------------------------------------------------------------------------
+int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData,
+												Vector const &viewOrigin,
+												Vector const &viewForward,
+												SortInfo_t *pSortInfo,
+												SortInfo_t *pSortTemp,
+												FastSpriteQuadBuildoutBufferX4_t *pQuadBuffer )
 {
 	// part 1 - do all vertex math, fading, etc into a buffer, using as much simd as we can
 	int nSIMDSprites = pData->m_nNumSIMDSprites;
 	FastSpriteX4_t const *pSprites = pData->m_pSprites;
-	SortInfo_t *pOut = m_pFastSortInfo;
-	FastSpriteQuadBuildoutBufferX4_t *pQuadBufferOut = m_pBuildoutBuffer;
+	SortInfo_t *pOut = pSortInfo;
+	FastSpriteQuadBuildoutBufferX4_t *pQuadBufferOut = pQuadBuffer;
 	int curidx = 0;
 	int nLastBfMask = 0;
 
@@ -2217,7 +2328,7 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 	} while( --nSIMDSprites );
 
 	// adjust count for tail
-	int nCount = pOut - m_pFastSortInfo;
+	int nCount = pOut - pSortInfo;
 	if ( nLastBfMask != 0xf )						// if last not skipped
 		nCount -= ( 0 - pData->m_nNumSprites ) & 3;
 
@@ -2225,13 +2336,66 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 	if ( nCount )
 	{
 		VPROF( "CDetailObjectSystem::SortSpritesBackToFront -- Sort" );
-		std::make_heap( m_pFastSortInfo, m_pFastSortInfo + nCount, SortLessFunc ); 
-		std::sort_heap( m_pFastSortInfo, m_pFastSortInfo + nCount, SortLessFunc ); 
+		RadixSortBackToFront( pSortInfo, pSortTemp, nCount );
 	}
 	return nCount;
 }
 
 
+void CDetailObjectSystem::ProcessFastSpriteJob( FastSpriteBuildJob_t &job )
+{
+	if ( job.m_pData )
+	{
+		job.m_nCount = BuildOutSortedSprites( job.m_pData, job.m_vecViewOrigin, job.m_vecViewForward,
+			job.m_pSortInfo, job.m_pSortTemp, job.m_pQuadBuffer );
+	}
+}
+
+
+void CDetailObjectSystem::BuildOutSortedSpritesThreaded( const Vector &viewOrigin, const Vector &viewForward, int nLeafCount, LeafIndex_t const *pLeafList )
+{
+	VPROF_BUDGET( "CDetailObjectSystem::BuildOutSortedSpritesThreaded", VPROF_BUDGETGROUP_DETAILPROP_RENDERING );
+
+	// Give every leaf its own slice of the output buffers
+	m_FastSpriteJobs.SetCount( nLeafCount );
+	int nTotalSIMDSprites = 0;
+	int i;
+	for ( i = 0; i < nLeafCount; ++i )
+	{
+		CFastDetailLeafSpriteList *pData = reinterpret_cast<CFastDetailLeafSpriteList *> (
+			ClientLeafSystem()->GetSubSystemDataInLeaf( pLeafList[i], CLSUBSYSTEM_DETAILOBJECTS ) );
+
+		FastSpriteBuildJob_t &job = m_FastSpriteJobs[i];
+		job.m_pData = pData;
+		job.m_vecViewOrigin = viewOrigin;
+		job.m_vecViewForward = viewForward;
+		job.m_nCount = 0;
+		if ( pData )
+		{
+			nTotalSIMDSprites += pData->m_nNumSIMDSprites;
+		}
+	}
+
+	m_ThreadedSortInfo.SetCount( nTotalSIMDSprites * 8 );
+	m_ThreadedBuildoutBuffer.SetCount( nTotalSIMDSprites );
+
+	int nSIMDOffset = 0;
+	for ( i = 0; i < nLeafCount; ++i )
+	{
+		FastSpriteBuildJob_t &job = m_FastSpriteJobs[i];
+		if ( !job.m_pData )
+			continue;
+
+		job.m_pSortInfo = m_ThreadedSortInfo.Base() + nSIMDOffset * 8;
+		job.m_pSortTemp = job.m_pSortInfo + job.m_pData->m_nNumSIMDSprites * 4;
+		job.m_pQuadBuffer = m_ThreadedBuildoutBuffer.Base() + nSIMDOffset;
+		nSIMDOffset += job.m_pData->m_nNumSIMDSprites;
+	}
+
+	ParallelProcess( "CDetailObjectSystem::BuildOutSortedSpritesThreaded", m_FastSpriteJobs.Base(), nLeafCount, this, &CDetailObjectSystem::ProcessFastSpriteJob );
+}
+
+
 void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList )
 {
 	// Here, we must draw all detail objects back-to-front
@@ -2246,6 +2410,13 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 	if  ( r_DrawDetailProps.GetInt() == 0 )
 		return;
 
+	// Build out and sort all the leaves up front on the thread pool, then draw them in order
+	bool bThreaded = ( nLeafCount > 1 && nQuadCount >= DETAIL_SPRITE_THREAD_THRESHOLD && 
+		cl_threaded_detail_sprites.GetBool() && g_pThreadPool->NumThreads() );
+	if ( bThreaded )
+	{
+		BuildOutSortedSpritesThreaded( viewOrigin, viewForward, nLeafCount, pLeafList );
+	}
 
 	CMatRenderContextPtr pRenderContext( materials );
 	pRenderContext->MatrixMode( MATERIAL_MODEL );
@@ -2291,12 +2462,24 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 		{
 			Assert( pData->m_nNumSprites );					// ptr with no sprites?
 
-			int nCount = BuildOutSortedSprites( pData, viewOrigin, viewForward, viewRight, viewUp );
+			int nCount;
+			SortInfo_t const *pDraw;
+			FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer;
+			if ( bThreaded )
+			{
+				FastSpriteBuildJob_t const &job = m_FastSpriteJobs[i];
+				nCount = job.m_nCount;
+				pDraw = job.m_pSortInfo;
+				pQuadBuffer = ( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) job.m_pQuadBuffer;
+			}
+			else
+			{
+				nCount = BuildOutSortedSprites( pData, viewOrigin, viewForward, viewRight, viewUp );
+				pDraw = m_pFastSortInfo;
+				pQuadBuffer = ( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
+			}
 
 			// part 3 - stuff the sorted sprites into the vb
-			SortInfo_t const *pDraw = m_pFastSortInfo;
-			FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer =
-				( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
 
 			COMPILE_TIME_ASSERT( sizeof( FastSpriteQuadBuildoutBufferNonSIMDView_t ) ==
 								 sizeof( FastSpriteQuadBuildoutBufferX4_t ) );
@@ -2809,3 +2992,80 @@ void CDetailObjectSystem::BuildDetailObjectRenderLists( const Vector &vViewOrigi
 									 cl_detaildist.GetFloat(), this, (int)&ctx );
 }
 
+
+//-----------------------------------------------------------------------------
+// Circles the current view origin, building out and sorting the fast sprites
+// of every leaf in the map each frame, both serially and on the thread pool.
+//-----------------------------------------------------------------------------
+void CDetailObjectSystem::RunBenchmark( int nFrames )
+{
+	if ( !m_pFastSpriteData )
+	{
+		Msg( "No fast detail sprites in this map.\n" );
+		return;
+	}
+
+	CUtlVector<LeafIndex_t> leaves;
+	int nLevelLeafCount = engine->LevelLeafCount();
+	for ( int i = 0; i < nLevelLeafCount; ++i )
+	{
+		if ( ClientLeafSystem()->GetSubSystemDataInLeaf( i, CLSUBSYSTEM_DETAILOBJECTS ) )
+		{
+			leaves.AddToTail( i );
+		}
+	}
+
+	Vector vecCenter = MainViewOrigin();
+	float flRadius = cl_detaildist.GetFloat() * 0.5f;
+
+	for ( int nThreaded = 0; nThreaded < 2; ++nThreaded )
+	{
+		if ( nThreaded && !g_pThreadPool->NumThreads() )
+			break;
+
+		int nSprites = 0;
+		double flStartTime = Plat_FloatTime();
+		for ( int nFrame = 0; nFrame < nFrames; ++nFrame )
+		{
+			float flAngle = 2.0f * M_PI * nFrame / nFrames;
+			float flSin, flCos;
+			SinCos( flAngle, &flSin, &flCos );
+
+			// Walk the circle facing along it
+			Vector vecOrigin = vecCenter + Vector( flCos, flSin, 0.0f ) * flRadius;
+			Vector vecForward( -flSin, flCos, 0.0f );
+
+			if ( nThreaded )
+			{
+				BuildOutSortedSpritesThreaded( vecOrigin, vecForward, leaves.Count(), leaves.Base() );
+				for ( int i = 0; i < m_FastSpriteJobs.Count(); ++i )
+				{
+					nSprites += m_FastSpriteJobs[i].m_nCount;
+				}
+			}
+			else
+			{
+				for ( int i = 0; i < leaves.Count(); ++i )
+				{
+					CFastDetailLeafSpriteList *pData = reinterpret_cast<CFastDetailLeafSpriteList *> (
+						ClientLeafSystem()->GetSubSystemDataInLeaf( leaves[i], CLSUBSYSTEM_DETAILOBJECTS ) );
+					nSprites += BuildOutSortedSprites( pData, vecOrigin, vecForward, vec3_origin, vec3_origin );
+				}
+			}
+		}
+		double flElapsed = Plat_FloatTime() - flStartTime;
+
+		Msg( "%s: %d frames, %d leaves, %.3f ms/frame, %d sprites/frame\n", nThreaded ? "threaded" : "serial",
+			nFrames, leaves.Count(), 1000.0 * flElapsed / nFrames, nSprites / nFrames );
+	}
+
+	// The partially drawn leaf state refers to the buffers we just stomped on
+	m_nSortedFastLeaf = -1;
+}
+
+
+CON_COMMAND_F( cl_detail_benchmark, "Times building out and sorting detail sprites along a circle around the view. Usage: cl_detail_benchmark [frames]", FCVAR_CHEAT )
+{
+	int nFrames = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 360;
+	s_DetailObjectSystem.RunBenchmark( MAX( nFrames, 1 ) );
+}
@@ -102,6 +102,9 @@ public:
 	Particle* GetNext();
 	float GetTimeDelta() const;
 
+	// True if IParticleEffect::PresimulateParticles already ran on these particles this frame.
+	bool WasPresimulated() const;
+
 	void RemoveParticle( Particle *pParticle );
 	void RemoveAllParticles();
 
@@ -109,6 +112,7 @@ private:
 	CParticleEffectBinding *m_pEffectBinding;
 	CEffectMaterial *m_pMaterial;
 	float m_flTimeDelta;
+	bool m_bPresimulated;
 
 	bool m_bGotFirst;
 	Particle *m_pNextParticle;
@@ -207,6 +211,7 @@ inline ParticleDraw* CParticleRenderIterator::GetParticleDraw() const
 inline CParticleSimulateIterator::CParticleSimulateIterator()
 {
 	m_pNextParticle = NULL;
+	m_bPresimulated = false;
 #ifdef _DEBUG
 	m_bGotFirst = false;
 #endif
@@ -265,6 +270,11 @@ inline float CParticleSimulateIterator::GetTimeDelta() const
 	return m_flTimeDelta;
 }
 
+inline bool CParticleSimulateIterator::WasPresimulated() const
+{
+	return m_bPresimulated;
+}
+
 
 #endif // PARTICLE_ITERATORS_H
 
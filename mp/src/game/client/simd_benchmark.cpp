@@ -0,0 +1,400 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: simd_benchmark - times 4-wide (fltx4) and 8-wide (fltx8) versions of
+//			the kinds of SIMD kernels the engine uses, and checks they agree.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "mathlib/ssemath.h"
+#include "mathlib/ssemath_avx.h"
+#include "tier1/processor_detect.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define SIMD_BENCHMARK_COUNT		4096			// elements per kernel call; multiple of 8
+#define SIMD_BENCHMARK_DEFAULT_REPS	2000
+
+struct SIMDBenchmarkData_t
+{
+	// inputs
+	float *m_pX;
+	float *m_pY;
+	float *m_pZ;
+	float *m_pT;
+
+	// outputs of the 4 and 8-wide kernels
+	float *m_pOut4[3];
+	float *m_pOut8[3];
+};
+
+struct SIMDBenchmarkParams_t
+{
+	Vector m_vecOrigin;
+	Vector m_vecForward;
+	float m_flMaxSqDist;
+	float m_flFadeSqDist;
+	Vector m_vecBoxMins;
+	Vector m_vecBoxMaxs;
+	matrix3x4_t m_Transform;
+};
+
+
+//-----------------------------------------------------------------------------
+// Detail sprite style cull and distance fade (see CDetailObjectSystem::BuildOutSortedSprites)
+//-----------------------------------------------------------------------------
+static int SpriteFade4( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float *pAlpha )
+{
+	FourVectors vecViewPos, vecFwd;
+	vecViewPos.DuplicateVector( params.m_vecOrigin );
+	vecFwd.DuplicateVector( params.m_vecForward );
+	fltx4 maxsqdist = ReplicateX4( params.m_flMaxSqDist );
+	fltx4 startFade = ReplicateX4( params.m_flFadeSqDist );
+	fltx4 falloffFactor = ReplicateX4( 1.0f / ( params.m_flMaxSqDist - params.m_flFadeSqDist ) );
+
+	int nCulled = 0;
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 4 )
+	{
+		FourVectors ofs;
+		ofs.x = LoadAlignedSIMD( data.m_pX + i );
+		ofs.y = LoadAlignedSIMD( data.m_pY + i );
+		ofs.z = LoadAlignedSIMD( data.m_pZ + i );
+		ofs -= vecViewPos;
+		fltx4 distanceSquared = ofs * ofs;
+		nCulled += TestSignSIMD( OrSIMD( ofs * vecFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) ) != 0;
+
+		fltx4 alpha = MulSIMD( falloffFactor, SubSIMD( distanceSquared, startFade ) );
+		alpha = SubSIMD( Four_Ones, MinSIMD( MaxSIMD( alpha, Four_Zeros ), Four_Ones ) );
+		StoreAlignedSIMD( pAlpha + i, alpha );
+	}
+	return nCulled;
+}
+
+#ifdef SSEMATH_AVX
+static AVX_TARGET int SpriteFade8( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float *pAlpha )
+{
+	EightVectors vecViewPos, vecFwd;
+	vecViewPos.DuplicateVector( params.m_vecOrigin );
+	vecFwd.DuplicateVector( params.m_vecForward );
+	fltx8 maxsqdist = ReplicateX8( params.m_flMaxSqDist );
+	fltx8 startFade = ReplicateX8( params.m_flFadeSqDist );
+	fltx8 falloffFactor = ReplicateX8( 1.0f / ( params.m_flMaxSqDist - params.m_flFadeSqDist ) );
+	fltx8 zeros = LoadZeroSIMD8();
+	fltx8 ones = ReplicateX8( 1.0f );
+
+	int nCulled = 0;
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 8 )
+	{
+		EightVectors ofs;
+		ofs.x = LoadAlignedSIMD8( data.m_pX + i );
+		ofs.y = LoadAlignedSIMD8( data.m_pY + i );
+		ofs.z = LoadAlignedSIMD8( data.m_pZ + i );
+		ofs -= vecViewPos;
+		fltx8 distanceSquared = ofs * ofs;
+
+		// count in groups of 4 to match the 4-wide version
+		int nMask = TestSignSIMD( OrSIMD( ofs * vecFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) );
+		nCulled += ( ( nMask & 0xf ) != 0 ) + ( ( nMask & 0xf0 ) != 0 );
+
+		fltx8 alpha = MulSIMD( falloffFactor, SubSIMD( distanceSquared, startFade ) );
+		alpha = SubSIMD( ones, MinSIMD( MaxSIMD( alpha, zeros ), ones ) );
+		StoreAlignedSIMD( pAlpha + i, alpha );
+	}
+	EndSIMD8();
+	return nCulled;
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Ray vs box slab test, as in the raytracer's FourRays code. The inputs are used as
+// ray directions from the origin.
+//-----------------------------------------------------------------------------
+static int RayBox4( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float *pTMin )
+{
+	FourVectors vecOrigin, vecMins, vecMaxs;
+	vecOrigin.DuplicateVector( params.m_vecOrigin );
+	vecMins.DuplicateVector( params.m_vecBoxMins );
+	vecMaxs.DuplicateVector( params.m_vecBoxMaxs );
+	vecMins -= vecOrigin;
+	vecMaxs -= vecOrigin;
+
+	int nHits = 0;
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 4 )
+	{
+		fltx4 fl4InvX = ReciprocalSIMD( LoadAlignedSIMD( data.m_pX + i ) );
+		fltx4 fl4InvY = ReciprocalSIMD( LoadAlignedSIMD( data.m_pY + i ) );
+		fltx4 fl4InvZ = ReciprocalSIMD( LoadAlignedSIMD( data.m_pZ + i ) );
+
+		fltx4 t0 = MulSIMD( vecMins.x, fl4InvX ), t1 = MulSIMD( vecMaxs.x, fl4InvX );
+		fltx4 tmin = MinSIMD( t0, t1 ), tmax = MaxSIMD( t0, t1 );
+		t0 = MulSIMD( vecMins.y, fl4InvY ); t1 = MulSIMD( vecMaxs.y, fl4InvY );
+		tmin = MaxSIMD( tmin, MinSIMD( t0, t1 ) ); tmax = MinSIMD( tmax, MaxSIMD( t0, t1 ) );
+		t0 = MulSIMD( vecMins.z, fl4InvZ ); t1 = MulSIMD( vecMaxs.z, fl4InvZ );
+		tmin = MaxSIMD( tmin, MinSIMD( t0, t1 ) ); tmax = MinSIMD( tmax, MaxSIMD( t0, t1 ) );
+
+		fltx4 hit = AndSIMD( CmpLeSIMD( tmin, tmax ), CmpGeSIMD( tmax, Four_Zeros ) );
+		int nMask = TestSignSIMD( hit );
+		nHits += ( nMask & 1 ) + ( ( nMask >> 1 ) & 1 ) + ( ( nMask >> 2 ) & 1 ) + ( ( nMask >> 3 ) & 1 );
+		StoreAlignedSIMD( pTMin + i, AndSIMD( hit, tmin ) );
+	}
+	return nHits;
+}
+
+#ifdef SSEMATH_AVX
+static AVX_TARGET int RayBox8( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float *pTMin )
+{
+	EightVectors vecOrigin, vecMins, vecMaxs;
+	vecOrigin.DuplicateVector( params.m_vecOrigin );
+	vecMins.DuplicateVector( params.m_vecBoxMins );
+	vecMaxs.DuplicateVector( params.m_vecBoxMaxs );
+	vecMins -= vecOrigin;
+	vecMaxs -= vecOrigin;
+	fltx8 zeros = LoadZeroSIMD8();
+
+	int nHits = 0;
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 8 )
+	{
+		fltx8 fl8InvX = ReciprocalSIMD( LoadAlignedSIMD8( data.m_pX + i ) );
+		fltx8 fl8InvY = ReciprocalSIMD( LoadAlignedSIMD8( data.m_pY + i ) );
+		fltx8 fl8InvZ = ReciprocalSIMD( LoadAlignedSIMD8( data.m_pZ + i ) );
+
+		fltx8 t0 = MulSIMD( vecMins.x, fl8InvX ), t1 = MulSIMD( vecMaxs.x, fl8InvX );
+		fltx8 tmin = MinSIMD( t0, t1 ), tmax = MaxSIMD( t0, t1 );
+		t0 = MulSIMD( vecMins.y, fl8InvY ); t1 = MulSIMD( vecMaxs.y, fl8InvY );
+		tmin = MaxSIMD( tmin, MinSIMD( t0, t1 ) ); tmax = MinSIMD( tmax, MaxSIMD( t0, t1 ) );
+		t0 = MulSIMD( vecMins.z, fl8InvZ ); t1 = MulSIMD( vecMaxs.z, fl8InvZ );
+		tmin = MaxSIMD( tmin, MinSIMD( t0, t1 ) ); tmax = MinSIMD( tmax, MaxSIMD( t0, t1 ) );
+
+		fltx8 hit = AndSIMD( CmpLeSIMD( tmin, tmax ), CmpGeSIMD( tmax, zeros ) );
+		int nMask = TestSignSIMD( hit );
+		for ( ; nMask; nMask &= nMask - 1 )
+		{
+			++nHits;
+		}
+		StoreAlignedSIMD( pTMin + i, AndSIMD( hit, tmin ) );
+	}
+	EndSIMD8();
+	return nHits;
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Transforming points by a bone matrix (FourVectors::TransformBy)
+//-----------------------------------------------------------------------------
+static int Transform4( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float **ppOut )
+{
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 4 )
+	{
+		FourVectors v;
+		v.x = LoadAlignedSIMD( data.m_pX + i );
+		v.y = LoadAlignedSIMD( data.m_pY + i );
+		v.z = LoadAlignedSIMD( data.m_pZ + i );
+		v.TransformBy( params.m_Transform );
+		StoreAlignedSIMD( ppOut[0] + i, v.x );
+		StoreAlignedSIMD( ppOut[1] + i, v.y );
+		StoreAlignedSIMD( ppOut[2] + i, v.z );
+	}
+	return 0;
+}
+
+#ifdef SSEMATH_AVX
+static AVX_TARGET int Transform8( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float **ppOut )
+{
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 8 )
+	{
+		EightVectors v;
+		v.x = LoadAlignedSIMD8( data.m_pX + i );
+		v.y = LoadAlignedSIMD8( data.m_pY + i );
+		v.z = LoadAlignedSIMD8( data.m_pZ + i );
+		v.TransformBy( params.m_Transform );
+		StoreAlignedSIMD( ppOut[0] + i, v.x );
+		StoreAlignedSIMD( ppOut[1] + i, v.y );
+		StoreAlignedSIMD( ppOut[2] + i, v.z );
+	}
+	EndSIMD8();
+	return 0;
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Noise-style quintic fade curve and lerp (see NoiseSIMD in ssenoise.cpp)
+//-----------------------------------------------------------------------------
+static int Fade4( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float *pOut )
+{
+	fltx4 fl4Six = ReplicateX4( 6.0f );
+	fltx4 fl4Fifteen = ReplicateX4( 15.0f );
+	fltx4 fl4Ten = ReplicateX4( 10.0f );
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 4 )
+	{
+		fltx4 t = LoadAlignedSIMD( data.m_pT + i );
+		fltx4 a = LoadAlignedSIMD( data.m_pX + i );
+		fltx4 b = LoadAlignedSIMD( data.m_pY + i );
+
+		// t^3 * ( t * ( t * 6 - 15 ) + 10 )
+		fltx4 f = MaddSIMD( t, MaddSIMD( t, fl4Six, NegSIMD( fl4Fifteen ) ), fl4Ten );
+		f = MulSIMD( f, MulSIMD( t, MulSIMD( t, t ) ) );
+		StoreAlignedSIMD( pOut + i, MaddSIMD( f, SubSIMD( b, a ), a ) );
+	}
+	return 0;
+}
+
+#ifdef SSEMATH_AVX
+static AVX_TARGET int Fade8( const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params, float *pOut )
+{
+	fltx8 fl8Six = ReplicateX8( 6.0f );
+	fltx8 fl8Fifteen = ReplicateX8( 15.0f );
+	fltx8 fl8Ten = ReplicateX8( 10.0f );
+	for ( int i = 0; i < SIMD_BENCHMARK_COUNT; i += 8 )
+	{
+		fltx8 t = LoadAlignedSIMD8( data.m_pT + i );
+		fltx8 a = LoadAlignedSIMD8( data.m_pX + i );
+		fltx8 b = LoadAlignedSIMD8( data.m_pY + i );
+
+		// t^3 * ( t * ( t * 6 - 15 ) + 10 )
+		fltx8 f = MaddSIMD( t, MaddSIMD( t, fl8Six, NegSIMD( fl8Fifteen ) ), fl8Ten );
+		f = MulSIMD( f, MulSIMD( t, MulSIMD( t, t ) ) );
+		StoreAlignedSIMD( pOut + i, MaddSIMD( f, SubSIMD( b, a ), a ) );
+	}
+	EndSIMD8();
+	return 0;
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Runs the kernels
+//-----------------------------------------------------------------------------
+enum SIMDBenchmarkKernel_t
+{
+	SIMD_KERNEL_SPRITE_FADE = 0,
+	SIMD_KERNEL_RAY_BOX,
+	SIMD_KERNEL_TRANSFORM,
+	SIMD_KERNEL_FADE_CURVE,
+
+	SIMD_KERNEL_COUNT
+};
+
+static const char *s_pSIMDKernelNames[SIMD_KERNEL_COUNT] =
+{
+	"detail sprite fade",
+	"ray vs box",
+	"point transform",
+	"noise fade curve",
+};
+
+static int RunSIMDKernel( int nKernel, bool b8Wide, const SIMDBenchmarkData_t &data, const SIMDBenchmarkParams_t &params )
+{
+	float **ppOut = b8Wide ? (float **)data.m_pOut8 : (float **)data.m_pOut4;
+
+#ifdef SSEMATH_AVX
+	if ( b8Wide )
+	{
+		switch( nKernel )
+		{
+		case SIMD_KERNEL_SPRITE_FADE:	return SpriteFade8( data, params, ppOut[0] );
+		case SIMD_KERNEL_RAY_BOX:		return RayBox8( data, params, ppOut[0] );
+		case SIMD_KERNEL_TRANSFORM:		return Transform8( data, params, ppOut );
+		case SIMD_KERNEL_FADE_CURVE:	return Fade8( data, params, ppOut[0] );
+		}
+		return 0;
+	}
+#endif
+
+	switch( nKernel )
+	{
+	case SIMD_KERNEL_SPRITE_FADE:	return SpriteFade4( data, params, ppOut[0] );
+	case SIMD_KERNEL_RAY_BOX:		return RayBox4( data, params, ppOut[0] );
+	case SIMD_KERNEL_TRANSFORM:		return Transform4( data, params, ppOut );
+	case SIMD_KERNEL_FADE_CURVE:	return Fade4( data, params, ppOut[0] );
+	}
+	return 0;
+}
+
+CON_COMMAND( simd_benchmark, "Times 4-wide and 8-wide (AVX) versions of common SIMD kernels. Usage: simd_benchmark [repetitions]" )
+{
+	int nReps = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : SIMD_BENCHMARK_DEFAULT_REPS;
+
+	bool b8Wide = false;
+#ifdef SSEMATH_AVX
+	b8Wide = ( GetCPUSIMDLevel() >= SIMD_LEVEL_AVX2_FMA );
+#endif
+	if ( !b8Wide )
+	{
+		Msg( "8-wide SIMD is not available (needs AVX2 and FMA); only timing the 4-wide kernels.\n" );
+	}
+
+	// Inputs are in [-512,512), except m_pT which is in [0,1)
+	SIMDBenchmarkData_t data;
+	float **ppArrays[] = { &data.m_pX, &data.m_pY, &data.m_pZ, &data.m_pT,
+		&data.m_pOut4[0], &data.m_pOut4[1], &data.m_pOut4[2], &data.m_pOut8[0], &data.m_pOut8[1], &data.m_pOut8[2] };
+	int i;
+	for ( i = 0; i < ARRAYSIZE( ppArrays ); ++i )
+	{
+		*ppArrays[i] = (float *)MemAlloc_AllocAligned( SIMD_BENCHMARK_COUNT * sizeof( float ), 32 );
+		memset( *ppArrays[i], 0, SIMD_BENCHMARK_COUNT * sizeof( float ) );
+	}
+
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	for ( i = 0; i < SIMD_BENCHMARK_COUNT; ++i )
+	{
+		data.m_pX[i] = random.RandomFloat( -512.0f, 512.0f );
+		data.m_pY[i] = random.RandomFloat( -512.0f, 512.0f );
+		data.m_pZ[i] = random.RandomFloat( -512.0f, 512.0f );
+		data.m_pT[i] = random.RandomFloat( 0.0f, 1.0f );
+	}
+
+	SIMDBenchmarkParams_t params;
+	params.m_vecOrigin.Init( 10.0f, 20.0f, 30.0f );
+	params.m_vecForward.Init( 0.6f, 0.8f, 0.0f );
+	params.m_flMaxSqDist = 400.0f * 400.0f;
+	params.m_flFadeSqDist = 300.0f * 300.0f;
+	params.m_vecBoxMins.Init( 100.0f, 100.0f, -50.0f );
+	params.m_vecBoxMaxs.Init( 200.0f, 300.0f, 50.0f );
+	AngleMatrix( QAngle( 10.0f, 45.0f, 5.0f ), Vector( 1.0f, 2.0f, 3.0f ), params.m_Transform );
+
+	Msg( "%d elements x %d repetitions\n", SIMD_BENCHMARK_COUNT, nReps );
+	Msg( "%-20s %12s %12s %8s %10s\n", "kernel", "4-wide ns/el", "8-wide ns/el", "speedup", "max diff" );
+	for ( int nKernel = 0; nKernel < SIMD_KERNEL_COUNT; ++nKernel )
+	{
+		double flTime[2] = { 0.0, 0.0 };
+		int nResult[2] = { 0, 0 };
+		for ( int nWide = 0; nWide < ( b8Wide ? 2 : 1 ); ++nWide )
+		{
+			double flStart = Plat_FloatTime();
+			for ( int nRep = 0; nRep < nReps; ++nRep )
+			{
+				nResult[nWide] = RunSIMDKernel( nKernel, nWide != 0, data, params );
+			}
+			flTime[nWide] = ( Plat_FloatTime() - flStart ) * 1e9 / ( (double)nReps * SIMD_BENCHMARK_COUNT );
+		}
+
+		if ( !b8Wide )
+		{
+			Msg( "%-20s %12.3f\n", s_pSIMDKernelNames[nKernel], flTime[0] );
+			continue;
+		}
+
+		// FMA and the reciprocal estimates mean the results won't be bit identical
+		float flMaxDiff = 0.0f;
+		for ( int j = 0; j < 3; ++j )
+		{
+			for ( i = 0; i < SIMD_BENCHMARK_COUNT; ++i )
+			{
+				flMaxDiff = MAX( flMaxDiff, fabs( data.m_pOut4[j][i] - data.m_pOut8[j][i] ) );
+			}
+		}
+
+		Msg( "%-20s %12.3f %12.3f %7.2fx %10g%s\n", s_pSIMDKernelNames[nKernel], flTime[0], flTime[1],
+			flTime[0] / MAX( flTime[1], 1e-9 ), flMaxDiff, ( nResult[0] != nResult[1] ) ? "  RESULT MISMATCH" : "" );
+	}
+
+	for ( i = 0; i < ARRAYSIZE( ppArrays ); ++i )
+	{
+		MemAlloc_FreeAligned( *ppArrays[i] );
+	}
+}
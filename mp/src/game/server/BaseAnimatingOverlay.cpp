@@ -448,20 +448,17 @@ void CBaseAnimatingOverlay::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Q
 	boneSetup.AccumulatePose( pos, q, GetSequence(), GetCycle(), 1.0, gpGlobals->curtime, m_pIk );
 
 	// sort the layers
+	int order[MAX_OVERLAYS] = {};
+	bool blended[MAX_OVERLAYS] = {};
 	int layer[MAX_OVERLAYS] = {};
 	int i;
 	for (i = 0; i < m_AnimOverlay.Count(); i++)
-	{
-		layer[i] = MAX_OVERLAYS;
-	}
-	for (i = 0; i < m_AnimOverlay.Count(); i++)
 	{
 		CAnimationLayer &pLayer = m_AnimOverlay[i];
-		if( (pLayer.m_flWeight > 0) && pLayer.IsActive() && pLayer.m_nOrder >= 0 && pLayer.m_nOrder < m_AnimOverlay.Count())
-		{
-			layer[pLayer.m_nOrder] = i;
-		}
+		order[i] = pLayer.m_nOrder;
+		blended[i] = (pLayer.m_flWeight > 0) && pLayer.IsActive();
 	}
+	SortSkeletonLayers( m_AnimOverlay.Count(), order, blended, layer );
 	for (i = 0; i < m_AnimOverlay.Count(); i++)
 	{
 		if (layer[i] >= 0 && layer[i] < m_AnimOverlay.Count())
@@ -487,6 +484,27 @@ void CBaseAnimatingOverlay::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Q
 
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Orders the layers for GetSkeleton(), given each one's order and
+//			whether it has weight and is active.  Shared with lag compensation,
+//			which poses players from recorded layers.
+//-----------------------------------------------------------------------------
+void CBaseAnimatingOverlay::SortSkeletonLayers( int nLayers, const int *pOrders, const bool *pBlended, int *pLayerAtOrder )
+{
+	int i;
+	for (i = 0; i < nLayers; i++)
+	{
+		pLayerAtOrder[i] = MAX_OVERLAYS;
+	}
+	for (i = 0; i < nLayers; i++)
+	{
+		if ( pBlended[i] && pOrders[i] >= 0 && pOrders[i] < nLayers )
+		{
+			pLayerAtOrder[pOrders[i]] = i;
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: zero's out all non-restore safe fields
 // Output :
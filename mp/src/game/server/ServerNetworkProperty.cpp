@@ -15,6 +15,170 @@
 
 extern CTimedEventMgr g_NetworkPropertyEventMgr;
 
+ConVar net_trackchangedprops( "net_trackchangedprops", "0", 0, "Track changed network vars per entity as a bitset of SendProps, which doesn't overflow like the edict change offsets do. Needed for net_changestats." );
+
+NetworkChangeStats_t g_NetworkChangeStats;
+
+// Full-change fallbacks per ServerClass::m_ClassID, for net_changestats
+static CUtlVector< int > s_ClassOverflowCounts;
+
+// Changes per flattened SendProp, per ServerClass::m_ClassID, for net_changestats
+static CUtlVector< CUtlVector< int > > s_PropChangeCounts;
+static int s_nUnmappedChanges = 0;
+static float s_flChangeStatsStartTime = 0.0f;
+static int s_nChangeStatsStartTick = 0;
+
+
+//-----------------------------------------------------------------------------
+// Flattened SendProp offset maps, indexed by ServerClass::m_ClassID
+//-----------------------------------------------------------------------------
+class CSendPropChangeMapList
+{
+public:
+	~CSendPropChangeMapList()
+	{
+		m_Maps.PurgeAndDeleteElements();
+	}
+
+	CUtlVector< CSendPropChangeMap * > m_Maps;
+};
+
+static CSendPropChangeMapList s_SendPropChangeMaps;
+
+CSendPropChangeMap *CSendPropChangeMap::Get( ServerClass *pServerClass )
+{
+	int nClassID = pServerClass->m_ClassID;
+	Assert( nClassID >= 0 );
+
+	CUtlVector< CSendPropChangeMap * > &maps = s_SendPropChangeMaps.m_Maps;
+	if ( nClassID >= maps.Count() )
+	{
+		int nFirstNew = maps.AddMultipleToTail( nClassID + 1 - maps.Count() );
+		for ( int i = nFirstNew; i < maps.Count(); ++i )
+		{
+			maps[i] = NULL;
+		}
+	}
+
+	if ( !maps[nClassID] )
+	{
+		CSendPropChangeMap *pMap = new CSendPropChangeMap;
+		pMap->m_nMaxRangeSize = 0;
+		pMap->AddTable( pServerClass->m_pTable, 0 );
+		pMap->m_Ranges.Sort( RangeCompare );
+		maps[nClassID] = pMap;
+	}
+
+	return maps[nClassID];
+}
+
+int __cdecl CSendPropChangeMap::RangeCompare( const PropRange_t *pLeft, const PropRange_t *pRight )
+{
+	if ( pLeft->m_nStart != pRight->m_nStart )
+		return ( pLeft->m_nStart < pRight->m_nStart ) ? -1 : 1;
+	return pLeft->m_iProp - pRight->m_iProp;
+}
+
+void CSendPropChangeMap::AddTable( SendTable *pTable, int nBaseOffset )
+{
+	for ( int i = 0; i < pTable->GetNumProps(); ++i )
+	{
+		SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() || pProp->IsInsideArray() )
+			continue;
+
+		// SENDINFO_VECTORELEM offsets stay negative until the engine has initialized the table.
+		int nOffset = pProp->GetOffset();
+		bool bVectorElem = ( pProp->GetFlags() & SPROP_IS_A_VECTOR_ELEM ) != 0;
+		if ( nOffset < 0 )
+		{
+			nOffset = -nOffset;
+			bVectorElem = true;
+		}
+		nOffset += nBaseOffset;
+
+		if ( pProp->GetType() == DPT_DataTable )
+		{
+			AddTable( pProp->GetDataTable(), nOffset );
+			continue;
+		}
+
+		int nSize;
+		switch ( pProp->GetType() )
+		{
+		case DPT_Vector:	nSize = sizeof( Vector ); break;
+		case DPT_VectorXY:	nSize = 2 * sizeof( float ); break;
+#ifdef SUPPORTS_INT64
+		case DPT_Int64:		nSize = sizeof( int64 ); break;
+#endif
+		case DPT_String:	nSize = 1; break;
+		case DPT_Array:		nSize = pProp->GetElementStride() * pProp->GetNumElements(); break;
+		default:			nSize = sizeof( int ); break;
+		}
+
+		PropRange_t range;
+		range.m_nStart = nOffset;
+		range.m_nEnd = nOffset + MAX( nSize, 1 );
+		range.m_iProp = m_Props.AddToTail( pProp );
+
+		// CNetworkVector reports the offset of the whole vector, so a vector
+		// element has to match the offsets of the elements before it too.
+		if ( bVectorElem )
+		{
+			range.m_nStart = MAX( nBaseOffset, nOffset - 2 * (int)sizeof( float ) );
+		}
+
+		m_nMaxRangeSize = MAX( m_nMaxRangeSize, range.m_nEnd - range.m_nStart );
+		m_Ranges.AddToTail( range );
+	}
+}
+
+int CSendPropChangeMap::GetPropCount() const
+{
+	return m_Props.Count();
+}
+
+const SendProp *CSendPropChangeMap::GetProp( int iProp ) const
+{
+	return m_Props[iProp];
+}
+
+bool CSendPropChangeMap::MarkChanged( unsigned short varOffset, CVarBitVec &changedProps ) const
+{
+	// Find the first range starting past the offset, then walk back over
+	// every range that could still contain it.
+	int nLow = 0;
+	int nHigh = m_Ranges.Count();
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) >> 1;
+		if ( m_Ranges[nMid].m_nStart <= varOffset )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	bool bFound = false;
+	for ( int i = nLow - 1; i >= 0; --i )
+	{
+		const PropRange_t &range = m_Ranges[i];
+		if ( range.m_nStart + m_nMaxRangeSize <= varOffset )
+			break;
+
+		if ( range.m_nEnd > varOffset )
+		{
+			changedProps.Set( range.m_iProp );
+			bFound = true;
+		}
+	}
+	return bFound;
+}
+
+
 
 //-----------------------------------------------------------------------------
 // Save/load
@@ -64,6 +228,7 @@ void CServerNetworkProperty::Init( CBaseEntity *pEntity )
 	m_pServerClass = NULL;
 //	m_pTransmitProxy = NULL;
 	m_bPendingStateChange = false;
+	m_bAllPropsChanged = true;
 	m_PVSInfo.m_nClusterCount = 0;
 	m_TimerEvent.Init( &g_NetworkPropertyEventMgr, this );
 }
@@ -296,10 +461,253 @@ void CServerNetworkProperty::FireEvent()
 	// trigger a state change in the edict.
 	if ( m_bPendingStateChange )
 	{
-		m_pPev->StateChanged();
+		NetworkStateForceUpdate();
 		m_bPendingStateChange = false;
 	}
 }
 
 
+//-----------------------------------------------------------------------------
+// Per-prop change tracking
+//-----------------------------------------------------------------------------
+void CServerNetworkProperty::MarkPropChanged( unsigned short varOffset, int nOldStateFlags )
+{
+	// The engine clears FL_EDICT_CHANGED once it has packed the entity, so
+	// whatever we remembered before that is stale.
+	if ( !( nOldStateFlags & FL_EDICT_CHANGED ) )
+	{
+		m_bAllPropsChanged = false;
+		m_ChangedProps.ClearAll();
+	}
+
+	if ( m_bAllPropsChanged )
+		return;
+
+	ServerClass *pServerClass = GetServerClass();
+	if ( !pServerClass )
+	{
+		m_bAllPropsChanged = true;
+		return;
+	}
+
+	const CSendPropChangeMap *pMap = CSendPropChangeMap::Get( pServerClass );
+	if ( m_ChangedProps.GetNumBits() != pMap->GetPropCount() )
+	{
+		m_ChangedProps.Resize( pMap->GetPropCount(), true );
+	}
+
+	if ( !pMap->MarkChanged( varOffset, m_ChangedProps ) )
+	{
+		m_bAllPropsChanged = true;
+	}
+}
+
+void CServerNetworkProperty::MarkAllPropsChanged()
+{
+	m_bAllPropsChanged = true;
+}
+
+const CVarBitVec *CServerNetworkProperty::GetChangedProps()
+{
+	if ( !m_pPev || !net_trackchangedprops.GetBool() )
+		return NULL;
+
+	if ( !m_pPev->HasStateChanged() )
+	{
+		// Nothing changed since the last pack.
+		m_bAllPropsChanged = false;
+		m_ChangedProps.ClearAll();
+		return &m_ChangedProps;
+	}
+
+	return m_bAllPropsChanged ? NULL : &m_ChangedProps;
+}
+
+
+//-----------------------------------------------------------------------------
+// net_changestats bookkeeping. Called when StateChanged( offset ) newly set
+// FL_EDICT_CHANGED or fell back to FL_FULL_EDICT_CHANGED.
+//-----------------------------------------------------------------------------
+void CServerNetworkProperty::NoteOffsetStateChange( int nOldStateFlags, bool bChangeInfoOverflow )
+{
+	if ( !( nOldStateFlags & FL_EDICT_CHANGED ) )
+	{
+		++g_NetworkChangeStats.m_nChangedEdicts;
+	}
+
+	if ( !( m_pPev->m_fStateFlags & FL_FULL_EDICT_CHANGED ) )
+		return;
+
+	if ( bChangeInfoOverflow )
+	{
+		++g_NetworkChangeStats.m_nChangeInfoOverflows;
+	}
+	else
+	{
+		++g_NetworkChangeStats.m_nOffsetListOverflows;
+	}
+
+	ServerClass *pServerClass = GetServerClass();
+	if ( pServerClass && pServerClass->m_ClassID >= 0 )
+	{
+		int nClassID = pServerClass->m_ClassID;
+		if ( nClassID >= s_ClassOverflowCounts.Count() )
+		{
+			int nFirstNew = s_ClassOverflowCounts.AddMultipleToTail( nClassID + 1 - s_ClassOverflowCounts.Count() );
+			for ( int i = nFirstNew; i < s_ClassOverflowCounts.Count(); ++i )
+			{
+				s_ClassOverflowCounts[i] = 0;
+			}
+		}
+		++s_ClassOverflowCounts[nClassID];
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Counts which props changed on the entities about to be packed
+//-----------------------------------------------------------------------------
+void NetworkChangeStats_SampleChangedProps()
+{
+	for ( CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt( pEntity ) )
+	{
+		CServerNetworkProperty *pNetworkProp = pEntity->NetworkProp();
+		if ( !pNetworkProp->edict() || !pNetworkProp->edict()->HasStateChanged() )
+			continue;
+
+		ServerClass *pServerClass = pNetworkProp->GetServerClass();
+		const CVarBitVec *pChangedProps = pNetworkProp->GetChangedProps();
+		if ( !pServerClass || pServerClass->m_ClassID < 0 || !pChangedProps )
+		{
+			++s_nUnmappedChanges;
+			continue;
+		}
+
+		int nClassID = pServerClass->m_ClassID;
+		if ( nClassID >= s_PropChangeCounts.Count() )
+		{
+			s_PropChangeCounts.AddMultipleToTail( nClassID + 1 - s_PropChangeCounts.Count() );
+		}
+
+		CUtlVector< int > &counts = s_PropChangeCounts[nClassID];
+		if ( counts.Count() < pChangedProps->GetNumBits() )
+		{
+			int nFirstNew = counts.AddMultipleToTail( pChangedProps->GetNumBits() - counts.Count() );
+			for ( int i = nFirstNew; i < counts.Count(); ++i )
+			{
+				counts[i] = 0;
+			}
+		}
+
+		for ( int iProp = pChangedProps->FindNextSetBit( 0 ); iProp >= 0; iProp = pChangedProps->FindNextSetBit( iProp + 1 ) )
+		{
+			++counts[iProp];
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Reports how often edicts overflow their change offset list
+//-----------------------------------------------------------------------------
+static int __cdecl ClassOverflowCompare( ServerClass * const *ppLeft, ServerClass * const *ppRight )
+{
+	return s_ClassOverflowCounts[(*ppRight)->m_ClassID] - s_ClassOverflowCounts[(*ppLeft)->m_ClassID];
+}
+
+struct PropChangeCount_t
+{
+	ServerClass *m_pClass;
+	int m_iProp;
+	int m_nChanges;
+};
+
+static int __cdecl PropChangeCountCompare( const PropChangeCount_t *pLeft, const PropChangeCount_t *pRight )
+{
+	return pRight->m_nChanges - pLeft->m_nChanges;
+}
+
+CON_COMMAND( net_changestats, "Report how often entities overflow their network change offset list. 'net_changestats reset' clears the counters." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		Q_memset( &g_NetworkChangeStats, 0, sizeof( g_NetworkChangeStats ) );
+		s_ClassOverflowCounts.RemoveAll();
+		s_PropChangeCounts.RemoveAll();
+		s_nUnmappedChanges = 0;
+		s_flChangeStatsStartTime = gpGlobals->curtime;
+		s_nChangeStatsStartTick = gpGlobals->tickcount;
+		return;
+	}
+
+	if ( !net_trackchangedprops.GetBool() )
+	{
+		Msg( "net_trackchangedprops is off, so changes aren't being counted.\n" );
+	}
+
+	const NetworkChangeStats_t &stats = g_NetworkChangeStats;
+	int nTicks = MAX( 1, gpGlobals->tickcount - s_nChangeStatsStartTick );
+	int nOverflows = stats.m_nOffsetListOverflows + stats.m_nChangeInfoOverflows;
+
+	Msg( "Network change stats over %d ticks (%.1f seconds):\n", nTicks, gpGlobals->curtime - s_flChangeStatsStartTime );
+	Msg( "  %d offset changes, %d full changes (%.1f / %.1f per tick)\n", 
+		stats.m_nOffsetChanges, stats.m_nFullChanges, (float)stats.m_nOffsetChanges / nTicks, (float)stats.m_nFullChanges / nTicks );
+	Msg( "  %d changed edicts (%.1f per tick)\n", stats.m_nChangedEdicts, (float)stats.m_nChangedEdicts / nTicks );
+	Msg( "  %d overflowed MAX_CHANGE_OFFSETS (%d), %d overflowed MAX_EDICT_CHANGE_INFOS (%d)\n", 
+		stats.m_nOffsetListOverflows, MAX_CHANGE_OFFSETS, stats.m_nChangeInfoOverflows, MAX_EDICT_CHANGE_INFOS );
+	Msg( "  %.1f%% of changed edicts fell back to a full compare\n", 
+		stats.m_nChangedEdicts ? 100.0f * nOverflows / stats.m_nChangedEdicts : 0.0f );
+
+	CUtlVector< ServerClass * > classes;
+	for ( ServerClass *pClass = g_pServerClassHead; pClass; pClass = pClass->m_pNext )
+	{
+		if ( pClass->m_ClassID >= 0 && pClass->m_ClassID < s_ClassOverflowCounts.Count() && s_ClassOverflowCounts[pClass->m_ClassID] > 0 )
+		{
+			classes.AddToTail( pClass );
+		}
+	}
+
+	if ( classes.Count() )
+	{
+		classes.Sort( ClassOverflowCompare );
+		Msg( "  Overflows by class:\n" );
+		for ( int i = 0; i < classes.Count() && i < 16; ++i )
+		{
+			Msg( "    %6d %s\n", s_ClassOverflowCounts[classes[i]->m_ClassID], classes[i]->GetName() );
+		}
+	}
+
+	CUtlVector< PropChangeCount_t > props;
+	for ( ServerClass *pClass = g_pServerClassHead; pClass; pClass = pClass->m_pNext )
+	{
+		if ( pClass->m_ClassID < 0 || pClass->m_ClassID >= s_PropChangeCounts.Count() )
+			continue;
+
+		const CUtlVector< int > &counts = s_PropChangeCounts[pClass->m_ClassID];
+		for ( int iProp = 0; iProp < counts.Count(); ++iProp )
+		{
+			if ( counts[iProp] > 0 )
+			{
+				PropChangeCount_t prop = { pClass, iProp, counts[iProp] };
+				props.AddToTail( prop );
+			}
+		}
+	}
+
+	if ( props.Count() )
+	{
+		props.Sort( PropChangeCountCompare );
+		Msg( "  Most changed props (%d packed changes couldn't be narrowed to props):\n", s_nUnmappedChanges );
+		for ( int i = 0; i < props.Count() && i < 16; ++i )
+		{
+			const SendProp *pProp = CSendPropChangeMap::Get( props[i].m_pClass )->GetProp( props[i].m_iProp );
+			Msg( "    %6d %s::%s\n", props[i].m_nChanges, props[i].m_pClass->GetName(), pProp->GetName() );
+		}
+	}
+}
+
+
 
@@ -16,6 +16,63 @@
 #include "edict.h"
 #include "timedeventmgr.h"
 
+
+//-----------------------------------------------------------------------------
+// Counters for net_changestats. CBaseEdict::StateChanged( offset ) can only
+// remember MAX_CHANGE_OFFSETS offsets per edict and MAX_EDICT_CHANGE_INFOS
+// edicts per frame; past that the edict is flagged FL_FULL_EDICT_CHANGED and
+// the engine falls back to a full SendTable delta compare.
+//-----------------------------------------------------------------------------
+struct NetworkChangeStats_t
+{
+	int m_nOffsetChanges;			// StateChanged( offset ) calls
+	int m_nFullChanges;				// StateChanged() calls
+	int m_nChangedEdicts;			// Edicts that went from unchanged to changed
+	int m_nOffsetListOverflows;		// Edicts that ran past MAX_CHANGE_OFFSETS
+	int m_nChangeInfoOverflows;		// Edicts that couldn't get a CEdictChangeInfo
+};
+
+extern NetworkChangeStats_t g_NetworkChangeStats;
+extern ConVar net_trackchangedprops;
+
+// Counts the props of every changed entity for net_changestats. Called
+// before the engine packs entities, when net_trackchangedprops is on.
+void NetworkChangeStats_SampleChangedProps();
+
+
+//-----------------------------------------------------------------------------
+// Maps entity-relative network var offsets onto a ServerClass's SendProps,
+// flattened depth-first through its datatables (this is not the engine's
+// priority-sorted prop order). Built once per class, on first use.
+//-----------------------------------------------------------------------------
+class CSendPropChangeMap
+{
+public:
+	static CSendPropChangeMap *Get( ServerClass *pServerClass );
+
+	int GetPropCount() const;
+	const SendProp *GetProp( int iProp ) const;
+
+	// Sets the bits of every prop that may be stored at varOffset.
+	// Returns false if no prop maps to the offset.
+	bool MarkChanged( unsigned short varOffset, CVarBitVec &changedProps ) const;
+
+private:
+	struct PropRange_t
+	{
+		int m_nStart;
+		int m_nEnd;
+		int m_iProp;
+	};
+
+	void AddTable( SendTable *pTable, int nBaseOffset );
+	static int __cdecl RangeCompare( const PropRange_t *pLeft, const PropRange_t *pRight );
+
+	CUtlVector< const SendProp * > m_Props;
+	CUtlVector< PropRange_t > m_Ranges;	// Sorted by m_nStart
+	int m_nMaxRangeSize;
+};
+
 //
 // Lightweight base class for networkable data on the server.
 //
@@ -61,6 +118,12 @@ public:
 	void NetworkStateChanged();
 	void NetworkStateChanged( unsigned short offset );
 
+	// Returns the SendProps changed since the engine last packed this entity,
+	// indexed by CSendPropChangeMap's flattened prop index. Unlike the edict's
+	// change offsets this doesn't overflow. Returns NULL if tracking is off
+	// (net_trackchangedprops) or every prop has to be treated as changed.
+	const CVarBitVec *GetChangedProps();
+
 	// Marks the PVS information dirty
 	void MarkPVSInformationDirty();
 
@@ -109,6 +172,11 @@ private:
 	// Marks the networkable that it will should transmit
 	void SetTransmit( CCheckTransmitInfo *pInfo );
 
+	// Per-prop change tracking + net_changestats bookkeeping
+	void MarkPropChanged( unsigned short varOffset, int nOldStateFlags );
+	void MarkAllPropsChanged();
+	void NoteOffsetStateChange( int nOldStateFlags, bool bChangeInfoOverflow );
+
 private:
 	CBaseEntity *m_pOuter;
 	// CBaseTransmitProxy *m_pTransmitProxy;
@@ -124,6 +192,12 @@ private:
 	CEventRegister	m_TimerEvent;
 	bool m_bPendingStateChange : 1;
 
+	// Set when a change couldn't be mapped to specific props.
+	bool m_bAllPropsChanged : 1;
+
+	// Flattened SendProps changed since the last pack, see GetChangedProps().
+	CVarBitVec m_ChangedProps;
+
 //	friend class CBaseTransmitProxy;
 };
 
@@ -179,7 +253,20 @@ inline void CServerNetworkProperty::SetNetworkParent( EHANDLE hParent )
 inline void CServerNetworkProperty::NetworkStateForceUpdate()
 { 
 	if ( m_pPev )
+	{
+		if ( net_trackchangedprops.GetBool() )
+		{
+			MarkAllPropsChanged();
+
+			++g_NetworkChangeStats.m_nFullChanges;
+			if ( !( m_pPev->m_fStateFlags & FL_EDICT_CHANGED ) )
+			{
+				++g_NetworkChangeStats.m_nChangedEdicts;
+			}
+		}
+
 		m_pPev->StateChanged();
+	}
 }
 
 inline void CServerNetworkProperty::NetworkStateChanged()
@@ -193,8 +280,7 @@ inline void CServerNetworkProperty::NetworkStateChanged()
 	}
 	else
 	{
-		if ( m_pPev )
-			m_pPev->StateChanged();
+		NetworkStateForceUpdate();
 	}
 }
 
@@ -207,13 +293,36 @@ inline void CServerNetworkProperty::NetworkStateChanged( unsigned short varOffse
 		// when the timer goes off.
 		m_bPendingStateChange = true;
 	}
-	else
+	else if ( m_pPev )
 	{
-		if ( m_pPev )
+		if ( !net_trackchangedprops.GetBool() )
+		{
 			m_pPev->StateChanged( varOffset );
+			return;
+		}
+
+		int nOldFlags = m_pPev->m_fStateFlags;
+		MarkPropChanged( varOffset, nOldFlags );
+
+		++g_NetworkChangeStats.m_nOffsetChanges;
+		if ( nOldFlags & FL_FULL_EDICT_CHANGED )
+			return;
+
+		// The edict can only lose its change info (rather than overflow its offset
+		// list) if the shared list is full and it doesn't own a slot in it yet.
+		bool bChangeInfoOverflow = ( g_pSharedChangeInfo->m_nChangeInfos == MAX_EDICT_CHANGE_INFOS ) && 
+			( !( nOldFlags & FL_EDICT_CHANGED ) || m_pPev->GetChangeInfoSerialNumber() != g_pSharedChangeInfo->m_iSerialNumber );
+
+		m_pPev->StateChanged( varOffset );
+
+		if ( ( m_pPev->m_fStateFlags & ~nOldFlags ) & ( FL_EDICT_CHANGED | FL_FULL_EDICT_CHANGED ) )
+		{
+			NoteOffsetStateChange( nOldFlags, bChangeInfoOverflow );
+		}
 	}
 }
 
+
 //-----------------------------------------------------------------------------
 // Methods to get the entindex + edict
 //-----------------------------------------------------------------------------
@@ -25,12 +25,16 @@
 #include "ndebugoverlay.h"
 #include "ai_hint.h"
 #include "tier0/icommandline.h"
+#include "checksum_crc.h"
+#include "engine/IStaticPropMgr.h"
+#include "vphysics_interface.h"
+#include "physics_shared.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 // Increment this to force rebuilding of all networks
-#define	 AINET_VERSION_NUMBER	37
+#define	 AINET_VERSION_NUMBER	38
 
 //-----------------------------------------------------------------------------
 
@@ -70,6 +74,301 @@ CON_COMMAND( ai_debug_node_connect, "Debug the attempted connection between two
 
 ConVar g_ai_norebuildgraph( "ai_norebuildgraph", "0" );
 
+//-----------------------------------------------------------------------------
+// When a graph is out of date only rebuild the nodes whose placement or
+// surrounding geometry changed, taking everything else from the old graph.
+
+ConVar g_ai_reusegraph( "ai_reusegraph", "1", 0, "Reuse the unchanged parts of an out of date node graph when rebuilding it" );
+
+//-----------------------------------------------------------------------------
+// CAI_NetworkBuildRecord
+//
+//-----------------------------------------------------------------------------
+
+inline unsigned int AI_ConnectionKey( int iSrcID, int iDestID )
+{
+	return ( (unsigned int)iSrcID << 16 ) | (unsigned int)iDestID;
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuildRecord::Purge()
+{
+	m_InputHashes.Purge();
+	m_Neighbors.Purge();
+	m_FailedConnections.Purge();
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuildRecord::Save( CUtlBuffer &buf ) const
+{
+	buf.PutInt( m_InputHashes.Count() );
+
+	int node;
+	for ( node = 0; node < m_InputHashes.Count(); node++ )
+	{
+		buf.PutUnsignedInt( m_InputHashes[node] );
+		buf.PutUnsignedShort( m_Neighbors[node].Count() );
+		for ( int i = 0; i < m_Neighbors[node].Count(); i++ )
+		{
+			buf.PutUnsignedShort( m_Neighbors[node][i] );
+		}
+	}
+
+	buf.PutInt( m_FailedConnections.Count() );
+	for ( int i = 0; i < m_FailedConnections.Count(); i++ )
+	{
+		buf.PutUnsignedInt( m_FailedConnections[i] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkBuildRecord::Restore( CUtlBuffer &buf, int nNodes )
+{
+	Purge();
+
+	if ( buf.GetBytesRemaining() < (int)sizeof(int) || buf.GetInt() != nNodes )
+		return false;
+
+	m_InputHashes.SetCount( nNodes );
+	m_Neighbors.SetCount( nNodes );
+
+	int node;
+	for ( node = 0; node < nNodes && buf.IsValid(); node++ )
+	{
+		m_InputHashes[node] = buf.GetUnsignedInt();
+
+		int nNeighbors = buf.GetUnsignedShort();
+		m_Neighbors[node].SetCount( nNeighbors );
+		for ( int i = 0; i < nNeighbors; i++ )
+		{
+			m_Neighbors[node][i] = buf.GetUnsignedShort();
+			if ( m_Neighbors[node][i] >= nNodes )
+				return false;
+		}
+	}
+
+	int nFailedConnections = buf.GetInt();
+	if ( !buf.IsValid() || nFailedConnections < 0 || nFailedConnections > buf.GetBytesRemaining() / (int)sizeof(unsigned int) )
+		return false;
+
+	m_FailedConnections.SetCount( nFailedConnections );
+	for ( int i = 0; i < nFailedConnections; i++ )
+	{
+		m_FailedConnections[i] = buf.GetUnsignedInt();
+	}
+
+	return buf.IsValid();
+}
+
+//-----------------------------------------------------------------------------
+// CAI_PreviousNetwork
+//
+// Purpose: The out of date graph of the map being built, and the record of
+//			what it was built from
+//
+//-----------------------------------------------------------------------------
+
+#define AI_PREVIOUS_CONNECTION_FAILED	-2
+
+struct AI_PreviousNode_t
+{
+	Vector	vecOrigin;
+	float	flVOffset[NUM_HULLS];
+	int		nType;
+	int		nInfo;
+	int		nWCId;
+};
+
+struct AI_PreviousLink_t
+{
+	byte	acceptedMoveTypes[NUM_HULLS];
+};
+
+class CAI_PreviousNetwork
+{
+public:
+	CAI_PreviousNetwork()
+	{
+		SetDefLessFunc( m_Connections );
+	}
+
+	// The link made by testing src to dest, AI_PREVIOUS_CONNECTION_FAILED, or -1 if they weren't tested
+	int FindConnection( int iSrcID, int iDestID ) const
+	{
+		int i = m_Connections.Find( AI_ConnectionKey( iSrcID, iDestID ) );
+		return ( i != m_Connections.InvalidIndex() ) ? m_Connections[i] : -1;
+	}
+
+	CUtlVector<AI_PreviousNode_t>	m_Nodes;
+	CUtlVector<AI_PreviousLink_t>	m_Links;
+	CUtlMap<unsigned int, int, int>	m_Connections;
+	CAI_NetworkBuildRecord			m_Record;
+};
+
+//-----------------------------------------------------------------------------
+// CAI_GeometryHasher
+//
+// Purpose: Hashes the geometry that node positions and links are computed
+//			against. Hashes are kept by cell, so nearby nodes share the work.
+//
+//-----------------------------------------------------------------------------
+
+#define AI_GRAPH_CELL_SIZE			512
+#define AI_GRAPH_CELLS_PER_SIDE		( ( MAX_COORD_INTEGER * 2 ) / AI_GRAPH_CELL_SIZE )
+#define AI_GRAPH_CONTENTS_MASK		( MASK_NPCSOLID | MASK_WATER | CONTENTS_LADDER )
+
+class CAI_GeometryHasher
+{
+public:
+	CAI_GeometryHasher()
+	{
+		SetDefLessFunc( m_CellHashes );
+	}
+
+	void HashRegion( CRC32_t *pCRC, const Vector &mins, const Vector &maxs )
+	{
+		int minX = GetCellCoord( mins.x ), minY = GetCellCoord( mins.y ), minZ = GetCellCoord( mins.z );
+		int maxX = GetCellCoord( maxs.x ), maxY = GetCellCoord( maxs.y ), maxZ = GetCellCoord( maxs.z );
+
+		for ( int x = minX; x <= maxX; x++ )
+		{
+			for ( int y = minY; y <= maxY; y++ )
+			{
+				for ( int z = minZ; z <= maxZ; z++ )
+				{
+					CRC32_t cellHash = GetCellHash( x, y, z );
+					CRC32_ProcessBuffer( pCRC, &cellHash, sizeof(cellHash) );
+				}
+			}
+		}
+	}
+
+private:
+	static int GetCellCoord( float flCoord )
+	{
+		int coord = (int)floor( ( flCoord + MAX_COORD_INTEGER ) / AI_GRAPH_CELL_SIZE );
+		return clamp( coord, 0, AI_GRAPH_CELLS_PER_SIDE - 1 );
+	}
+
+	CRC32_t GetCellHash( int x, int y, int z )
+	{
+		int key = x + ( y + z * AI_GRAPH_CELLS_PER_SIDE ) * AI_GRAPH_CELLS_PER_SIDE;
+		int i = m_CellHashes.Find( key );
+		if ( i == m_CellHashes.InvalidIndex() )
+		{
+			i = m_CellHashes.Insert( key, ComputeCellHash( x, y, z ) );
+		}
+		return m_CellHashes[i];
+	}
+
+	static CRC32_t ComputeCellHash( int x, int y, int z );
+
+	CUtlMap<int, CRC32_t, int>	m_CellHashes;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything the engine reports as touching the cell is summed, so
+//			the hash doesn't depend on the order it's reported in
+//-----------------------------------------------------------------------------
+
+CRC32_t CAI_GeometryHasher::ComputeCellHash( int x, int y, int z )
+{
+	Vector mins( x * AI_GRAPH_CELL_SIZE - MAX_COORD_INTEGER, y * AI_GRAPH_CELL_SIZE - MAX_COORD_INTEGER, z * AI_GRAPH_CELL_SIZE - MAX_COORD_INTEGER );
+	Vector maxs = mins + Vector( AI_GRAPH_CELL_SIZE, AI_GRAPH_CELL_SIZE, AI_GRAPH_CELL_SIZE );
+
+	CRC32_t sums[4] = { 0, 0, 0, 0 };
+	CRC32_t crc;
+	int i;
+
+	// ------------------
+	//  World brushes
+	// ------------------
+	CUtlVector<int> brushes;
+	CUtlVector<Vector4D> planes;
+	enginetrace->GetBrushesInAABB( mins, maxs, &brushes, AI_GRAPH_CONTENTS_MASK );
+	for ( i = 0; i < brushes.Count(); i++ )
+	{
+		int contents;
+		if ( !enginetrace->GetBrushInfo( brushes[i], &planes, &contents ) )
+			continue;
+
+		CRC32_Init( &crc );
+		CRC32_ProcessBuffer( &crc, &contents, sizeof(contents) );
+		CRC32_ProcessBuffer( &crc, planes.Base(), planes.Count() * sizeof(Vector4D) );
+		CRC32_Final( &crc );
+		sums[0] += crc;
+	}
+
+	// ------------------
+	//  Static props
+	// ------------------
+	CUtlVector<ICollideable *> props;
+	staticpropmgr->GetAllStaticPropsInAABB( mins, maxs, &props );
+	for ( i = 0; i < props.Count(); i++ )
+	{
+		SolidType_t solid = props[i]->GetSolid();
+		if ( solid == SOLID_NONE )
+			continue;
+
+		const char *pszModel = modelinfo->GetModelName( props[i]->GetCollisionModel() );
+
+		CRC32_Init( &crc );
+		CRC32_ProcessBuffer( &crc, &solid, sizeof(solid) );
+		CRC32_ProcessBuffer( &crc, &props[i]->GetCollisionOrigin(), sizeof(Vector) );
+		CRC32_ProcessBuffer( &crc, &props[i]->GetCollisionAngles(), sizeof(QAngle) );
+		if ( pszModel )
+			CRC32_ProcessBuffer( &crc, pszModel, Q_strlen( pszModel ) );
+		CRC32_Final( &crc );
+		sums[1] += crc;
+	}
+
+	// ------------------
+	//  Solid entities, other than NPCs and players
+	// ------------------
+	CBaseEntity *pList[1024];
+	int nEntities = UTIL_EntitiesInBox( pList, ARRAYSIZE(pList), mins, maxs, 0 );
+	for ( i = 0; i < nEntities; i++ )
+	{
+		CBaseEntity *pEntity = pList[i];
+		if ( !pEntity->IsSolid() || pEntity->MyCombatCharacterPointer() )
+			continue;
+
+		SolidType_t solid = pEntity->GetSolid();
+
+		CRC32_Init( &crc );
+		CRC32_ProcessBuffer( &crc, &solid, sizeof(solid) );
+		CRC32_ProcessBuffer( &crc, &pEntity->GetAbsOrigin(), sizeof(Vector) );
+		CRC32_ProcessBuffer( &crc, &pEntity->GetAbsAngles(), sizeof(QAngle) );
+		CRC32_ProcessBuffer( &crc, &pEntity->CollisionProp()->OBBMins(), sizeof(Vector) );
+		CRC32_ProcessBuffer( &crc, &pEntity->CollisionProp()->OBBMaxs(), sizeof(Vector) );
+
+		// Brush models are numbered by the compile, so only studio models are known by name
+		const char *pszModel = STRING( pEntity->GetModelName() );
+		if ( pszModel && pszModel[0] && pszModel[0] != '*' )
+			CRC32_ProcessBuffer( &crc, pszModel, Q_strlen( pszModel ) );
+		CRC32_Final( &crc );
+		sums[2] += crc;
+	}
+
+	// ------------------
+	//  Displacements
+	// ------------------
+	CPhysCollide *pDispCollide = enginetrace->GetCollidableFromDisplacementsInAABB( mins, maxs );
+	if ( pDispCollide )
+	{
+		CUtlVector<char> bytes;
+		bytes.SetCount( physcollision->CollideSize( pDispCollide ) );
+		physcollision->CollideWrite( bytes.Base(), pDispCollide );
+		sums[3] = CRC32_ProcessSingleBuffer( bytes.Base(), bytes.Count() );
+		physcollision->DestroyCollide( pDispCollide );
+	}
+
+	return CRC32_ProcessSingleBuffer( sums, sizeof(sums) );
+}
+
 
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
@@ -344,6 +643,11 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 		buf.PutInt( GetEditOps()->m_pNodeIndexTable[node] );
 	}
 
+	// -------------------------------
+	// Dump what the graph was built from
+	// -------------------------------
+	g_AINetworkBuilder.GetBuildRecord().Save( buf );
+
 	// -------------------------------
 	// Write the file out
 	// -------------------------------
@@ -714,6 +1018,101 @@ void CAI_NetworkManager::LoadNetworkGraph( void )
 	CAI_DynamicLink::gm_bInitialized = false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose:  Reads the graph being rebuilt, for the builder to reuse the parts
+//			 of it that are still good. The map version isn't checked, as
+//			 the graph being out of date is the point.
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkManager::LoadPreviousNetworkGraph( CAI_PreviousNetwork *pPrevious )
+{
+	char szNrpFilename[MAX_PATH];
+	Q_snprintf( szNrpFilename, sizeof( szNrpFilename ), "maps/graphs/%s%s", STRING( gpGlobals->mapname ), IsX360() ? ".360.ain" : ".ain" );
+
+	CUtlBuffer buf;
+	if ( !filesystem->ReadFile( szNrpFilename, "game", buf ) )
+		return false;
+
+	if ( buf.GetInt() != AINET_VERSION_NUMBER )
+	{
+		DevMsg( "Previous AI node graph %s is from another version, rebuilding all of it\n", szNrpFilename );
+		return false;
+	}
+
+	buf.GetInt(); // map version
+
+	int numNodes = buf.GetInt();
+	if ( numNodes > MAX_NODES || numNodes <= 0 )
+		return false;
+
+	// -------------------------------
+	// Load the nodes
+	// -------------------------------
+	pPrevious->m_Nodes.SetCount( numNodes );
+
+	int node;
+	for ( node = 0; node < numNodes; node++ )
+	{
+		AI_PreviousNode_t &previousNode = pPrevious->m_Nodes[node];
+
+		previousNode.vecOrigin.x = buf.GetFloat();
+		previousNode.vecOrigin.y = buf.GetFloat();
+		previousNode.vecOrigin.z = buf.GetFloat();
+		buf.GetFloat(); // yaw
+		buf.Get( previousNode.flVOffset, sizeof( previousNode.flVOffset ) );
+		previousNode.nType = buf.GetChar();
+		if ( IsX360() )
+		{
+			buf.SeekGet( CUtlBuffer::SEEK_CURRENT, 3 );
+		}
+		previousNode.nInfo = buf.GetUnsignedShort();
+		buf.GetShort(); // zone
+	}
+
+	// -------------------------------
+	// Load the links
+	// -------------------------------
+	int totalNumLinks = buf.GetInt();
+	if ( !buf.IsValid() || totalNumLinks < 0 || totalNumLinks > buf.GetBytesRemaining() / (int)( 2 * sizeof(short) + NUM_HULLS ) )
+		return false;
+
+	pPrevious->m_Links.SetCount( totalNumLinks );
+
+	for ( int link = 0; link < totalNumLinks; link++ )
+	{
+		int srcID = buf.GetShort();
+		int destID = buf.GetShort();
+		buf.Get( pPrevious->m_Links[link].acceptedMoveTypes, sizeof( pPrevious->m_Links[link].acceptedMoveTypes ) );
+
+		pPrevious->m_Connections.InsertOrReplace( AI_ConnectionKey( srcID, destID ), link );
+	}
+
+	// -------------------------------
+	// Load the WC lookup table
+	// -------------------------------
+	for ( node = 0; node < numNodes; node++ )
+	{
+		pPrevious->m_Nodes[node].nWCId = buf.GetInt();
+	}
+
+	// -------------------------------
+	// Load what the graph was built from
+	// -------------------------------
+	if ( !buf.IsValid() || !pPrevious->m_Record.Restore( buf, numNodes ) )
+	{
+		DevMsg( "Previous AI node graph %s has no build record, rebuilding all of it\n", szNrpFilename );
+		return false;
+	}
+
+	const CUtlVector<unsigned int> &failedConnections = pPrevious->m_Record.m_FailedConnections;
+	for ( int i = 0; i < failedConnections.Count(); i++ )
+	{
+		pPrevious->m_Connections.InsertOrReplace( failedConnections[i], AI_PREVIOUS_CONNECTION_FAILED );
+	}
+
+	return true;
+}
+
 /* Keep this around for debugging
 //-----------------------------------------------------------------------------
 // Purpose:  Only called if network has changed since last time level
@@ -907,7 +1306,12 @@ void CAI_NetworkManager::BuildNetworkGraph( void )
 		return;
 
 	CAI_DynamicLink::gm_bInitialized = false;
-	g_AINetworkBuilder.Build( m_pNetwork );
+
+	// When building for the first time reuse what's still good of the graph being replaced
+	CAI_PreviousNetwork previous;
+	bool bHavePrevious = ( g_ai_reusegraph.GetBool() && !engine->IsInEditMode() && !CAI_NetworkManager::NetworksLoaded() && LoadPreviousNetworkGraph( &previous ) );
+
+	g_AINetworkBuilder.Build( m_pNetwork, ( bHavePrevious ) ? &previous : NULL );
 
 	// If I'm loading for the first time save.  Otherwise I'm 
 	// doing a wc edit and I don't want to save
@@ -2210,6 +2614,7 @@ void CAI_NetworkBuilder::Rebuild( CAI_Network *pNetwork )
 void CAI_NetworkBuilder::BeginBuild()
 {
 	m_pTestHull = CAI_TestHull::GetTestHull();
+	m_BuildRecord.Purge();
 }
 
 //-----------------------------------------------------------------------------
@@ -2219,6 +2624,11 @@ void CAI_NetworkBuilder::EndBuild()
 	m_NeighborsTable.SetSize(0);
 	m_DidSetNeighborsTable.Resize(0);
 	CAI_TestHull::ReturnTestHull();
+
+	m_pPrevious = NULL;
+	m_PreviousIds.Purge();
+	m_CurrentIds.Purge();
+	m_NeighborsToInit.Resize(0);
 }
 
 //-----------------------------------------------------------------------------
@@ -2227,7 +2637,7 @@ void CAI_NetworkBuilder::EndBuild()
 //-----------------------------------------------------------------------------
 
 
-void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
+void CAI_NetworkBuilder::Build( CAI_Network *pNetwork, const CAI_PreviousNetwork *pPrevious )
 {
 	int nNodes = pNetwork->NumNodes();
 	CAI_Node **ppNodes = pNetwork->AccessNodes();
@@ -2246,12 +2656,18 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	
 	DevMsg( "Building AI node graph...\n");
 	masterTimer.Start();
+
+	m_pPrevious = pPrevious;
+	m_nReusedNeighbors = 0;
+	m_nReusedConnections = 0;
+	m_nComputedConnections = 0;
 	
 	// ---------------------------
 	// Initialize node positions
 	// ---------------------------
 	DevMsg( "Initializing node positions...\n" );
 	timer.Start();
+	BeginInputHashes( pNetwork );
 	int i;
 	for ( i = 0; i < nNodes; i++)
 	{
@@ -2263,6 +2679,16 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	timer.End();
 	DevMsg( "...done initializing node positions. %f seconds\n", timer.GetDuration().GetSeconds() );
 
+	// ---------------------------
+	// Find what can be reused
+	// ---------------------------
+	DevMsg( "Comparing with previous graph...\n" );
+	timer.Start();
+	EndInputHashes( pNetwork );
+	MatchPreviousNodes( pNetwork );
+	timer.End();
+	DevMsg( "...done comparing with previous graph. %f seconds\n", timer.GetDuration().GetSeconds() );
+
 	// ---------------------------
 	// Initialize node neighbors
 	// ---------------------------
@@ -2278,8 +2704,16 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	}
 	for (i = 0; i < nNodes; i++)
 	{	
+		if ( !m_NeighborsToInit.IsBitSet( i ) && RestoreNeighbors( pNetwork, ppNodes[i] ) )
+		{
+			m_nReusedNeighbors++;
+			continue;
+		}
+
 		InitNeighbors( pNetwork, ppNodes[i] );
+		CheckPreviousNeighbors( pNetwork, ppNodes[i] );
 	}
+	RecordNeighbors( pNetwork );
 	timer.End();
 	DevMsg( "...done initializing node neighbors. %f seconds\n", timer.GetDuration().GetSeconds() );
 
@@ -2320,6 +2754,12 @@ void CAI_NetworkBuilder::Build( CAI_Network *pNetwork )
 	DevMsg( "...done determining zones. %f seconds\n", timer.GetDuration().GetSeconds() );
 	DevMsg( "...done building AI node graph, %f seconds\n", masterTimer.GetDuration().GetSeconds() );
 
+	if ( m_pPrevious )
+	{
+		DevMsg( "Reused %d nodes and rebuilt %d from previous graph, reused %d of %d connections\n", 
+			m_nReusedNeighbors, nNodes - m_nReusedNeighbors, m_nReusedConnections, m_nReusedConnections + m_nComputedConnections );
+	}
+
 	g_pAINetworkManager->FixupHints();
 
 	EndBuild();
@@ -2384,6 +2824,339 @@ void CAI_NetworkBuilder::ForceDynamicLinkNeighbors(void)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Starts the hash of what each node's position and links are
+//			computed from with the node as placed, before it's positioned
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuilder::BeginInputHashes( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+	m_BuildRecord.m_InputHashes.SetCount( nNodes );
+
+	for ( int i = 0; i < nNodes; i++ )
+	{
+		CAI_Node *pNode = pNetwork->GetNode( i );
+		int type = pNode->GetType();
+		int info = pNode->m_eNodeInfo;
+		int hintType = ( pNode->GetHint() ) ? pNode->GetHint()->HintType() : HINT_NONE;
+		float yaw = pNode->GetYaw();
+
+		CRC32_t *pCRC = &m_BuildRecord.m_InputHashes[i];
+		CRC32_Init( pCRC );
+		CRC32_ProcessBuffer( pCRC, &pNode->GetOrigin(), sizeof(Vector) );
+		CRC32_ProcessBuffer( pCRC, &yaw, sizeof(yaw) );
+		CRC32_ProcessBuffer( pCRC, &type, sizeof(type) );
+		CRC32_ProcessBuffer( pCRC, &info, sizeof(info) );
+		CRC32_ProcessBuffer( pCRC, &hintType, sizeof(hintType) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finishes the hashes with the geometry around where the nodes 
+//			ended up: everything within half a link of them, which covers 
+//			every trace between them and another node, plus the floor they
+//			were dropped to
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuilder::EndInputHashes( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+	int nPlacedNodes = m_BuildRecord.m_InputHashes.Count();
+	int i;
+
+	float flLinkDist = MAX_NODE_LINK_DIST;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		if ( pNetwork->GetNode( i )->GetType() == NODE_AIR )
+		{
+			flLinkDist = MAX_AIR_NODE_LINK_DIST;
+			break;
+		}
+	}
+
+	float flHullWidth = 0;
+	float flHullHeight = 0;
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		flHullWidth = MAX( flHullWidth, MAX( NAI_Hull::Maxs( hull ).x, NAI_Hull::Maxs( hull ).y ) );
+		flHullWidth = MAX( flHullWidth, MAX( -NAI_Hull::Mins( hull ).x, -NAI_Hull::Mins( hull ).y ) );
+		flHullHeight = MAX( flHullHeight, NAI_Hull::Maxs( hull ).z );
+	}
+
+	// Jumps arc above the nodes, so look a whole link up
+	Vector vecRegionMins( -( 0.5 * flLinkDist + flHullWidth ), -( 0.5 * flLinkDist + flHullWidth ), -( 0.5 * flLinkDist + 384 + flHullHeight ) );
+	Vector vecRegionMaxs( 0.5 * flLinkDist + flHullWidth, 0.5 * flLinkDist + flHullWidth, flLinkDist + flHullHeight );
+
+	CAI_GeometryHasher geometryHasher;
+
+	m_BuildRecord.m_InputHashes.SetCountNonDestructively( nNodes );
+	for ( i = 0; i < nNodes; i++ )
+	{
+		CAI_Node *pNode = pNetwork->GetNode( i );
+		CRC32_t *pCRC = &m_BuildRecord.m_InputHashes[i];
+
+		// Nodes made by the build are never reused
+		if ( i >= nPlacedNodes )
+		{
+			*pCRC = 0;
+			continue;
+		}
+
+		geometryHasher.HashRegion( pCRC, pNode->GetOrigin() + vecRegionMins, pNode->GetOrigin() + vecRegionMaxs );
+		CRC32_Final( pCRC );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Nodes are taken from the previous graph when they have the same 
+//			Hammer id, inputs and resulting position. Those that aren't, and 
+//			the old positions of nodes that moved or went away, are changes
+//			that every node within linking distance of has to be redone for.
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuilder::MatchPreviousNodes( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+	CAI_Node **ppNodes = pNetwork->AccessNodes();
+	int *pWCIds = g_pAINetworkManager->GetEditOps()->m_pNodeIndexTable;
+	int i;
+
+	m_PreviousIds.SetCount( nNodes );
+	m_NeighborsToInit.Resize( nNodes );
+	for ( i = 0; i < nNodes; i++ )
+	{
+		m_PreviousIds[i] = NO_NODE;
+		m_NeighborsToInit.Set( i );
+	}
+
+	if ( !m_pPrevious )
+		return;
+
+	int nPreviousNodes = m_pPrevious->m_Nodes.Count();
+	m_CurrentIds.SetCount( nPreviousNodes );
+	for ( i = 0; i < nPreviousNodes; i++ )
+	{
+		m_CurrentIds[i] = NO_NODE;
+	}
+
+	// ---------------------------
+	// Match up by Hammer id, which has to be unique in both graphs
+	// ---------------------------
+	CUtlMap<int, int> previousWCIds;
+	CUtlMap<int, int> currentWCIds;
+	SetDefLessFunc( previousWCIds );
+	SetDefLessFunc( currentWCIds );
+
+	for ( i = 0; i < nPreviousNodes; i++ )
+	{
+		int iWCId = m_pPrevious->m_Nodes[i].nWCId;
+		int iExisting = previousWCIds.Find( iWCId );
+		if ( iExisting != previousWCIds.InvalidIndex() )
+			previousWCIds[iExisting] = NO_NODE;
+		else if ( iWCId != NO_NODE )
+			previousWCIds.Insert( iWCId, i );
+	}
+
+	for ( i = 0; i < nNodes; i++ )
+	{
+		int iExisting = currentWCIds.Find( pWCIds[i] );
+		if ( iExisting != currentWCIds.InvalidIndex() )
+			currentWCIds[iExisting] = NO_NODE;
+		else if ( pWCIds[i] != NO_NODE )
+			currentWCIds.Insert( pWCIds[i], i );
+	}
+
+	bool bHaveAirNodes = false;
+
+	for ( i = 0; i < nNodes; i++ )
+	{
+		CAI_Node *pNode = ppNodes[i];
+		if ( pNode->GetType() == NODE_AIR )
+			bHaveAirNodes = true;
+
+		int iCurrent = currentWCIds.Find( pWCIds[i] );
+		int iPrevious = previousWCIds.Find( pWCIds[i] );
+		if ( iCurrent == currentWCIds.InvalidIndex() || currentWCIds[iCurrent] != i || iPrevious == previousWCIds.InvalidIndex() )
+			continue;
+
+		iPrevious = previousWCIds[iPrevious];
+		if ( iPrevious == NO_NODE || m_pPrevious->m_Record.m_InputHashes[iPrevious] != m_BuildRecord.m_InputHashes[i] )
+			continue;
+
+		// Hull drops and climb mounts are in the hash's region, but check what they came to anyway
+		const AI_PreviousNode_t &previousNode = m_pPrevious->m_Nodes[iPrevious];
+		if ( previousNode.vecOrigin != pNode->GetOrigin() ||
+			 memcmp( previousNode.flVOffset, pNode->m_flVOffset, sizeof( previousNode.flVOffset ) ) != 0 ||
+			 previousNode.nInfo != (unsigned short)pNode->m_eNodeInfo ||
+			 ( previousNode.nType != pNode->GetType() && previousNode.nType != NODE_DELETED ) )
+		{
+			continue;
+		}
+
+		m_PreviousIds[i] = iPrevious;
+		m_CurrentIds[iPrevious] = i;
+	}
+
+	// ---------------------------
+	// Collect the changes
+	// ---------------------------
+	CUtlVector<Vector> changes;
+
+	for ( i = 0; i < nNodes; i++ )
+	{
+		if ( m_PreviousIds[i] == NO_NODE )
+			changes.AddToTail( ppNodes[i]->GetOrigin() );
+	}
+
+	for ( i = 0; i < nPreviousNodes; i++ )
+	{
+		if ( m_pPrevious->m_Nodes[i].nType == NODE_AIR )
+			bHaveAirNodes = true;
+
+		if ( m_CurrentIds[i] == NO_NODE )
+			changes.AddToTail( m_pPrevious->m_Nodes[i].vecOrigin );
+	}
+
+	// Duplicates delete each other depending on which is built first, so they're always redone
+	int j;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		for ( j = i + 1; j < nNodes; j++ )
+		{
+			if ( ppNodes[i]->GetOrigin() == ppNodes[j]->GetOrigin() && ( ppNodes[i]->GetType() != NODE_CLIMB || ppNodes[j]->GetType() != NODE_CLIMB ) )
+				changes.AddToTail( ppNodes[i]->GetOrigin() );
+		}
+	}
+
+	// ---------------------------
+	// Everything else keeps its neighbors
+	// ---------------------------
+	float flLinkDistSqr = ( bHaveAirNodes ) ? MAX_AIR_NODE_LINK_DIST_SQ : MAX_NODE_LINK_DIST_SQ;
+	for ( i = 0; i < nNodes; i++ )
+	{
+		if ( m_PreviousIds[i] == NO_NODE )
+			continue;
+
+		int iChange;
+		for ( iChange = 0; iChange < changes.Count(); iChange++ )
+		{
+			if ( ( changes[iChange] - ppNodes[i]->GetOrigin() ).LengthSqr() <= flLinkDistSqr )
+				break;
+		}
+
+		if ( iChange == changes.Count() )
+			m_NeighborsToInit.Clear( i );
+	}
+
+	// ...unless it swapped order with a node near it, as the later of two nodes
+	// takes whether they see each other from the earlier one
+	for ( i = 0; i < nNodes; i++ )
+	{
+		for ( j = i + 1; j < nNodes; j++ )
+		{
+			if ( m_PreviousIds[i] != NO_NODE && m_PreviousIds[j] != NO_NODE && m_PreviousIds[i] > m_PreviousIds[j] &&
+				 ( ppNodes[i]->GetOrigin() - ppNodes[j]->GetOrigin() ).LengthSqr() <= flLinkDistSqr )
+			{
+				m_NeighborsToInit.Set( i );
+				m_NeighborsToInit.Set( j );
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes the neighbors of an unchanged node from the previous graph
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkBuilder::RestoreNeighbors( CAI_Network *pNetwork, CAI_Node *pNode )
+{
+	const CUtlVector<unsigned short> &previousNeighbors = m_pPrevious->m_Record.m_Neighbors[ m_PreviousIds[pNode->m_iID] ];
+
+	m_NeighborsTable[pNode->m_iID].ClearAll();
+	for ( int i = 0; i < previousNeighbors.Count(); i++ )
+	{
+		int iNeighbor = m_CurrentIds[ previousNeighbors[i] ];
+		if ( iNeighbor == NO_NODE )
+			return false;
+
+		m_NeighborsTable[pNode->m_iID].Set( iNeighbor );
+	}
+
+	m_DidSetNeighborsTable.Set( pNode->m_iID );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Later nodes copy whether they see a node from the node's own 
+//			neighbors, so any that would now copy something different than
+//			they did in the previous graph have to be redone as well
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuilder::CheckPreviousNeighbors( CAI_Network *pNetwork, CAI_Node *pNode )
+{
+	if ( !m_pPrevious )
+		return;
+
+	int iPrevious = m_PreviousIds[pNode->m_iID];
+	const CUtlVector<unsigned short> *pPreviousNeighbors = ( iPrevious != NO_NODE ) ? &m_pPrevious->m_Record.m_Neighbors[iPrevious] : NULL;
+
+	for ( int i = pNode->m_iID + 1; i < pNetwork->NumNodes(); i++ )
+	{
+		if ( m_NeighborsToInit.IsBitSet( i ) )
+			continue;
+
+		bool bWasNeighbor = ( pPreviousNeighbors && pPreviousNeighbors->HasElement( m_PreviousIds[i] ) );
+		if ( m_NeighborsTable[pNode->m_iID].IsBitSet( i ) != bWasNeighbor )
+			m_NeighborsToInit.Set( i );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void CAI_NetworkBuilder::RecordNeighbors( CAI_Network *pNetwork )
+{
+	int nNodes = pNetwork->NumNodes();
+
+	m_BuildRecord.m_Neighbors.SetCount( nNodes );
+	for ( int i = 0; i < nNodes; i++ )
+	{
+		CUtlVector<unsigned short> &neighbors = m_BuildRecord.m_Neighbors[i];
+		neighbors.RemoveAll();
+		for ( int j = 0; j < nNodes; j++ )
+		{
+			if ( m_NeighborsTable[i].IsBitSet( j ) )
+				neighbors.AddToTail( j );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gets the hulls that can move between two unchanged nodes from the
+//			previous graph, if it tested them the same way around
+//-----------------------------------------------------------------------------
+
+bool CAI_NetworkBuilder::GetPreviousConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, int *pAcceptedMotions )
+{
+	int iPreviousSrc = ( m_pPrevious ) ? m_PreviousIds[pSrcNode->m_iID] : NO_NODE;
+	int iPreviousDest = ( m_pPrevious ) ? m_PreviousIds[pDestNode->m_iID] : NO_NODE;
+	int iLink = ( iPreviousSrc != NO_NODE && iPreviousDest != NO_NODE ) ? m_pPrevious->FindConnection( iPreviousSrc, iPreviousDest ) : -1;
+
+	if ( iLink == -1 )
+	{
+		m_nComputedConnections++;
+		return false;
+	}
+
+	for ( int hull = 0; hull < NUM_HULLS; hull++ )
+	{
+		pAcceptedMotions[hull] = ( iLink != AI_PREVIOUS_CONNECTION_FAILED ) ? m_pPrevious->m_Links[iLink].acceptedMoveTypes[hull] : 0;
+	}
+
+	m_nReusedConnections++;
+	return true;
+}
+
 CAI_NetworkBuilder g_AINetworkBuilder;
 
 
@@ -3209,11 +3982,18 @@ void CAI_NetworkBuilder::InitLinks(CAI_Network *pNetwork, CAI_Node *pNode)
 
 			if ( !(pNode->m_eNodeInfo & bits_NODE_FALLEN) && !(pDestNode->m_eNodeInfo & bits_NODE_FALLEN) )
 			{
+				bool bReused = GetPreviousConnection( pNode, pDestNode, acceptedMotions );
+				if ( bReused )
+					DebugConnectMsg( pNode->m_iID, i, "   Reusing connection from previous graph\n" );
+
 				for (int hull = 0 ; hull < NUM_HULLS; hull++ )
 				{
-					DebugConnectMsg( pNode->m_iID, i, "   Testing for hull %s\n", NAI_Hull::Name( (Hull_t)hull  ) );
+					if ( !bReused )
+					{
+						DebugConnectMsg( pNode->m_iID, i, "   Testing for hull %s\n", NAI_Hull::Name( (Hull_t)hull  ) );
 					
-					acceptedMotions[hull] = ComputeConnection( pNode, pDestNode, (Hull_t)hull );
+						acceptedMotions[hull] = ComputeConnection( pNode, pDestNode, (Hull_t)hull );
+					}
 					if ( acceptedMotions[hull] != 0 )
 						bAllFailed = false;
 				}
@@ -3237,6 +4017,7 @@ void CAI_NetworkBuilder::InitLinks(CAI_Network *pNetwork, CAI_Node *pNode)
 			else 
 			{
 				m_NeighborsTable[pNode->m_iID].Clear(pDestNode->m_iID);
+				m_BuildRecord.m_FailedConnections.AddToTail( AI_ConnectionKey( pNode->m_iID, pDestNode->m_iID ) );
 				DebugConnectMsg(pNode->m_iID, i, "   NO LINK\n" );
 			}
 		}
@@ -19,6 +19,8 @@ class CAI_Network;
 class CAI_Node;
 class CAI_Link;
 class CAI_TestHull;
+class CAI_PreviousNetwork;
+class CUtlBuffer;
 
 //-----------------------------------------------------------------------------
 // CAI_NetworkManager
@@ -67,6 +69,7 @@ private:
 	void			DelayedInit();
 	void			RebuildThink();
 	void			SaveNetworkGraph( void) ;	
+	bool			LoadPreviousNetworkGraph( CAI_PreviousNetwork *pPrevious );
 	static bool		IsAIFileCurrent( const char *szMapName );		
 	
 	static bool				gm_fNetworksLoaded;							// Have AINetworks been loaded
@@ -90,18 +93,41 @@ public:
 	virtual void PostInitNodePosition( CAI_Network *pNetwork, CAI_Node *pNode ) = 0;
 };
 
+//-----------------------------------------------------------------------------
+// CAI_NetworkBuildRecord
+//
+// Purpose: What a graph was built from, saved along with it so that the
+//			next build of the map only has to redo the nodes whose
+//			placement or surrounding geometry changed.
+//
+//-----------------------------------------------------------------------------
+
+class CAI_NetworkBuildRecord
+{
+public:
+	void			Purge();
+	void			Save( CUtlBuffer &buf ) const;
+	bool			Restore( CUtlBuffer &buf, int nNodes );
+
+	CUtlVector<unsigned int>				m_InputHashes;			// Node placement and the geometry it was linked against
+	CUtlVector< CUtlVector<unsigned short> > m_Neighbors;			// Before dynamic links were forced
+	CUtlVector<unsigned int>				m_FailedConnections;	// Tested with no hull passing, ( src << 16 ) | dest
+};
+
 //-----------------------------------------------------------------------------
 
 class CAI_NetworkBuilder
 {
 public:
-	void			Build( CAI_Network *pNetwork );
+	void			Build( CAI_Network *pNetwork, const CAI_PreviousNetwork *pPrevious = NULL );
 	void			Rebuild( CAI_Network *pNetwork );
 
 	void			InitNodePosition( CAI_Network *pNetwork, CAI_Node *pNode );
 
 	void			InitZones( CAI_Network *pNetwork );
 
+	const CAI_NetworkBuildRecord &GetBuildRecord() const	{ return m_BuildRecord; }
+
 private:
 	void			InitVisibility( CAI_Network *pNetwork, CAI_Node *pNode );
 	void			InitNeighbors( CAI_Network *pNetwork, CAI_Node *pNode );
@@ -112,6 +138,15 @@ private:
 	
 	void			FloodFillZone( CAI_Node **ppNodes, CAI_Node *pNode, int zone );
 
+	// Reuse of the graph being replaced
+	void			BeginInputHashes( CAI_Network *pNetwork );
+	void			EndInputHashes( CAI_Network *pNetwork );
+	void			MatchPreviousNodes( CAI_Network *pNetwork );
+	bool			RestoreNeighbors( CAI_Network *pNetwork, CAI_Node *pNode );
+	void			CheckPreviousNeighbors( CAI_Network *pNetwork, CAI_Node *pNode );
+	void			RecordNeighbors( CAI_Network *pNetwork );
+	bool			GetPreviousConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, int *pAcceptedMotions );
+
 	int				ComputeConnection( CAI_Node *pSrcNode, CAI_Node *pDestNode, Hull_t hull );
 	
 	void 			BeginBuild();
@@ -120,6 +155,16 @@ private:
 	CUtlVector<CVarBitVec>	m_NeighborsTable;
 	CVarBitVec				m_DidSetNeighborsTable;
 	CAI_TestHull *			m_pTestHull;
+
+	const CAI_PreviousNetwork *m_pPrevious;
+	CUtlVector<int>			m_PreviousIds;			// Same node in the previous graph, if nothing it was built from changed
+	CUtlVector<int>			m_CurrentIds;			// And back again
+	CVarBitVec				m_NeighborsToInit;		// Nodes whose neighbors can't be taken from the previous graph
+	CAI_NetworkBuildRecord	m_BuildRecord;
+
+	int						m_nReusedNeighbors;
+	int						m_nReusedConnections;
+	int						m_nComputedConnections;
 };
 
 extern CAI_NetworkBuilder g_AINetworkBuilder;
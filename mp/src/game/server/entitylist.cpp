@@ -17,6 +17,7 @@
 #include "ai_initutils.h"
 #include "globalstate.h"
 #include "datacache/imdlcache.h"
+#include "entityquerygrid.h"
 
 #ifdef HL2_DLL
 #include "npc_playercompanion.h"
@@ -684,6 +685,10 @@ CBaseEntity	*CGlobalEntityList::FindEntityByTarget( CBaseEntity *pStartEntity, c
 //-----------------------------------------------------------------------------
 CBaseEntity *CGlobalEntityList::FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
 {
+	// Entities without edicts aren't in the grid, so carry on from them the slow way
+	if ( g_EntityQueryGrid.IsEnabled() && ( !pStartEntity || g_EntityQueryGrid.HasEntity( pStartEntity ) ) )
+		return g_EntityQueryGrid.FindEntityInSphere( pStartEntity, vecCenter, flRadius );
+
 	const CEntInfo *pInfo = pStartEntity ? GetEntInfoPtr( pStartEntity->GetRefEHandle() )->m_pNext : FirstEntInfo();
 
 	for ( ;pInfo; pInfo = pInfo->m_pNext )
@@ -1092,6 +1097,8 @@ void CGlobalEntityList::OnAddEntity( IHandleEntity *pEnt, CBaseHandle handle )
 	CBaseEntity *pBaseEnt = static_cast<IServerUnknown*>(pEnt)->GetBaseEntity();
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts++;
+
+	g_EntityQueryGrid.AddEntity( pBaseEnt, handle.GetEntryIndex() );
 	
 	// NOTE: Must be a CBaseEntity on server
 	Assert( pBaseEnt );
@@ -1125,6 +1132,8 @@ void CGlobalEntityList::OnRemoveEntity( IHandleEntity *pEnt, CBaseHandle handle
 	if ( pBaseEnt->edict() )
 		m_iNumEdicts--;
 
+	g_EntityQueryGrid.RemoveEntity( handle.GetEntryIndex() );
+
 	m_iNumEnts--;
 }
 
@@ -1302,6 +1302,11 @@ void CServerGameDLL::PreClientUpdate( bool simulating )
 	
 	IGameSystem::PreClientUpdateAllSystems();
 
+	if ( net_trackchangedprops.GetBool() )
+	{
+		NetworkChangeStats_SampleChangedProps();
+	}
+
 #ifdef _DEBUG
 	if ( sv_showhitboxes.GetInt() == -1 )
 		return;
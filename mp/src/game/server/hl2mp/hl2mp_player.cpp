@@ -593,13 +593,25 @@ void CHL2MP_Player::PlayerDeathThink()
 	}
 }
 
+extern ConVar sv_unlag_snapshot;
+
 void CHL2MP_Player::FireBullets ( const FireBulletsInfo_t &info )
 {
-	// Move other players back to history positions based on local player's lag
-	lagcompensation->StartLagCompensation( this, this->GetCurrentCommand() );
-
 	FireBulletsInfo_t modinfo = info;
 
+	bool bLagSnapshot = sv_unlag_snapshot.GetBool();
+	if ( bLagSnapshot )
+	{
+		// Pose other players at their history positions without moving them
+		lagcompensation->PrepareSnapshot( this, this->GetCurrentCommand() );
+		modinfo.m_nFlags |= FIRE_BULLETS_LAG_COMPENSATION_SNAPSHOT;
+	}
+	else
+	{
+		// Move other players back to history positions based on local player's lag
+		lagcompensation->StartLagCompensation( this, this->GetCurrentCommand() );
+	}
+
 	CWeaponHL2MPBase *pWeapon = dynamic_cast<CWeaponHL2MPBase *>( GetActiveWeapon() );
 
 	if ( pWeapon )
@@ -611,8 +623,11 @@ void CHL2MP_Player::FireBullets ( const FireBulletsInfo_t &info )
 
 	BaseClass::FireBullets( modinfo );
 
-	// Move other players back to history positions based on local player's lag
-	lagcompensation->FinishLagCompensation( this );
+	if ( !bLagSnapshot )
+	{
+		// Move other players back to history positions based on local player's lag
+		lagcompensation->FinishLagCompensation( this );
+	}
 }
 
 void CHL2MP_Player::NoteWeaponFired( void )
@@ -11,8 +11,12 @@
 #pragma once
 #endif
 
+class CBaseEntity;
 class CBasePlayer;
 class CUserCmd;
+class CGameTrace;
+typedef CGameTrace trace_t;
+struct Ray_t;
 
 //-----------------------------------------------------------------------------
 // Purpose: This is also an IServerSystem
@@ -23,6 +27,22 @@ public:
 	// Called during player movement to set up/restore after lag compensation
 	virtual void	StartLagCompensation( CBasePlayer *player, CUserCmd *cmd ) = 0;
 	virtual void	FinishLagCompensation( CBasePlayer *player ) = 0;
+
+	// Poses the hitboxes of the players this command would move back into a
+	// snapshot, without moving anyone.  Commands going back to the same tick
+	// share the snapshot while the players haven't moved.  Main thread only.
+	// Used instead of StartLagCompensation when sv_unlag_snapshot is set; see
+	// FIRE_BULLETS_LAG_COMPENSATION_SNAPSHOT.
+	virtual void	PrepareSnapshot( CBasePlayer *player, CUserCmd *cmd ) = 0;
+
+	// True if pEntity is one of the players in this player's snapshot, which
+	// traces against the world should skip.
+	virtual bool	IsInSnapshot( CBasePlayer *player, CBaseEntity *pEntity ) = 0;
+
+	// Traces against the snapshot prepared for this player's command.  It only
+	// reads the snapshot, so traces for different players can run in parallel
+	// until the next PrepareSnapshot.
+	virtual bool	TraceSnapshot( CBasePlayer *player, const Ray_t &ray, unsigned int fContentsMask, trace_t *pTrace ) = 0;
 };
 
 extern ILagCompensationManager *lagcompensation;
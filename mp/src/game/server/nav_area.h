@@ -47,6 +47,33 @@ typedef CNavVectorNoEditAllocator CNavVectorAllocator;
 #endif
 
 
+//-------------------------------------------------------------------------------------------------------------------
+/**
+ * Search state of one area in a CNavPathQuery (see nav_pathfind.h). The query keeps these itself,
+ * so searches don't write to the areas and can run on several threads at once.
+ */
+struct NavPathQueryArea_t
+{
+	unsigned int generation;									// the rest is only valid if this matches the query's generation
+	int openIndex;												// position in the query's open heap, or -1 once closed
+	unsigned int openOrder;										// when the area was opened, so equal costs come off the heap in order
+	float totalCost;
+	float costSoFar;
+	float pathLengthSoFar;
+	CNavArea *parent;
+	NavTraverseType parentHow;
+};
+
+extern int g_nRunningNavPathQueries;							// number of CNavPathQuery searches running on any thread
+extern const NavPathQueryArea_t *FindRunningNavPathQueryArea( const CNavArea *area );	// the area's state in the search running on this thread, if any
+
+inline const NavPathQueryArea_t *GetRunningNavPathQueryArea( const CNavArea *area )
+{
+	// checked before the thread local lookup, since every search state accessor comes through here
+	return g_nRunningNavPathQueries ? FindRunningNavPathQueryArea( area ) : NULL;
+}
+
+
 //-------------------------------------------------------------------------------------------------------------------
 /**
  * Functor interface for iteration
@@ -131,6 +158,7 @@ public:
 
 	void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;
 	void Load( CUtlBuffer &fileBuffer, unsigned int version );
+	void Load( unsigned int id, const Vector &pos, unsigned char flags );	// set up a spot from already decoded data
 	NavErrorType PostLoad( void );
 
 	const Vector &GetPosition( void ) const		{ return m_pos; }	// get the position of the hiding spot
@@ -427,9 +455,10 @@ public:
 	void Mark( void )					{ m_marker = m_masterMarker; }
 	BOOL IsMarked( void ) const			{ return (m_marker == m_masterMarker) ? true : false; }
 	
+	// while a CNavPathQuery is searching on this thread, the search state accessors return its state instead
 	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ m_parent = parent; m_parentHow = how; }
-	CNavArea *GetParent( void ) const	{ return m_parent; }
-	NavTraverseType GetParentHow( void ) const	{ return m_parentHow; }
+	CNavArea *GetParent( void ) const;
+	NavTraverseType GetParentHow( void ) const;
 
 	bool IsOpen( void ) const;									// true if on "open list"
 	void AddToOpenList( void );									// add to open list in decreasing value order
@@ -446,13 +475,13 @@ public:
 	static void ClearSearchLists( void );						// clears the open and closed lists for a new search
 
 	void SetTotalCost( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_totalCost = value; }
-	float GetTotalCost( void ) const	{ return m_totalCost; }
+	float GetTotalCost( void ) const;
 
 	void SetCostSoFar( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_costSoFar = value; }
-	float GetCostSoFar( void ) const	{ return m_costSoFar; }
+	float GetCostSoFar( void ) const;
 
 	void SetPathLengthSoFar( float value )	{ Assert( value >= 0.0 && !IS_NAN(value) ); m_pathLengthSoFar = value; }
-	float GetPathLengthSoFar( void ) const	{ return m_pathLengthSoFar; }
+	float GetPathLengthSoFar( void ) const;
 
 	//- editing -----------------------------------------------------------------------------------------
 	virtual void Draw( void ) const;							// draw area for debugging & editing
@@ -722,6 +751,12 @@ private:
 
 	void FinishSplitEdit( CNavArea *newArea, NavDirType ignoreEdge );	// given the portion of the original area, update its internal data
 
+	// used by Load() and CNavMesh::LoadCompiled() so both set up an area the same way
+	void LoadID( unsigned int id );
+	void LoadExtent( const Vector &nwCorner, const Vector &seCorner, float neZ, float swZ );
+	void LoadConnection( NavDirType dir, unsigned int id );
+	void LoadLadderConnection( CNavLadder::LadderDirectionType dir, unsigned int id );
+
 	void CalcDebugID();
 
 #ifdef NEXT_BOT
@@ -824,6 +859,41 @@ inline CNavArea *CNavArea::GetAdjacentArea( NavDirType dir, int i ) const
 	return NULL;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+inline CNavArea *CNavArea::GetParent( void ) const
+{
+	const NavPathQueryArea_t *state = GetRunningNavPathQueryArea( this );
+	return state ? state->parent : m_parent;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline NavTraverseType CNavArea::GetParentHow( void ) const
+{
+	const NavPathQueryArea_t *state = GetRunningNavPathQueryArea( this );
+	return state ? state->parentHow : m_parentHow;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetTotalCost( void ) const
+{
+	const NavPathQueryArea_t *state = GetRunningNavPathQueryArea( this );
+	return state ? state->totalCost : m_totalCost;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetCostSoFar( void ) const
+{
+	const NavPathQueryArea_t *state = GetRunningNavPathQueryArea( this );
+	return state ? state->costSoFar : m_costSoFar;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetPathLengthSoFar( void ) const
+{
+	const NavPathQueryArea_t *state = GetRunningNavPathQueryArea( this );
+	return state ? state->pathLengthSoFar : m_pathLengthSoFar;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 inline bool CNavArea::IsOpen( void ) const
 {
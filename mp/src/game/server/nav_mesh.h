@@ -273,6 +273,7 @@ public:
 
 	virtual NavErrorType Load( void );									// load navigation data from a file
 	virtual NavErrorType PostLoad( unsigned int version );				// (EXTEND) invoked after all areas have been loaded - for pointer binding, etc
+	bool LoadCompiled( const char *navFilename, NavErrorType *result );	// load the compiled copy of the nav file instead, return false if there is no up to date one
 	bool IsLoaded( void ) const		{ return m_isLoaded; }				// return true if a Navigation Mesh has been loaded
 	bool IsAnalyzed( void ) const	{ return m_isAnalyzed; }			// return true if a Navigation Mesh has been analyzed
 
@@ -285,6 +286,7 @@ public:
 	const CUtlVector< Place > *GetPlacesFromNavFile( bool *hasUnnamedPlaces );	// Reads the used place names from the nav file (can be used to selectively precache before the nav is loaded)
 
 	virtual bool Save( void ) const;									// store Navigation Mesh to a file
+	bool SaveCompiled( unsigned int bspSize ) const;					// store a compiled copy of the nav file alongside it (see nav_compiled_mesh)
 	bool IsOutOfDate( void ) const	{ return m_isOutOfDate; }			// return true if the Navigation Mesh is older than the current map version
 
 	virtual unsigned int GetSubVersionNumber( void ) const;										// returns sub-version number of data format used by derived classes
@@ -349,6 +351,7 @@ public:
 	#define INCREMENTAL_GENERATION true
 	void BeginGeneration( bool incremental = false );					// initiate the generation process
 	void BeginAnalysis( bool quitWhenFinished = false );						// re-analyze an existing Mesh.  Determine Hiding Spots, Encounter Spots, etc.
+	void GenerateInBatch( bool quitWhenFinished = false );				// run a full generation to completion in one call, using worker threads, and report the time spent in each phase
 
 	bool IsGenerating( void ) const		{ return m_generationMode != GENERATE_NONE; }	// return true while a Navigation Mesh is being generated
 	const char *GetPlayerSpawnName( void ) const;						// return name of player spawn entity
@@ -1157,12 +1160,52 @@ private:
 	CNavNode *m_currentNode;									// the current node we are sampling from
 	NavDirType m_generationDir;
 	CNavNode *AddNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist );		// add a nav node and connect it, update current node
+	CNavNode *ConnectNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist, bool *isNew );	// find or create a nav node and connect it to source
+	void CheckNodeAttributes( CNavNode *node );					// determine crouch and cliff attributes of a sampled node
 
 	NavLadderVector m_ladders;									// list of ladder navigation representations
 	void BuildLadders( void );
 	void DestroyLadders( void );
 
 	bool SampleStep( void );									// sample the walkable areas of the map
+	CNavNode *GetNextSampleStartNode( void );					// return the next seed or ladder end to sample from, or NULL if sampling is complete
+
+	struct SampleStepResult
+	{
+		Vector to;
+		Vector normal;
+		bool isOnDisplacement;
+		float obstacleHeight;
+		float obstacleStartDist;
+		float obstacleEndDist;
+	};
+	bool TestSampleStep( const Vector &from, NavDirType dir, SampleStepResult *step );	// trace one step from 'from' in the given direction, return false if we can't move there
+
+	//
+	// Batch generation runs the sampling as a breadth-first wavefront, tracing every step of a
+	// wave on worker threads and then connecting the results in the order the steps were gathered,
+	// so the resulting mesh does not depend on the number of threads or their timing.
+	//
+	struct SampleStepTask
+	{
+		CNavNode *node;
+		NavDirType dir;
+		bool canMove;
+		SampleStepResult result;
+	};
+	void SampleWalkableSpaceInBatch( void );					// sample the walkable areas of the map in one call
+	void ProcessSampleStepTask( SampleStepTask &task );
+	void ProcessNodeAttributes( CNavNode *&node );
+	bool m_isBatchGenerating;									// true while GenerateInBatch() is running
+
+	struct TestAreaTask
+	{
+		CNavNode *node;
+		int width;
+		int height;
+		bool canBuild;
+	};
+	void ProcessTestAreaTask( TestAreaTask &task );
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
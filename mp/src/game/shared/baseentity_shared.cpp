@@ -35,6 +35,7 @@
 #endif
 
 	#include "gamestats.h"
+	#include "ilagcompensationmanager.h"
 
 #endif
 
@@ -1569,10 +1570,16 @@ Go to the trouble of combining multiple pellets into a single damage call.
 class CBulletsTraceFilter : public CTraceFilterSimpleList
 {
 public:
-	CBulletsTraceFilter( int collisionGroup ) : CTraceFilterSimpleList( collisionGroup ) {}
+	CBulletsTraceFilter( int collisionGroup ) : CTraceFilterSimpleList( collisionGroup ), m_pLagSnapshotShooter( NULL ) {}
+
+	// Skip the players in this shooter's lag compensation snapshot, they're traced separately
+	void SetLagSnapshotShooter( CBasePlayer *pShooter ) { m_pLagSnapshotShooter = pShooter; }
 
 	bool ShouldHitEntity( IHandleEntity *pHandleEntity, int contentsMask )
 	{
+		if ( m_pLagSnapshotShooter && lagcompensation->IsInSnapshot( m_pLagSnapshotShooter, EntityFromEntityHandle( pHandleEntity ) ) )
+			return false;
+
 		if ( m_PassEntities.Count() )
 		{
 			CBaseEntity *pEntity = EntityFromEntityHandle( pHandleEntity );
@@ -1588,6 +1595,8 @@ public:
 		return CTraceFilterSimpleList::ShouldHitEntity( pHandleEntity, contentsMask );
 	}
 
+private:
+	CBasePlayer *m_pLagSnapshotShooter;
 };
 #else
 typedef CTraceFilterSimpleList CBulletsTraceFilter;
@@ -1668,6 +1677,15 @@ void CBaseEntity::FireBullets( const FireBulletsInfo_t &info )
 	}
 #endif // SERVER_DLL
 
+#ifdef GAME_DLL
+	CBasePlayer *pLagSnapshotShooter = NULL;
+	if ( ( info.m_nFlags & FIRE_BULLETS_LAG_COMPENSATION_SNAPSHOT ) && IsPlayer() )
+	{
+		pLagSnapshotShooter = ToBasePlayer( this );
+		traceFilter.SetLagSnapshotShooter( pLagSnapshotShooter );
+	}
+#endif
+
 	bool bUnderwaterBullets = ShouldDrawUnderwaterBulletBubbles();
 	bool bStartedInWater = false;
 	if ( bUnderwaterBullets )
@@ -1726,7 +1744,8 @@ void CBaseEntity::FireBullets( const FireBulletsInfo_t &info )
 #endif
 
 
-		if( IsPlayer() && info.m_iShots > 1 && iShot % 2 )
+		bool bHullShot = IsPlayer() && info.m_iShots > 1 && iShot % 2;
+		if( bHullShot )
 		{
 			// Half of the shotgun pellets are hulls that make it easier to hit targets with the shotgun.
 #ifdef PORTAL
@@ -1778,6 +1797,30 @@ void CBaseEntity::FireBullets( const FireBulletsInfo_t &info )
 			tr.fraction = 0.0f;
 		}
 
+#ifdef GAME_DLL
+		// The snapshot players were skipped above, see if one of them is in front of what was hit
+		if ( pLagSnapshotShooter && tr.fraction > 0.0f )
+		{
+			Ray_t snapshotRay;
+			if ( bHullShot )
+			{
+				snapshotRay.Init( tr.startpos, tr.endpos, Vector( -3, -3, -3 ), Vector( 3, 3, 3 ) );
+			}
+			else
+			{
+				snapshotRay.Init( tr.startpos, tr.endpos );
+			}
+
+			trace_t snapshotTrace;
+			if ( lagcompensation->TraceSnapshot( pLagSnapshotShooter, snapshotRay, MASK_SHOT, &snapshotTrace ) )
+			{
+				float flFraction = tr.fraction * snapshotTrace.fraction;
+				tr = snapshotTrace;
+				tr.fraction = flFraction;
+			}
+		}
+#endif
+
 	// bullet's final direction can be changed by passing through a portal
 #ifdef PORTAL
 		if ( !tr.startsolid )
@@ -16,6 +16,10 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+// Pooled strings are copied into blocks of this size, so a level's worth of
+// strings is a handful of allocations rather than one per string
+#define GAME_STRING_BLOCK_SIZE	( 16 * 1024 )
+
 //-----------------------------------------------------------------------------
 // Purpose: The actual storage for pooled per-level strings
 //-----------------------------------------------------------------------------
@@ -36,14 +40,49 @@ class CGameStringPool : public CBaseGameSystem
 #endif
 		m_Strings.Purge();
 		m_KeyLookupCache.Purge();
+
+		for ( int i = 0; i < m_Blocks.Count(); ++i )
+		{
+			free( m_Blocks[i] );
+		}
+		m_Blocks.Purge();
+		m_nBlockUsed = GAME_STRING_BLOCK_SIZE;
+	}
+
+	// Copies the string into the current block. Blocks are never moved or freed
+	// until FreeAll, so the returned pointer is stable for the level.
+	const char *CopyString( const char *string )
+	{
+		int nLen = V_strlen( string ) + 1;
+		char *pDest;
+		if ( nLen > GAME_STRING_BLOCK_SIZE / 4 )
+		{
+			// Big strings get their own allocation; keep filling the current block
+			pDest = (char *)malloc( nLen );
+			m_Blocks.AddToHead( pDest );
+		}
+		else
+		{
+			if ( m_nBlockUsed + nLen > GAME_STRING_BLOCK_SIZE )
+			{
+				m_Blocks.AddToTail( (char *)malloc( GAME_STRING_BLOCK_SIZE ) );
+				m_nBlockUsed = 0;
+			}
+			pDest = m_Blocks.Tail() + m_nBlockUsed;
+			m_nBlockUsed += nLen;
+		}
+		memcpy( pDest, string, nLen );
+		return pDest;
 	}
 
-	CUtlHashtable<CUtlConstString> m_Strings;
+	CUtlHashtable<const char *, empty_t, StringHashFunctor, StringEqualFunctor> m_Strings;
 	CUtlHashtable<const void*, const char*> m_KeyLookupCache;
+	CUtlVector<char *> m_Blocks;
+	int m_nBlockUsed;
 
 public:
 
-	CGameStringPool() : m_Strings(256) { }
+	CGameStringPool() : m_Strings(256), m_nBlockUsed( GAME_STRING_BLOCK_SIZE ) { }
 
 	~CGameStringPool() { FreeAll(); }
 
@@ -52,7 +91,7 @@ public:
 		CUtlVector<const char*> strings( 0, m_Strings.Count() );
 		for (UtlHashHandle_t i = m_Strings.FirstHandle(); i != m_Strings.InvalidHandle(); i = m_Strings.NextHandle(i))
 		{
-			strings.AddToTail( strings[i] );
+			strings.AddToTail( m_Strings.Key( i ) );
 		}
 		struct _Local {
 			static int __cdecl F(const char * const *a, const char * const *b) { return strcmp(*a, *b); }
@@ -70,12 +109,17 @@ public:
 	const char *Find(const char *string)
 	{
 		UtlHashHandle_t i = m_Strings.Find( string );
-		return i == m_Strings.InvalidHandle() ? NULL : m_Strings[ i ].Get();
+		return i == m_Strings.InvalidHandle() ? NULL : m_Strings.Key( i );
 	}
 
 	const char *Allocate(const char *string)
 	{
-		return m_Strings[ m_Strings.Insert( string ) ].Get();
+		UtlHashHandle_t i = m_Strings.Find( string );
+		if ( i == m_Strings.InvalidHandle() )
+		{
+			i = m_Strings.Insert( CopyString( string ) );
+		}
+		return m_Strings.Key( i );
 	}
 
 	const char *AllocateWithKey(const char *string, const void* key)
@@ -18,6 +18,7 @@
 #endif
 #include "particle_parse.h"
 #include "KeyValues.h"
+#include "filesystem.h"
 #include "time.h"
 
 #ifdef USES_ECON_ITEMS
@@ -986,6 +987,26 @@ void UTIL_StringToColor32( color32 *color, const char *pString )
 	color->a = tmp[3];
 }
 
+// Cache directories already created this session
+static CUtlSymbolTable s_KeyValuesCacheDirs( 0, 16, true );
+
+bool UTIL_LoadKeyValuesCached( KeyValues *pKeyValues, const char *pszFilename, const char *pszPathID )
+{
+	char szCacheName[MAX_PATH];
+	Q_snprintf( szCacheName, sizeof( szCacheName ), "kvcache/%s.bin", pszFilename );
+	Q_FixSlashes( szCacheName );
+
+	char szCacheDir[MAX_PATH];
+	Q_ExtractFilePath( szCacheName, szCacheDir, sizeof( szCacheDir ) );
+	if ( !s_KeyValuesCacheDirs.Find( szCacheDir ).IsValid() )
+	{
+		filesystem->CreateDirHierarchy( szCacheDir, "DEFAULT_WRITE_PATH" );
+		s_KeyValuesCacheDirs.AddString( szCacheDir );
+	}
+
+	return pKeyValues->LoadFromFileCached( filesystem, pszFilename, pszPathID, szCacheName, "DEFAULT_WRITE_PATH" );
+}
+
 #ifndef _XBOX
 void UTIL_DecodeICE( unsigned char * buffer, int size, const unsigned char *key)
 {
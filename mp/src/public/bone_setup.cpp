@@ -5240,6 +5240,71 @@ static int ClipRayToHitbox( const Ray_t &ray, mstudiobbox_t *pbox, matrix3x4_t&
 #pragma warning (default : 4701)
 
 
+//-----------------------------------------------------------------------------
+// Hitboxes are culled against the ray a batch at a time with the SIMD OBB 
+// test before running the exact per-hitbox tests. Each hitbox is bloated by
+// the ray extents projected onto the bone axes plus a small epsilon, so the
+// cull never rejects a hitbox the exact test would have hit.
+//-----------------------------------------------------------------------------
+#define HITBOX_CULL_BATCH	32
+#define HITBOX_CULL_EPSILON	1.0f
+
+static int CullHitboxesAgainstRay( const Ray_t &ray, CStudioHdr *pStudioHdr, mstudiohitboxset_t *set, 
+	matrix3x4_t **hitboxbones, int fContentsMask, int nFirstHitbox, bool bCull, int *pCandidates )
+{
+	int nHitboxes = 0;
+	int pHitboxes[HITBOX_CULL_BATCH];
+	const matrix3x4_t *ppBones[HITBOX_CULL_BATCH];
+	Vector vecMins[HITBOX_CULL_BATCH], vecMaxs[HITBOX_CULL_BATCH];
+
+	int nLastHitbox = MIN( nFirstHitbox + HITBOX_CULL_BATCH, set->numhitboxes );
+	for ( int i = nFirstHitbox; i < nLastHitbox; i++ )
+	{
+		mstudiobbox_t *pbox = set->pHitbox(i);
+
+		// Filter based on contents mask
+		int fBoneContents = pStudioHdr->pBone( pbox->bone )->contents;
+		if ( ( fBoneContents & fContentsMask ) == 0 )
+			continue;
+
+		pHitboxes[nHitboxes] = i;
+		if ( bCull )
+		{
+			const matrix3x4_t &matrix = *hitboxbones[pbox->bone];
+			Vector vecBloat;
+			for ( int j = 0; j < 3; j++ )
+			{
+				vecBloat[j] = fabsf( matrix[0][j] * ray.m_Extents.x ) + fabsf( matrix[1][j] * ray.m_Extents.y ) + 
+					fabsf( matrix[2][j] * ray.m_Extents.z ) + HITBOX_CULL_EPSILON;
+			}
+			ppBones[nHitboxes] = &matrix;
+			VectorSubtract( pbox->bbmin, vecBloat, vecMins[nHitboxes] );
+			VectorAdd( pbox->bbmax, vecBloat, vecMaxs[nHitboxes] );
+		}
+		++nHitboxes;
+	}
+
+	if ( !bCull )
+	{
+		memcpy( pCandidates, pHitboxes, nHitboxes * sizeof( int ) );
+		return nHitboxes;
+	}
+
+	uint32 nHitMask;
+	IntersectRayWithOBBs( ray.m_Start, ray.m_Delta, ppBones, vecMins, vecMaxs, nHitboxes, 0.0f, NULL, &nHitMask );
+
+	int nCandidates = 0;
+	for ( int i = 0; i < nHitboxes; i++ )
+	{
+		if ( nHitMask & ( 1 << i ) )
+		{
+			pCandidates[nCandidates++] = pHitboxes[i];
+		}
+	}
+	return nCandidates;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -5249,34 +5314,34 @@ bool SweepBoxToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHd
 	tr.fraction = 1.0;
 	tr.startsolid = false;
 
-	// OPTIMIZE: Partition these?
 	Ray_t clippedRay = ray;
 	int hitbox = -1;
-	for ( int i = 0; i < set->numhitboxes; i++ )
+	int pCandidates[HITBOX_CULL_BATCH];
+	for ( int nFirst = 0; nFirst < set->numhitboxes && !tr.startsolid; nFirst += HITBOX_CULL_BATCH )
 	{
-		mstudiobbox_t *pbox = set->pHitbox(i);
+		int nCandidates = CullHitboxesAgainstRay( ray, pStudioHdr, set, hitboxbones, fContentsMask, nFirst, true, pCandidates );
+		for ( int c = 0; c < nCandidates; c++ )
+		{
+			int i = pCandidates[c];
+			mstudiobbox_t *pbox = set->pHitbox(i);
 
-		// Filter based on contents mask
-		int fBoneContents = pStudioHdr->pBone( pbox->bone )->contents;
-		if ( ( fBoneContents & fContentsMask ) == 0 )
-			continue;
-		
-		//FIXME: Won't work with scaling!
-		trace_t obbTrace;
-		if ( IntersectRayWithOBB( clippedRay, *hitboxbones[pbox->bone], pbox->bbmin, pbox->bbmax, 0.0f, &obbTrace ) )
-		{
-			tr.startpos = obbTrace.startpos;
-			tr.endpos = obbTrace.endpos;
-			tr.plane = obbTrace.plane;
-			tr.startsolid = obbTrace.startsolid;
-			tr.allsolid = obbTrace.allsolid;
-
-			// This logic here is to shorten the ray each time to get more early outs
-			tr.fraction *= obbTrace.fraction;
-			clippedRay.m_Delta *= obbTrace.fraction;
-			hitbox = i;
-			if (tr.startsolid)
-				break;
+			//FIXME: Won't work with scaling!
+			trace_t obbTrace;
+			if ( IntersectRayWithOBB( clippedRay, *hitboxbones[pbox->bone], pbox->bbmin, pbox->bbmax, 0.0f, &obbTrace ) )
+			{
+				tr.startpos = obbTrace.startpos;
+				tr.endpos = obbTrace.endpos;
+				tr.plane = obbTrace.plane;
+				tr.startsolid = obbTrace.startsolid;
+				tr.allsolid = obbTrace.allsolid;
+
+				// This logic here is to shorten the ray each time to get more early outs
+				tr.fraction *= obbTrace.fraction;
+				clippedRay.m_Delta *= obbTrace.fraction;
+				hitbox = i;
+				if (tr.startsolid)
+					break;
+			}
 		}
 	}
 
@@ -5316,66 +5381,70 @@ bool TraceToStudio( IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudioHdr *
 	int hitbox = -1;
 	int hitside = -1;
 
-	// OPTIMIZE: Partition these?
-	for ( int i = 0; i < set->numhitboxes; i++ )
+	// Scaled models transform each bone and the ray before testing, so only
+	// unscaled models use the batched cull
+	bool bScaled = ( flScale < 1.0f-FLT_EPSILON || flScale > 1.0f+FLT_EPSILON );
+
+	int pCandidates[HITBOX_CULL_BATCH];
+	for ( int nFirst = 0; nFirst < set->numhitboxes; nFirst += HITBOX_CULL_BATCH )
 	{
-		mstudiobbox_t *pbox = set->pHitbox(i);
+		int nCandidates = CullHitboxesAgainstRay( ray, pStudioHdr, set, hitboxbones, fContentsMask, nFirst, !bScaled, pCandidates );
+		for ( int c = 0; c < nCandidates; c++ )
+		{
+			int i = pCandidates[c];
+			mstudiobbox_t *pbox = set->pHitbox(i);
 
-		// Filter based on contents mask
-		int fBoneContents = pStudioHdr->pBone( pbox->bone )->contents;
-		if ( ( fBoneContents & fContentsMask ) == 0 )
-			continue;
-		
-		// columns are axes of the bones in world space, translation is in world space
-		matrix3x4_t& matrix = *hitboxbones[pbox->bone];
-		
-		// Because we're sending in a matrix with scale data, and because the matrix inversion in the hitbox
-		// code does not handle that case, we pre-scale the bones and ray down here and do our collision checks
-		// in unscaled space.  We can then rescale the results afterwards.
+			// columns are axes of the bones in world space, translation is in world space
+			matrix3x4_t& matrix = *hitboxbones[pbox->bone];
+			
+			// Because we're sending in a matrix with scale data, and because the matrix inversion in the hitbox
+			// code does not handle that case, we pre-scale the bones and ray down here and do our collision checks
+			// in unscaled space.  We can then rescale the results afterwards.
 
-		int side = -1;
-		if ( flScale < 1.0f-FLT_EPSILON || flScale > 1.0f+FLT_EPSILON )
-		{
-			matrix3x4_t matScaled;
-			MatrixCopy( matrix, matScaled );
+			int side = -1;
+			if ( bScaled )
+			{
+				matrix3x4_t matScaled;
+				MatrixCopy( matrix, matScaled );
 			
-			float invScale = 1.0f / flScale;
+				float invScale = 1.0f / flScale;
 
-			Vector vecBoneOrigin;
-			MatrixGetColumn( matScaled, 3, vecBoneOrigin );
+				Vector vecBoneOrigin;
+				MatrixGetColumn( matScaled, 3, vecBoneOrigin );
 			
-			// Pre-scale the origin down
-			Vector vecNewOrigin = vecBoneOrigin - vecOrigin;
-			vecNewOrigin *= invScale;
-			vecNewOrigin += vecOrigin;
-			MatrixSetColumn( vecNewOrigin, 3, matScaled );
-
-			// Scale it uniformly
-			VectorScale( matScaled[0], invScale, matScaled[0] );
-			VectorScale( matScaled[1], invScale, matScaled[1] );
-			VectorScale( matScaled[2], invScale, matScaled[2] );
+				// Pre-scale the origin down
+				Vector vecNewOrigin = vecBoneOrigin - vecOrigin;
+				vecNewOrigin *= invScale;
+				vecNewOrigin += vecOrigin;
+				MatrixSetColumn( vecNewOrigin, 3, matScaled );
+
+				// Scale it uniformly
+				VectorScale( matScaled[0], invScale, matScaled[0] );
+				VectorScale( matScaled[1], invScale, matScaled[1] );
+				VectorScale( matScaled[2], invScale, matScaled[2] );
 			
-			// Pre-scale our ray as well
-			Vector vecRayStart = ray.m_Start - vecOrigin;
-			vecRayStart *= invScale;
-			vecRayStart += vecOrigin;
+				// Pre-scale our ray as well
+				Vector vecRayStart = ray.m_Start - vecOrigin;
+				vecRayStart *= invScale;
+				vecRayStart += vecOrigin;
 			
-			Vector vecRayDelta = ray.m_Delta * invScale;
+				Vector vecRayDelta = ray.m_Delta * invScale;
 
-			Ray_t newRay;
-			newRay.Init( vecRayStart, vecRayStart + vecRayDelta );  
+				Ray_t newRay;
+				newRay.Init( vecRayStart, vecRayStart + vecRayDelta );  
 			
-			side = ClipRayToHitbox( newRay, pbox, matScaled, tr );
-		}
-		else
-		{
-			side = ClipRayToHitbox( ray, pbox, matrix, tr );
-		}
+				side = ClipRayToHitbox( newRay, pbox, matScaled, tr );
+			}
+			else
+			{
+				side = ClipRayToHitbox( ray, pbox, matrix, tr );
+			}
 
-		if ( side >= 0 )
-		{
-			hitbox = i;
-			hitside = side;
+			if ( side >= 0 )
+			{
+				hitbox = i;
+				hitside = side;
+			}
 		}
 	}
 
@@ -53,6 +53,8 @@ public:
 
 CUtlHash<DispCollPlaneIndex_t, CPlaneIndexHashFuncs, CPlaneIndexHashFuncs> g_DispCollPlaneIndexHash( 512 );
 
+bool g_bDispCollFourWideTris = true;
+
 
 //=============================================================================
 //	Displacement Collision Triangle
@@ -288,6 +290,34 @@ int FORCEINLINE CDispCollTree::BuildRayLeafList( int iNode, rayleaflist_t &list
 	return listIndex;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Load the triangles of the leaves at listIndex and listIndex+1 into
+//          one lane each.  When there is only one leaf left its triangles are
+//          repeated in lanes 2 and 3.
+//-----------------------------------------------------------------------------
+void FORCEINLINE CDispCollTree::GatherLeafTris( const rayleaflist_t &list, int listIndex, CDispCollTri **ppTris, FourVectors &v1, FourVectors &v2, FourVectors &v3 )
+{
+	const CDispCollLeaf &leaf0 = m_leaves[list.nodeList[listIndex] - m_nodes.Count()];
+	ppTris[0] = &m_aTris[leaf0.m_tris[0]];
+	ppTris[1] = &m_aTris[leaf0.m_tris[1]];
+	if ( listIndex < list.maxIndex )
+	{
+		const CDispCollLeaf &leaf1 = m_leaves[list.nodeList[listIndex+1] - m_nodes.Count()];
+		ppTris[2] = &m_aTris[leaf1.m_tris[0]];
+		ppTris[3] = &m_aTris[leaf1.m_tris[1]];
+	}
+	else
+	{
+		ppTris[2] = ppTris[0];
+		ppTris[3] = ppTris[1];
+	}
+
+	// Same winding the scalar tests use (0, 2, 1)
+	v1.LoadAndSwizzle( m_aVerts[ppTris[0]->GetVert( 0 )], m_aVerts[ppTris[1]->GetVert( 0 )], m_aVerts[ppTris[2]->GetVert( 0 )], m_aVerts[ppTris[3]->GetVert( 0 )] );
+	v2.LoadAndSwizzle( m_aVerts[ppTris[0]->GetVert( 2 )], m_aVerts[ppTris[1]->GetVert( 2 )], m_aVerts[ppTris[2]->GetVert( 2 )], m_aVerts[ppTris[3]->GetVert( 2 )] );
+	v3.LoadAndSwizzle( m_aVerts[ppTris[0]->GetVert( 1 )], m_aVerts[ppTris[1]->GetVert( 1 )], m_aVerts[ppTris[2]->GetVert( 1 )], m_aVerts[ppTris[3]->GetVert( 1 )] );
+}
+
 
 //-----------------------------------------------------------------------------
 // Purpose: Create the AABB tree.
@@ -327,9 +357,11 @@ void CDispCollTree::AABBTree_CopyDispData( CCoreDispInfo *pDisp )
 		pSurf->GetPoint( iPoint, m_vecSurfPoints[iPoint] );
 	}
 
-	// Allocate collision tree data.
+	// Allocate collision tree data.  FourVectors::LoadAndSwizzle reads 16 bytes
+	// per vertex, so leave room for one more past the end.
 	{
 	MEM_ALLOC_CREDIT();
+	m_aVerts.EnsureCapacity( GetSize() + 1 );
 	m_aVerts.SetSize( GetSize() );
 	}
 
@@ -691,6 +723,33 @@ void CDispCollTree::AABBTree_TreeTrisRayTest( const Ray_t &ray, const Vector &ve
 	list.rayExtents.DuplicateVector(ext);
 	int listIndex = BuildRayLeafList( iNode, list );
 
+	if ( g_bDispCollFourWideTris )
+	{
+		// Two leaves (four triangles) per test
+		for ( ; listIndex <= list.maxIndex; listIndex += 2 )
+		{
+			CDispCollTri *pTris[4];
+			FourVectors v1, v2, v3;
+			GatherLeafTris( list, listIndex, pTris, v1, v2, v3 );
+
+			fltx4 fl4Frac = IntersectRayWithFourTriangles( ray, v1, v2, v3, bSide );
+			if ( !TestSignSIMD( CmpGeSIMD( fl4Frac, Four_Zeros ) ) )
+				continue;
+
+			// Walk the lanes in order so ties go to the same triangle as the scalar loop
+			for ( int iLane = 0; iLane < 4; ++iLane )
+			{
+				float flFrac = SubFloat( fl4Frac, iLane );
+				if( ( flFrac >= 0.0f ) && ( flFrac < pTrace->fraction ) )
+				{
+					pTrace->fraction = flFrac;
+					(*pImpactTri) = pTris[iLane];
+				}
+			}
+		}
+		return;
+	}
+
 	for ( ;listIndex <= list.maxIndex; listIndex++ )
 	{
 		int leafIndex = list.nodeList[listIndex] - m_nodes.Count();
@@ -912,7 +971,56 @@ bool CDispCollTree::AABBTree_SweepAABB( const Ray_t &ray, const Vector &vecInvDe
 	list.rayExtents.DuplicateVector(ext);
 	int listIndex = BuildRayLeafList( 0, list );
 
-	if ( listIndex <= list.maxIndex )
+	if ( listIndex <= list.maxIndex && g_bDispCollFourWideTris )
+	{
+		// Run the cheap rejections of SweepAABBTriIntersect -- moving away from
+		// the face and the axial planes of the triangle bounds -- on four 
+		// triangles at once.  Triangles that survive take the full scalar test,
+		// in the original order, so the trace result is unchanged.
+		FourVectors rayStart, rayDelta, rayExtents;
+		rayStart.DuplicateVector( ray.m_Start );
+		rayDelta.DuplicateVector( ray.m_Delta );
+		rayExtents.DuplicateVector( ray.m_Extents );
+		fltx4 fl4Epsilon = ReplicateX4( DISPCOLL_DIST_EPSILON );
+
+		LockCache();
+		for ( ; listIndex <= list.maxIndex; listIndex += 2 )
+		{
+			CDispCollTri *pTris[4];
+			FourVectors v1, v2, v3;
+			GatherLeafTris( list, listIndex, pTris, v1, v2, v3 );
+
+			FourVectors normals;
+			normals.LoadAndSwizzle( pTris[0]->m_vecNormal, pTris[1]->m_vecNormal, pTris[2]->m_vecNormal, pTris[3]->m_vecNormal );
+			fltx4 fl4DistAlongNormal = AddSIMD( AddSIMD( MulSIMD( normals.x, rayDelta.x ), MulSIMD( normals.y, rayDelta.y ) ), MulSIMD( normals.z, rayDelta.z ) );
+			fltx4 fl4Reject = CmpGtSIMD( fl4DistAlongNormal, fl4Epsilon );
+
+			// A plane rejects when the whole sweep is in front of it, see ResolveRayPlaneIntersect
+			FourVectors triMins = minimum( v1, minimum( v2, v3 ) );
+			FourVectors triMaxs = maximum( v1, maximum( v2, v3 ) );
+			for ( int iAxis = 0; iAxis < 3; ++iAxis )
+			{
+				fltx4 flStart = SubSIMD( SubSIMD( triMins[iAxis], rayExtents[iAxis] ), rayStart[iAxis] );
+				fltx4 flEnd = SubSIMD( flStart, rayDelta[iAxis] );
+				fl4Reject = OrSIMD( fl4Reject, AndSIMD( CmpGtSIMD( flStart, Four_Zeros ), CmpGtSIMD( flEnd, Four_Zeros ) ) );
+
+				flStart = SubSIMD( rayStart[iAxis], AddSIMD( triMaxs[iAxis], rayExtents[iAxis] ) );
+				flEnd = AddSIMD( flStart, rayDelta[iAxis] );
+				fl4Reject = OrSIMD( fl4Reject, AndSIMD( CmpGtSIMD( flStart, Four_Zeros ), CmpGtSIMD( flEnd, Four_Zeros ) ) );
+			}
+
+			int nTestMask = ~TestSignSIMD( fl4Reject ) & ( ( listIndex < list.maxIndex ) ? 0xf : 0x3 );
+			for ( int iLane = 0; nTestMask; ++iLane, nTestMask >>= 1 )
+			{
+				if ( nTestMask & 1 )
+				{
+					SweepAABBTriIntersect( ray, rayDir, pTris[iLane] - m_aTris.Base(), pTris[iLane], pTrace );
+				}
+			}
+		}
+		UnlockCache();
+	}
+	else if ( listIndex <= list.maxIndex )
 	{
 		LockCache();
 		for ( ; listIndex <= list.maxIndex; listIndex++ )
@@ -0,0 +1,469 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: - 8-wide (AVX) versions of the SIMD types and functions in ssemath.h.
+//
+// fltx8 and EightVectors work like fltx4 and FourVectors, and the functions below
+// overload the fltx4 ones (AddSIMD, MaddSIMD, CmpLtSIMD, ...) so that code can be
+// written once for either width. The few that can't be overloaded, because they only
+// differ by return type, have an 8 on the end (LoadAlignedSIMD8, ReplicateX8, ...).
+//
+// All of this needs a CPU with AVX2 and FMA. Only call it after checking
+// GetCPUSIMDLevel() in tier1/processor_detect.h, and keep the 4-wide code as the
+// fallback. Never make global fltx8 constants: their initializers would run AVX
+// instructions at startup on every machine.
+//
+// With gcc, any function that uses these has to be marked AVX_TARGET (or the file
+// compiled with -mavx2 -mfma) so that they can be inlined into it.
+//===========================================================================//
+#ifndef SSEMATH_AVX_H
+#define SSEMATH_AVX_H
+
+#include "mathlib/ssemath.h"
+
+#if !defined( _X360 ) && ( ( defined( _MSC_VER ) && _MSC_VER >= 1700 ) || \
+	( defined( __GNUC__ ) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) )
+#define SSEMATH_AVX 1
+#endif
+
+#ifdef SSEMATH_AVX
+
+#include <immintrin.h>
+
+// MSVC emits VEX code for the intrinsics without /arch:AVX; gcc has to be told per function.
+#ifdef _MSC_VER
+#define AVX_TARGET
+#else
+#define AVX_TARGET __attribute__(( target( "avx2,fma" ) ))
+#endif
+
+#define FORCEINLINE_AVX FORCEINLINE AVX_TARGET
+
+typedef __m256 fltx8;
+typedef __m256 i32x8;
+typedef __m256 u32x8;
+
+typedef const fltx8 & FLTX8;
+
+
+//---------------------------------------------------------------------
+// Loads, stores and lane access
+//---------------------------------------------------------------------
+
+FORCEINLINE_AVX fltx8 LoadAlignedSIMD8( const void *pSIMD )					// pSIMD must be 32 byte aligned
+{
+	return _mm256_load_ps( reinterpret_cast< const float *> ( pSIMD ) );
+}
+
+FORCEINLINE_AVX fltx8 LoadUnalignedSIMD8( const void *pSIMD )
+{
+	return _mm256_loadu_ps( reinterpret_cast< const float *> ( pSIMD ) );
+}
+
+FORCEINLINE_AVX void StoreAlignedSIMD( float * RESTRICT pSIMD, const fltx8 & a )
+{
+	_mm256_store_ps( pSIMD, a );
+}
+
+FORCEINLINE_AVX void StoreUnalignedSIMD( float * RESTRICT pSIMD, const fltx8 & a )
+{
+	_mm256_storeu_ps( pSIMD, a );
+}
+
+FORCEINLINE_AVX fltx8 LoadZeroSIMD8( void )
+{
+	return _mm256_setzero_ps();
+}
+
+FORCEINLINE_AVX fltx8 ReplicateX8( float flValue )
+{
+	return _mm256_set1_ps( flValue );
+}
+
+// a in the low four lanes, b in the high four
+FORCEINLINE_AVX fltx8 ConcatSIMD( const fltx4 & a, const fltx4 & b )
+{
+	return _mm256_insertf128_ps( _mm256_castps128_ps256( a ), b, 1 );
+}
+
+FORCEINLINE_AVX fltx4 LowSIMD( const fltx8 & a )
+{
+	return _mm256_castps256_ps128( a );
+}
+
+FORCEINLINE_AVX fltx4 HighSIMD( const fltx8 & a )
+{
+	return _mm256_extractf128_ps( a, 1 );
+}
+
+FORCEINLINE float SubFloat( const fltx8 & a, int idx )
+{
+	// NOTE: like the fltx4 version, this goes through memory
+	return (reinterpret_cast<float const *>(&a))[idx];
+}
+
+FORCEINLINE float & SubFloat( fltx8 & a, int idx )
+{
+	return (reinterpret_cast<float *>(&a))[idx];
+}
+
+
+//---------------------------------------------------------------------
+// Arithmetic
+//---------------------------------------------------------------------
+
+FORCEINLINE_AVX fltx8 AddSIMD( const fltx8 & a, const fltx8 & b )				// a+b
+{
+	return _mm256_add_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 SubSIMD( const fltx8 & a, const fltx8 & b )				// a-b
+{
+	return _mm256_sub_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 MulSIMD( const fltx8 & a, const fltx8 & b )				// a*b
+{
+	return _mm256_mul_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 DivSIMD( const fltx8 & a, const fltx8 & b )				// a/b
+{
+	return _mm256_div_ps( a, b );
+}
+
+// NOTE: these are fused, so they round once rather than twice like the fltx4 versions
+FORCEINLINE_AVX fltx8 MaddSIMD( const fltx8 & a, const fltx8 & b, const fltx8 & c )	// a*b + c
+{
+	return _mm256_fmadd_ps( a, b, c );
+}
+
+FORCEINLINE_AVX fltx8 MsubSIMD( const fltx8 & a, const fltx8 & b, const fltx8 & c )	// c - a*b
+{
+	return _mm256_fnmadd_ps( a, b, c );
+}
+
+FORCEINLINE_AVX fltx8 NegSIMD( const fltx8 & a )								// -a
+{
+	return _mm256_sub_ps( _mm256_setzero_ps(), a );
+}
+
+FORCEINLINE_AVX fltx8 MinSIMD( const fltx8 & a, const fltx8 & b )				// min(a,b)
+{
+	return _mm256_min_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 MaxSIMD( const fltx8 & a, const fltx8 & b )				// max(a,b)
+{
+	return _mm256_max_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 SqrtEstSIMD( const fltx8 & a )							// sqrt(a), more or less
+{
+	return _mm256_sqrt_ps( a );
+}
+
+FORCEINLINE_AVX fltx8 SqrtSIMD( const fltx8 & a )								// sqrt(a)
+{
+	return _mm256_sqrt_ps( a );
+}
+
+FORCEINLINE_AVX fltx8 ReciprocalSqrtEstSIMD( const fltx8 & a )					// 1/sqrt(a), more or less
+{
+	return _mm256_rsqrt_ps( a );
+}
+
+/// uses newton iteration for higher precision results than ReciprocalSqrtEstSIMD
+FORCEINLINE_AVX fltx8 ReciprocalSqrtSIMD( const fltx8 & a )					// 1/sqrt(a)
+{
+	fltx8 guess = ReciprocalSqrtEstSIMD( a );
+	// newton iteration for 1/sqrt(a) : y(n+1) = 1/2 (y(n)*(3-a*y(n)^2));
+	guess = MulSIMD( guess, MsubSIMD( a, MulSIMD( guess, guess ), _mm256_set1_ps( 3.0f ) ) );
+	return MulSIMD( _mm256_set1_ps( 0.5f ), guess );
+}
+
+FORCEINLINE_AVX fltx8 ReciprocalEstSIMD( const fltx8 & a )						// 1/a, more or less
+{
+	return _mm256_rcp_ps( a );
+}
+
+/// 1/x for all 8 values. uses reciprocal approximation instruction plus newton iteration.
+/// No error checking!
+FORCEINLINE_AVX fltx8 ReciprocalSIMD( const fltx8 & a )						// 1/a
+{
+	fltx8 ret = ReciprocalEstSIMD( a );
+	// newton iteration is: Y(n+1) = 2*Y(n)-a*Y(n)^2
+	return MsubSIMD( a, MulSIMD( ret, ret ), AddSIMD( ret, ret ) );
+}
+
+
+//---------------------------------------------------------------------
+// Comparisons and masks
+//---------------------------------------------------------------------
+
+FORCEINLINE_AVX fltx8 AndSIMD( const fltx8 & a, const fltx8 & b )				// a & b
+{
+	return _mm256_and_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 AndNotSIMD( const fltx8 & a, const fltx8 & b )			// ~a & b
+{
+	return _mm256_andnot_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 OrSIMD( const fltx8 & a, const fltx8 & b )				// a | b
+{
+	return _mm256_or_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 XorSIMD( const fltx8 & a, const fltx8 & b )				// a ^ b
+{
+	return _mm256_xor_ps( a, b );
+}
+
+FORCEINLINE_AVX fltx8 CmpEqSIMD( const fltx8 & a, const fltx8 & b )			// (a==b) ? ~0:0
+{
+	return _mm256_cmp_ps( a, b, _CMP_EQ_OQ );
+}
+
+FORCEINLINE_AVX fltx8 CmpGtSIMD( const fltx8 & a, const fltx8 & b )			// (a>b) ? ~0:0
+{
+	return _mm256_cmp_ps( a, b, _CMP_GT_OS );
+}
+
+FORCEINLINE_AVX fltx8 CmpGeSIMD( const fltx8 & a, const fltx8 & b )			// (a>=b) ? ~0:0
+{
+	return _mm256_cmp_ps( a, b, _CMP_GE_OS );
+}
+
+FORCEINLINE_AVX fltx8 CmpLtSIMD( const fltx8 & a, const fltx8 & b )			// (a<b) ? ~0:0
+{
+	return _mm256_cmp_ps( a, b, _CMP_LT_OS );
+}
+
+FORCEINLINE_AVX fltx8 CmpLeSIMD( const fltx8 & a, const fltx8 & b )			// (a<=b) ? ~0:0
+{
+	return _mm256_cmp_ps( a, b, _CMP_LE_OS );
+}
+
+FORCEINLINE_AVX fltx8 CmpInBoundsSIMD( const fltx8 & a, const fltx8 & b )		// (a <= b && a >= -b) ? ~0 : 0
+{
+	return AndSIMD( CmpLeSIMD( a, b ), CmpGeSIMD( a, NegSIMD( b ) ) );
+}
+
+FORCEINLINE_AVX int TestSignSIMD( const fltx8 & a )							// mask of which floats have the high bit set
+{
+	return _mm256_movemask_ps( a );
+}
+
+FORCEINLINE_AVX bool IsAnyNegative( const fltx8 & a )							// any lane < 0
+{
+	return ( 0 != TestSignSIMD( a ) );
+}
+
+// for branching when all lanes of a > b
+FORCEINLINE_AVX bool IsAllGreaterThan( const fltx8 &a, const fltx8 &b )
+{
+	return TestSignSIMD( CmpLeSIMD( a, b ) ) == 0;
+}
+
+// (ReplacementMask & NewValue) | (~ReplacementMask & OldValue)
+FORCEINLINE_AVX fltx8 MaskedAssign( const fltx8 & ReplacementMask, const fltx8 & NewValue, const fltx8 & OldValue )
+{
+	return _mm256_blendv_ps( OldValue, NewValue, ReplacementMask );
+}
+
+FORCEINLINE_AVX fltx8 fabs( const fltx8 & x )
+{
+	return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), x );
+}
+
+
+//---------------------------------------------------------------------
+// Integer ops
+//---------------------------------------------------------------------
+
+FORCEINLINE_AVX i32x8 IntSetImmediateSIMD8( int nValue )
+{
+	return _mm256_castsi256_ps( _mm256_set1_epi32( nValue ) );
+}
+
+FORCEINLINE_AVX i32x8 ConvertToInt32SIMD8( const fltx8 & a )					// truncates, like (int)
+{
+	return _mm256_castsi256_ps( _mm256_cvttps_epi32( a ) );
+}
+
+FORCEINLINE_AVX fltx8 ConvertInt32ToFloatSIMD8( const i32x8 & a )
+{
+	return _mm256_cvtepi32_ps( _mm256_castps_si256( a ) );
+}
+
+FORCEINLINE_AVX i32x8 IntAddSIMD( const i32x8 & a, const i32x8 & b )
+{
+	return _mm256_castsi256_ps( _mm256_add_epi32( _mm256_castps_si256( a ), _mm256_castps_si256( b ) ) );
+}
+
+
+//---------------------------------------------------------------------
+/// class EightVectors stores 8 independent vectors for use in SIMD processing, the same
+/// way FourVectors stores 4. It can be loaded from and stored to a pair of FourVectors.
+//---------------------------------------------------------------------
+class ALIGN32 EightVectors
+{
+public:
+	fltx8 x, y, z;
+
+	FORCEINLINE EightVectors( void )
+	{
+	}
+
+	FORCEINLINE_AVX void DuplicateVector( Vector const &v )					//< set all 8 vectors to the same vector value
+	{
+		x = ReplicateX8( v.x );
+		y = ReplicateX8( v.y );
+		z = ReplicateX8( v.z );
+	}
+
+	/// vectors 0-3 from lo, 4-7 from hi
+	FORCEINLINE_AVX void LoadFourVectors( FourVectors const &lo, FourVectors const &hi )
+	{
+		x = ConcatSIMD( lo.x, hi.x );
+		y = ConcatSIMD( lo.y, hi.y );
+		z = ConcatSIMD( lo.z, hi.z );
+	}
+
+	FORCEINLINE_AVX void StoreFourVectors( FourVectors *pLo, FourVectors *pHi ) const
+	{
+		pLo->x = LowSIMD( x );
+		pLo->y = LowSIMD( y );
+		pLo->z = LowSIMD( z );
+		pHi->x = HighSIMD( x );
+		pHi->y = HighSIMD( y );
+		pHi->z = HighSIMD( z );
+	}
+
+	FORCEINLINE_AVX void operator+=( EightVectors const &b )				//< add 8 vectors to another 8 vectors
+	{
+		x = AddSIMD( x, b.x );
+		y = AddSIMD( y, b.y );
+		z = AddSIMD( z, b.z );
+	}
+
+	FORCEINLINE_AVX void operator-=( EightVectors const &b )				//< subtract 8 vectors from another 8
+	{
+		x = SubSIMD( x, b.x );
+		y = SubSIMD( y, b.y );
+		z = SubSIMD( z, b.z );
+	}
+
+	FORCEINLINE_AVX void operator*=( EightVectors const &b )				//< scale all 8 vectors per component scale
+	{
+		x = MulSIMD( x, b.x );
+		y = MulSIMD( y, b.y );
+		z = MulSIMD( z, b.z );
+	}
+
+	FORCEINLINE_AVX void operator*=( const fltx8 & scale )					//< scale
+	{
+		x = MulSIMD( x, scale );
+		y = MulSIMD( y, scale );
+		z = MulSIMD( z, scale );
+	}
+
+	/// this += a * scale, fused
+	FORCEINLINE_AVX void MaddScaled( EightVectors const &a, const fltx8 & scale )
+	{
+		x = MaddSIMD( a.x, scale, x );
+		y = MaddSIMD( a.y, scale, y );
+		z = MaddSIMD( a.z, scale, z );
+	}
+
+	/// dot product of all 8 pairs of vectors
+	FORCEINLINE_AVX fltx8 operator*( EightVectors const &b ) const
+	{
+		return MaddSIMD( x, b.x, MaddSIMD( y, b.y, MulSIMD( z, b.z ) ) );
+	}
+
+	/// return the squared length of all 8 vectors
+	FORCEINLINE_AVX fltx8 length2( void ) const
+	{
+		return (*this)*(*this);
+	}
+
+	/// return the approximate length of all 8 vectors. uses the sqrt approximation instruction
+	FORCEINLINE_AVX fltx8 length( void ) const
+	{
+		return SqrtEstSIMD( length2() );
+	}
+
+	/// normalize all 8 vectors in place. not mega-accurate (uses reciprocal approximation instruction)
+	FORCEINLINE_AVX void VectorNormalizeFast( void )
+	{
+		fltx8 mag_sq = (*this)*(*this);										// length^2
+		(*this) *= ReciprocalSqrtEstSIMD( mag_sq );							// *(1.0/sqrt(length^2))
+	}
+
+	/// normalize all 8 vectors in place.
+	FORCEINLINE_AVX void VectorNormalize( void )
+	{
+		fltx8 mag_sq = (*this)*(*this);										// length^2
+		(*this) *= ReciprocalSqrtSIMD( mag_sq );							// *(1.0/sqrt(length^2))
+	}
+
+	FORCEINLINE_AVX fltx8 DistToSqr( EightVectors const &pnt ) const
+	{
+		fltx8 fl8dX = SubSIMD( pnt.x, x );
+		fltx8 fl8dY = SubSIMD( pnt.y, y );
+		fltx8 fl8dZ = SubSIMD( pnt.z, z );
+		return MaddSIMD( fl8dX, fl8dX, MaddSIMD( fl8dY, fl8dY, MulSIMD( fl8dZ, fl8dZ ) ) );
+	}
+
+	/// Transform all 8 points by a matrix3x4
+	FORCEINLINE_AVX void TransformBy( const matrix3x4_t& matrix )
+	{
+		fltx8 fl8X = x, fl8Y = y, fl8Z = z;
+		x = MaddSIMD( fl8X, ReplicateX8( matrix[0][0] ), MaddSIMD( fl8Y, ReplicateX8( matrix[0][1] ), MaddSIMD( fl8Z, ReplicateX8( matrix[0][2] ), ReplicateX8( matrix[0][3] ) ) ) );
+		y = MaddSIMD( fl8X, ReplicateX8( matrix[1][0] ), MaddSIMD( fl8Y, ReplicateX8( matrix[1][1] ), MaddSIMD( fl8Z, ReplicateX8( matrix[1][2] ), ReplicateX8( matrix[1][3] ) ) ) );
+		z = MaddSIMD( fl8X, ReplicateX8( matrix[2][0] ), MaddSIMD( fl8Y, ReplicateX8( matrix[2][1] ), MaddSIMD( fl8Z, ReplicateX8( matrix[2][2] ), ReplicateX8( matrix[2][3] ) ) ) );
+	}
+} ALIGN32_POST;
+
+/// form 8 cross products
+FORCEINLINE_AVX EightVectors operator^( const EightVectors &a, const EightVectors &b )
+{
+	EightVectors ret;
+	ret.x = SubSIMD( MulSIMD( a.y, b.z ), MulSIMD( a.z, b.y ) );
+	ret.y = SubSIMD( MulSIMD( a.z, b.x ), MulSIMD( a.x, b.z ) );
+	ret.z = SubSIMD( MulSIMD( a.x, b.y ), MulSIMD( a.y, b.x ) );
+	return ret;
+}
+
+/// component-by-componentwise MAX operator
+FORCEINLINE_AVX EightVectors maximum( const EightVectors &a, const EightVectors &b )
+{
+	EightVectors ret;
+	ret.x = MaxSIMD( a.x, b.x );
+	ret.y = MaxSIMD( a.y, b.y );
+	ret.z = MaxSIMD( a.z, b.z );
+	return ret;
+}
+
+/// component-by-componentwise MIN operator
+FORCEINLINE_AVX EightVectors minimum( const EightVectors &a, const EightVectors &b )
+{
+	EightVectors ret;
+	ret.x = MinSIMD( a.x, b.x );
+	ret.y = MinSIMD( a.y, b.y );
+	ret.z = MinSIMD( a.z, b.z );
+	return ret;
+}
+
+// Call at the end of a function that used fltx8 before going back to SSE code, to avoid the
+// penalty for mixing VEX and non-VEX instructions (MSVC compiles fltx4 code without VEX).
+FORCEINLINE_AVX void EndSIMD8( void )
+{
+	_mm256_zeroupper();
+}
+
+#endif // SSEMATH_AVX
+
+#endif // SSEMATH_AVX_H
@@ -217,6 +217,15 @@ public:
 	void			WriteBitVec3Normal( const Vector& fa );
 	void			WriteBitAngles( const QAngle& fa );
 
+	// Batched versions of the functions above. The output is bit-identical to
+	// calling the single-value function once per element, but the bits are
+	// packed into a 64-bit accumulator and stored a dword at a time.
+	void			WriteUBitLongs( const uint32 *pData, int nCount, int numbits );
+	void			WriteVarInt32s( const uint32 *pData, int nCount );
+	void			WriteBitCoords( const float *pValues, int nCount );
+	void			WriteBitVec3Coords( const Vector *pValues, int nCount );
+	void			WriteBitVec3Normals( const Vector *pValues, int nCount );
+
 
 // Byte functions.
 public:
@@ -592,6 +601,14 @@ public:
 	void			ReadBitVec3Normal( Vector& fa );
 	void			ReadBitAngles( QAngle& fa );
 
+	// Batched versions of the functions above, for streams written with the
+	// matching bf_write calls (or the equivalent single-value calls).
+	void			ReadUBitLongs( uint32 *pData, int nCount, int numbits );
+	void			ReadVarInt32s( uint32 *pData, int nCount );
+	void			ReadBitCoords( float *pValues, int nCount );
+	void			ReadBitVec3Coords( Vector *pValues, int nCount );
+	void			ReadBitVec3Normals( Vector *pValues, int nCount );
+
 	// Faster for comparisons but do not fully decode float values
 	unsigned int	ReadBitCoordBits();
 	unsigned int	ReadBitCoordMPBits( bool bIntegral, bool bLowPrecision );
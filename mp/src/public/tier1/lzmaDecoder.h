@@ -12,8 +12,10 @@
 
 #if !defined( _X360 )
 #define LZMA_ID				(('A'<<24)|('M'<<16)|('Z'<<8)|('L'))
+#define LZMA_CHUNKED_ID		(('C'<<24)|('M'<<16)|('Z'<<8)|('L'))
 #else
 #define LZMA_ID				(('L'<<24)|('Z'<<16)|('M'<<8)|('A'))
+#define LZMA_CHUNKED_ID		(('L'<<24)|('Z'<<16)|('M'<<8)|('C'))
 #endif
 
 // bind the buffer for correct identification
@@ -25,6 +27,19 @@ struct lzma_header_t
 	unsigned int	lzmaSize;		// always little endian
 	unsigned char	properties[5];
 };
+
+// Chunked container: the uncompressed data is cut into chunkSize pieces (the
+// last one may be shorter) and each piece is compressed on its own, so chunks
+// can be decoded in any order and on any thread. The header is followed by
+// numChunks + 1 offsets from the start of the header, chunk i occupying
+// [offset[i], offset[i+1]). Each chunk is a complete lzma_header_t stream.
+struct lzma_chunked_header_t
+{
+	unsigned int	id;
+	unsigned int	actualSize;		// always little endian
+	unsigned int	chunkSize;		// always little endian
+	unsigned int	numChunks;		// always little endian
+};
 #pragma pack()
 
 class CLZMA
@@ -34,7 +49,67 @@ public:
 	bool			IsCompressed( unsigned char *pInput );
 	unsigned int	GetActualSize( unsigned char *pInput );
 
+	// Chunked containers, which Uncompress decodes on several threads when
+	// large. A single stream counts as one chunk. UncompressChunk writes chunk
+	// nChunk at its place in pOutput, which must be sized for the whole
+	// payload, and is safe to call for different chunks concurrently.
+	bool			IsChunked( unsigned char *pInput );
+	unsigned int	GetNumChunks( unsigned char *pInput );
+	unsigned int	UncompressChunk( unsigned char *pInput, unsigned int nChunk, unsigned char *pOutput );
+
+private:
+	unsigned int	UncompressChunked( unsigned char *pInput, unsigned char *pOutput );
+	unsigned char	*GetChunk( unsigned char *pInput, unsigned int nChunk, unsigned int *pOutputOffset, unsigned int *pOutputSize );
+};
+
+//-----------------------------------------------------------------------------
+// Incremental decoding of a single lzma_header_t stream. Feed the compressed
+// bytes, header included, in pieces of any size and drain the output in pieces
+// of any size. Only a dictionary of min( dictionary size, actual size ) is
+// kept, so the whole output never has to be resident.
+//
+//	CLZMAStream stream;
+//	while ( !stream.IsFinished() )
+//	{
+//		...
+//		if ( !stream.Read( pIn, nIn, pOut, nOut, nInRead, nOutWritten ) )
+//			error;
+//	}
+//-----------------------------------------------------------------------------
+struct _CLzmaDecoderState;
+
+class CLZMAStream
+{
+public:
+	CLZMAStream();
+	~CLZMAStream();
+
+	// Back to expecting a header, for decoding another stream
+	void			Reset();
+
+	// Consumes up to nMaxInputBytes and writes up to nMaxOutputBytes. Returns
+	// false on corrupt data. Stops early when it needs more input; input it
+	// has not reported as read must be passed again.
+	bool			Read( unsigned char *pInput, unsigned int nMaxInputBytes,
+						  unsigned char *pOutput, unsigned int nMaxOutputBytes,
+						  unsigned int &nCompressedBytesRead, unsigned int &nOutputBytesWritten );
+
+	// Zero until the header has been read
+	unsigned int	GetActualSize() const { return m_nActualSize; }
+	bool			IsFinished() const { return m_bHeaderParsed && m_nOutputBytes == m_nActualSize; }
+
 private:
+	bool			ParseHeader();
+	void			FreeDecoder();
+
+	_CLzmaDecoderState *m_pDecoderState;
+	unsigned char	*m_pInputBuffer;		// compressed bytes not decoded yet
+	unsigned int	m_nInputStart;
+	unsigned int	m_nInputEnd;
+	bool			m_bHeaderParsed;
+	unsigned int	m_nActualSize;
+	unsigned int	m_nCompressedLeft;		// stream bytes not yet copied into m_pInputBuffer
+	unsigned int	m_nOutputBytes;
 };
 
 #endif
@@ -5,8 +5,52 @@
 // $NoKeywords: $
 //=============================================================================//
 
+#ifndef PROCESSOR_DETECT_H
+#define PROCESSOR_DETECT_H
+
 bool CheckMMXTechnology(void);
 bool CheckSSETechnology(void);
 bool CheckSSE2Technology(void);
 bool Check3DNowTechnology(void);
 
+// These also check that the OS saves the AVX registers
+bool CheckAVXTechnology(void);
+bool CheckAVX2Technology(void);
+bool CheckFMATechnology(void);
+
+// Carry-less multiply, used for CRC32
+bool CheckPCLMULQDQTechnology(void);
+
+// Widest SIMD instruction set usable on this machine, for picking between code paths
+enum SIMDLevel_t
+{
+	SIMD_LEVEL_NONE = 0,
+	SIMD_LEVEL_SSE,
+	SIMD_LEVEL_SSE2,
+	SIMD_LEVEL_AVX2_FMA,		// needed by the fltx8 code in mathlib/ssemath_avx.h
+};
+
+// NOTE: this runs CPUID every time, so cache the result (or whatever you pick with it).
+inline SIMDLevel_t GetCPUSIMDLevel()
+{
+	if ( CheckAVX2Technology() && CheckFMATechnology() )
+		return SIMD_LEVEL_AVX2_FMA;
+	if ( CheckSSE2Technology() )
+		return SIMD_LEVEL_SSE2;
+	if ( CheckSSETechnology() )
+		return SIMD_LEVEL_SSE;
+	return SIMD_LEVEL_NONE;
+}
+
+// Returns the 8-wide implementation of a function if this machine can run it, otherwise
+// the 4-wide one. Typically used once at init to fill in a function pointer.
+template< class FUNCTION_TYPE >
+inline FUNCTION_TYPE SelectSIMDImplementation( FUNCTION_TYPE pfn4Wide, FUNCTION_TYPE pfn8Wide )
+{
+	if ( pfn8Wide && GetCPUSIMDLevel() >= SIMD_LEVEL_AVX2_FMA )
+		return pfn8Wide;
+	return pfn4Wide;
+}
+
+#endif // PROCESSOR_DETECT_H
+
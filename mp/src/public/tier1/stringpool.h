@@ -14,6 +14,7 @@
 
 #include "utlrbtree.h"
 #include "utlvector.h"
+#include "utlhashtable.h"
 
 //-----------------------------------------------------------------------------
 // Purpose: Allocates memory for strings, checking for duplicates first,
@@ -35,7 +36,7 @@ public:
 	const char * Find( const char *pszValue );
 
 protected:
-	typedef CUtlRBTree<const char *, unsigned short> CStrSet;
+	typedef CUtlHashtable<const char *, empty_t, CaselessStringHashFunctor, CaselessStringEqualFunctor> CStrSet;
 
 	CStrSet m_Strings;
 };
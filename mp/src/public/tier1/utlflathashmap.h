@@ -0,0 +1,524 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: a flat open-addressing hash map which keeps one byte of control
+// data per slot and probes sixteen slots with a single SSE2 compare.
+//
+// Usage notes:
+// - the interface mirrors CUtlHashtable, so the two can be swapped freely
+// - handles are slot indices. Any insertion which grows the table
+//   invalidates all handles; removal never moves other elements, so
+//   handles to the remaining elements stay valid across Remove()
+// - Insert() first searches for an existing match and returns it if found
+// - a value type of "empty_t" turns the map into a set, and switches
+//   Element() to return const Key references instead of values
+// - alternate key types work exactly as in CUtlHashtable: for example a
+//   CUtlFlatHashMap< CUtlString, int > can be searched or inserted into
+//   with a const char* without constructing a temporary CUtlString
+// - storage comes from any CUtlMemory-compatible allocator over unsigned
+//   char (CUtlMemory, CUtlMemoryAligned, ...) passed as the last argument
+//
+// Implementation notes:
+// - a table of N slots is one allocation: N control bytes followed by
+//   N KVPairs, so probing touches only control bytes until a likely hit
+// - a control byte is EMPTY, DELETED, or the low 7 bits of the hash of
+//   the key stored in that slot
+// - the remaining hash bits select a 16-slot group, and groups are then
+//   visited in triangular order, which covers every group of a power of
+//   two sized table. A lookup ends at the first group with an EMPTY byte
+// - removal leaves a DELETED tombstone only if the group has been full at
+//   some point (no lookup could otherwise have probed past it)
+// - table load including tombstones is kept at or below 7/8; a rehash
+//   doubles the table, or rebuilds it in place if it is mostly tombstones
+// - like CUtlVector and CUtlHashtable, elements are relocated with a
+//   plain memory copy when the table is rebuilt
+//
+// CUtlFlatHashMap< uint32 >                  setOfIntegers;
+// CUtlFlatHashMap< const char*, int >        mapFromStringPointers;
+// CUtlFlatHashMap< CUtlString, CUtlString >  mapFromStrings;
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef UTLFLATHASHMAP_H
+#define UTLFLATHASHMAP_H
+#pragma once
+
+#include "utlcommon.h"
+#include "utlmemory.h"
+#include "utlhashtable.h"
+
+#if !defined( _X360 ) && !defined( _PS3 )
+#define UTLFLATHASHMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined( _MSC_VER ) && !defined( _X360 )
+#include <intrin.h>
+#endif
+
+// Slots per probe group, and the two reserved control byte values. FULL
+// slots hold 0..127, so "empty or deleted" is simply the sign bit.
+#define UTLFLATHASH_GROUP_SIZE	16
+#define UTLFLATHASH_CTRL_EMPTY	( (int8)-128 )
+#define UTLFLATHASH_CTRL_DELETED	( (int8)-2 )
+
+// Index of the lowest set bit; nMask must not be zero
+FORCEINLINE int UtlFlatHash_LowestBit( uint32 nMask )
+{
+#if defined( _MSC_VER ) && !defined( _X360 )
+	unsigned long nIndex;
+	_BitScanForward( &nIndex, nMask );
+	return (int)nIndex;
+#elif defined( GNUC )
+	return __builtin_ctz( nMask );
+#else
+	int nIndex = 0;
+	while ( !( nMask & 1 ) )
+	{
+		nMask >>= 1;
+		++nIndex;
+	}
+	return nIndex;
+#endif
+}
+
+// Bitmask of the slots in a group whose control byte equals nCtrl
+FORCEINLINE uint32 UtlFlatHash_GroupMatch( const int8 *pGroup, int8 nCtrl )
+{
+#ifdef UTLFLATHASHMAP_SSE2
+	__m128i ctrl = _mm_loadu_si128( (const __m128i *)pGroup );
+	return (uint32)_mm_movemask_epi8( _mm_cmpeq_epi8( ctrl, _mm_set1_epi8( nCtrl ) ) );
+#else
+	uint32 nMask = 0;
+	for ( int i = 0; i < UTLFLATHASH_GROUP_SIZE; ++i )
+	{
+		if ( pGroup[i] == nCtrl )
+			nMask |= 1u << i;
+	}
+	return nMask;
+#endif
+}
+
+// Bitmask of the slots in a group which are EMPTY or DELETED
+FORCEINLINE uint32 UtlFlatHash_GroupMatchEmptyOrDeleted( const int8 *pGroup )
+{
+#ifdef UTLFLATHASHMAP_SSE2
+	return (uint32)_mm_movemask_epi8( _mm_loadu_si128( (const __m128i *)pGroup ) );
+#else
+	uint32 nMask = 0;
+	for ( int i = 0; i < UTLFLATHASH_GROUP_SIZE; ++i )
+	{
+		if ( pGroup[i] < 0 )
+			nMask |= 1u << i;
+	}
+	return nMask;
+#endif
+}
+
+
+template <typename KeyT, typename ValueT = empty_t, typename KeyHashT = DefaultHashFunctor<KeyT>, typename KeyIsEqualT = DefaultEqualFunctor<KeyT>, typename AlternateKeyT = typename ArgumentTypeInfo<KeyT>::Alt_t, typename M = CUtlMemory< unsigned char > >
+class CUtlFlatHashMap
+{
+public:
+	typedef UtlHashHandle_t handle_t;
+
+protected:
+	typedef CUtlKeyValuePair<KeyT, ValueT> KVPair;
+	typedef typename ArgumentTypeInfo<KeyT>::Arg_t KeyArg_t;
+	typedef typename ArgumentTypeInfo<ValueT>::Arg_t ValueArg_t;
+	typedef typename ArgumentTypeInfo<AlternateKeyT>::Arg_t KeyAlt_t;
+
+	M m_memory;
+	int8 *m_pCtrl;
+	KVPair *m_pSlots;
+	int m_nCapacity;	// zero, or a power of two no smaller than a group
+	int m_nUsed;
+	int m_nGrowthLeft;	// EMPTY slots which may still be claimed before a rehash
+	KeyIsEqualT m_eq;
+	KeyHashT m_hash;
+
+	static int MaxLoad( int nCapacity ) { return nCapacity - nCapacity / 8; }
+	static int8 HashCtrl( unsigned int h ) { return (int8)( h & 0x7F ); }
+	static unsigned int HashGroup( unsigned int h ) { return h >> 7; }
+
+	// Allocate a table of the given size and re-insert all existing entries
+	void DoRealloc( int nCapacity );
+
+	// Make room for one more element, growing or cleaning out tombstones
+	void DoGrow();
+
+	// Index of the first EMPTY or DELETED slot along the probe sequence for h
+	int FindFirstFree( unsigned int h ) const;
+
+	// Claim a free slot for hash h and return its index; the KVPair is not constructed
+	int DoInsertUnconstructed( unsigned int h );
+
+	// Destruct the element in a slot and release the slot
+	void DoRemoveSlot( handle_t idx );
+
+	// Implementation for Insert functions, constructs a KVPair
+	// with either a default-construted or copy-constructed value
+	template <typename KeyParamT> handle_t DoInsert( KeyParamT k, unsigned int h );
+	template <typename KeyParamT> handle_t DoInsert( KeyParamT k, ValueArg_t v, unsigned int h, bool *pDidInsert );
+
+	// Key lookup
+	template <typename KeyParamT> handle_t DoLookup( KeyParamT x, unsigned int h ) const;
+
+public:
+	explicit CUtlFlatHashMap( int minimumSize = 0 )
+		: m_pCtrl(NULL), m_pSlots(NULL), m_nCapacity(0), m_nUsed(0), m_nGrowthLeft(0), m_eq(), m_hash() { if ( minimumSize > 0 ) Reserve( minimumSize ); }
+
+	CUtlFlatHashMap( int minimumSize, const KeyHashT &hash, KeyIsEqualT const &eq = KeyIsEqualT() )
+		: m_pCtrl(NULL), m_pSlots(NULL), m_nCapacity(0), m_nUsed(0), m_nGrowthLeft(0), m_eq(eq), m_hash(hash) { if ( minimumSize > 0 ) Reserve( minimumSize ); }
+
+	~CUtlFlatHashMap() { Purge(); }
+
+	CUtlFlatHashMap &operator=( CUtlFlatHashMap const &src );
+
+	// Functor/function-pointer access
+	KeyHashT& GetHashRef() { return m_hash; }
+	KeyIsEqualT& GetEqualRef() { return m_eq; }
+	KeyHashT const &GetHashRef() const { return m_hash; }
+	KeyIsEqualT const &GetEqualRef() const { return m_eq; }
+
+	// Handle validation
+	bool IsValidHandle( handle_t idx ) const { return idx < (handle_t)m_nCapacity && m_pCtrl[idx] >= 0; }
+	static handle_t InvalidHandle() { return (handle_t) -1; }
+
+	// Iteration functions
+	handle_t FirstHandle() const { return NextHandle( (handle_t) -1 ); }
+	handle_t NextHandle( handle_t start ) const;
+
+	// Returns the number of unique keys in the table
+	int Count() const { return m_nUsed; }
+
+	// Returns the number of slots currently allocated
+	int Capacity() const { return m_nCapacity; }
+
+	// Key lookup, returns InvalidHandle() if not found
+	handle_t Find( KeyArg_t k ) const { return DoLookup<KeyArg_t>( k, m_hash(k) ); }
+	handle_t Find( KeyArg_t k, unsigned int hash ) const { Assert( hash == m_hash(k) ); return DoLookup<KeyArg_t>( k, hash ); }
+	// Alternate-type key lookup, returns InvalidHandle() if not found
+	handle_t Find( KeyAlt_t k ) const { return DoLookup<KeyAlt_t>( k, m_hash(k) ); }
+	handle_t Find( KeyAlt_t k, unsigned int hash ) const { Assert( hash == m_hash(k) ); return DoLookup<KeyAlt_t>( k, hash ); }
+
+	// True if the key is in the table
+	bool HasElement( KeyArg_t k ) const { return InvalidHandle() != Find( k ); }
+	bool HasElement( KeyAlt_t k ) const { return InvalidHandle() != Find( k ); }
+
+	// Key insertion or lookup, always returns a valid handle
+	handle_t Insert( KeyArg_t k ) { return DoInsert<KeyArg_t>( k, m_hash(k) ); }
+	handle_t Insert( KeyArg_t k, ValueArg_t v, bool *pDidInsert = NULL ) { return DoInsert<KeyArg_t>( k, v, m_hash(k), pDidInsert ); }
+	handle_t Insert( KeyArg_t k, ValueArg_t v, unsigned int hash, bool *pDidInsert = NULL ) { Assert( hash == m_hash(k) ); return DoInsert<KeyArg_t>( k, v, hash, pDidInsert ); }
+	// Alternate-type key insertion or lookup, always returns a valid handle
+	handle_t Insert( KeyAlt_t k ) { return DoInsert<KeyAlt_t>( k, m_hash(k) ); }
+	handle_t Insert( KeyAlt_t k, ValueArg_t v, bool *pDidInsert = NULL ) { return DoInsert<KeyAlt_t>( k, v, m_hash(k), pDidInsert ); }
+	handle_t Insert( KeyAlt_t k, ValueArg_t v, unsigned int hash, bool *pDidInsert = NULL ) { Assert( hash == m_hash(k) ); return DoInsert<KeyAlt_t>( k, v, hash, pDidInsert ); }
+
+	// Key removal, returns false if not found
+	bool Remove( KeyArg_t k ) { handle_t idx = Find( k ); if ( idx == InvalidHandle() ) return false; DoRemoveSlot( idx ); return true; }
+	bool Remove( KeyArg_t k, unsigned int hash ) { handle_t idx = Find( k, hash ); if ( idx == InvalidHandle() ) return false; DoRemoveSlot( idx ); return true; }
+	// Alternate-type key removal, returns false if not found
+	bool Remove( KeyAlt_t k ) { handle_t idx = Find( k ); if ( idx == InvalidHandle() ) return false; DoRemoveSlot( idx ); return true; }
+	bool Remove( KeyAlt_t k, unsigned int hash ) { handle_t idx = Find( k, hash ); if ( idx == InvalidHandle() ) return false; DoRemoveSlot( idx ); return true; }
+
+	// Removal by handle; other handles remain valid
+	void RemoveByHandle( handle_t idx ) { Assert( IsValidHandle( idx ) ); DoRemoveSlot( idx ); }
+
+	// Remove while iterating, returns the next handle for forward iteration
+	handle_t RemoveAndAdvance( handle_t idx ) { Assert( IsValidHandle( idx ) ); DoRemoveSlot( idx ); return NextHandle( idx ); }
+
+	// Nuke contents
+	void RemoveAll();
+
+	// Nuke and release memory.
+	void Purge() { RemoveAll(); m_memory.Purge(); m_pCtrl = NULL; m_pSlots = NULL; m_nCapacity = 0; m_nGrowthLeft = 0; }
+
+	// Reserve table capacity up front to avoid reallocation during insertions
+	void Reserve( int expected ) { if ( expected > m_nUsed + m_nGrowthLeft ) DoRealloc( expected + expected / 7 + 1 ); }
+
+	// Access functions. Note: if ValueT is empty_t, all functions return const keys.
+	typedef typename KVPair::ValueReturn_t Element_t;
+	KeyT const &Key( handle_t idx ) const { Assert( IsValidHandle( idx ) ); return m_pSlots[idx].m_key; }
+	Element_t const &Element( handle_t idx ) const { Assert( IsValidHandle( idx ) ); return m_pSlots[idx].GetValue(); }
+	Element_t &Element( handle_t idx ) { Assert( IsValidHandle( idx ) ); return m_pSlots[idx].GetValue(); }
+	Element_t const &operator[]( handle_t idx ) const { Assert( IsValidHandle( idx ) ); return m_pSlots[idx].GetValue(); }
+	Element_t &operator[]( handle_t idx ) { Assert( IsValidHandle( idx ) ); return m_pSlots[idx].GetValue(); }
+
+	Element_t const &Get( KeyArg_t k, Element_t const &defaultValue ) const { handle_t h = Find( k ); if ( h != InvalidHandle() ) return Element( h ); return defaultValue; }
+	Element_t const &Get( KeyAlt_t k, Element_t const &defaultValue ) const { handle_t h = Find( k ); if ( h != InvalidHandle() ) return Element( h ); return defaultValue; }
+
+	Element_t const *GetPtr( KeyArg_t k ) const { handle_t h = Find(k); if ( h != InvalidHandle() ) return &Element( h ); return NULL; }
+	Element_t const *GetPtr( KeyAlt_t k ) const { handle_t h = Find(k); if ( h != InvalidHandle() ) return &Element( h ); return NULL; }
+	Element_t *GetPtr( KeyArg_t k ) { handle_t h = Find( k ); if ( h != InvalidHandle() ) return &Element( h ); return NULL; }
+	Element_t *GetPtr( KeyAlt_t k ) { handle_t h = Find( k ); if ( h != InvalidHandle() ) return &Element( h ); return NULL; }
+
+	// Swap memory and contents with another identical map
+	// (NOTE: if using function pointers or functors with state,
+	//  it is up to the caller to ensure that they are compatible!)
+	void Swap( CUtlFlatHashMap &other );
+
+#if _DEBUG
+	// Validate the integrity of the table
+	void DbgCheckIntegrity() const;
+#endif
+
+private:
+	CUtlFlatHashMap( const CUtlFlatHashMap& copyConstructorIsNotImplemented );
+};
+
+
+// Allocate a table of the given size and re-insert all existing entries.
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+void CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DoRealloc( int nCapacity )
+{
+	nCapacity = SmallestPowerOfTwoGreaterOrEqual( MAX( UTLFLATHASH_GROUP_SIZE, nCapacity ) );
+	Assert( MaxLoad( nCapacity ) >= m_nUsed );
+
+	M oldMemory;
+	oldMemory.Swap( m_memory );
+	const int8 *pOldCtrl = m_pCtrl;
+	KVPair *pOldSlots = m_pSlots;
+	int nOldCapacity = m_nCapacity;
+
+	// Control bytes come first; the slot array starts at a multiple of
+	// the group size, which is enough for any KVPair the engine stores
+	COMPILE_TIME_ASSERT( __alignof( KVPair ) <= UTLFLATHASH_GROUP_SIZE );
+	m_memory.EnsureCapacity( nCapacity + nCapacity * sizeof( KVPair ) );
+	m_pCtrl = (int8 *)m_memory.Base();
+	m_pSlots = (KVPair *)( m_memory.Base() + nCapacity );
+	m_nCapacity = nCapacity;
+	m_nGrowthLeft = MaxLoad( nCapacity ) - m_nUsed;
+	memset( m_pCtrl, UTLFLATHASH_CTRL_EMPTY, nCapacity );
+
+	for ( int i = 0; i < nOldCapacity; ++i )
+	{
+		if ( pOldCtrl[i] >= 0 )
+		{
+			int idx = FindFirstFree( m_hash( pOldSlots[i].m_key ) );
+			m_pCtrl[idx] = pOldCtrl[i];
+			memcpy( (void *)&m_pSlots[idx], (const void *)&pOldSlots[i], sizeof( KVPair ) );
+		}
+	}
+}
+
+// Make room for one more element
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+void CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DoGrow()
+{
+	// If at least half of the load is tombstones, rebuilding at the
+	// same size frees them without doubling the memory footprint
+	if ( m_nCapacity > 0 && m_nUsed <= MaxLoad( m_nCapacity ) / 2 )
+		DoRealloc( m_nCapacity );
+	else
+		DoRealloc( m_nCapacity * 2 );
+}
+
+// Index of the first EMPTY or DELETED slot along the probe sequence for h
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+int CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::FindFirstFree( unsigned int h ) const
+{
+	Assert( m_nCapacity > 0 );
+	const unsigned int groupMask = ( m_nCapacity / UTLFLATHASH_GROUP_SIZE ) - 1;
+	unsigned int group = HashGroup( h ) & groupMask;
+	for ( unsigned int step = 1; ; ++step )
+	{
+		const int base = group * UTLFLATHASH_GROUP_SIZE;
+		uint32 freeMask = UtlFlatHash_GroupMatchEmptyOrDeleted( m_pCtrl + base );
+		if ( freeMask )
+			return base + UtlFlatHash_LowestBit( freeMask );
+		Assert( step <= groupMask + 1 );
+		group = ( group + step ) & groupMask;
+	}
+}
+
+// Claim a free slot for hash h and return its index
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+int CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DoInsertUnconstructed( unsigned int h )
+{
+	if ( m_nGrowthLeft <= 0 )
+		DoGrow();
+
+	int idx = FindFirstFree( h );
+	if ( m_pCtrl[idx] == UTLFLATHASH_CTRL_EMPTY )
+		--m_nGrowthLeft;
+	m_pCtrl[idx] = HashCtrl( h );
+	++m_nUsed;
+	return idx;
+}
+
+// Destruct the element in a slot and release the slot
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+void CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DoRemoveSlot( handle_t idx )
+{
+	Destruct( &m_pSlots[idx] );
+	--m_nUsed;
+
+	// A group which still has an EMPTY slot has never been full, so no
+	// probe sequence continues past it and the slot can become EMPTY too
+	const int8 *pGroup = m_pCtrl + ( idx & ~( UTLFLATHASH_GROUP_SIZE - 1 ) );
+	if ( UtlFlatHash_GroupMatch( pGroup, UTLFLATHASH_CTRL_EMPTY ) )
+	{
+		m_pCtrl[idx] = UTLFLATHASH_CTRL_EMPTY;
+		++m_nGrowthLeft;
+	}
+	else
+	{
+		m_pCtrl[idx] = UTLFLATHASH_CTRL_DELETED;
+	}
+}
+
+// Key lookup
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+template <typename KeyParamT>
+UtlHashHandle_t CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DoLookup( KeyParamT x, unsigned int h ) const
+{
+	if ( m_nUsed == 0 )
+		return InvalidHandle();
+
+	const int8 ctrl = HashCtrl( h );
+	const unsigned int groupMask = ( m_nCapacity / UTLFLATHASH_GROUP_SIZE ) - 1;
+	unsigned int group = HashGroup( h ) & groupMask;
+	for ( unsigned int step = 1; step <= groupMask + 1; ++step )
+	{
+		const int base = group * UTLFLATHASH_GROUP_SIZE;
+		const int8 *pGroup = m_pCtrl + base;
+		for ( uint32 mask = UtlFlatHash_GroupMatch( pGroup, ctrl ); mask; mask &= mask - 1 )
+		{
+			int idx = base + UtlFlatHash_LowestBit( mask );
+			if ( m_eq( m_pSlots[idx].m_key, x ) )
+				return (handle_t)idx;
+		}
+		if ( UtlFlatHash_GroupMatch( pGroup, UTLFLATHASH_CTRL_EMPTY ) )
+			break;
+		group = ( group + step ) & groupMask;
+	}
+	return InvalidHandle();
+}
+
+// Insert a key with a default-constructed value
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+template <typename KeyParamT>
+UtlHashHandle_t CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DoInsert( KeyParamT k, unsigned int h )
+{
+	handle_t idx = DoLookup<KeyParamT>( k, h );
+	if ( idx == InvalidHandle() )
+	{
+		idx = (handle_t) DoInsertUnconstructed( h );
+		ConstructOneArg( &m_pSlots[idx], k );
+	}
+	return idx;
+}
+
+// Insert a key with a copy-constructed value
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+template <typename KeyParamT>
+UtlHashHandle_t CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DoInsert( KeyParamT k, ValueArg_t v, unsigned int h, bool *pDidInsert )
+{
+	handle_t idx = DoLookup<KeyParamT>( k, h );
+	if ( idx == InvalidHandle() )
+	{
+		idx = (handle_t) DoInsertUnconstructed( h );
+		ConstructTwoArg( &m_pSlots[idx], k, v );
+		if ( pDidInsert ) *pDidInsert = true;
+	}
+	else if ( pDidInsert )
+	{
+		*pDidInsert = false;
+	}
+	return idx;
+}
+
+// Iteration
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+UtlHashHandle_t CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::NextHandle( handle_t start ) const
+{
+	for ( int i = (int)start + 1; i < m_nCapacity; ++i )
+	{
+		if ( m_pCtrl[i] >= 0 )
+			return (handle_t) i;
+	}
+	return InvalidHandle();
+}
+
+// Nuke contents, keeping the allocation
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+void CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::RemoveAll()
+{
+	if ( m_nCapacity == 0 )
+		return;
+
+	for ( int i = 0; m_nUsed > 0 && i < m_nCapacity; ++i )
+	{
+		if ( m_pCtrl[i] >= 0 )
+		{
+			Destruct( &m_pSlots[i] );
+			--m_nUsed;
+		}
+	}
+	Assert( m_nUsed == 0 );
+	memset( m_pCtrl, UTLFLATHASH_CTRL_EMPTY, m_nCapacity );
+	m_nGrowthLeft = MaxLoad( m_nCapacity );
+}
+
+// Copy contents from another table of the same type
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M> &CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::operator=( CUtlFlatHashMap const &src )
+{
+	if ( &src == this )
+		return *this;
+
+	RemoveAll();
+	Reserve( src.Count() );
+	for ( int i = 0; i < src.m_nCapacity; ++i )
+	{
+		if ( src.m_pCtrl[i] >= 0 )
+		{
+			int idx = DoInsertUnconstructed( m_hash( src.m_pSlots[i].m_key ) );
+			CopyConstruct( &m_pSlots[idx], src.m_pSlots[i] );
+		}
+	}
+	return *this;
+}
+
+// Swap memory and contents with another identical map
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+void CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::Swap( CUtlFlatHashMap &other )
+{
+	m_memory.Swap( other.m_memory );
+	::V_swap( m_pCtrl, other.m_pCtrl );
+	::V_swap( m_pSlots, other.m_pSlots );
+	::V_swap( m_nCapacity, other.m_nCapacity );
+	::V_swap( m_nUsed, other.m_nUsed );
+	::V_swap( m_nGrowthLeft, other.m_nGrowthLeft );
+}
+
+#if _DEBUG
+template <typename KeyT, typename ValueT, typename KeyHashT, typename KeyIsEqualT, typename AltKeyT, typename M>
+void CUtlFlatHashMap<KeyT, ValueT, KeyHashT, KeyIsEqualT, AltKeyT, M>::DbgCheckIntegrity() const
+{
+	int nUsed = 0, nEmpty = 0;
+	for ( int i = 0; i < m_nCapacity; ++i )
+	{
+		if ( m_pCtrl[i] >= 0 )
+		{
+			++nUsed;
+			unsigned int h = m_hash( m_pSlots[i].m_key );
+			Assert( m_pCtrl[i] == HashCtrl( h ) );
+			Assert( DoLookup<KeyArg_t>( m_pSlots[i].m_key, h ) == (handle_t)i );
+		}
+		else if ( m_pCtrl[i] == UTLFLATHASH_CTRL_EMPTY )
+		{
+			++nEmpty;
+		}
+		else
+		{
+			Assert( m_pCtrl[i] == UTLFLATHASH_CTRL_DELETED );
+		}
+	}
+	Assert( nUsed == m_nUsed );
+	Assert( m_nCapacity == 0 || m_nGrowthLeft == nEmpty - ( m_nCapacity - MaxLoad( m_nCapacity ) ) );
+}
+#endif
+
+#endif // UTLFLATHASHMAP_H
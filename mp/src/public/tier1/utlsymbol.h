@@ -85,6 +85,11 @@ protected:
 //    of strings to symbols and back. The symbol class itself contains
 //    a static version of this class for creating global strings, but this
 //    class can also be instanced to create local symbol tables.
+//
+//    Strings are looked up through an open addressed hash table of symbol
+//    ids. Nothing a reader touches is ever moved or freed while the table is
+//    alive (string pools, symbol entries and replaced hash tables are all
+//    kept), which is what lets CUtlSymbolTableMT do lookups without a lock.
 //-----------------------------------------------------------------------------
 
 class CUtlSymbolTable
@@ -108,46 +113,28 @@ public:
 
 	int GetNumStrings( void ) const
 	{
-		return m_Lookup.Count();
+		return m_nSymbols;
 	}
 
 protected:
-	class CStringPoolIndex
+	enum
 	{
-	public:
-		inline CStringPoolIndex()
-		{
-		}
-
-		inline CStringPoolIndex( unsigned short iPool, unsigned short iOffset )
-		{
-			m_iPool = iPool;
-			m_iOffset = iOffset;
-		}
-
-		inline bool operator==( const CStringPoolIndex &other )	const
-		{
-			return m_iPool == other.m_iPool && m_iOffset == other.m_iOffset;
-		}
-
-		unsigned short m_iPool;		// Index into m_StringPools.
-		unsigned short m_iOffset;	// Index into the string pool.
+		SYMBOL_SEGMENT_BITS = 10,
+		SYMBOL_SEGMENT_SIZE = 1 << SYMBOL_SEGMENT_BITS,
+		SYMBOL_SEGMENT_COUNT = 0x10000 / SYMBOL_SEGMENT_SIZE,
 	};
 
-	class CLess
+	struct SymbolEntry_t
 	{
-	public:
-		CLess( int ignored = 0 ) {} // permits default initialization to NULL in CUtlRBTree
-		bool operator!() const { return false; }
-		bool operator()( const CStringPoolIndex &left, const CStringPoolIndex &right ) const;
+		const char *m_pString;		// Points into one of m_StringPools
+		unsigned int m_nHash;
 	};
 
-	// Stores the symbol lookup
-	class CTree : public CUtlRBTree<CStringPoolIndex, unsigned short, CLess>
+	// Slots hold symbol ids, UTL_INVAL_SYMBOL is an empty slot. Linear probing.
+	struct LookupTable_t
 	{
-	public:
-		CTree(  int growSize, int initSize ) : CUtlRBTree<CStringPoolIndex, unsigned short, CLess>( growSize, initSize ) {}
-		friend class CUtlSymbolTable::CLess; // Needed to allow CLess to calculate pointer to symbol table
+		unsigned int m_nMask;
+		UtlSymId_t m_Slots[1];
 	};
 
 	struct StringPool_t
@@ -157,18 +144,25 @@ protected:
 		char m_Data[1];
 	};
 
-	CTree m_Lookup;
+	// Symbol ids index these fixed size segments, so entries never move once written
+	SymbolEntry_t * volatile m_pSymbolSegments[SYMBOL_SEGMENT_COUNT];
+	volatile int m_nSymbols;
+
+	LookupTable_t * volatile m_pLookup;
+	CUtlVector<LookupTable_t*> m_RetiredLookups;	// Old tables a reader could still be using
+	int m_nInitSize;
+
 	bool m_bInsensitive;
-	mutable const char* m_pUserSearchString;
 
 	// stores the string data
 	CUtlVector<StringPool_t*> m_StringPools;
 
 private:
-	int FindPoolWithSpace( int len ) const;
-	const char* StringFromIndex( const CStringPoolIndex &index ) const;
-
-	friend class CLess;
+	unsigned int HashString( const char *pString ) const;
+	bool StringsMatch( const char *pString1, const char *pString2 ) const;
+	const SymbolEntry_t &Entry( UtlSymId_t id ) const;
+	const char *CopyToPool( const char *pString, int len );
+	void GrowLookup();
 };
 
 class CUtlSymbolTableMT : private CUtlSymbolTable
@@ -179,36 +173,31 @@ public:
 	{
 	}
 
+	// Existing strings are found without locking; only adding a new one takes the lock
 	CUtlSymbol AddString( const char* pString )
 	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::AddString( pString );
-		m_lock.UnlockWrite();
+		CUtlSymbol result = CUtlSymbolTable::Find( pString );
+		if ( result.IsValid() || !pString )
+			return result;
+
+		m_lock.Lock();
+		result = CUtlSymbolTable::AddString( pString );
+		m_lock.Unlock();
 		return result;
 	}
 
 	CUtlSymbol Find( const char* pString ) const
 	{
-		m_lock.LockForRead();
-		CUtlSymbol result = CUtlSymbolTable::Find( pString );
-		m_lock.UnlockRead();
-		return result;
+		return CUtlSymbolTable::Find( pString );
 	}
 
 	const char* String( CUtlSymbol id ) const
 	{
-		m_lock.LockForRead();
-		const char *pszResult = CUtlSymbolTable::String( id );
-		m_lock.UnlockRead();
-		return pszResult;
+		return CUtlSymbolTable::String( id );
 	}
 	
 private:
-#if defined(WIN32) || defined(_WIN32)
-	mutable CThreadSpinRWLock m_lock;
-#else
-	mutable CThreadRWLock m_lock;
-#endif
+	CThreadFastMutex m_lock;
 };
 
 
@@ -119,6 +119,174 @@ public:
 static CBitWriteMasksInit g_BitWriteMasksInit;
 
 
+// ---------------------------------------------------------------------------------------- //
+// Accumulators for the batched read/write functions. They keep up to 63 pending bits in a
+// 64-bit register and touch memory one dword at a time, instead of masking two dwords per
+// field. Callers must make sure the whole batch fits in the buffer before using them.
+// ---------------------------------------------------------------------------------------- //
+
+class CBitWriteAccumulator
+{
+public:
+	CBitWriteAccumulator( bf_write *pBuf ) : m_pBuf( pBuf )
+	{
+		m_nDWord = pBuf->m_iCurBit >> 5;
+		m_nBits = pBuf->m_iCurBit & 31;
+
+		// Keep the bits already written to the current dword
+		m_nAccum = LoadLittleDWord( pBuf->m_pData, m_nDWord ) & g_ExtraMasks[m_nBits];
+	}
+
+	// data must fit in numbits, numbits <= 32
+	FORCEINLINE void Write( unsigned int data, int numbits )
+	{
+		m_nAccum |= (uint64)data << m_nBits;
+		m_nBits += numbits;
+		if ( m_nBits >= 32 )
+		{
+			StoreLittleDWord( m_pBuf->m_pData, m_nDWord++, (unsigned long)m_nAccum );
+			m_nAccum >>= 32;
+			m_nBits -= 32;
+		}
+	}
+
+	void Flush()
+	{
+		if ( m_nBits )
+		{
+			// Like WriteUBitLong, leave the bits past the write position untouched
+			unsigned long dword = LoadLittleDWord( m_pBuf->m_pData, m_nDWord ) & ~g_ExtraMasks[m_nBits];
+			StoreLittleDWord( m_pBuf->m_pData, m_nDWord, dword | (unsigned long)m_nAccum );
+		}
+		m_pBuf->m_iCurBit = m_nDWord * 32 + m_nBits;
+	}
+
+private:
+	bf_write	*m_pBuf;
+	uint64		m_nAccum;
+	int			m_nBits;
+	int			m_nDWord;
+};
+
+class CBitReadAccumulator
+{
+public:
+	CBitReadAccumulator( bf_read *pBuf ) : m_pBuf( pBuf )
+	{
+		m_nDWord = pBuf->m_iCurBit >> 5;
+		m_nBits = 32 - ( pBuf->m_iCurBit & 31 );
+		m_nAccum = LoadLittleDWord( (const unsigned long*)pBuf->m_pData, m_nDWord++ ) >> ( pBuf->m_iCurBit & 31 );
+	}
+
+	// numbits <= 32
+	FORCEINLINE unsigned int Read( int numbits )
+	{
+		if ( m_nBits < numbits )
+		{
+			m_nAccum |= (uint64)LoadLittleDWord( (const unsigned long*)m_pBuf->m_pData, m_nDWord++ ) << m_nBits;
+			m_nBits += 32;
+		}
+		unsigned int data = (unsigned int)m_nAccum & g_ExtraMasks[numbits];
+		m_nAccum >>= numbits;
+		m_nBits -= numbits;
+		return data;
+	}
+
+	int GetNumBitsLeft() const
+	{
+		return m_pBuf->m_nDataBits - GetCurBit();
+	}
+
+	void Finish()
+	{
+		m_pBuf->m_iCurBit = GetCurBit();
+	}
+
+private:
+	int GetCurBit() const { return m_nDWord * 32 - m_nBits; }
+
+	bf_read		*m_pBuf;
+	uint64		m_nAccum;
+	int			m_nBits;
+	int			m_nDWord;
+};
+
+// Largest encodings of the batched types, used to pick the fast path
+#define MAX_BITCOORD_BITS		( 3 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS )
+#define MAX_BITVEC3COORD_BITS	( 3 + 3 * MAX_BITCOORD_BITS )
+#define MAX_BITNORMAL_BITS		( 1 + NORMAL_FRACTIONAL_BITS )
+#define MAX_BITVEC3NORMAL_BITS	( 3 + 2 * MAX_BITNORMAL_BITS )
+#define MAX_VARINT32_BITS		( bitbuf::kMaxVarint32Bytes * 8 )
+
+// Packs the WriteBitCoord encoding of f into *pBits (first bit in the LSB), returns the bit count
+static FORCEINLINE int EncodeBitCoord( const float f, unsigned int *pBits )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	if ( !intval && !fractval )
+	{
+		*pBits = 0;
+		return 2;
+	}
+
+	// Integer flag, fraction flag, sign bit, then the integer and fraction if present.
+	// Integers are adjusted from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1].
+	unsigned int bits = ( intval ? 1 : 0 ) | ( fractval ? 2 : 0 ) | ( signbit << 2 );
+	int numbits = 3;
+	if ( intval )
+	{
+		bits |= ( (unsigned int)( intval - 1 ) & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) ) << numbits;
+		numbits += COORD_INTEGER_BITS;
+	}
+	if ( fractval )
+	{
+		bits |= (unsigned int)fractval << numbits;
+		numbits += COORD_FRACTIONAL_BITS;
+	}
+	*pBits = bits;
+	return numbits;
+}
+
+// Packs the WriteBitNormal encoding of f (sign bit, then the fraction)
+static FORCEINLINE unsigned int EncodeBitNormal( float f )
+{
+	int	signbit = (f <= -NORMAL_RESOLUTION);
+
+	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+
+	// clamp..
+	if (fractval > NORMAL_DENOMINATOR)
+		fractval = NORMAL_DENOMINATOR;
+
+	return signbit | ( fractval << 1 );
+}
+
+static FORCEINLINE float DecodeBitCoord( CBitReadAccumulator &in )
+{
+	unsigned int flags = in.Read( 2 );
+	if ( !flags )
+		return 0.0f;
+
+	int signbit = in.Read( 1 );
+	int intval = ( flags & 1 ) ? in.Read( COORD_INTEGER_BITS ) + 1 : 0;
+	int fractval = ( flags & 2 ) ? in.Read( COORD_FRACTIONAL_BITS ) : 0;
+
+	// Same arithmetic as ReadBitCoord so the results match exactly
+	float value = intval + ((float)fractval * COORD_RESOLUTION);
+	return signbit ? -value : value;
+}
+
+static FORCEINLINE float DecodeBitNormal( CBitReadAccumulator &in )
+{
+	int signbit = in.Read( 1 );
+	float value = (float)in.Read( NORMAL_FRACTIONAL_BITS ) * NORMAL_RESOLUTION;
+	return signbit ? -value : value;
+}
+
+
 // ---------------------------------------------------------------------------------------- //
 // bf_write
 // ---------------------------------------------------------------------------------------- //
@@ -621,34 +789,10 @@ void bf_write::WriteBitCoord (const float f)
 #if defined( BB_PROFILING )
 	VPROF( "bf_write::WriteBitCoord" );
 #endif
-	int		signbit = (f <= -COORD_RESOLUTION);
-	int		intval = (int)abs(f);
-	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
-
-
-	// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-	WriteOneBit( intval );
-	WriteOneBit( fractval );
-
-	if ( intval || fractval )
-	{
-		// Send the sign bit
-		WriteOneBit( signbit );
-
-		// Send the integer if we have one.
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-		}
-		
-		// Send the fraction if we have one
-		if ( fractval )
-		{
-			WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
-		}
-	}
+	// The flags, sign, integer and fraction are at most 22 bits, so send them in one go
+	unsigned int bits;
+	int numbits = EncodeBitCoord( f, &bits );
+	WriteUBitLong( bits, numbits );
 }
 
 void bf_write::WriteBitVec3Coord( const Vector& fa )
@@ -673,20 +817,8 @@ void bf_write::WriteBitVec3Coord( const Vector& fa )
 
 void bf_write::WriteBitNormal( float f )
 {
-	int	signbit = (f <= -NORMAL_RESOLUTION);
-
-	// NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
-	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
-
-	// clamp..
-	if (fractval > NORMAL_DENOMINATOR)
-		fractval = NORMAL_DENOMINATOR;
-
-	// Send the sign bit
-	WriteOneBit( signbit );
-
-	// Send the fractional component
-	WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+	// Sign bit and fractional component
+	WriteUBitLong( EncodeBitNormal( f ), MAX_BITNORMAL_BITS );
 }
 
 void bf_write::WriteBitVec3Normal( const Vector& fa )
@@ -716,6 +848,142 @@ void bf_write::WriteBitAngles( const QAngle& fa )
 	WriteBitVec3Coord( tmp );
 }
 
+// The batched writers fall back to the single-value functions when the batch
+// might not fit, so that overflow behaves exactly as it always has.
+void bf_write::WriteUBitLongs( const uint32 *pData, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+	if ( nCount <= 0 || GetNumBitsLeft() < nCount * numbits )
+	{
+		for ( int i = 0; i < nCount; ++i )
+			WriteUBitLong( pData[i], numbits );
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	unsigned int mask = g_ExtraMasks[numbits];
+	for ( int i = 0; i < nCount; ++i )
+	{
+#ifdef _DEBUG
+		if ( numbits < 32 && pData[i] > mask )
+		{
+			CallErrorHandler( BITBUFERROR_VALUE_OUT_OF_RANGE, GetDebugName() );
+		}
+#endif
+		out.Write( pData[i] & mask, numbits );
+	}
+	out.Flush();
+}
+
+void bf_write::WriteVarInt32s( const uint32 *pData, int nCount )
+{
+	if ( nCount <= 0 || GetNumBitsLeft() < nCount * MAX_VARINT32_BITS )
+	{
+		for ( int i = 0; i < nCount; ++i )
+			WriteVarInt32( pData[i] );
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; ++i )
+	{
+		uint32 data = pData[i];
+		while ( data > 0x7F )
+		{
+			out.Write( ( data & 0x7F ) | 0x80, 8 );
+			data >>= 7;
+		}
+		out.Write( data, 8 );
+	}
+	out.Flush();
+}
+
+void bf_write::WriteBitCoords( const float *pValues, int nCount )
+{
+	if ( nCount <= 0 || GetNumBitsLeft() < nCount * MAX_BITCOORD_BITS )
+	{
+		for ( int i = 0; i < nCount; ++i )
+			WriteBitCoord( pValues[i] );
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; ++i )
+	{
+		unsigned int bits;
+		int numbits = EncodeBitCoord( pValues[i], &bits );
+		out.Write( bits, numbits );
+	}
+	out.Flush();
+}
+
+void bf_write::WriteBitVec3Coords( const Vector *pValues, int nCount )
+{
+	if ( nCount <= 0 || GetNumBitsLeft() < nCount * MAX_BITVEC3COORD_BITS )
+	{
+		for ( int i = 0; i < nCount; ++i )
+			WriteBitVec3Coord( pValues[i] );
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; ++i )
+	{
+		const Vector &fa = pValues[i];
+		int xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
+		int yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
+		int zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
+		out.Write( xflag | ( yflag << 1 ) | ( zflag << 2 ), 3 );
+
+		unsigned int bits;
+		int numbits;
+		if ( xflag )
+		{
+			numbits = EncodeBitCoord( fa[0], &bits );
+			out.Write( bits, numbits );
+		}
+		if ( yflag )
+		{
+			numbits = EncodeBitCoord( fa[1], &bits );
+			out.Write( bits, numbits );
+		}
+		if ( zflag )
+		{
+			numbits = EncodeBitCoord( fa[2], &bits );
+			out.Write( bits, numbits );
+		}
+	}
+	out.Flush();
+}
+
+void bf_write::WriteBitVec3Normals( const Vector *pValues, int nCount )
+{
+	if ( nCount <= 0 || GetNumBitsLeft() < nCount * MAX_BITVEC3NORMAL_BITS )
+	{
+		for ( int i = 0; i < nCount; ++i )
+			WriteBitVec3Normal( pValues[i] );
+		return;
+	}
+
+	CBitWriteAccumulator out( this );
+	for ( int i = 0; i < nCount; ++i )
+	{
+		const Vector &fa = pValues[i];
+		int xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
+		int yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
+		out.Write( xflag | ( yflag << 1 ), 2 );
+
+		if ( xflag )
+			out.Write( EncodeBitNormal( fa[0] ), MAX_BITNORMAL_BITS );
+		if ( yflag )
+			out.Write( EncodeBitNormal( fa[1] ), MAX_BITNORMAL_BITS );
+
+		// z sign bit
+		out.Write( fa[2] <= -NORMAL_RESOLUTION, 1 );
+	}
+	out.Flush();
+}
+
 void bf_write::WriteChar(int val)
 {
 	WriteSBitLong(val, sizeof(char) << 3);
@@ -1088,28 +1356,35 @@ float bf_read::ReadBitCoord (void)
 	int		intval=0,fractval=0,signbit=0;
 	float	value = 0.0;
 
-
 	// Read the required integer and fraction flags
-	intval = ReadOneBit();
-	fractval = ReadOneBit();
+	unsigned int flags = ReadUBitLong( 2 );
 
 	// If we got either parse them, otherwise it's a zero.
-	if ( intval || fractval )
+	if ( flags )
 	{
-		// Read the sign bit
-		signbit = ReadOneBit();
+		// Read the sign bit, integer and fraction at once
+		static const int numbits_table[3] =
+		{
+			COORD_INTEGER_BITS + 1,
+			COORD_FRACTIONAL_BITS + 1,
+			COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS + 1
+		};
+		unsigned int bits = ReadUBitLong( numbits_table[ flags-1 ] );
+		signbit = bits & 1;
+		bits >>= 1;
 
-		// If there's an integer, read it in
-		if ( intval )
+		// If there's an integer, extract it
+		if ( flags & 1 )
 		{
 			// Adjust the integers from [0..MAX_COORD_VALUE-1] to [1..MAX_COORD_VALUE]
-			intval = ReadUBitLong( COORD_INTEGER_BITS ) + 1;
+			intval = ( bits & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) ) + 1;
+			bits >>= COORD_INTEGER_BITS;
 		}
 
-		// If there's a fraction, read it in
-		if ( fractval )
+		// If there's a fraction, the remaining bits are it
+		if ( flags & 2 )
 		{
-			fractval = ReadUBitLong( COORD_FRACTIONAL_BITS );
+			fractval = bits;
 		}
 
 		// Calculate the correct floating point value
@@ -1341,6 +1616,116 @@ void bf_read::ReadBitAngles( QAngle& fa )
 	fa.Init( tmp.x, tmp.y, tmp.z );
 }
 
+// The batched readers use the accumulator while the largest possible element
+// still fits in the buffer, and finish with the single-value functions so that
+// truncated streams overflow exactly as they always have.
+void bf_read::ReadUBitLongs( uint32 *pData, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+	int i = 0;
+	if ( GetNumBitsLeft() >= numbits )
+	{
+		int nFit = MIN( nCount, GetNumBitsLeft() / numbits );
+		CBitReadAccumulator in( this );
+		for ( ; i < nFit; ++i )
+			pData[i] = in.Read( numbits );
+		in.Finish();
+	}
+	for ( ; i < nCount; ++i )
+		pData[i] = ReadUBitLong( numbits );
+}
+
+void bf_read::ReadVarInt32s( uint32 *pData, int nCount )
+{
+	int i = 0;
+	if ( GetNumBitsLeft() >= MAX_VARINT32_BITS )
+	{
+		CBitReadAccumulator in( this );
+		for ( ; i < nCount && in.GetNumBitsLeft() >= MAX_VARINT32_BITS; ++i )
+		{
+			uint32 result = 0;
+			uint32 b;
+			int count = 0;
+			do
+			{
+				if ( count == bitbuf::kMaxVarint32Bytes )
+					break;
+				b = in.Read( 8 );
+				result |= (b & 0x7F) << (7 * count);
+				++count;
+			} while ( b & 0x80 );
+			pData[i] = result;
+		}
+		in.Finish();
+	}
+	for ( ; i < nCount; ++i )
+		pData[i] = ReadVarInt32();
+}
+
+void bf_read::ReadBitCoords( float *pValues, int nCount )
+{
+	int i = 0;
+	if ( GetNumBitsLeft() >= MAX_BITCOORD_BITS )
+	{
+		CBitReadAccumulator in( this );
+		for ( ; i < nCount && in.GetNumBitsLeft() >= MAX_BITCOORD_BITS; ++i )
+			pValues[i] = DecodeBitCoord( in );
+		in.Finish();
+	}
+	for ( ; i < nCount; ++i )
+		pValues[i] = ReadBitCoord();
+}
+
+void bf_read::ReadBitVec3Coords( Vector *pValues, int nCount )
+{
+	int i = 0;
+	if ( GetNumBitsLeft() >= MAX_BITVEC3COORD_BITS )
+	{
+		CBitReadAccumulator in( this );
+		for ( ; i < nCount && in.GetNumBitsLeft() >= MAX_BITVEC3COORD_BITS; ++i )
+		{
+			unsigned int flags = in.Read( 3 );
+			Vector &fa = pValues[i];
+			fa[0] = ( flags & 1 ) ? DecodeBitCoord( in ) : 0.0f;
+			fa[1] = ( flags & 2 ) ? DecodeBitCoord( in ) : 0.0f;
+			fa[2] = ( flags & 4 ) ? DecodeBitCoord( in ) : 0.0f;
+		}
+		in.Finish();
+	}
+	for ( ; i < nCount; ++i )
+		ReadBitVec3Coord( pValues[i] );
+}
+
+void bf_read::ReadBitVec3Normals( Vector *pValues, int nCount )
+{
+	int i = 0;
+	if ( GetNumBitsLeft() >= MAX_BITVEC3NORMAL_BITS )
+	{
+		CBitReadAccumulator in( this );
+		for ( ; i < nCount && in.GetNumBitsLeft() >= MAX_BITVEC3NORMAL_BITS; ++i )
+		{
+			unsigned int flags = in.Read( 2 );
+			Vector &fa = pValues[i];
+			fa[0] = ( flags & 1 ) ? DecodeBitNormal( in ) : 0.0f;
+			fa[1] = ( flags & 2 ) ? DecodeBitNormal( in ) : 0.0f;
+
+			// The first two imply the third (but not its sign)
+			int znegative = in.Read( 1 );
+			float fafafbfb = fa[0] * fa[0] + fa[1] * fa[1];
+			if (fafafbfb < 1.0f)
+				fa[2] = sqrt( 1.0f - fafafbfb );
+			else
+				fa[2] = 0.0f;
+
+			if (znegative)
+				fa[2] = -fa[2];
+		}
+		in.Finish();
+	}
+	for ( ; i < nCount; ++i )
+		ReadBitVec3Normal( pValues[i] );
+}
+
 int64 bf_read::ReadLongLong()
 {
 	int64 retval;
@@ -12,9 +12,16 @@ bool CheckMMXTechnology(void) { return false; }
 bool CheckSSETechnology(void) { return false; }
 bool CheckSSE2Technology(void) { return false; }
 bool Check3DNowTechnology(void) { return false; }
+bool CheckAVXTechnology(void) { return false; }
+bool CheckAVX2Technology(void) { return false; }
+bool CheckFMATechnology(void) { return false; }
+bool CheckPCLMULQDQTechnology(void) { return false; }
 
 #elif defined( _WIN32 ) && !defined( _X360 )
 
+#include <intrin.h>
+#include "tier1/processor_detect.h"
+
 #pragma optimize( "", off )
 #pragma warning( disable: 4800 ) //'int' : forcing value to bool 'true' or 'false' (performance warning)
 
@@ -269,6 +276,51 @@ bool Check3DNowTechnology(void)
     return retval;
 }
 
+// The AVX checks need VS2010 SP1 or later for __cpuidex and _xgetbv
+bool CheckAVXTechnology(void)
+{
+	int regs[4];
+	__cpuid( regs, 1 );
+
+	// AVX (ecx bit 28) and OSXSAVE (ecx bit 27) ...
+	if ( ( regs[2] & 0x18000000 ) != 0x18000000 )
+		return false;
+
+	// ... and the OS has to save the xmm and ymm registers on a context switch
+	return ( _xgetbv( 0 ) & 6 ) == 6;
+}
+
+bool CheckAVX2Technology(void)
+{
+	if ( !CheckAVXTechnology() )
+		return false;
+
+	int regs[4];
+	__cpuid( regs, 0 );
+	if ( regs[0] < 7 )
+		return false;
+
+	__cpuidex( regs, 7, 0 );
+	return ( regs[1] & 0x20 ) != 0;		// bit 5 of ebx is set for AVX2
+}
+
+bool CheckFMATechnology(void)
+{
+	if ( !CheckAVXTechnology() )
+		return false;
+
+	int regs[4];
+	__cpuid( regs, 1 );
+	return ( regs[2] & 0x1000 ) != 0;	// bit 12 of ecx is set for FMA3
+}
+
+bool CheckPCLMULQDQTechnology(void)
+{
+	int regs[4];
+	__cpuid( regs, 1 );
+	return ( regs[2] & 0x2 ) != 0;		// bit 1 of ecx is set for PCLMULQDQ
+}
+
 #pragma optimize( "", on )
 
 #endif // _WIN32
@@ -9,6 +9,13 @@
 #define cpuid(in,a,b,c,d)												\
 	asm("pushl %%ebx\n\t" "cpuid\n\t" "movl %%ebx,%%esi\n\t" "pop %%ebx": "=a" (a), "=S" (b), "=c" (c), "=d" (d) : "a" (in));
 
+#define cpuid_count(in,count,a,b,c,d)									\
+	asm("pushl %%ebx\n\t" "cpuid\n\t" "movl %%ebx,%%esi\n\t" "pop %%ebx": "=a" (a), "=S" (b), "=c" (c), "=d" (d) : "a" (in), "c" (count));
+
+// xgetbv isn't known to older assemblers
+#define xgetbv(index,a,d)												\
+	asm(".byte 0x0f, 0x01, 0xd0" : "=a" (a), "=d" (d) : "c" (index));
+
 bool CheckMMXTechnology(void)
 {
     unsigned long eax,ebx,edx,unused;
@@ -45,3 +52,48 @@ bool Check3DNowTechnology(void)
     }
     return false;
 }
+
+bool CheckAVXTechnology(void)
+{
+    unsigned long eax,ebx,ecx,edx;
+    cpuid(1,eax,ebx,ecx,edx);
+
+    // AVX (bit 28) and OSXSAVE (bit 27) ...
+    if ( ( ecx & 0x18000000 ) != 0x18000000 )
+        return false;
+
+    // ... and the OS has to save the xmm and ymm registers on a context switch
+    xgetbv(0,eax,edx);
+    return ( eax & 6 ) == 6;
+}
+
+bool CheckAVX2Technology(void)
+{
+    if ( !CheckAVXTechnology() )
+        return false;
+
+    unsigned long eax,ebx,ecx,edx;
+    cpuid(0,eax,ebx,ecx,edx);
+    if ( eax < 7 )
+        return false;
+
+    cpuid_count(7,0,eax,ebx,ecx,edx);
+    return ( ebx & 0x20 ) != 0;
+}
+
+bool CheckFMATechnology(void)
+{
+    if ( !CheckAVXTechnology() )
+        return false;
+
+    unsigned long eax,ebx,ecx,edx;
+    cpuid(1,eax,ebx,ecx,edx);
+    return ( ecx & 0x1000 ) != 0;
+}
+
+bool CheckPCLMULQDQTechnology(void)
+{
+    unsigned long eax,ebx,ecx,edx;
+    cpuid(1,eax,ebx,ecx,edx);
+    return ( ecx & 0x2 ) != 0;
+}
@@ -27,7 +27,7 @@ bool StrLess( const char * const &pszLeft, const char * const &pszRight )
 //-----------------------------------------------------------------------------
 
 CStringPool::CStringPool()
-  : m_Strings( 32, 256, StrLess )
+  : m_Strings( 256 )
 {
 }
 
@@ -51,27 +51,21 @@ unsigned int CStringPool::Count() const
 //-----------------------------------------------------------------------------
 const char * CStringPool::Find( const char *pszValue )
 {
-	unsigned short i = m_Strings.Find(pszValue);
-	if ( m_Strings.IsValidIndex(i) )
-		return m_Strings[i];
+	UtlHashHandle_t i = m_Strings.Find(pszValue);
+	if ( i != m_Strings.InvalidHandle() )
+		return m_Strings.Key(i);
 
 	return NULL;
 }
 
 const char * CStringPool::Allocate( const char *pszValue )
 {
-	char	*pszNew;
+	const char *pszExisting = Find( pszValue );
+	if ( pszExisting )
+		return pszExisting;
 
-	unsigned short i 	= m_Strings.Find(pszValue);
-	bool		   bNew = (i == m_Strings.InvalidIndex());
-
-	if ( !bNew )
-		return m_Strings[i];
-
-	pszNew = strdup( pszValue );
-
-	if ( bNew )
-		m_Strings.Insert( pszNew );
+	char *pszNew = strdup( pszValue );
+	m_Strings.Insert( pszNew );
 
 	return pszNew;
 }
@@ -81,11 +75,9 @@ const char * CStringPool::Allocate( const char *pszValue )
 
 void CStringPool::FreeAll()
 {
-	unsigned short i = m_Strings.FirstInorder();
-	while ( i != m_Strings.InvalidIndex() )
+	for ( UtlHashHandle_t i = m_Strings.FirstHandle(); i != m_Strings.InvalidHandle(); i = m_Strings.NextHandle(i) )
 	{
-		free( (void *)m_Strings[i] );
-		i = m_Strings.NextInorder(i);
+		free( (void *)m_Strings.Key(i) );
 	}
 	m_Strings.RemoveAll();
 }
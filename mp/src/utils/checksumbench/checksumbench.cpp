@@ -0,0 +1,169 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Measures the throughput of the tier1 checksums (CRC32, MD5, SHA1)
+//			against the original byte-at-a-time CRC32 loop.
+//
+// $NoKeywords: $
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include "tier0/platform.h"
+#include "tier1/checksum_crc.h"
+#include "tier1/checksum_md5.h"
+#include "tier1/checksum_sha1.h"
+#include "tier1/processor_detect.h"
+#include "tier1/strtools.h"
+
+#define DEFAULT_BUFFER_MB	64
+
+void Usage( void )
+{
+	printf( "Usage: checksumbench [-mb <buffer size in MB>] [-reps <count>] [file]\n" );
+	exit( -1 );
+}
+
+// The CRC32_ProcessBuffer loop from before slicing-by-8, one table lookup per byte
+static CRC32_t ReferenceCRC32( const unsigned char *pb, int nBuffer )
+{
+	CRC32_t ulCrc;
+	CRC32_Init( &ulCrc );
+	while ( nBuffer-- )
+	{
+		ulCrc = CRC32_GetTableEntry( *pb++ ^ (unsigned char)ulCrc ) ^ ( ulCrc >> 8 );
+	}
+	CRC32_Final( &ulCrc );
+	return ulCrc;
+}
+
+static unsigned int s_nResult;
+
+static void RunReference( const unsigned char *pBuffer, int nBuffer )
+{
+	s_nResult = ReferenceCRC32( pBuffer, nBuffer );
+}
+
+static void RunCRC32( const unsigned char *pBuffer, int nBuffer )
+{
+	s_nResult = CRC32_ProcessSingleBuffer( pBuffer, nBuffer );
+}
+
+static void RunCRC32Parallel( const unsigned char *pBuffer, int nBuffer )
+{
+	CRC32_t crc;
+	CRC32_Init( &crc );
+	CRC32_ProcessBufferParallel( &crc, pBuffer, nBuffer );
+	CRC32_Final( &crc );
+	s_nResult = crc;
+}
+
+static void RunMD5( const unsigned char *pBuffer, int nBuffer )
+{
+	MD5Value_t md5;
+	MD5_ProcessSingleBuffer( pBuffer, nBuffer, md5 );
+	s_nResult = *(unsigned int *)md5.bits;
+}
+
+static void RunSHA1( const unsigned char *pBuffer, int nBuffer )
+{
+	CSHA1 sha1;
+	sha1.Update( (unsigned char *)pBuffer, nBuffer );
+	sha1.Final();
+	SHADigest_t digest;
+	sha1.GetHash( digest );
+	s_nResult = *(unsigned int *)digest;
+}
+
+static void Time( const char *pName, void (*pfnRun)( const unsigned char *, int ), const unsigned char *pBuffer, int nBuffer, int nReps )
+{
+	// Warm up the caches and the tables
+	pfnRun( pBuffer, MIN( nBuffer, 65536 ) );
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nReps; ++i )
+	{
+		pfnRun( pBuffer, nBuffer );
+	}
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	printf( "%-22s %10.1f MB/s  %08x\n", pName, ( (double)nBuffer * nReps ) / ( 1024.0 * 1024.0 * MAX( flElapsed, 1e-9 ) ), s_nResult );
+}
+
+int main( int argc, char **argv )
+{
+	int nBufferMB = DEFAULT_BUFFER_MB;
+	int nReps = 4;
+	const char *pFileName = NULL;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !Q_stricmp( argv[i], "-mb" ) && i + 1 < argc )
+		{
+			nBufferMB = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-reps" ) && i + 1 < argc )
+		{
+			nReps = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( argv[i][0] == '-' || pFileName )
+		{
+			Usage();
+		}
+		else
+		{
+			pFileName = argv[i];
+		}
+	}
+
+	unsigned char *pBuffer;
+	int nBuffer;
+	if ( pFileName )
+	{
+		FILE *fp = fopen( pFileName, "rb" );
+		if ( !fp )
+		{
+			fprintf( stderr, "Unable to open %s\n", pFileName );
+			return -1;
+		}
+		fseek( fp, 0, SEEK_END );
+		nBuffer = ftell( fp );
+		fseek( fp, 0, SEEK_SET );
+		pBuffer = (unsigned char *)malloc( nBuffer + 1 );
+		if ( (int)fread( pBuffer, 1, nBuffer, fp ) != nBuffer )
+		{
+			fprintf( stderr, "Unable to read %s\n", pFileName );
+			fclose( fp );
+			return -1;
+		}
+		fclose( fp );
+	}
+	else
+	{
+		nBuffer = nBufferMB * 1024 * 1024;
+		pBuffer = (unsigned char *)malloc( nBuffer + 1 );
+		unsigned int nSeed = 0x12345678;
+		for ( int i = 0; i < nBuffer; ++i )
+		{
+			nSeed = nSeed * 1664525 + 1013904223;
+			pBuffer[i] = (unsigned char)( nSeed >> 24 );
+		}
+	}
+
+	printf( "%s: %d bytes, %d reps, %d logical processors, PCLMULQDQ %s\n", pFileName ? pFileName : "random data", nBuffer, nReps,
+		GetCPUInformation()->m_nLogicalProcessors, CheckPCLMULQDQTechnology() ? "yes" : "no" );
+
+	Time( "CRC32 (bytewise)", RunReference, pBuffer, nBuffer, nReps );
+	Time( "CRC32", RunCRC32, pBuffer, nBuffer, nReps );
+	Time( "CRC32 parallel", RunCRC32Parallel, pBuffer, nBuffer, nReps );
+
+	// Misaligned start, to cover the unaligned head/tail handling
+	Time( "CRC32 (bytewise) +1", RunReference, pBuffer + 1, nBuffer, nReps );
+	Time( "CRC32 +1", RunCRC32, pBuffer + 1, nBuffer, nReps );
+
+	Time( "MD5", RunMD5, pBuffer, nBuffer, nReps );
+	Time( "SHA1", RunSHA1, pBuffer, nBuffer, nReps );
+
+	free( pBuffer );
+	return 0;
+}
@@ -0,0 +1,289 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Compares insert/find/erase times of the tier1 associative
+//			containers (CUtlMap, CUtlDict, CUtlHashtable, CUtlFlatHashMap)
+//			on integer keys, entity names and file paths.
+//
+// $NoKeywords: $
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "tier1/utlstring.h"
+#include "tier1/utlmap.h"
+#include "tier1/utldict.h"
+#include "tier1/utlhashtable.h"
+#include "tier1/utlflathashmap.h"
+
+#define DEFAULT_KEY_COUNT	50000
+
+void Usage( void )
+{
+	printf( "Usage: hashmapbench [-n <key count>] [-reps <count>]\n" );
+	exit( -1 );
+}
+
+static unsigned int s_nSeed = 0x12345678;
+
+static unsigned int RandomInt()
+{
+	s_nSeed = s_nSeed * 1664525 + 1013904223;
+	return s_nSeed;
+}
+
+//-----------------------------------------------------------------------------
+// Key sets. Each set has nKeys present keys and nKeys keys that are never
+// inserted, so that lookups measure both hits and misses.
+//-----------------------------------------------------------------------------
+struct KeySet_t
+{
+	CUtlVector< uint32 > m_Ints;
+	CUtlVector< uint32 > m_MissingInts;
+	CUtlVector< const char * > m_Strings;
+	CUtlVector< const char * > m_MissingStrings;
+	CUtlVector< char > m_StringData;
+};
+
+static void AddString( CUtlVector< int > &offsets, CUtlVector< char > &data, const char *pString )
+{
+	int nLen = Q_strlen( pString ) + 1;
+	offsets.AddToTail( data.AddMultipleToTail( nLen, pString ) );
+}
+
+// Entity names as a map would spawn them: a classname or targetname
+// prefix followed by a number, as generated for unnamed entities
+static void BuildEntityNames( KeySet_t &keys, int nKeys )
+{
+	static const char *s_pPrefixes[] =
+	{
+		"npc_combine_s", "prop_physics", "func_door_rotating", "info_node",
+		"env_sprite", "trigger_once", "logic_relay", "ambient_generic",
+		"light_spot", "path_track", "weapon_smg1", "item_healthkit",
+	};
+
+	CUtlVector< int > offsets;
+	char name[256];
+	for ( int i = 0; i < nKeys * 2; ++i )
+	{
+		Q_snprintf( name, sizeof( name ), "%s_%d", s_pPrefixes[ RandomInt() % ARRAYSIZE( s_pPrefixes ) ], i );
+		AddString( offsets, keys.m_StringData, name );
+	}
+	for ( int i = 0; i < offsets.Count(); ++i )
+	{
+		( i & 1 ? keys.m_MissingStrings : keys.m_Strings ).AddToTail( keys.m_StringData.Base() + offsets[i] );
+	}
+}
+
+// Content paths, which share long prefixes and only differ near the end
+static void BuildFilePaths( KeySet_t &keys, int nKeys )
+{
+	static const char *s_pDirs[] =
+	{
+		"models/props_c17", "models/props_junk", "models/humans/group01", "materials/concrete",
+		"materials/metal", "materials/decals/concrete", "sound/ambient/machines", "sound/weapons/smg1",
+	};
+	static const char *s_pExts[] = { "mdl", "vmt", "vtf", "wav" };
+
+	CUtlVector< int > offsets;
+	char name[256];
+	for ( int i = 0; i < nKeys * 2; ++i )
+	{
+		Q_snprintf( name, sizeof( name ), "%s/asset%05d_%c.%s", s_pDirs[ RandomInt() % ARRAYSIZE( s_pDirs ) ],
+			i, 'a' + ( RandomInt() % 26 ), s_pExts[ RandomInt() % ARRAYSIZE( s_pExts ) ] );
+		AddString( offsets, keys.m_StringData, name );
+	}
+	for ( int i = 0; i < offsets.Count(); ++i )
+	{
+		( i & 1 ? keys.m_MissingStrings : keys.m_Strings ).AddToTail( keys.m_StringData.Base() + offsets[i] );
+	}
+}
+
+static void BuildInts( KeySet_t &keys, int nKeys )
+{
+	// Odd keys are present, even keys are missing
+	for ( int i = 0; i < nKeys; ++i )
+	{
+		unsigned int n = RandomInt();
+		keys.m_Ints.AddToTail( n | 1 );
+		keys.m_MissingInts.AddToTail( n & ~1 );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Timing. Every container runs the same sequence: insert all keys, look all
+// of them up, look up the missing keys, then erase everything.
+//-----------------------------------------------------------------------------
+struct BenchResult_t
+{
+	double m_flInsert;
+	double m_flFind;
+	double m_flMiss;
+	double m_flErase;
+	int m_nCheck;
+};
+
+static void PrintResult( const char *pName, const BenchResult_t &result, int nKeys, int nReps )
+{
+	double flScale = 1e9 / ( (double)nKeys * nReps );
+	printf( "  %-34s %8.1f %8.1f %8.1f %8.1f   %d\n", pName, result.m_flInsert * flScale, result.m_flFind * flScale,
+		result.m_flMiss * flScale, result.m_flErase * flScale, result.m_nCheck );
+}
+
+// CUtlMap and CUtlDict: index based, Find() returns InvalidIndex() on a miss
+template < class ContainerT, typename KeyT >
+static void BenchIndexed( ContainerT &container, const CUtlVector< KeyT > &keys, const CUtlVector< KeyT > &missing, BenchResult_t &result )
+{
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		container.Insert( keys[i], i );
+	}
+	double flInserted = Plat_FloatTime();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		result.m_nCheck += container.Find( keys[i] ) != container.InvalidIndex();
+	}
+	double flFound = Plat_FloatTime();
+	for ( int i = 0; i < missing.Count(); ++i )
+	{
+		result.m_nCheck -= container.Find( missing[i] ) != container.InvalidIndex();
+	}
+	double flMissed = Plat_FloatTime();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		container.Remove( keys[i] );
+	}
+	double flErased = Plat_FloatTime();
+
+	result.m_flInsert += flInserted - flStart;
+	result.m_flFind += flFound - flInserted;
+	result.m_flMiss += flMissed - flFound;
+	result.m_flErase += flErased - flMissed;
+}
+
+// CUtlHashtable and CUtlFlatHashMap: handle based, Find() returns InvalidHandle() on a miss
+template < class ContainerT, typename KeyT >
+static void BenchHashed( ContainerT &container, const CUtlVector< KeyT > &keys, const CUtlVector< KeyT > &missing, BenchResult_t &result )
+{
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		container.Insert( keys[i], i );
+	}
+	double flInserted = Plat_FloatTime();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		result.m_nCheck += container.Find( keys[i] ) != container.InvalidHandle();
+	}
+	double flFound = Plat_FloatTime();
+	for ( int i = 0; i < missing.Count(); ++i )
+	{
+		result.m_nCheck -= container.Find( missing[i] ) != container.InvalidHandle();
+	}
+	double flMissed = Plat_FloatTime();
+	for ( int i = 0; i < keys.Count(); ++i )
+	{
+		container.Remove( keys[i] );
+	}
+	double flErased = Plat_FloatTime();
+
+	result.m_flInsert += flInserted - flStart;
+	result.m_flFind += flFound - flInserted;
+	result.m_flMiss += flMissed - flFound;
+	result.m_flErase += flErased - flMissed;
+}
+
+static void RunInts( const KeySet_t &keys, int nReps )
+{
+	int nKeys = keys.m_Ints.Count();
+	printf( "\nints (%d keys)\n", nKeys );
+
+	BenchResult_t mapResult = {}, hashResult = {}, flatResult = {};
+	for ( int r = 0; r < nReps; ++r )
+	{
+		CUtlMap< uint32, int, int > map( DefLessFunc( uint32 ) );
+		BenchIndexed( map, keys.m_Ints, keys.m_MissingInts, mapResult );
+
+		CUtlHashtable< uint32, int > hash;
+		BenchHashed( hash, keys.m_Ints, keys.m_MissingInts, hashResult );
+
+		CUtlFlatHashMap< uint32, int > flat;
+		BenchHashed( flat, keys.m_Ints, keys.m_MissingInts, flatResult );
+	}
+
+	PrintResult( "CUtlMap", mapResult, nKeys, nReps );
+	PrintResult( "CUtlHashtable", hashResult, nKeys, nReps );
+	PrintResult( "CUtlFlatHashMap", flatResult, nKeys, nReps );
+}
+
+static void RunStrings( const char *pName, const KeySet_t &keys, int nReps )
+{
+	int nKeys = keys.m_Strings.Count();
+	printf( "\n%s (%d keys)\n", pName, nKeys );
+
+	BenchResult_t mapResult = {}, dictResult = {}, hashResult = {}, flatResult = {}, flatStringResult = {};
+	for ( int r = 0; r < nReps; ++r )
+	{
+		CUtlMap< const char *, int, int > map( StringLessThan );
+		BenchIndexed( map, keys.m_Strings, keys.m_MissingStrings, mapResult );
+
+		CUtlDict< int, int > dict( k_eDictCompareTypeCaseSensitive );
+		BenchIndexed( dict, keys.m_Strings, keys.m_MissingStrings, dictResult );
+
+		CUtlHashtable< const char *, int > hash;
+		BenchHashed( hash, keys.m_Strings, keys.m_MissingStrings, hashResult );
+
+		CUtlFlatHashMap< const char *, int > flat;
+		BenchHashed( flat, keys.m_Strings, keys.m_MissingStrings, flatResult );
+
+		// Owning keys, found through const char* without temporaries
+		CUtlFlatHashMap< CUtlString, int > flatString;
+		BenchHashed( flatString, keys.m_Strings, keys.m_MissingStrings, flatStringResult );
+	}
+
+	PrintResult( "CUtlMap", mapResult, nKeys, nReps );
+	PrintResult( "CUtlDict (copies keys)", dictResult, nKeys, nReps );
+	PrintResult( "CUtlHashtable", hashResult, nKeys, nReps );
+	PrintResult( "CUtlFlatHashMap", flatResult, nKeys, nReps );
+	PrintResult( "CUtlFlatHashMap<CUtlString>", flatStringResult, nKeys, nReps );
+}
+
+int main( int argc, char **argv )
+{
+	int nKeys = DEFAULT_KEY_COUNT;
+	int nReps = 4;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !Q_stricmp( argv[i], "-n" ) && i + 1 < argc )
+		{
+			nKeys = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-reps" ) && i + 1 < argc )
+		{
+			nReps = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else
+		{
+			Usage();
+		}
+	}
+
+	KeySet_t ints, entityNames, filePaths;
+	BuildInts( ints, nKeys );
+	BuildEntityNames( entityNames, nKeys );
+	BuildFilePaths( filePaths, nKeys );
+
+	printf( "ns per operation, %d reps. Last column is hits minus false hits and should equal the key count times reps.\n", nReps );
+	printf( "  %-34s %8s %8s %8s %8s\n", "", "insert", "find", "miss", "erase" );
+
+	RunInts( ints, nReps );
+	RunStrings( "entity names", entityNames, nReps );
+	RunStrings( "file paths", filePaths, nReps );
+
+	return 0;
+}
@@ -0,0 +1,372 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Measures LZMA decoding of the compressed lumps and game lumps of
+//			.bsp files, or of standalone lzma_header_t / chunked payloads:
+//			whole-buffer CLZMA::Uncompress, CLZMAStream through small input
+//			and output windows, and every payload of a file spread across
+//			threads.
+//
+// $NoKeywords: $
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include "tier0/platform.h"
+#include "tier0/threadtools.h"
+#include "tier1/lzmaDecoder.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "bspfile.h"
+
+#define STREAM_INPUT_SIZE	( 16 * 1024 )
+#define STREAM_OUTPUT_SIZE	( 64 * 1024 )
+#define MAX_THREADS			32
+
+void Usage( void )
+{
+	printf( "Usage: lzmabench [-reps <count>] [-threads <count>] <file.bsp | file.lzma> ...\n" );
+	exit( -1 );
+}
+
+struct Payload_t
+{
+	unsigned char *m_pData;
+	unsigned int m_nCompressedSize;
+	unsigned int m_nActualSize;
+	unsigned char *m_pOutput;
+};
+
+static void AddPayload( CUtlVector< Payload_t > &payloads, unsigned char *pData, unsigned int nAvailable )
+{
+	CLZMA lzma;
+	if ( nAvailable < sizeof( lzma_header_t ) || !lzma.IsCompressed( pData ) || !lzma.GetActualSize( pData ) )
+		return;
+
+	Payload_t &payload = payloads[ payloads.AddToTail() ];
+	payload.m_pData = pData;
+	payload.m_nCompressedSize = nAvailable;
+	payload.m_nActualSize = lzma.GetActualSize( pData );
+	payload.m_pOutput = (unsigned char *)malloc( payload.m_nActualSize );
+}
+
+// Compressed map lumps start with an lzma_header_t, compressed game lumps
+// (static props, detail props) are flagged in the game lump directory
+static void CollectPayloads( CUtlVector< Payload_t > &payloads, unsigned char *pFile, unsigned int nFile )
+{
+	dheader_t *pHeader = (dheader_t *)pFile;
+	if ( nFile < sizeof( dheader_t ) || LittleLong( pHeader->ident ) != IDBSPHEADER )
+	{
+		AddPayload( payloads, pFile, nFile );
+		return;
+	}
+
+	for ( int i = 0; i < HEADER_LUMPS; ++i )
+	{
+		unsigned int nOffset = LittleLong( pHeader->lumps[i].fileofs );
+		unsigned int nLength = LittleLong( pHeader->lumps[i].filelen );
+		if ( !nLength || nOffset > nFile || nLength > nFile - nOffset )
+			continue;
+
+		if ( i == LUMP_GAME_LUMP )
+		{
+			dgamelumpheader_t *pGameLumps = (dgamelumpheader_t *)( pFile + nOffset );
+			dgamelump_t *pGameLump = (dgamelump_t *)( pGameLumps + 1 );
+			int nGameLumps = LittleLong( pGameLumps->lumpCount );
+			for ( int j = 0; j < nGameLumps && (unsigned char *)( pGameLump + j + 1 ) <= pFile + nFile; ++j )
+			{
+				unsigned int nGameOffset = LittleLong( pGameLump[j].fileofs );
+				unsigned int nGameLength = LittleLong( pGameLump[j].filelen );
+				if ( !( LittleShort( pGameLump[j].flags ) & GAMELUMPFLAG_COMPRESSED ) || nGameOffset > nFile || nGameLength > nFile - nGameOffset )
+					continue;
+
+				AddPayload( payloads, pFile + nGameOffset, nGameLength );
+			}
+			continue;
+		}
+
+		AddPayload( payloads, pFile + nOffset, nLength );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Decoders under test
+//-----------------------------------------------------------------------------
+static bool RunUncompress( CUtlVector< Payload_t > &payloads )
+{
+	CLZMA lzma;
+	bool bOk = true;
+	for ( int i = 0; i < payloads.Count(); ++i )
+	{
+		bOk &= lzma.Uncompress( payloads[i].m_pData, payloads[i].m_pOutput ) == payloads[i].m_nActualSize;
+	}
+	return bOk;
+}
+
+// Feeds STREAM_INPUT_SIZE pieces and drains STREAM_OUTPUT_SIZE windows, as
+// a loader reading from disk into a fixed buffer would. With bVerify each
+// window is compared against the Uncompress output.
+static bool RunStream( CUtlVector< Payload_t > &payloads, bool bVerify )
+{
+	static unsigned char s_Window[STREAM_OUTPUT_SIZE];
+	CLZMA lzma;
+	CLZMAStream stream;
+	bool bOk = true;
+	for ( int i = 0; i < payloads.Count(); ++i )
+	{
+		const Payload_t &payload = payloads[i];
+		if ( lzma.IsChunked( payload.m_pData ) )
+			continue;
+
+		stream.Reset();
+		unsigned int nInput = 0;
+		unsigned int nOutput = 0;
+		while ( !stream.IsFinished() )
+		{
+			unsigned int nRead, nWritten;
+			unsigned int nInputSize = MIN( payload.m_nCompressedSize - nInput, STREAM_INPUT_SIZE );
+			if ( !stream.Read( payload.m_pData + nInput, nInputSize, s_Window, sizeof( s_Window ), nRead, nWritten ) ||
+				( !nRead && !nWritten ) )
+			{
+				bOk = false;
+				break;
+			}
+
+			if ( bVerify && memcmp( s_Window, payload.m_pOutput + nOutput, nWritten ) )
+			{
+				bOk = false;
+			}
+			nInput += nRead;
+			nOutput += nWritten;
+		}
+	}
+	return bOk;
+}
+
+struct ParallelWork_t
+{
+	Payload_t *m_pPayload;
+	unsigned int m_nChunk;
+};
+
+struct ParallelJob_t
+{
+	CUtlVector< ParallelWork_t > m_Work;
+	long volatile m_nNext;
+	bool m_bFailed;
+};
+
+static unsigned ParallelThread( void *pParam )
+{
+	ParallelJob_t *pJob = (ParallelJob_t *)pParam;
+	CLZMA lzma;
+	while ( true )
+	{
+		int i = ThreadInterlockedIncrement( &pJob->m_nNext ) - 1;
+		if ( i >= pJob->m_Work.Count() )
+			break;
+
+		const ParallelWork_t &work = pJob->m_Work[i];
+		if ( !lzma.UncompressChunk( work.m_pPayload->m_pData, work.m_nChunk, work.m_pPayload->m_pOutput ) )
+		{
+			pJob->m_bFailed = true;
+		}
+	}
+	return 0;
+}
+
+// Every chunk of every payload is an independent work item, largest first
+// so that the big lumps don't end up last on a single thread
+static int __cdecl ParallelWorkLessFunc( const ParallelWork_t *pLeft, const ParallelWork_t *pRight )
+{
+	return (int)pRight->m_pPayload->m_nActualSize - (int)pLeft->m_pPayload->m_nActualSize;
+}
+
+static bool RunParallel( CUtlVector< Payload_t > &payloads, int nThreads )
+{
+	CLZMA lzma;
+	ParallelJob_t job;
+	for ( int i = 0; i < payloads.Count(); ++i )
+	{
+		unsigned int nChunks = lzma.GetNumChunks( payloads[i].m_pData );
+		for ( unsigned int j = 0; j < nChunks; ++j )
+		{
+			ParallelWork_t &work = job.m_Work[ job.m_Work.AddToTail() ];
+			work.m_pPayload = &payloads[i];
+			work.m_nChunk = j;
+		}
+	}
+	job.m_Work.Sort( ParallelWorkLessFunc );
+	job.m_nNext = 0;
+	job.m_bFailed = false;
+
+	ThreadHandle_t hThreads[MAX_THREADS];
+	for ( int i = 1; i < nThreads; ++i )
+	{
+		hThreads[i] = CreateSimpleThread( ParallelThread, &job );
+	}
+	ParallelThread( &job );
+	for ( int i = 1; i < nThreads; ++i )
+	{
+		if ( hThreads[i] )
+		{
+			ThreadJoin( hThreads[i] );
+			ReleaseThreadHandle( hThreads[i] );
+		}
+	}
+	return !job.m_bFailed;
+}
+
+//-----------------------------------------------------------------------------
+// Timing
+//-----------------------------------------------------------------------------
+static void PrintTime( const char *pName, double flElapsed, unsigned int nActualBytes, int nReps, bool bOk )
+{
+	double flMilliseconds = flElapsed * 1000.0 / nReps;
+	printf( "  %-28s %9.2f ms %8.1f MB/s  %s\n", pName, flMilliseconds,
+		( (double)nActualBytes * nReps ) / ( 1024.0 * 1024.0 * MAX( flElapsed, 1e-9 ) ), bOk ? "ok" : "FAILED" );
+}
+
+static bool BenchFile( const char *pFileName, int nReps, int nThreads )
+{
+	FILE *fp = fopen( pFileName, "rb" );
+	if ( !fp )
+	{
+		fprintf( stderr, "Unable to open %s\n", pFileName );
+		return false;
+	}
+	fseek( fp, 0, SEEK_END );
+	unsigned int nFile = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+	unsigned char *pFile = (unsigned char *)malloc( nFile + 1 );
+	if ( fread( pFile, 1, nFile, fp ) != nFile )
+	{
+		fprintf( stderr, "Unable to read %s\n", pFileName );
+		fclose( fp );
+		free( pFile );
+		return false;
+	}
+	fclose( fp );
+
+	CUtlVector< Payload_t > payloads;
+	CollectPayloads( payloads, pFile, nFile );
+
+	CLZMA lzma;
+	unsigned int nCompressed = 0, nActual = 0, nStreamed = 0, nChunks = 0, nLargestWindow = 0;
+	for ( int i = 0; i < payloads.Count(); ++i )
+	{
+		lzma_header_t *pHeader = (lzma_header_t *)payloads[i].m_pData;
+		nCompressed += payloads[i].m_nCompressedSize;
+		nActual += payloads[i].m_nActualSize;
+		nChunks += lzma.GetNumChunks( payloads[i].m_pData );
+		if ( !lzma.IsChunked( payloads[i].m_pData ) )
+		{
+			nStreamed += payloads[i].m_nActualSize;
+
+			// What CLZMAStream keeps resident instead of the whole output
+			unsigned int nDictionary = pHeader->properties[1] | ( pHeader->properties[2] << 8 ) | ( pHeader->properties[3] << 16 ) | ( pHeader->properties[4] << 24 );
+			nLargestWindow = MAX( nLargestWindow, MIN( nDictionary, payloads[i].m_nActualSize ) );
+		}
+	}
+
+	printf( "\n%s: %d compressed payloads in %u chunks, %u -> %u bytes, largest stream dictionary %u bytes\n",
+		pFileName, payloads.Count(), nChunks, nCompressed, nActual, nLargestWindow );
+	if ( !payloads.Count() )
+	{
+		free( pFile );
+		return true;
+	}
+
+	// One untimed pass to warm up and to produce the reference output
+	bool bReference = RunUncompress( payloads );
+
+	double flStart = Plat_FloatTime();
+	bool bOk = bReference;
+	for ( int r = 0; r < nReps; ++r )
+	{
+		bOk &= RunUncompress( payloads );
+	}
+	PrintTime( "Uncompress", Plat_FloatTime() - flStart, nActual, nReps, bOk );
+
+	// Chunked payloads are skipped, CLZMAStream reads single streams
+	if ( nStreamed )
+	{
+		bOk = RunStream( payloads, true );
+		flStart = Plat_FloatTime();
+		for ( int r = 0; r < nReps; ++r )
+		{
+			bOk &= RunStream( payloads, false );
+		}
+		PrintTime( "CLZMAStream 16K in/64K out", Plat_FloatTime() - flStart, nStreamed, nReps, bOk );
+	}
+
+	// Decode into fresh buffers and compare, then time
+	CUtlVector< unsigned char * > reference;
+	for ( int i = 0; i < payloads.Count(); ++i )
+	{
+		reference.AddToTail( payloads[i].m_pOutput );
+		payloads[i].m_pOutput = (unsigned char *)malloc( payloads[i].m_nActualSize );
+	}
+	bOk = RunParallel( payloads, nThreads );
+	for ( int i = 0; i < payloads.Count(); ++i )
+	{
+		bOk &= !memcmp( reference[i], payloads[i].m_pOutput, payloads[i].m_nActualSize );
+		free( reference[i] );
+	}
+	flStart = Plat_FloatTime();
+	for ( int r = 0; r < nReps; ++r )
+	{
+		bOk &= RunParallel( payloads, nThreads );
+	}
+	char name[64];
+	V_snprintf( name, sizeof( name ), "all payloads, %d threads", nThreads );
+	PrintTime( name, Plat_FloatTime() - flStart, nActual, nReps, bOk );
+
+	for ( int i = 0; i < payloads.Count(); ++i )
+	{
+		free( payloads[i].m_pOutput );
+	}
+	free( pFile );
+	return true;
+}
+
+int main( int argc, char **argv )
+{
+	int nReps = 4;
+	int nThreads = GetCPUInformation()->m_nLogicalProcessors;
+	CUtlVector< const char * > files;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !Q_stricmp( argv[i], "-reps" ) && i + 1 < argc )
+		{
+			nReps = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-threads" ) && i + 1 < argc )
+		{
+			nThreads = atoi( argv[i + 1] );
+			++i;
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			Usage();
+		}
+		else
+		{
+			files.AddToTail( argv[i] );
+		}
+	}
+	if ( !files.Count() )
+	{
+		Usage();
+	}
+	nThreads = clamp( nThreads, 1, MAX_THREADS );
+
+	printf( "%d reps, %d logical processors\n", nReps, GetCPUInformation()->m_nLogicalProcessors );
+
+	bool bOk = true;
+	for ( int i = 0; i < files.Count(); ++i )
+	{
+		bOk &= BenchFile( files[i], nReps, nThreads );
+	}
+	return bOk ? 0 : -1;
+}
@@ -0,0 +1,347 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Times GeneratePolyhedronFromPlanes() and ClipPolyhedron() on
+//			random plane sets, and checks that the shapes they build are
+//			closed.
+//
+// $NoKeywords: $
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/vector.h"
+#include "mathlib/polyhedron.h"
+
+#define DEFAULT_SHAPE_COUNT		2000
+#define ON_PLANE_EPSILON		0.01f
+#define SHORT_LINE_LENGTH		0.01f
+
+void Usage( void )
+{
+	printf( "Usage: polyhedronbench [-n <shape count>] [-reps <count>] [-seed <seed>]\n" );
+	exit( -1 );
+}
+
+static unsigned int s_nSeed = 0x12345678;
+
+static unsigned int RandomInt()
+{
+	s_nSeed = s_nSeed * 1664525 + 1013904223;
+	return s_nSeed >> 8;
+}
+
+static float RandomFloat( float flMin, float flMax )
+{
+	return flMin + ( flMax - flMin ) * ( RandomInt() & 0xffff ) * ( 1.0f / 65535.0f );
+}
+
+static Vector RandomDirection()
+{
+	Vector vDir;
+	do
+	{
+		vDir.Init( RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ) );
+	} while ( vDir.LengthSqr() < 0.01f || vDir.LengthSqr() > 1.0f );
+	VectorNormalize( vDir );
+	return vDir;
+}
+
+static void AddPlane( CUtlVector< float > &planes, const Vector &vNormal, float flDist )
+{
+	planes.AddToTail( vNormal.x );
+	planes.AddToTail( vNormal.y );
+	planes.AddToTail( vNormal.z );
+	planes.AddToTail( flDist );
+}
+
+//-----------------------------------------------------------------------------
+// Plane sets. Each test is a set of outward facing planes for
+// GeneratePolyhedronFromPlanes() and a second set to clip the result with.
+//-----------------------------------------------------------------------------
+struct PlaneTest_t
+{
+	CUtlVector< float > m_Planes;
+	CUtlVector< float > m_ClipPlanes;
+};
+
+// Planes tangent to a sphere, like an occluder or a rounded trigger volume
+static void BuildSphereTest( PlaneTest_t &test )
+{
+	float flRadius = RandomFloat( 16.0f, 512.0f );
+	int nPlanes = 4 + ( RandomInt() % 40 );
+	for ( int i = 0; i < nPlanes; ++i )
+	{
+		AddPlane( test.m_Planes, RandomDirection(), flRadius );
+	}
+}
+
+// Brushes: an axial box with a few bevels, all on integer coordinates, so
+// that planes regularly pass exactly through existing points and lines
+static void BuildBrushTest( PlaneTest_t &test )
+{
+	Vector vMins( (float)( RandomInt() % 256 ) - 256.0f, (float)( RandomInt() % 256 ) - 256.0f, (float)( RandomInt() % 256 ) - 256.0f );
+	Vector vMaxs( (float)( RandomInt() % 256 ) + 1.0f, (float)( RandomInt() % 256 ) + 1.0f, (float)( RandomInt() % 256 ) + 1.0f );
+	for ( int i = 0; i < 3; ++i )
+	{
+		Vector vNormal( 0.0f, 0.0f, 0.0f );
+		vNormal[i] = 1.0f;
+		AddPlane( test.m_Planes, vNormal, vMaxs[i] );
+		vNormal[i] = -1.0f;
+		AddPlane( test.m_Planes, vNormal, -vMins[i] );
+	}
+
+	int nBevels = RandomInt() % 6;
+	for ( int i = 0; i < nBevels; ++i )
+	{
+		// 45 degree bevel through a corner of the box or a point on one of its edges
+		int iAxis = RandomInt() % 3;
+		Vector vNormal( 0.0f, 0.0f, 0.0f );
+		vNormal[iAxis] = ( RandomInt() & 1 ) ? 1.0f : -1.0f;
+		vNormal[( iAxis + 1 ) % 3] = ( RandomInt() & 1 ) ? 1.0f : -1.0f;
+		VectorNormalize( vNormal );
+
+		Vector vCorner( ( RandomInt() & 1 ) ? vMins.x : vMaxs.x, ( RandomInt() & 1 ) ? vMins.y : vMaxs.y, ( RandomInt() & 1 ) ? vMins.z : vMaxs.z );
+		vCorner = vCorner * 0.75f;
+		AddPlane( test.m_Planes, vNormal, DotProduct( vNormal, vCorner ) );
+	}
+}
+
+// Clip planes through random points of the generated shape, some of them exactly through its vertices
+static void BuildClipPlanes( PlaneTest_t &test, const CPolyhedron *pPolyhedron )
+{
+	Vector vCenter = const_cast< CPolyhedron * >( pPolyhedron )->Center();
+	int nPlanes = 1 + ( RandomInt() % 6 );
+	for ( int i = 0; i < nPlanes; ++i )
+	{
+		Vector vNormal = RandomDirection();
+		Vector vPoint;
+		if ( RandomInt() & 1 )
+		{
+			vPoint = pPolyhedron->pVertices[ RandomInt() % pPolyhedron->iVertexCount ];
+		}
+		else
+		{
+			const Vector &vVertex = pPolyhedron->pVertices[ RandomInt() % pPolyhedron->iVertexCount ];
+			vPoint = vCenter + ( vVertex - vCenter ) * RandomFloat( 0.1f, 0.9f );
+		}
+		AddPlane( test.m_ClipPlanes, vNormal, DotProduct( vNormal, vPoint ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Checks that every polygon is a closed loop of lines and that every line is
+// used once in each direction
+//-----------------------------------------------------------------------------
+static bool IsClosed( const CPolyhedron *pPolyhedron )
+{
+	CUtlVector< int > lineUses;
+	lineUses.SetCount( pPolyhedron->iLineCount * 2 );
+	memset( lineUses.Base(), 0, lineUses.Count() * sizeof( int ) );
+
+	for ( int i = 0; i < pPolyhedron->iPolygonCount; ++i )
+	{
+		const Polyhedron_IndexedPolygon_t &polygon = pPolyhedron->pPolygons[i];
+
+		int iPrevEnd = -1;
+		int iFirstStart = -1;
+		for ( int j = 0; j < polygon.iIndexCount; ++j )
+		{
+			const Polyhedron_IndexedLineReference_t &lineRef = pPolyhedron->pIndices[ polygon.iFirstIndex + j ];
+			const Polyhedron_IndexedLine_t &line = pPolyhedron->pLines[ lineRef.iLineIndex ];
+			++lineUses[ lineRef.iLineIndex * 2 + lineRef.iEndPointIndex ];
+
+			int iStart = line.iPointIndices[ 1 - lineRef.iEndPointIndex ];
+			if ( iPrevEnd != -1 && iPrevEnd != iStart )
+				return false;
+			if ( iFirstStart == -1 )
+			{
+				iFirstStart = iStart;
+			}
+			iPrevEnd = line.iPointIndices[ lineRef.iEndPointIndex ];
+		}
+
+		if ( iPrevEnd != iFirstStart )
+			return false;
+	}
+
+	for ( int i = 0; i < lineUses.Count(); ++i )
+	{
+		if ( lineUses[i] != 1 )
+			return false;
+	}
+	return true;
+}
+
+// The clipper can cut the same line twice from its two polygons and leave a
+// (nearly) zero length line between the two copies of the point
+static bool HasShortLine( const CPolyhedron *pPolyhedron )
+{
+	for ( int i = 0; i < pPolyhedron->iLineCount; ++i )
+	{
+		const Polyhedron_IndexedLine_t &line = pPolyhedron->pLines[i];
+		if ( VectorsAreEqual( pPolyhedron->pVertices[ line.iPointIndices[0] ], pPolyhedron->pVertices[ line.iPointIndices[1] ], SHORT_LINE_LENGTH ) )
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Runs every test, checking results on the first rep
+//-----------------------------------------------------------------------------
+struct BenchResult_t
+{
+	double m_flTime;
+	int m_nInvalid;
+	int m_nShortLines;
+	int m_nEmpty;
+};
+
+static void PrintResult( const char *pName, const BenchResult_t &result, int nShapes, int nReps )
+{
+	double flScale = 1e6 / ( (double)nShapes * nReps );
+	printf( "  %-28s %8.2f   invalid %d  short lines %d  empty %d\n", pName,
+		result.m_flTime * flScale, result.m_nInvalid, result.m_nShortLines, result.m_nEmpty );
+}
+
+static CPolyhedron *Generate( const PlaneTest_t &test, bool bUseTemporaryMemory )
+{
+	return GeneratePolyhedronFromPlanes( test.m_Planes.Base(), test.m_Planes.Count() / 4, ON_PLANE_EPSILON, bUseTemporaryMemory );
+}
+
+static CPolyhedron *Clip( const PlaneTest_t &test, const CPolyhedron *pSource, bool bUseTemporaryMemory )
+{
+	return ClipPolyhedron( pSource, test.m_ClipPlanes.Base(), test.m_ClipPlanes.Count() / 4, ON_PLANE_EPSILON, bUseTemporaryMemory );
+}
+
+static void CheckResult( const CPolyhedron *pPolyhedron, BenchResult_t &result )
+{
+	if ( !pPolyhedron )
+	{
+		++result.m_nEmpty;
+		return;
+	}
+
+	result.m_nInvalid += !IsClosed( pPolyhedron );
+	result.m_nShortLines += HasShortLine( pPolyhedron );
+}
+
+static void RunTests( const char *pName, CUtlVector< PlaneTest_t > &tests, CUtlVector< CPolyhedron * > &sources, int nReps )
+{
+	BenchResult_t generateResult = {}, clipResult = {};
+
+	for ( int i = 0; i < tests.Count(); ++i )
+	{
+		CPolyhedron *pSource = Generate( tests[i], false );
+		CheckResult( pSource, generateResult );
+
+		sources.AddToTail( pSource );
+		if ( pSource )
+		{
+			BuildClipPlanes( tests[i], pSource );
+			CPolyhedron *pClipped = Clip( tests[i], pSource, false );
+			CheckResult( pClipped, clipResult );
+			if ( pClipped )
+			{
+				pClipped->Release();
+			}
+		}
+	}
+
+	double flStart = Plat_FloatTime();
+	for ( int r = 0; r < nReps; ++r )
+	{
+		for ( int i = 0; i < tests.Count(); ++i )
+		{
+			CPolyhedron *pPolyhedron = Generate( tests[i], true );
+			if ( pPolyhedron )
+			{
+				pPolyhedron->Release();
+			}
+		}
+	}
+	double flGenerated = Plat_FloatTime();
+	for ( int r = 0; r < nReps; ++r )
+	{
+		for ( int i = 0; i < tests.Count(); ++i )
+		{
+			if ( !sources[i] )
+				continue;
+
+			CPolyhedron *pPolyhedron = Clip( tests[i], sources[i], true );
+			if ( pPolyhedron )
+			{
+				pPolyhedron->Release();
+			}
+		}
+	}
+	double flClipped = Plat_FloatTime();
+
+	generateResult.m_flTime = flGenerated - flStart;
+	clipResult.m_flTime = flClipped - flGenerated;
+
+	printf( "\n%s (%d shapes)\n", pName, tests.Count() );
+	PrintResult( "GeneratePolyhedronFromPlanes", generateResult, tests.Count(), nReps );
+	PrintResult( "ClipPolyhedron", clipResult, tests.Count(), nReps );
+
+	for ( int i = 0; i < sources.Count(); ++i )
+	{
+		if ( sources[i] )
+		{
+			sources[i]->Release();
+		}
+	}
+	sources.RemoveAll();
+}
+
+int main( int argc, char **argv )
+{
+	int nShapes = DEFAULT_SHAPE_COUNT;
+	int nReps = 4;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !Q_stricmp( argv[i], "-n" ) && i + 1 < argc )
+		{
+			nShapes = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-reps" ) && i + 1 < argc )
+		{
+			nReps = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-seed" ) && i + 1 < argc )
+		{
+			s_nSeed = (unsigned int)atoi( argv[i + 1] );
+			++i;
+		}
+		else
+		{
+			Usage();
+		}
+	}
+
+	MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
+
+	CUtlVector< PlaneTest_t > sphereTests, brushTests;
+	sphereTests.SetCount( nShapes );
+	brushTests.SetCount( nShapes );
+	for ( int i = 0; i < nShapes; ++i )
+	{
+		BuildSphereTest( sphereTests[i] );
+		BuildBrushTest( brushTests[i] );
+	}
+
+	printf( "us per call, %d reps. \"invalid\" counts shapes that aren't closed, \"short lines\" counts\n", nReps );
+	printf( "shapes with a line shorter than %.2f units.\n", SHORT_LINE_LENGTH );
+
+	CUtlVector< CPolyhedron * > sources;
+	RunTests( "spheres", sphereTests, sources, nReps );
+	RunTests( "brushes", brushTests, sources, nReps );
+
+	return 0;
+}
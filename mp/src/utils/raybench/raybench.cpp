@@ -0,0 +1,273 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Measures ray vs. box throughput of the scalar collisionutils
+//			queries against the batched SIMD ones (one ray vs. many boxes,
+//			many rays vs. one box, one ray vs. many OBBs), and checks that
+//			both return the same results.
+//
+// $NoKeywords: $
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "tier0/platform.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/vector.h"
+#include "collisionutils.h"
+
+#define DEFAULT_BOX_COUNT	64
+#define DEFAULT_RAY_COUNT	4096
+
+void Usage( void )
+{
+	printf( "Usage: raybench [-boxes <count>] [-rays <count>] [-reps <count>]\n" );
+	exit( -1 );
+}
+
+static unsigned int s_nSeed = 0x12345678;
+
+static unsigned int RandomInt()
+{
+	s_nSeed = s_nSeed * 1664525 + 1013904223;
+	return s_nSeed >> 8;
+}
+
+static float RandomFloat( float flMin, float flMax )
+{
+	return flMin + ( flMax - flMin ) * ( RandomInt() & 0xffff ) * ( 1.0f / 65535.0f );
+}
+
+static Vector RandomVectorInBox( float flMin, float flMax )
+{
+	return Vector( RandomFloat( flMin, flMax ), RandomFloat( flMin, flMax ), RandomFloat( flMin, flMax ) );
+}
+
+//-----------------------------------------------------------------------------
+// Scene: boxes sized like hitboxes scattered around a player sized volume,
+// and rays of bullet length fired through it from outside, so that most
+// rays touch a few boxes and miss the rest.
+//-----------------------------------------------------------------------------
+struct Scene_t
+{
+	CUtlVector< Vector > m_BoxMins;
+	CUtlVector< Vector > m_BoxMaxs;
+	CUtlVector< matrix3x4_t > m_Bones;
+	CUtlVector< const matrix3x4_t * > m_BonePtrs;
+	CUtlVector< Vector > m_RayStarts;
+	CUtlVector< Vector > m_RayDeltas;
+};
+
+static void BuildScene( Scene_t &scene, int nBoxes, int nRays )
+{
+	for ( int i = 0; i < nBoxes; ++i )
+	{
+		Vector vecCenter = RandomVectorInBox( -32.0f, 32.0f );
+		Vector vecHalf = RandomVectorInBox( 2.0f, 8.0f );
+		scene.m_BoxMins.AddToTail( vecCenter - vecHalf );
+		scene.m_BoxMaxs.AddToTail( vecCenter + vecHalf );
+
+		QAngle angles( RandomFloat( -180.0f, 180.0f ), RandomFloat( -180.0f, 180.0f ), RandomFloat( -180.0f, 180.0f ) );
+		matrix3x4_t &bone = scene.m_Bones[ scene.m_Bones.AddToTail() ];
+		AngleMatrix( angles, RandomVectorInBox( -32.0f, 32.0f ), bone );
+	}
+	for ( int i = 0; i < nBoxes; ++i )
+	{
+		scene.m_BonePtrs.AddToTail( &scene.m_Bones[i] );
+	}
+
+	for ( int i = 0; i < nRays; ++i )
+	{
+		Vector vecDir = RandomVectorInBox( -1.0f, 1.0f );
+		VectorNormalize( vecDir );
+		Vector vecStart = RandomVectorInBox( -16.0f, 16.0f ) - vecDir * 128.0f;
+		scene.m_RayStarts.AddToTail( vecStart );
+		scene.m_RayDeltas.AddToTail( vecDir * 256.0f );
+	}
+}
+
+static bool ResultsMatch( const BoxTraceInfo_t &a, bool bHit, const BoxTraceInfo_t &b, const uint32 *pHitMask, int nIndex )
+{
+	bool bBatchHit = ( pHitMask[nIndex >> 5] & ( 1 << ( nIndex & 31 ) ) ) != 0;
+	return bHit == bBatchHit && a.t1 == b.t1 && a.t2 == b.t2 && a.hitside == b.hitside && a.startsolid == b.startsolid;
+}
+
+static void PrintResult( const char *pName, double flScalar, double flBatch, double flTests, int nScalarHits, int nBatchHits, int nMismatches )
+{
+	printf( "  %-22s %8.1f %8.1f  %5.2fx   hits %d/%d  mismatches %d\n", pName,
+		flTests / flScalar * 1e-6, flTests / flBatch * 1e-6, flScalar / flBatch, nScalarHits, nBatchHits, nMismatches );
+}
+
+//-----------------------------------------------------------------------------
+// One ray against every box
+//-----------------------------------------------------------------------------
+static void RunRayVsBoxes( const Scene_t &scene, int nReps )
+{
+	int nBoxes = scene.m_BoxMins.Count();
+	int nRays = scene.m_RayStarts.Count();
+	CUtlVector< BoxTraceInfo_t > scalarTraces, batchTraces;
+	CUtlVector< bool > scalarHits;
+	CUtlVector< uint32 > hitMask;
+	scalarTraces.SetCount( nBoxes );
+	batchTraces.SetCount( nBoxes );
+	scalarHits.SetCount( nBoxes );
+	hitMask.SetCount( ( nBoxes + 31 ) / 32 );
+
+	int nScalarHits = 0, nBatchHits = 0, nMismatches = 0;
+	double flScalar = 0.0, flBatch = 0.0;
+	for ( int r = 0; r < nReps; ++r )
+	{
+		for ( int i = 0; i < nRays; ++i )
+		{
+			double flStart = Plat_FloatTime();
+			for ( int j = 0; j < nBoxes; ++j )
+			{
+				scalarHits[j] = IntersectRayWithBox( scene.m_RayStarts[i], scene.m_RayDeltas[i], scene.m_BoxMins[j], scene.m_BoxMaxs[j], 0.0f, &scalarTraces[j] );
+				nScalarHits += scalarHits[j];
+			}
+			double flMid = Plat_FloatTime();
+			nBatchHits += IntersectRayWithBoxes( scene.m_RayStarts[i], scene.m_RayDeltas[i], scene.m_BoxMins.Base(), scene.m_BoxMaxs.Base(), nBoxes, 0.0f, batchTraces.Base(), hitMask.Base() );
+			double flEnd = Plat_FloatTime();
+			flScalar += flMid - flStart;
+			flBatch += flEnd - flMid;
+
+			for ( int j = 0; j < nBoxes; ++j )
+			{
+				nMismatches += !ResultsMatch( scalarTraces[j], scalarHits[j], batchTraces[j], hitMask.Base(), j );
+			}
+		}
+	}
+
+	PrintResult( "1 ray vs N boxes", flScalar, flBatch, (double)nBoxes * nRays * nReps, nScalarHits, nBatchHits, nMismatches );
+}
+
+//-----------------------------------------------------------------------------
+// Every ray against one box at a time
+//-----------------------------------------------------------------------------
+static void RunRaysVsBox( const Scene_t &scene, int nReps )
+{
+	int nBoxes = scene.m_BoxMins.Count();
+	int nRays = scene.m_RayStarts.Count();
+	CUtlVector< BoxTraceInfo_t > scalarTraces, batchTraces;
+	CUtlVector< bool > scalarHits;
+	CUtlVector< uint32 > hitMask;
+	scalarTraces.SetCount( nRays );
+	batchTraces.SetCount( nRays );
+	scalarHits.SetCount( nRays );
+	hitMask.SetCount( ( nRays + 31 ) / 32 );
+
+	int nScalarHits = 0, nBatchHits = 0, nMismatches = 0;
+	double flScalar = 0.0, flBatch = 0.0;
+	for ( int r = 0; r < nReps; ++r )
+	{
+		for ( int j = 0; j < nBoxes; ++j )
+		{
+			double flStart = Plat_FloatTime();
+			for ( int i = 0; i < nRays; ++i )
+			{
+				scalarHits[i] = IntersectRayWithBox( scene.m_RayStarts[i], scene.m_RayDeltas[i], scene.m_BoxMins[j], scene.m_BoxMaxs[j], 0.0f, &scalarTraces[i] );
+				nScalarHits += scalarHits[i];
+			}
+			double flMid = Plat_FloatTime();
+			nBatchHits += IntersectRaysWithBox( scene.m_RayStarts.Base(), scene.m_RayDeltas.Base(), nRays, scene.m_BoxMins[j], scene.m_BoxMaxs[j], 0.0f, batchTraces.Base(), hitMask.Base() );
+			double flEnd = Plat_FloatTime();
+			flScalar += flMid - flStart;
+			flBatch += flEnd - flMid;
+
+			for ( int i = 0; i < nRays; ++i )
+			{
+				nMismatches += !ResultsMatch( scalarTraces[i], scalarHits[i], batchTraces[i], hitMask.Base(), i );
+			}
+		}
+	}
+
+	PrintResult( "N rays vs 1 box", flScalar, flBatch, (double)nBoxes * nRays * nReps, nScalarHits, nBatchHits, nMismatches );
+}
+
+//-----------------------------------------------------------------------------
+// One ray against every box, each box in the space of its own bone
+//-----------------------------------------------------------------------------
+static void RunRayVsOBBs( const Scene_t &scene, int nReps )
+{
+	int nBoxes = scene.m_BoxMins.Count();
+	int nRays = scene.m_RayStarts.Count();
+	CUtlVector< BoxTraceInfo_t > scalarTraces, batchTraces;
+	CUtlVector< bool > scalarHits;
+	CUtlVector< uint32 > hitMask;
+	scalarTraces.SetCount( nBoxes );
+	batchTraces.SetCount( nBoxes );
+	scalarHits.SetCount( nBoxes );
+	hitMask.SetCount( ( nBoxes + 31 ) / 32 );
+
+	int nScalarHits = 0, nBatchHits = 0, nMismatches = 0;
+	double flScalar = 0.0, flBatch = 0.0;
+	for ( int r = 0; r < nReps; ++r )
+	{
+		for ( int i = 0; i < nRays; ++i )
+		{
+			double flStart = Plat_FloatTime();
+			for ( int j = 0; j < nBoxes; ++j )
+			{
+				scalarHits[j] = IntersectRayWithOBB( scene.m_RayStarts[i], scene.m_RayDeltas[i], scene.m_Bones[j], scene.m_BoxMins[j], scene.m_BoxMaxs[j], 0.0f, &scalarTraces[j] );
+				nScalarHits += scalarHits[j];
+			}
+			double flMid = Plat_FloatTime();
+			nBatchHits += IntersectRayWithOBBs( scene.m_RayStarts[i], scene.m_RayDeltas[i], scene.m_BonePtrs.Base(), scene.m_BoxMins.Base(), scene.m_BoxMaxs.Base(), nBoxes, 0.0f, batchTraces.Base(), hitMask.Base() );
+			double flEnd = Plat_FloatTime();
+			flScalar += flMid - flStart;
+			flBatch += flEnd - flMid;
+
+			for ( int j = 0; j < nBoxes; ++j )
+			{
+				nMismatches += !ResultsMatch( scalarTraces[j], scalarHits[j], batchTraces[j], hitMask.Base(), j );
+			}
+		}
+	}
+
+	PrintResult( "1 ray vs N OBBs", flScalar, flBatch, (double)nBoxes * nRays * nReps, nScalarHits, nBatchHits, nMismatches );
+}
+
+int main( int argc, char **argv )
+{
+	int nBoxes = DEFAULT_BOX_COUNT;
+	int nRays = DEFAULT_RAY_COUNT;
+	int nReps = 4;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !Q_stricmp( argv[i], "-boxes" ) && i + 1 < argc )
+		{
+			nBoxes = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-rays" ) && i + 1 < argc )
+		{
+			nRays = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-reps" ) && i + 1 < argc )
+		{
+			nReps = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else
+		{
+			Usage();
+		}
+	}
+
+	MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
+
+	Scene_t scene;
+	BuildScene( scene, nBoxes, nRays );
+
+	printf( "%d boxes, %d rays, %d reps. Millions of ray/box tests per second.\n", nBoxes, nRays, nReps );
+	printf( "  %-22s %8s %8s\n", "", "scalar", "batch" );
+
+	RunRayVsBoxes( scene, nReps );
+	RunRaysVsBox( scene, nReps );
+	RunRayVsOBBs( scene, nReps );
+
+	return 0;
+}
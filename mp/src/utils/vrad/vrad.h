@@ -529,6 +529,9 @@ public:
 	// general timing -- should be moved!!
 	virtual void StartTimer( const char *name ) = 0;
 	virtual void EndTimer( void ) = 0;
+
+	// collision tree trace timings (-disptracebench)
+	virtual void TraceBenchmark( void ) = 0;
 };
 
 IVRadDispMgr *StaticDispMgr( void );
@@ -123,6 +123,8 @@ public:
 	void StartTimer( const char *name );
 	void EndTimer( void );
 
+	void TraceBenchmark( void );
+
 	//=========================================================================
 	//
 	// Enumeration Methods
@@ -1554,6 +1556,155 @@ void CVRadDispMgr::EndTimer( void )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Time traces against the displacement collision trees the way the
+//          game issues them -- ray probes down onto the surface, player hull
+//          moves across it and npc hulls dropping onto it.  Each set runs with
+//          the scalar triangle tests and then four-wide, and the two passes
+//          must produce identical traces.
+//-----------------------------------------------------------------------------
+#define DISPTRACEBENCH_TRACES_PER_DISP	256
+
+struct DispBenchTrace_t
+{
+	int		m_iDisp;
+	Vector	m_vecStart;
+	Vector	m_vecEnd;
+	Vector	m_vecMins;
+	Vector	m_vecMaxs;
+};
+
+static unsigned int s_nDispBenchSeed;
+
+static float DispBenchRandom( float flMin, float flMax )
+{
+	s_nDispBenchSeed = s_nDispBenchSeed * 1664525 + 1013904223;
+	return flMin + ( flMax - flMin ) * ( ( s_nDispBenchSeed >> 8 ) * ( 1.0f / 16777216.0f ) );
+}
+
+static double RunDispBenchTraces( CUtlVector<CVRADDispColl*> &trees, const CUtlVector<DispBenchTrace_t> &traces, bool bRay, CBaseTrace *pResults )
+{
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < traces.Count(); ++i )
+	{
+		const DispBenchTrace_t &bench = traces[i];
+
+		Ray_t ray;
+		ray.Init( bench.m_vecStart, bench.m_vecEnd, bench.m_vecMins, bench.m_vecMaxs );
+
+		CBaseTrace *pTrace = &pResults[i];
+		memset( pTrace, 0, sizeof( *pTrace ) );
+		pTrace->fraction = 1.0f;
+		if ( bRay )
+		{
+			trees[bench.m_iDisp]->AABBTree_Ray( ray, ray.InvDelta(), pTrace );
+		}
+		else
+		{
+			trees[bench.m_iDisp]->AABBTree_SweepAABB( ray, ray.InvDelta(), pTrace );
+		}
+	}
+	return Plat_FloatTime() - flStart;
+}
+
+void CVRadDispMgr::TraceBenchmark( void )
+{
+	CUtlVector<CVRADDispColl*> trees;
+	for ( int iDisp = 0; iDisp < m_DispTrees.Count(); ++iDisp )
+	{
+		CVRADDispColl *pTree = m_DispTrees[iDisp].m_pDispTree;
+		if ( pTree )
+		{
+			// Hull sweeps need the edge plane cache
+			pTree->Cache();
+			trees.AddToTail( pTree );
+		}
+	}
+
+	if ( !trees.Count() )
+	{
+		Msg( "No displacements to trace against.\n" );
+		return;
+	}
+
+	static const char *s_pSetNames[3] = { "ray probes", "player moves", "npc drops" };
+	CUtlVector<DispBenchTrace_t> traceSets[3];
+
+	s_nDispBenchSeed = 0x12345678;
+	for ( int iTree = 0; iTree < trees.Count(); ++iTree )
+	{
+		Vector vecMins, vecMaxs;
+		trees[iTree]->GetBounds( vecMins, vecMaxs );
+
+		for ( int i = 0; i < DISPTRACEBENCH_TRACES_PER_DISP; ++i )
+		{
+			Vector vecPoint( DispBenchRandom( vecMins.x, vecMaxs.x ), DispBenchRandom( vecMins.y, vecMaxs.y ), DispBenchRandom( vecMins.z, vecMaxs.z ) );
+
+			// Straight down through the whole surface
+			DispBenchTrace_t &probe = traceSets[0][traceSets[0].AddToTail()];
+			probe.m_iDisp = iTree;
+			probe.m_vecStart.Init( vecPoint.x, vecPoint.y, vecMaxs.z + 16.0f );
+			probe.m_vecEnd.Init( vecPoint.x, vecPoint.y, vecMins.z - 16.0f );
+			probe.m_vecMins.Init();
+			probe.m_vecMaxs.Init();
+
+			// One tick of walking plus gravity with the standing hull
+			DispBenchTrace_t &move = traceSets[1][traceSets[1].AddToTail()];
+			move.m_iDisp = iTree;
+			move.m_vecStart = vecPoint;
+			move.m_vecStart.z += DispBenchRandom( 0.0f, 24.0f );
+			move.m_vecEnd = move.m_vecStart + Vector( DispBenchRandom( -8.0f, 8.0f ), DispBenchRandom( -8.0f, 8.0f ), DispBenchRandom( -18.0f, 0.0f ) );
+			move.m_vecMins.Init( -16.0f, -16.0f, 0.0f );
+			move.m_vecMaxs.Init( 16.0f, 16.0f, 72.0f );
+
+			// Ground check for a human sized npc
+			DispBenchTrace_t &drop = traceSets[2][traceSets[2].AddToTail()];
+			drop.m_iDisp = iTree;
+			drop.m_vecStart = vecPoint;
+			drop.m_vecStart.z += 32.0f;
+			drop.m_vecEnd = vecPoint;
+			drop.m_vecEnd.z -= 64.0f;
+			drop.m_vecMins.Init( -13.0f, -13.0f, 0.0f );
+			drop.m_vecMaxs.Init( 13.0f, 13.0f, 72.0f );
+		}
+	}
+
+	Msg( "Displacement traces: %d trees, %d traces per set\n", trees.Count(), traceSets[0].Count() );
+	Msg( "                   scalar      4-wide   mismatches\n" );
+
+	bool bSaveFourWide = g_bDispCollFourWideTris;
+	for ( int iSet = 0; iSet < 3; ++iSet )
+	{
+		const CUtlVector<DispBenchTrace_t> &traces = traceSets[iSet];
+		CUtlVector<CBaseTrace> results[2];
+		results[0].SetCount( traces.Count() );
+		results[1].SetCount( traces.Count() );
+
+		double flTime[2] = { 0.0, 0.0 };
+		for ( int iPass = 0; iPass < 2; ++iPass )
+		{
+			g_bDispCollFourWideTris = ( iPass != 0 );
+			flTime[iPass] = RunDispBenchTraces( trees, traces, iSet == 0, results[iPass].Base() );
+		}
+
+		int nMismatches = 0;
+		for ( int i = 0; i < traces.Count(); ++i )
+		{
+			const CBaseTrace &scalar = results[0][i];
+			const CBaseTrace &fourWide = results[1][i];
+			if ( scalar.fraction != fourWide.fraction || scalar.plane.normal != fourWide.plane.normal ||
+				 scalar.plane.dist != fourWide.plane.dist || scalar.dispFlags != fourWide.dispFlags )
+			{
+				++nMismatches;
+			}
+		}
+
+		Msg( "  %-14s %8.2f ms  %8.2f ms   %d\n", s_pSetNames[iSet], flTime[0] * 1000.0, flTime[1] * 1000.0, nMismatches );
+	}
+	g_bDispCollFourWideTris = bSaveFourWide;
+}
+
+
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 bool CVRadDispMgr::BuildDispSamples( lightinfo_t *pLightInfo, facelight_t *pFaceLight, int ndxFace )
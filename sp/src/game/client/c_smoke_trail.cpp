@@ -76,7 +76,9 @@ public:
 	//Create
 	static CSmokeParticle *Create( const char *pDebugName )
 	{
-		return new CSmokeParticle( pDebugName );
+		CSmokeParticle *pRet = new CSmokeParticle( pDebugName );
+		pRet->m_bCanPresimulate = true;
+		return pRet;
 	}
 
 	//Alpha
@@ -116,6 +118,17 @@ public:
 		return pParticle->m_flRoll;
 	}
 
+	virtual void UpdateRollSIMD( fltx4 &flRoll, fltx4 &flRollDelta, const fltx4 &flTimeDelta )
+	{
+		flRoll = MaddSIMD( flRollDelta, flTimeDelta, flRoll );
+
+		flRollDelta = MaddSIMD( flRollDelta, MulSIMD( flTimeDelta, ReplicateX4( -8.0f ) ), flRollDelta );
+
+		//Cap the minimum roll
+		fltx4 flMinRoll = MaskedAssign( CmpGtSIMD( flRollDelta, Four_Zeros ), Four_PointFives, SubSIMD( Four_Zeros, Four_PointFives ) );
+		flRollDelta = MaskedAssign( CmpLtSIMD( fabs( flRollDelta ), Four_PointFives ), flMinRoll, flRollDelta );
+	}
+
 private:
 	CSmokeParticle( const CSmokeParticle & );
 };
@@ -271,7 +271,7 @@ void C_SoundscapeSystem::AddSoundScapeFile( const char *filename )
 {
 	KeyValues *script = new KeyValues( filename );
 #ifndef _XBOX
-	if ( script->LoadFromFile( filesystem, filename ) )
+	if ( UTIL_LoadKeyValuesCached( script, filename ) )
 #else
 	if ( filesystem->LoadKeyValues( *script, IFileSystem::TYPE_SOUNDSCAPE, filename, "GAME" ) )
 #endif
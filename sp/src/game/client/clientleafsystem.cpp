@@ -34,6 +34,9 @@ static ConVar r_PortalTestEnts( "r_PortalTestEnts", "1", FCVAR_CHEAT, "Clip enti
 static ConVar r_portalsopenall( "r_portalsopenall", "0", FCVAR_CHEAT, "Open all portals" );
 static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0"  );
 
+// Translucent lists longer than this get radix sorted
+#define TRANSLUCENT_RADIX_SORT_THRESHOLD	32
+
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CClientRenderablesList, 1, CUtlMemoryPool::GROW_SLOW );
 
@@ -155,6 +158,14 @@ private:
 	void AddRenderableToLeaf( int leaf, ClientRenderHandle_t handle );
 
 	void SortEntities(  const Vector &vecRenderOrigin, const Vector &vecRenderForward, CClientRenderablesList::CEntry *pEntities, int nEntities );
+	void RadixSortEntities( CClientRenderablesList::CEntry *pEntities, const float *pDists, int nEntities );
+
+	// Helpers for CollateRenderablesInLeaf. CullRenderable is safe to run from the threaded
+	// collation; it doesn't check whether the renderable was collated from another leaf already.
+	bool CullRenderable( ClientRenderHandle_t handle, const SetupRenderInfo_t &info, bool bPortalTestEnts, RenderGroup_t &group, unsigned char &nAlpha );
+	void AddCollatedRenderable( ClientRenderHandle_t handle, int worldListLeafIndex, const SetupRenderInfo_t &info, RenderGroup_t group, unsigned char nAlpha );
+	void CollateDetailObjectsInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info );
+	void CollateLeavesThreaded( const SetupRenderInfo_t &info );
 
 	// Returns -1 if the renderable spans more than one area. If it's totally in one area, then this returns the leaf.
 	short GetRenderableArea( ClientRenderHandle_t handle );
@@ -324,6 +335,34 @@ private:
 	int	m_ShadowEnum;
 
 	CTSList<EnumResultList_t> m_DeferredInserts;
+
+	// Threaded collation for BuildRenderablesList. Each leaf job only culls the
+	// renderables it owns (the first leaf they're found in, same as the serial
+	// path), so no renderable is touched by two threads and the merged render
+	// list comes out identical to the serial one.
+	struct CollatedRenderable_t
+	{
+		ClientRenderHandle_t	m_hRenderable;
+		unsigned char			m_nRenderGroup;
+		unsigned char			m_nAlpha;
+	};
+
+	struct CollateLeafJob_t
+	{
+		const SetupRenderInfo_t				*m_pInfo;
+		bool								m_bPortalTestEnts;
+		CUtlVector< ClientRenderHandle_t >	m_Candidates;
+		CUtlVector< CollatedRenderable_t >	m_Visible;
+	};
+
+	void CollateLeafJob( CollateLeafJob_t &job );
+
+	CUtlVector< CollateLeafJob_t > m_CollateLeafJobs;
+
+	// Scratch space for RadixSortEntities
+	CUtlVector< uint32 > m_SortKeys;
+	CUtlVector< unsigned short > m_SortIndices;
+	CUtlVector< CClientRenderablesList::CEntry > m_SortEntries;
 };
 
 
@@ -1503,8 +1542,164 @@ static RenderGroup_t DetectBucketedRenderGroup( RenderGroup_t group, float fDime
 	return bucketedGroup;
 }
 
+//-----------------------------------------------------------------------------
+// Culls a renderable found in a leaf and picks the render group it goes in.
+// Returns false if it shouldn't be drawn.
+//-----------------------------------------------------------------------------
+bool CClientLeafSystem::CullRenderable( ClientRenderHandle_t handle, const SetupRenderInfo_t &info, bool bPortalTestEnts, RenderGroup_t &group, unsigned char &nAlpha )
+{
+	RenderableInfo_t& renderable = m_Renderables[handle];
+
+	nAlpha = 255;
+	if ( info.m_bDrawTranslucentObjects ) 
+	{
+		// Prevent culling if the renderable is invisible
+		// NOTE: OPAQUE objects can have alpha == 0. 
+		// They are made to be opaque because they don't have to be sorted.
+		nAlpha = renderable.m_pRenderable->GetFxBlend();
+		if ( nAlpha == 0 )
+			return false;
+	}
+
+	Vector absMins, absMaxs;
+	CalcRenderableWorldSpaceAABB( renderable.m_pRenderable, absMins, absMaxs );
+	// If the renderable is inside an area, cull it using the frustum for that area.
+	if ( bPortalTestEnts && renderable.m_Area != -1 )
+	{
+		VPROF( "r_PortalTestEnts" );
+		if ( !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area ) )
+			return false;
+	}
+	else
+	{
+		// cull with main frustum
+		if ( engine->CullBox( absMins, absMaxs ) )
+			return false;
+	}
+
+	// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
+	if ( renderable.m_Flags & RENDER_FLAGS_STUDIO_MODEL )
+	{
+		// test to see if this renderable is occluded by the engine's occlusion system
+		if ( engine->IsOccluded( absMins, absMaxs ) )
+			return false;
+	}
+
+#ifdef INVASION_CLIENT_DLL
+	if (info.m_flRenderDistSq != 0.0f)
+	{
+		Vector mins, maxs;
+		renderable.m_pRenderable->GetRenderBounds( mins, maxs );
+
+		if ((maxs.z - mins.z) < 100)
+		{
+			Vector vCenter;
+			VectorLerp( mins, maxs, 0.5f, vCenter );
+			vCenter += renderable.m_pRenderable->GetRenderOrigin();
+
+			float flDistSq = info.m_vecRenderOrigin.DistToSqr( vCenter );
+			if (info.m_flRenderDistSq <= flDistSq)
+				return false;
+		}
+	}
+#endif
+
+	group = (RenderGroup_t)renderable.m_RenderGroup;
+
+	// Determine object group offset
+	if ( RENDER_GROUP_CFG_NUM_OPAQUE_ENT_BUCKETS > 1 &&
+		 group >= RENDER_GROUP_OPAQUE_STATIC &&
+		 group <= RENDER_GROUP_OPAQUE_ENTITY )
+	{
+		Vector dims;
+		VectorSubtract( absMaxs, absMins, dims );
+
+		float const fDimension = MAX( MAX( fabs(dims.x), fabs(dims.y) ), fabs(dims.z) );
+		group = DetectBucketedRenderGroup( group, fDimension );
+		
+		Assert( group >= RENDER_GROUP_OPAQUE_STATIC_HUGE && group <= RENDER_GROUP_OPAQUE_ENTITY );
+	}
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds a renderable that passed CullRenderable to the render list
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::AddCollatedRenderable( ClientRenderHandle_t handle, int worldListLeafIndex, const SetupRenderInfo_t &info, RenderGroup_t group, unsigned char nAlpha )
+{
+	RenderableInfo_t& renderable = m_Renderables[handle];
+
+	if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+	{
+		AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
+			worldListLeafIndex, group, handle);
+	}
+	else
+	{
+		bool bTwoPass = ((renderable.m_Flags & RENDER_FLAGS_TWOPASS) != 0) && ( nAlpha == 255 );	// Two pass?
+
+		// Add to appropriate list if drawing translucent objects (shadow depth mapping will skip this)
+		if ( info.m_bDrawTranslucentObjects ) 
+		{
+			AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
+				worldListLeafIndex, (RenderGroup_t)renderable.m_RenderGroup, handle, bTwoPass );
+		}
+		
+		if ( bTwoPass )	// Also add to opaque list if it's a two-pass model... 
+		{
+			AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
+				worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, handle, bTwoPass );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Adds detail props in a leaf to the render list.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateDetailObjectsInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info )
+{
+	// These don't have render handles!
+	if ( !info.m_bDrawDetailObjects || !ShouldDrawDetailObjectsInLeaf( leaf, info.m_nDetailBuildFrame ) )
+		return;
+
+	int idx = m_Leaf[leaf].m_FirstDetailProp;
+	int count = m_Leaf[leaf].m_DetailPropCount;
+	while( --count >= 0 )
+	{
+		IClientRenderable* pRenderable = DetailObjectSystem()->GetDetailModel(idx);
+
+		// FIXME: This if check here is necessary because the detail object system also maintains lists of sprites...
+		if (pRenderable)
+		{
+			if( pRenderable->IsTransparent() )
+			{
+				if ( info.m_bDrawTranslucentObjects )	// Don't draw translucent objects into shadow depth maps
+				{
+					// Lots of the detail entities are invisible so avoid sorting them and all that.
+					if( pRenderable->GetFxBlend() > 0 )
+					{
+						AddRenderableToRenderList( *info.m_pRenderList, pRenderable, 
+							worldListLeafIndex, RENDER_GROUP_TRANSLUCENT_ENTITY, DETAIL_PROP_RENDER_HANDLE );
+					}
+				}
+			}
+			else
+			{
+				AddRenderableToRenderList( *info.m_pRenderList, pRenderable, 
+					worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, DETAIL_PROP_RENDER_HANDLE );
+			}
+		}
+		++idx;
+	}
+}
+
+
 void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafIndex,	const SetupRenderInfo_t &info )
 {
+	VPROF( "CClientLeafSystem::CollateRenderablesInLeaf" );
 	bool portalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
 	
 	// Place a fake entity for static/opaque ents in this leaf
@@ -1553,133 +1748,195 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 				continue;
 		}
 
-		unsigned char nAlpha = 255;
-		if ( info.m_bDrawTranslucentObjects ) 
+		RenderGroup_t group;
+		unsigned char nAlpha;
+		if ( CullRenderable( handle, info, portalTestEnts, group, nAlpha ) )
 		{
-			// Prevent culling if the renderable is invisible
-			// NOTE: OPAQUE objects can have alpha == 0. 
-			// They are made to be opaque because they don't have to be sorted.
-			nAlpha = renderable.m_pRenderable->GetFxBlend();
-			if ( nAlpha == 0 )
-				continue;
+			AddCollatedRenderable( handle, worldListLeafIndex, info, group, nAlpha );
 		}
+	}
+
+	// Do detail objects.
+	CollateDetailObjectsInLeaf( leaf, worldListLeafIndex, info );
+}
 
-		Vector absMins, absMaxs;
-		CalcRenderableWorldSpaceAABB( renderable.m_pRenderable, absMins, absMaxs );
-		// If the renderable is inside an area, cull it using the frustum for that area.
-		if ( portalTestEnts && renderable.m_Area != -1 )
-		{
-			VPROF( "r_PortalTestEnts" );
-			if ( !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area ) )
-				continue;
-		}
-		else
-		{
-			// cull with main frustum
-			if ( engine->CullBox( absMins, absMaxs ) )
-				continue;
-		}
 
-		// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
-		if ( renderable.m_Flags & RENDER_FLAGS_STUDIO_MODEL )
+//-----------------------------------------------------------------------------
+// Culls the renderables a leaf owns; runs on the thread pool
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateLeafJob( CollateLeafJob_t &job )
+{
+	for ( int i = 0; i < job.m_Candidates.Count(); ++i )
+	{
+		RenderGroup_t group;
+		unsigned char nAlpha;
+		if ( CullRenderable( job.m_Candidates[i], *job.m_pInfo, job.m_bPortalTestEnts, group, nAlpha ) )
 		{
-			// test to see if this renderable is occluded by the engine's occlusion system
-			if ( engine->IsOccluded( absMins, absMaxs ) )
-				continue;
+			CollatedRenderable_t &visible = job.m_Visible[ job.m_Visible.AddToTail() ];
+			visible.m_hRenderable = job.m_Candidates[i];
+			visible.m_nRenderGroup = group;
+			visible.m_nAlpha = nAlpha;
 		}
+	}
+}
 
-#ifdef INVASION_CLIENT_DLL
-		if (info.m_flRenderDistSq != 0.0f)
-		{
-			Vector mins, maxs;
-			renderable.m_pRenderable->GetRenderBounds( mins, maxs );
 
-			if ((maxs.z - mins.z) < 100)
+//-----------------------------------------------------------------------------
+// Threaded version of calling CollateRenderablesInLeaf on every leaf: the
+// leaves' renderables are culled in parallel into per-leaf lists, which are
+// then added to the render list in leaf order.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateLeavesThreaded( const SetupRenderInfo_t &info )
+{
+	int leafCount = info.m_pWorldListInfo->m_LeafCount;
+	bool portalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
+
+	if ( m_CollateLeafJobs.Count() < leafCount )
+	{
+		m_CollateLeafJobs.AddMultipleToTail( leafCount - m_CollateLeafJobs.Count() );
+	}
+
+	// Hand each renderable to the first leaf it's found in, exactly like the
+	// serial path does.
+	{
+		VPROF( "CClientLeafSystem::CollateLeavesThreaded - Gather" );
+		for ( int i = 0; i < leafCount; i++ )
+		{
+			int leaf = info.m_pWorldListInfo->m_pLeafList[i];
+			CollateLeafJob_t &job = m_CollateLeafJobs[i];
+			job.m_pInfo = &info;
+			job.m_bPortalTestEnts = portalTestEnts;
+			job.m_Candidates.RemoveAll();
+			job.m_Visible.RemoveAll();
+
+			unsigned short idx = m_RenderablesInLeaf.FirstElement(leaf);
+			for ( ;idx != m_RenderablesInLeaf.InvalidIndex(); idx = m_RenderablesInLeaf.NextElement(idx) )
 			{
-				Vector vCenter;
-				VectorLerp( mins, maxs, 0.5f, vCenter );
-				vCenter += renderable.m_pRenderable->GetRenderOrigin();
+				ClientRenderHandle_t handle = m_RenderablesInLeaf.Element(idx);
+				RenderableInfo_t& renderable = m_Renderables[handle];
+
+				if ((!m_DrawStaticProps) && (renderable.m_Flags & RENDER_FLAGS_STATIC_PROP))
+					continue;
 
-				float flDistSq = info.m_vecRenderOrigin.DistToSqr( vCenter );
-				if (info.m_flRenderDistSq <= flDistSq)
+				if ( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
+				{
+					if ( renderable.m_RenderFrame2 == info.m_nRenderFrame )
+						continue;
+
+					renderable.m_RenderFrame2 = info.m_nRenderFrame;
+				}
+				else if ( renderable.m_RenderLeaf != leaf )
+				{
 					continue;
+				}
+
+				job.m_Candidates.AddToTail( handle );
 			}
 		}
-#endif
+	}
 
-		if( renderable.m_RenderGroup != RENDER_GROUP_TRANSLUCENT_ENTITY )
-		{
-			RenderGroup_t group = (RenderGroup_t)renderable.m_RenderGroup;
+	{
+		VPROF( "CClientLeafSystem::CollateLeavesThreaded - Cull" );
+		ParallelProcess( "CClientLeafSystem::CollateLeavesThreaded", m_CollateLeafJobs.Base(), leafCount, this, &CClientLeafSystem::CollateLeafJob, &CClientLeafSystem::FrameLock, &CClientLeafSystem::FrameUnlock );
+	}
 
-			// Determine object group offset
-			if ( RENDER_GROUP_CFG_NUM_OPAQUE_ENT_BUCKETS > 1 &&
-				 group >= RENDER_GROUP_OPAQUE_STATIC &&
-				 group <= RENDER_GROUP_OPAQUE_ENTITY )
-			{
-				Vector dims;
-				VectorSubtract( absMaxs, absMins, dims );
+	VPROF( "CClientLeafSystem::CollateLeavesThreaded - Merge" );
+	const Vector &vecRenderOrigin = info.m_vecRenderOrigin;
+	const Vector &vecRenderForward = info.m_vecRenderForward;
+	CClientRenderablesList::CEntry *pTranslucentEntries = info.m_pRenderList->m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY];
+	int &nTranslucentEntries = info.m_pRenderList->m_RenderGroupCounts[RENDER_GROUP_TRANSLUCENT_ENTITY];
 
-				float const fDimension = MAX( MAX( fabs(dims.x), fabs(dims.y) ), fabs(dims.z) );
-				group = DetectBucketedRenderGroup( group, fDimension );
-				
-				Assert( group >= RENDER_GROUP_OPAQUE_STATIC_HUGE && group <= RENDER_GROUP_OPAQUE_ENTITY );
-			}
+	for ( int i = 0; i < leafCount; i++ )
+	{
+		int nTranslucent = nTranslucentEntries;
 
-			AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-				worldListLeafIndex, group, handle);
-		}
-		else
+		// Place a fake entity for static/opaque ents in this leaf
+		AddRenderableToRenderList( *info.m_pRenderList, NULL, i, RENDER_GROUP_OPAQUE_STATIC, NULL );
+		AddRenderableToRenderList( *info.m_pRenderList, NULL, i, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+
+		const CollateLeafJob_t &job = m_CollateLeafJobs[i];
+		for ( int j = 0; j < job.m_Visible.Count(); ++j )
 		{
-			bool bTwoPass = ((renderable.m_Flags & RENDER_FLAGS_TWOPASS) != 0) && ( nAlpha == 255 );	// Two pass?
+			const CollatedRenderable_t &visible = job.m_Visible[j];
+			AddCollatedRenderable( visible.m_hRenderable, i, info, (RenderGroup_t)visible.m_nRenderGroup, visible.m_nAlpha );
+		}
 
-			// Add to appropriate list if drawing translucent objects (shadow depth mapping will skip this)
-			if ( info.m_bDrawTranslucentObjects ) 
-			{
-				AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-					worldListLeafIndex, (RenderGroup_t)renderable.m_RenderGroup, handle, bTwoPass );
-			}
-			
-			if ( bTwoPass )	// Also add to opaque list if it's a two-pass model... 
-			{
-				AddRenderableToRenderList( *info.m_pRenderList, renderable.m_pRenderable, 
-					worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, handle, bTwoPass );
-			}
+		CollateDetailObjectsInLeaf( info.m_pWorldListInfo->m_pLeafList[i], i, info );
+
+		int nNewTranslucent = nTranslucentEntries - nTranslucent;
+		if( (nNewTranslucent != 0 ) && info.m_bDrawTranslucentObjects )
+		{
+			// Sort the new translucent entities.
+			SortEntities( vecRenderOrigin, vecRenderForward, &pTranslucentEntries[nTranslucent], nNewTranslucent );
 		}
 	}
+}
 
-	// Do detail objects.
-	// These don't have render handles!
-	if ( info.m_bDrawDetailObjects && ShouldDrawDetailObjectsInLeaf( leaf, info.m_nDetailBuildFrame ) )
+
+//-----------------------------------------------------------------------------
+// Stable LSD radix sort of entries by view depth. The float depths are mapped
+// to uints that sort in the same order, so this gives the same order as a
+// comparison sort.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::RadixSortEntities( CClientRenderablesList::CEntry *pEntities, const float *pDists, int nEntities )
+{
+	m_SortKeys.SetCount( nEntities * 2 );
+	m_SortIndices.SetCount( nEntities * 2 );
+
+	uint32 *pKeys = m_SortKeys.Base();
+	uint32 *pKeysTemp = pKeys + nEntities;
+	unsigned short *pIndices = m_SortIndices.Base();
+	unsigned short *pIndicesTemp = pIndices + nEntities;
+
+	int nHistogram[4][256];
+	memset( nHistogram, 0, sizeof(nHistogram) );
+
+	int i;
+	for ( i = 0; i < nEntities; ++i )
 	{
-		idx = m_Leaf[leaf].m_FirstDetailProp;
-		int count = m_Leaf[leaf].m_DetailPropCount;
-		while( --count >= 0 )
+		// Flip negative floats entirely, and the sign bit of positive ones
+		uint32 nBits = *(const uint32 *)&pDists[i];
+		uint32 nKey = ( nBits & 0x80000000 ) ? ~nBits : ( nBits | 0x80000000 );
+		pKeys[i] = nKey;
+		pIndices[i] = i;
+
+		++nHistogram[0][ nKey & 0xFF ];
+		++nHistogram[1][ ( nKey >> 8 ) & 0xFF ];
+		++nHistogram[2][ ( nKey >> 16 ) & 0xFF ];
+		++nHistogram[3][ nKey >> 24 ];
+	}
+
+	for ( int nPass = 0; nPass < 4; ++nPass )
+	{
+		int nShift = nPass * 8;
+
+		// Skip passes where every key has the same digit
+		if ( nHistogram[nPass][ ( pKeys[0] >> nShift ) & 0xFF ] == nEntities )
+			continue;
+
+		int nOffset = 0;
+		for ( int nDigit = 0; nDigit < 256; ++nDigit )
 		{
-			IClientRenderable* pRenderable = DetailObjectSystem()->GetDetailModel(idx);
+			int nCount = nHistogram[nPass][nDigit];
+			nHistogram[nPass][nDigit] = nOffset;
+			nOffset += nCount;
+		}
 
-			// FIXME: This if check here is necessary because the detail object system also maintains lists of sprites...
-			if (pRenderable)
-			{
-				if( pRenderable->IsTransparent() )
-				{
-					if ( info.m_bDrawTranslucentObjects )	// Don't draw translucent objects into shadow depth maps
-					{
-						// Lots of the detail entities are invisible so avoid sorting them and all that.
-						if( pRenderable->GetFxBlend() > 0 )
-						{
-							AddRenderableToRenderList( *info.m_pRenderList, pRenderable, 
-								worldListLeafIndex, RENDER_GROUP_TRANSLUCENT_ENTITY, DETAIL_PROP_RENDER_HANDLE );
-						}
-					}
-				}
-				else
-				{
-					AddRenderableToRenderList( *info.m_pRenderList, pRenderable, 
-						worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, DETAIL_PROP_RENDER_HANDLE );
-				}
-			}
-			++idx;
+		for ( i = 0; i < nEntities; ++i )
+		{
+			int nDest = nHistogram[nPass][ ( pKeys[i] >> nShift ) & 0xFF ]++;
+			pKeysTemp[nDest] = pKeys[i];
+			pIndicesTemp[nDest] = pIndices[i];
 		}
+
+		V_swap( pKeys, pKeysTemp );
+		V_swap( pIndices, pIndicesTemp );
+	}
+
+	m_SortEntries.CopyArray( pEntities, nEntities );
+	for ( i = 0; i < nEntities; ++i )
+	{
+		pEntities[i] = m_SortEntries[ pIndices[i] ];
 	}
 }
 
@@ -1693,6 +1950,8 @@ void CClientLeafSystem::SortEntities( const Vector &vecRenderOrigin, const Vecto
 	if ( nEntities <= 1 )
 		return;
 
+	VPROF( "CClientLeafSystem::SortEntities" );
+
 	float dists[CClientRenderablesList::MAX_GROUP_ENTITIES];
 
 	// First get a distance for each entity.
@@ -1714,6 +1973,13 @@ void CClientLeafSystem::SortEntities( const Vector &vecRenderOrigin, const Vecto
 		dists[i] = DotProduct( delta, vecRenderForward );
 	}
 
+	// The H-sort below goes quadratic on big lists
+	if ( nEntities > TRANSLUCENT_RADIX_SORT_THRESHOLD )
+	{
+		RadixSortEntities( pEntities, dists, nEntities );
+		return;
+	}
+
 	// H-sort.
 	int stepSize = 4;
 	while( stepSize )
@@ -1746,6 +2012,13 @@ void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 {
 	VPROF_BUDGET( "BuildRenderablesList", "BuildRenderablesList" );
 	int leafCount = info.m_pWorldListInfo->m_LeafCount;
+
+	if ( leafCount > 1 && cl_threaded_client_leaf_system.GetBool() && g_pThreadPool->NumThreads() )
+	{
+		CollateLeavesThreaded( info );
+		return;
+	}
+
 	const Vector &vecRenderOrigin = info.m_vecRenderOrigin;
 	const Vector &vecRenderForward = info.m_vecRenderForward;
 	CClientRenderablesList::CEntry *pTranslucentEntries = info.m_pRenderList->m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY];
@@ -69,6 +69,9 @@ static ConVar cl_particle_stats_trigger_count( "cl_particle_stats_trigger_count"
 
 #define PARTICLE_SIZE	96
 
+// Particles per pool blob
+#define PARTICLE_POOL_BLOB_COUNT	256
+
 CParticleMgr *ParticleMgr()
 {
 	static CParticleMgr s_ParticleMgr;
@@ -650,7 +653,7 @@ void CParticleEffectBinding::GrowBBoxFromParticlePositions( CEffectMaterial *pMa
 //-----------------------------------------------------------------------------
 // Simulate particles
 //-----------------------------------------------------------------------------
-void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
+void CParticleEffectBinding::SimulateParticles( float flTimeDelta, bool bPresimulated )
 {
 	if ( !m_pSim->ShouldSimulate() )
 		return;
@@ -694,6 +697,7 @@ void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
 			simulateIterator.m_pEffectBinding = this;
 			simulateIterator.m_pMaterial = pMaterial;
 			simulateIterator.m_flTimeDelta = flTimeDelta;
+			simulateIterator.m_bPresimulated = bPresimulated;
 
 			m_pSim->SimulateParticles( &simulateIterator );
 
@@ -711,6 +715,26 @@ void CParticleEffectBinding::SimulateParticles( float flTimeDelta )
 }
 
 
+//-----------------------------------------------------------------------------
+// Thread-safe part of the simulation; only touches this effect's particles
+//-----------------------------------------------------------------------------
+void CParticleEffectBinding::PresimulateParticles( float flTimeDelta )
+{
+	Assert( m_pSim->CanPresimulateParticles() && !GetFlag( FLAGS_NEW_PARTICLE_SYSTEM ) );
+
+	FOR_EACH_LL( m_Materials, i )
+	{
+		CParticleSimulateIterator simulateIterator;
+
+		simulateIterator.m_pEffectBinding = this;
+		simulateIterator.m_pMaterial = m_Materials[i];
+		simulateIterator.m_flTimeDelta = flTimeDelta;
+
+		m_pSim->PresimulateParticles( &simulateIterator );
+	}
+}
+
+
 void CParticleEffectBinding::SetDrawThruLeafSystem( int bDraw )
 {
 	// NOTE (2012/11/27, TomF) - this whole system seems to be deprecated - nothing ever checks these flags, and CParticleMgr::DrawBeforeViewModelEffects is never called by anything!
@@ -1034,7 +1058,7 @@ CEffectMaterial* CParticleEffectBinding::GetEffectMaterial( CParticleSubTexture
 //-----------------------------------------------------------------------------
 // CParticleMgr
 //-----------------------------------------------------------------------------
-CParticleMgr::CParticleMgr()
+CParticleMgr::CParticleMgr() : m_ParticlePool( PARTICLE_SIZE, PARTICLE_POOL_BLOB_COUNT, CUtlMemoryPool::GROW_SLOW, "CParticleMgr::m_ParticlePool", 16 )
 {
 	m_nToolParticleEffectId = 0;
 	m_bUpdatingEffects = false;
@@ -1052,6 +1076,7 @@ CParticleMgr::CParticleMgr()
 	m_DefaultInvalidSubTexture.m_tCoordMaxs[0] = m_DefaultInvalidSubTexture.m_tCoordMaxs[1] = 1;
 	
 	m_nCurrentParticlesAllocated = 0;
+	StatsResetOldParticleBudget();
 
 	SetDefLessFunc( m_effectFactories );
 }
@@ -1157,6 +1182,10 @@ void CParticleMgr::Term()
 	}
 
 	Assert( m_nCurrentParticlesAllocated == 0 );
+	if ( m_nCurrentParticlesAllocated == 0 )
+	{
+		m_ParticlePool.Clear();
+	}
 }
 
 
@@ -1171,8 +1200,12 @@ Particle *CParticleMgr::AllocParticle( int size )
 	// Enforce max particle limit.
 	if ( m_nCurrentParticlesAllocated >= MAX_TOTAL_PARTICLES )
 		return NULL;
+
+	Assert( size <= PARTICLE_SIZE );
+	if ( size > PARTICLE_SIZE )
+		return NULL;
 		
-	Particle *pRet = (Particle *)malloc( size );
+	Particle *pRet = (Particle *)m_ParticlePool.Alloc();
 	if ( pRet )
 		++m_nCurrentParticlesAllocated;
 
@@ -1181,11 +1214,13 @@ Particle *CParticleMgr::AllocParticle( int size )
 
 void CParticleMgr::FreeParticle( Particle *pParticle )
 {
+	if ( !pParticle )
+		return;
+
 	Assert( m_nCurrentParticlesAllocated > 0 );
-	if ( pParticle )
-		--m_nCurrentParticlesAllocated;
+	--m_nCurrentParticlesAllocated;
 	
-	free( pParticle );
+	m_ParticlePool.Free( pParticle );
 }
 
 
@@ -1907,6 +1942,15 @@ void CParticleMgr::UpdateNewEffects( float flTimeDelta )
 	}
 }
 
+static ConVar cl_particle_presimulate( "cl_particle_presimulate", "1", 0, "Run the SIMD presimulate pass for simple particle effects, on the job threads if r_threaded_particles is set." );
+
+static float s_flPresimulateTimeStep;
+
+static void PresimulateEffect( CParticleEffectBinding *&pEffect )
+{
+	pEffect->PresimulateParticles( s_flPresimulateTimeStep );
+}
+
 void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 {
 	// These reflect the convars so we don't parse the strings every particle.
@@ -1919,6 +1963,13 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 	if( flTimeDelta > 0.1f )
 		flTimeDelta = 0.1f;
 
+	double flStartTime = Plat_FloatTime();
+
+	// Effects whose simulation is split into a thread-safe presimulate pass
+	// and a main thread pass that removes dead particles and updates the bbox.
+	CUtlVectorFixedGrowable< CParticleEffectBinding*, 128 > presimulateEffects;
+	bool bPresimulate = cl_particle_presimulate.GetBool();
+
 	FOR_EACH_LL( m_Effects, iEffect )
 	{
 		CParticleEffectBinding *pEffect = m_Effects[iEffect];
@@ -1947,14 +1998,57 @@ void CParticleMgr::UpdateAllEffects( float flTimeDelta )
 		pEffect->m_pSim->Update( flTimeDelta );
 
 		if ( pEffect->GetFirstFrameFlag() )
+		{
 			pEffect->SetFirstFrameFlag( false );
+		}
+		else if ( bPresimulate && pEffect->m_pSim->CanPresimulateParticles() && pEffect->m_pSim->ShouldSimulate() &&
+			!pEffect->GetFlag( CParticleEffectBinding::FLAGS_NEW_PARTICLE_SYSTEM ) )
+		{
+			// Simulated below, once every effect has been updated.
+			presimulateEffects.AddToTail( pEffect );
+			continue;
+		}
 		else
+		{
 			pEffect->SimulateParticles( flTimeDelta );
+		}
 
 		// Update its position in the leaf system if its bbox changed.
 		pEffect->DetectChanges();
 	}
 
+	int nPresimulateCount = presimulateEffects.Count();
+	if ( nPresimulateCount )
+	{
+		s_flPresimulateTimeStep = flTimeDelta;
+		if ( r_threaded_particles.GetBool() && nPresimulateCount > 1 )
+		{
+			ParallelProcess( "CParticleMgr::UpdateAllEffects", presimulateEffects.Base(), nPresimulateCount, PresimulateEffect );
+		}
+		else
+		{
+			for ( int i = 0; i < nPresimulateCount; i++ )
+			{
+				PresimulateEffect( presimulateEffects[i] );
+			}
+		}
+
+		// now, run the non-reentrant part: particle removal, bbox and leaf system updates
+		for ( int i = 0; i < nPresimulateCount; i++ )
+		{
+			presimulateEffects[i]->SimulateParticles( flTimeDelta, true );
+			presimulateEffects[i]->DetectChanges();
+		}
+	}
+
+	float flSimTime = Plat_FloatTime() - flStartTime;
+	m_OldParticleBudget.m_nFrames++;
+	m_OldParticleBudget.m_nMaxEffects = MAX( m_OldParticleBudget.m_nMaxEffects, m_Effects.Count() );
+	m_OldParticleBudget.m_nMaxParticles = MAX( m_OldParticleBudget.m_nMaxParticles, m_nCurrentParticlesAllocated );
+	m_OldParticleBudget.m_nTotalParticles += m_nCurrentParticlesAllocated;
+	m_OldParticleBudget.m_flTotalSimTime += flSimTime;
+	m_OldParticleBudget.m_flMaxSimTime = MAX( m_OldParticleBudget.m_flMaxSimTime, flSimTime );
+
 	if ( g_bMeasureParticlePerformance )					// use fixed time step
 	{
 		for( float dt=0.0f; dt <= flTimeDelta ; dt+= 0.01f )
@@ -2225,6 +2319,8 @@ float Helper_GetFrameTime()
 
 static void StatsParticlesStart()
 {
+	ParticleMgr()->StatsResetOldParticleBudget();
+
 #ifdef STAGING_ONLY
 	CParticleMgr *pMgr = ParticleMgr();
 	if ( pMgr->m_bStatsRunning )
@@ -2238,6 +2334,8 @@ static void StatsParticlesStart()
 
 static void StatsParticlesStop()
 {
+	ParticleMgr()->StatsSpewOldParticleBudget();
+
 #ifdef STAGING_ONLY
 	CParticleMgr *pMgr = ParticleMgr();
 	if ( pMgr->m_bStatsRunning )
@@ -2352,6 +2450,24 @@ void CParticleMgr::StatsAccumulateActiveParticleSystems()
 #endif
 }
 
+void CParticleMgr::StatsResetOldParticleBudget()
+{
+	memset( &m_OldParticleBudget, 0, sizeof( m_OldParticleBudget ) );
+}
+
+void CParticleMgr::StatsSpewOldParticleBudget()
+{
+	const OldParticleBudget_t &budget = m_OldParticleBudget;
+	int nFrames = MAX( budget.m_nFrames, 1 );
+
+	Msg( "Old-style particles over %d frames:\n", budget.m_nFrames );
+	Msg( "  effects: %d now, %d max\n", m_Effects.Count(), budget.m_nMaxEffects );
+	Msg( "  particles: %d now, %d avg, %d max (limit %d)\n", m_nCurrentParticlesAllocated, 
+		(int)( budget.m_nTotalParticles / nFrames ), budget.m_nMaxParticles, MAX_TOTAL_PARTICLES );
+	Msg( "  pool: %d blocks allocated, %d peak\n", m_ParticlePool.Count(), m_ParticlePool.PeakCount() );
+	Msg( "  simulate: %.3f ms avg, %.3f ms max\n", 1000.0 * budget.m_flTotalSimTime / nFrames, 1000.0f * budget.m_flMaxSimTime );
+}
+
 void CParticleMgr::StatsReset()
 {
 #ifdef STAGING_ONLY
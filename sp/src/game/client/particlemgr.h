@@ -119,6 +119,7 @@ entities. Each one is useful under different conditions.
 #include "tier0/fasttimer.h"
 #include "utllinkedlist.h"
 #include "utldict.h"
+#include "mempool.h"
 #ifdef WIN32
 #include <typeinfo.h>
 #else
@@ -269,6 +270,13 @@ public:
 	virtual void	SetShouldSimulate( bool bSim ) = 0;
 	virtual void	SimulateParticles( CParticleSimulateIterator *pIterator ) = 0;
 
+	// Optional first half of SimulateParticles. If CanPresimulateParticles returns true, the
+	// particle manager calls PresimulateParticles for each material before SimulateParticles,
+	// possibly from a worker thread and alongside other effects, so it must only touch the
+	// particles it is handed. SimulateParticles then sees WasPresimulated() on its iterator.
+	virtual bool	CanPresimulateParticles() const { return false; }
+	virtual void	PresimulateParticles( CParticleSimulateIterator *pIterator ) {}
+
 	// Render the particles.
 	virtual void	RenderParticles( CParticleRenderIterator *pIterator ) = 0;
 
@@ -345,7 +353,10 @@ public:
 public:
 
 	// Simulate all the particles.
-	void			SimulateParticles( float flTimeDelta );
+	void			SimulateParticles( float flTimeDelta, bool bPresimulated = false );
+
+	// Run the thread-safe IParticleEffect::PresimulateParticles pass over all the particles.
+	void			PresimulateParticles( float flTimeDelta );
 
 	// Use this to specify materials when adding particles. 
 	// Returns the index of the material it found or added.
@@ -696,6 +707,10 @@ public:
 	void StatsNewParticleEffectDrawn ( CNewParticleEffect *pParticles );
 	void StatsOldParticleEffectDrawn ( CParticleEffectBinding *pParticles );
 
+	// Budget for the old-style (CParticleEffectBinding) effects; always gathered.
+	void StatsResetOldParticleBudget();
+	void StatsSpewOldParticleBudget();
+
 private:
 	struct RetireInfo_t
 	{
@@ -723,6 +738,21 @@ private:
 
 	int m_nCurrentParticlesAllocated;
 
+	// Old-style particles are all PARTICLE_SIZE, so they come out of one pool
+	// instead of going through malloc for every particle.
+	CUtlMemoryPool m_ParticlePool;
+
+	struct OldParticleBudget_t
+	{
+		int		m_nFrames;
+		int		m_nMaxEffects;
+		int		m_nMaxParticles;
+		int64	m_nTotalParticles;
+		double	m_flTotalSimTime;
+		float	m_flMaxSimTime;
+	};
+	OldParticleBudget_t m_OldParticleBudget;
+
 	// Directional lighting info.
 	CParticleLightInfo m_DirectionalLight;
 
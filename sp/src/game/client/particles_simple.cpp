@@ -225,6 +225,7 @@ CSimpleEmitter::CSimpleEmitter( const char *pDebugName ) : CParticleEffect( pDeb
 {
 	m_flNearClipMin	= 16.0f;
 	m_flNearClipMax	= 64.0f;
+	m_bCanPresimulate = false;
 }
 
 
@@ -236,6 +237,9 @@ CSmartPtr<CSimpleEmitter> CSimpleEmitter::Create( const char *pDebugName )
 {
 	CSimpleEmitter *pRet = new CSimpleEmitter( pDebugName );
 	pRet->SetDynamicallyAllocated( true );
+
+	// Subclasses that override UpdateVelocity or UpdateRoll have to opt in themselves.
+	pRet->m_bCanPresimulate = true;
 	return pRet;
 }
 
@@ -346,6 +350,14 @@ float CSimpleEmitter::UpdateRoll( SimpleParticle *pParticle, float timeDelta )
 	return pParticle->m_flRoll;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Same as UpdateRoll, for four particles at once
+//-----------------------------------------------------------------------------
+void CSimpleEmitter::UpdateRollSIMD( fltx4 &flRoll, fltx4 &flRollDelta, const fltx4 &flTimeDelta )
+{
+	flRoll = MaddSIMD( flRollDelta, flTimeDelta, flRoll );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *pParticle - 
@@ -366,17 +378,23 @@ void CSimpleEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 {
 	float timeDelta = pIterator->GetTimeDelta();
 
+	// PresimulateParticles has already moved everything but the windblown particles.
+	bool bPresimulated = pIterator->WasPresimulated();
+
 	SimpleParticle *pParticle = (SimpleParticle*)pIterator->GetFirst();
 	while ( pParticle )
 	{
-		//Update velocity
-		UpdateVelocity( pParticle, timeDelta );
-		pParticle->m_Pos += pParticle->m_vecVelocity * timeDelta;
+		if ( !bPresimulated || ( pParticle->m_iFlags & SIMPLE_PARTICLE_FLAG_WINDBLOWN ) )
+		{
+			//Update velocity
+			UpdateVelocity( pParticle, timeDelta );
+			pParticle->m_Pos += pParticle->m_vecVelocity * timeDelta;
 
-		//Should this particle die?
-		pParticle->m_flLifetime += timeDelta;
-		UpdateRoll( pParticle, timeDelta );
+			pParticle->m_flLifetime += timeDelta;
+			UpdateRoll( pParticle, timeDelta );
+		}
 
+		//Should this particle die?
 		if ( pParticle->m_flLifetime >= pParticle->m_flDieTime )
 			pIterator->RemoveParticle( pParticle );
 
@@ -384,6 +402,77 @@ void CSimpleEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Transposes four particles into SIMD registers, moves them, ages
+//			them and updates their roll, then writes them back.
+//-----------------------------------------------------------------------------
+void CSimpleEmitter::PresimulateBatch( SimpleParticle **ppParticles, const fltx4 &flTimeDelta )
+{
+	FourVectors vecPos, vecVelocity;
+	vecPos.LoadAndSwizzle( ppParticles[0]->m_Pos, ppParticles[1]->m_Pos, ppParticles[2]->m_Pos, ppParticles[3]->m_Pos );
+	vecVelocity.LoadAndSwizzle( ppParticles[0]->m_vecVelocity, ppParticles[1]->m_vecVelocity, ppParticles[2]->m_vecVelocity, ppParticles[3]->m_vecVelocity );
+
+	fltx4 flLifetime = Four_Zeros, flRoll = Four_Zeros, flRollDelta = Four_Zeros;
+	for ( int i = 0; i < 4; i++ )
+	{
+		SubFloat( flLifetime, i ) = ppParticles[i]->m_flLifetime;
+		SubFloat( flRoll, i ) = ppParticles[i]->m_flRoll;
+		SubFloat( flRollDelta, i ) = ppParticles[i]->m_flRollDelta;
+	}
+
+	vecVelocity *= flTimeDelta;
+	vecPos += vecVelocity;
+	flLifetime = AddSIMD( flLifetime, flTimeDelta );
+	UpdateRollSIMD( flRoll, flRollDelta, flTimeDelta );
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		ppParticles[i]->m_Pos = vecPos.Vec( i );
+		ppParticles[i]->m_flLifetime = SubFloat( flLifetime, i );
+		ppParticles[i]->m_flRoll = SubFloat( flRoll, i );
+		ppParticles[i]->m_flRollDelta = SubFloat( flRollDelta, i );
+	}
+}
+
+void CSimpleEmitter::PresimulateParticles( CParticleSimulateIterator *pIterator )
+{
+	fltx4 flTimeDelta = ReplicateX4( pIterator->GetTimeDelta() );
+
+	// Windblown particles read the global wind state, so they're left for SimulateParticles.
+	SimpleParticle *pBatch[4];
+	int nBatch = 0;
+
+	SimpleParticle *pParticle = (SimpleParticle*)pIterator->GetFirst();
+	while ( pParticle )
+	{
+		if ( !( pParticle->m_iFlags & SIMPLE_PARTICLE_FLAG_WINDBLOWN ) )
+		{
+			pBatch[nBatch++] = pParticle;
+			if ( nBatch == 4 )
+			{
+				PresimulateBatch( pBatch, flTimeDelta );
+				nBatch = 0;
+			}
+		}
+
+		pParticle = (SimpleParticle*)pIterator->GetNext();
+	}
+
+	if ( nBatch )
+	{
+		// Pad the last batch with a scratch particle.
+		SimpleParticle scratch;
+		scratch.m_Pos.Init();
+		scratch.m_vecVelocity.Init();
+		scratch.m_flLifetime = scratch.m_flRoll = scratch.m_flRollDelta = 0.0f;
+		for ( int i = nBatch; i < 4; i++ )
+		{
+			pBatch[i] = &scratch;
+		}
+		PresimulateBatch( pBatch, flTimeDelta );
+	}
+}
+
 void CSimpleEmitter::RenderParticles( CParticleRenderIterator *pIterator )
 {
 	const SimpleParticle *pParticle = (const SimpleParticle *)pIterator->GetFirst();
@@ -14,6 +14,7 @@
 #include "particlemgr.h"
 #include "particlesphererenderer.h"
 #include "smartptr.h"
+#include "mathlib/ssemath.h"
 
 
 // ------------------------------------------------------------------------------------------------ //
@@ -172,6 +173,11 @@ public:
 	virtual void	SimulateParticles( CParticleSimulateIterator *pIterator );
 	virtual void	RenderParticles( CParticleRenderIterator *pIterator );
 
+	// Moves non-windblown particles four at a time; SimulateParticles then only
+	// handles windblown particles and removes the dead ones.
+	virtual bool	CanPresimulateParticles() const { return m_bCanPresimulate; }
+	virtual void	PresimulateParticles( CParticleSimulateIterator *pIterator );
+
 	void			SetNearClip( float nearClipMin, float nearClipMax );
 
 	void			SetDrawBeforeViewModel( bool state = true );
@@ -189,10 +195,19 @@ protected:
 	virtual	void	UpdateVelocity( SimpleParticle *pParticle, float timeDelta );
 	virtual Vector	UpdateColor( const SimpleParticle *pParticle );
 
+	// SIMD version of UpdateRoll used by PresimulateParticles.
+	virtual void	UpdateRollSIMD( fltx4 &flRoll, fltx4 &flRollDelta, const fltx4 &flTimeDelta );
+
 	float			m_flNearClipMin;
 	float			m_flNearClipMax;
 
+	// Only set by emitters whose UpdateVelocity and UpdateRoll match the
+	// presimulate pass (see CSimpleEmitter::Create).
+	bool			m_bCanPresimulate;
+
 private:
+	void			PresimulateBatch( SimpleParticle **ppParticles, const fltx4 &flTimeDelta );
+
 	CSimpleEmitter( const CSimpleEmitter & ); // not defined, not accessible
 };
 
@@ -22,6 +22,7 @@
 #include "stringpool.h"
 #include "fmtstr.h"
 #include "multiplay_gamerules.h"
+#include "tier0/fasttimer.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -29,9 +30,17 @@
 ConVar rr_debugresponses( "rr_debugresponses", "0", FCVAR_NONE, "Show verbose matching output (1 for simple, 2 for rule scoring). If set to 3, it will only show response success/failure for npc_selected NPCs." );
 ConVar rr_debugrule( "rr_debugrule", "", FCVAR_NONE, "If set to the name of the rule, that rule's score will be shown whenever a concept is passed into the response rules system.");
 ConVar rr_dumpresponses( "rr_dumpresponses", "0", FCVAR_NONE, "Dump all response_rules.txt and rules (requires restart)" );
+ConVar rr_ruleindex( "rr_ruleindex", "1", FCVAR_NONE, "Only score the rules whose required criteria can match, through an index built when the rules are loaded. 0 scores every rule." );
 
 static CUtlSymbolTable g_RS;
 
+class CResponseSystem;
+
+// Criteria sets recorded for rr_benchmark
+static CResponseSystem *g_pBenchmarkSystem = NULL;
+static CUtlVector< AI_CriteriaSet * > g_BenchmarkSets;
+static int g_nBenchmarkSetsToRecord = 0;
+
 inline static char *CopyString( const char *in )
 {
 	if ( !in )
@@ -683,6 +692,12 @@ public:
 	float		LookupEnumeration( const char *name, bool& found );
 
 	int			FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose );
+	void		FindBestMatchingRules( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< int >& bestrules );
+
+	bool		IsIndexableCriterion( Criteria *c );
+	void		BuildRuleIndex();
+	bool		GetCandidateRules( const AI_CriteriaSet& set, CUtlVector< unsigned short >& rules );
+	void		Benchmark( const CUtlVector< AI_CriteriaSet * >& sets, int nReps );
 
 	float		ScoreCriteriaAgainstRule( const AI_CriteriaSet& set, int irule, bool verbose = false );
 	float		RecursiveScoreSubcriteriaAgainstRule( const AI_CriteriaSet& set, Criteria *parent, bool& exclude, bool verbose /*=false*/ );
@@ -710,6 +725,22 @@ public:
 	CUtlDict< Rule, short >	m_Rules;
 	CUtlDict< Enumeration, short > m_Enumerations;
 
+	// Rules keyed by one required criterion they test for equality (the concept
+	// when they have one), so a query only scores the rules that can match it
+	struct RuleIndexEntry_t
+	{
+		CUtlSymbol		name;
+		CUtlSymbol		value;
+		unsigned short	rule;
+	};
+
+	CUtlVector< RuleIndexEntry_t >	m_RuleIndex;			// sorted by name, value then rule
+	CUtlVector< CUtlSymbol >		m_RuleIndexNames;		// each criterion name used as a key
+	CUtlVector< unsigned short >	m_UnindexedRules;		// rules without a key, always scored
+	CUtlSymbolTable					m_RuleIndexNameTable;	// names compare as the criteria set does
+	CUtlSymbolTable					m_RuleIndexValueTable;	// values compare as the matcher does, ignoring case
+	bool							m_bRuleIndexDirty;
+
 	char		token[ 1204 ];
 
 	bool		m_bUnget;
@@ -756,12 +787,13 @@ END_DATADESC()
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
-CResponseSystem::CResponseSystem()
+CResponseSystem::CResponseSystem() : m_RuleIndexValueTable( 0, 32, true )
 {
 	token[0] = 0;
 	m_bUnget = false;
 	m_bPrecache = true;
 	m_bCustomManagable = false;
+	m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -817,6 +849,7 @@ void CResponseSystem::Clear()
 	m_Criteria.RemoveAll();
 	m_Rules.RemoveAll();
 	m_Enumerations.RemoveAll();
+	m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -1685,12 +1718,51 @@ bool CResponseSystem::GetBestResponse( ResponseSearchResult& searchResult, Rule
 int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbose )
 {
 	CUtlVector< int >	bestrules;
+	FindBestMatchingRules( set, verbose, rr_ruleindex.GetBool(), bestrules );
+
+	int bestCount = bestrules.Count();
+	if ( bestCount <= 0 )
+		return -1;
+
+	if ( bestCount == 1 )
+		return bestrules[ 0 ];
+
+	// Randomly pick one of the tied matching rules
+	int idx = random->RandomInt( 0, bestCount - 1 );
+	if ( verbose )
+	{
+		DevMsg( "Found %i matching rules, selecting slot %i\n", bestCount, idx );
+	}
+	return bestrules[ idx ];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects every rule tied for the best score, in rule order
+// Input  : set - 
+//			verbose - 
+//			bUseIndex - only score the rules the rule index can't rule out
+//			bestrules - 
+//-----------------------------------------------------------------------------
+void CResponseSystem::FindBestMatchingRules( const AI_CriteriaSet& set, bool verbose, bool bUseIndex, CUtlVector< int >& bestrules )
+{
+	bestrules.RemoveAll();
 	float bestscore = 0.001f;
 
-	int c = m_Rules.Count();
-	int i;
-	for ( i = 0; i < c; i++ )
+	// Debug output expects every rule to be scored
+	const char *pszText = rr_debugrule.GetString();
+	if ( verbose || ( pszText && pszText[0] ) )
+	{
+		bUseIndex = false;
+	}
+
+	CUtlVector< unsigned short > candidates;
+	bool bIndexed = bUseIndex && GetCandidateRules( set, candidates );
+
+	int c = bIndexed ? candidates.Count() : m_Rules.Count();
+	for ( int j = 0; j < c; j++ )
 	{
+		int i = bIndexed ? candidates[ j ] : j;
+
 		float score = ScoreCriteriaAgainstRule( set, i, verbose );
 		// Check equals so that we keep track of all matching rules
 		if ( score >= bestscore )
@@ -1706,21 +1778,215 @@ int CResponseSystem::FindBestMatchingRule( const AI_CriteriaSet& set, bool verbo
 			bestrules.AddToTail( i );
 		}
 	}
+}
 
-	int bestCount = bestrules.Count();
-	if ( bestCount <= 0 )
-		return -1;
+//-----------------------------------------------------------------------------
+// Purpose: Can a criterion only be met by one exact value?
+//-----------------------------------------------------------------------------
+bool CResponseSystem::IsIndexableCriterion( Criteria *c )
+{
+	// Required, so a rule that fails it scores nothing; compared as a string, so
+	// any other value fails it; not empty, so a set without the criterion fails it
+	if ( c->IsSubCriteriaType() || !c->required || !c->name )
+		return false;
 
-	if ( bestCount == 1 )
-		return bestrules[ 0 ];
+	const Matcher &m = c->matcher;
+	if ( !m.valid || m.isnumeric || m.notequal || m.usemin || m.usemax )
+		return false;
 
-	// Randomly pick one of the tied matching rules
-	int idx = random->RandomInt( 0, bestCount - 1 );
-	if ( verbose )
+	return c->matcher.GetToken()[0] != 0;
+}
+
+static int __cdecl RuleIndexEntryCompare( const CResponseSystem::RuleIndexEntry_t *pLeft, const CResponseSystem::RuleIndexEntry_t *pRight )
+{
+	if ( pLeft->name != pRight->name )
+		return (int)(UtlSymId_t)pLeft->name - (int)(UtlSymId_t)pRight->name;
+	if ( pLeft->value != pRight->value )
+		return (int)(UtlSymId_t)pLeft->value - (int)(UtlSymId_t)pRight->value;
+	return (int)pLeft->rule - (int)pRight->rule;
+}
+
+static int __cdecl RuleNumberCompare( const unsigned short *pLeft, const unsigned short *pRight )
+{
+	return (int)*pLeft - (int)*pRight;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Keys each rule by one of its indexable criteria
+//-----------------------------------------------------------------------------
+void CResponseSystem::BuildRuleIndex()
+{
+	m_RuleIndex.RemoveAll();
+	m_RuleIndexNames.RemoveAll();
+	m_UnindexedRules.RemoveAll();
+	m_RuleIndexNameTable.RemoveAll();
+	m_RuleIndexValueTable.RemoveAll();
+
+	int c = m_Rules.Count();
+	for ( int i = 0; i < c; i++ )
 	{
-		DevMsg( "Found %i matching rules, selecting slot %i\n", bestCount, idx );
+		Rule *rule = &m_Rules[ i ];
+
+		// The concept is the most selective key, otherwise take the first
+		Criteria *key = NULL;
+		int count = rule->m_Criteria.Count();
+		for ( int j = 0; j < count; j++ )
+		{
+			Criteria *pCriteria = &m_Criteria[ rule->m_Criteria[ j ] ];
+			if ( !IsIndexableCriterion( pCriteria ) )
+				continue;
+
+			if ( !key || !Q_stricmp( pCriteria->name, "concept" ) )
+			{
+				key = pCriteria;
+				if ( !Q_stricmp( pCriteria->name, "concept" ) )
+					break;
+			}
+		}
+
+		if ( !key )
+		{
+			m_UnindexedRules.AddToTail( i );
+			continue;
+		}
+
+		RuleIndexEntry_t entry;
+		entry.name = m_RuleIndexNameTable.AddString( key->name );
+		entry.value = m_RuleIndexValueTable.AddString( key->matcher.GetToken() );
+		entry.rule = i;
+		m_RuleIndex.AddToTail( entry );
+
+		if ( m_RuleIndexNames.Find( entry.name ) == m_RuleIndexNames.InvalidIndex() )
+		{
+			m_RuleIndexNames.AddToTail( entry.name );
+		}
 	}
-	return bestrules[ idx ];
+
+	m_RuleIndex.Sort( RuleIndexEntryCompare );
+	m_bRuleIndexDirty = false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Lists the rules that can score against the criteria set, in rule
+//			order.  Returns false if the set can't be looked up, in which case
+//			every rule has to be scored.
+//-----------------------------------------------------------------------------
+bool CResponseSystem::GetCandidateRules( const AI_CriteriaSet& set, CUtlVector< unsigned short >& rules )
+{
+	if ( m_bRuleIndexDirty )
+	{
+		BuildRuleIndex();
+	}
+
+	rules.RemoveAll();
+	rules.AddVectorToTail( m_UnindexedRules );
+
+	FOR_EACH_VEC( m_RuleIndexNames, n )
+	{
+		CUtlSymbol name = m_RuleIndexNames[ n ];
+
+		// Without the criterion none of the rules keyed by it can match
+		int found = set.FindCriterionIndex( m_RuleIndexNameTable.String( name ) );
+		if ( found == -1 )
+			continue;
+
+		const char *value = set.GetValue( found );
+		if ( !value )
+			return false;
+
+		CUtlSymbol valueSymbol = m_RuleIndexValueTable.Find( value );
+		if ( !valueSymbol.IsValid() )
+			continue;
+
+		// Find the first entry for this name and value
+		int lo = 0;
+		int hi = m_RuleIndex.Count();
+		while ( lo < hi )
+		{
+			int mid = ( lo + hi ) / 2;
+			const RuleIndexEntry_t &entry = m_RuleIndex[ mid ];
+			if ( entry.name < name || ( entry.name == name && entry.value < valueSymbol ) )
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for ( ; lo < m_RuleIndex.Count() && m_RuleIndex[ lo ].name == name && m_RuleIndex[ lo ].value == valueSymbol; ++lo )
+		{
+			rules.AddToTail( m_RuleIndex[ lo ].rule );
+		}
+	}
+
+	// Rules are scored in order, so ties are broken the same way
+	rules.Sort( RuleNumberCompare );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Times matching the criteria sets by scoring every rule and through
+//			the rule index, and checks both find the same best rules
+//-----------------------------------------------------------------------------
+void CResponseSystem::Benchmark( const CUtlVector< AI_CriteriaSet * >& sets, int nReps )
+{
+	if ( !sets.Count() )
+	{
+		Msg( "No criteria sets recorded, use rr_benchmark_record first.\n" );
+		return;
+	}
+
+	CUtlVector< int > scanned;
+	CUtlVector< int > indexed;
+	CUtlVector< unsigned short > candidates;
+
+	int nCandidates = 0;
+	int nMismatches = 0;
+	double flScan = 0.0;
+	double flIndex = 0.0;
+
+	CFastTimer timer;
+	for ( int r = 0; r < nReps; ++r )
+	{
+		FOR_EACH_VEC( sets, i )
+		{
+			const AI_CriteriaSet &set = *sets[ i ];
+
+			timer.Start();
+			FindBestMatchingRules( set, false, false, scanned );
+			timer.End();
+			flScan += timer.GetDuration().GetSeconds();
+
+			timer.Start();
+			FindBestMatchingRules( set, false, true, indexed );
+			timer.End();
+			flIndex += timer.GetDuration().GetSeconds();
+
+			if ( r == 0 )
+			{
+				if ( GetCandidateRules( set, candidates ) )
+				{
+					nCandidates += candidates.Count();
+				}
+
+				bool bMatch = ( scanned.Count() == indexed.Count() );
+				for ( int j = 0; bMatch && j < scanned.Count(); ++j )
+				{
+					bMatch = ( scanned[ j ] == indexed[ j ] );
+				}
+
+				if ( !bMatch )
+				{
+					++nMismatches;
+					Msg( "Criteria set %d: %d best rules scoring every rule, %d through the index\n", i, scanned.Count(), indexed.Count() );
+				}
+			}
+		}
+	}
+
+	int nQueries = sets.Count() * nReps;
+	Msg( "%d criteria sets x %d against %d rules:\n", sets.Count(), nReps, m_Rules.Count() );
+	Msg( "  every rule  %8.4f ms per query\n", flScan * 1000.0 / nQueries );
+	Msg( "  rule index  %8.4f ms per query, %.1f rules scored per query\n", flIndex * 1000.0 / nQueries, (float)nCandidates / sets.Count() );
+	Msg( "  %d mismatches\n", nMismatches );
 }
 
 //-----------------------------------------------------------------------------
@@ -1732,6 +1998,15 @@ bool CResponseSystem::FindBestResponse( const AI_CriteriaSet& set, AI_Response&
 {
 	bool valid = false;
 
+	if ( this == g_pBenchmarkSystem && g_nBenchmarkSetsToRecord > 0 )
+	{
+		g_BenchmarkSets.AddToTail( new AI_CriteriaSet( set ) );
+		if ( --g_nBenchmarkSetsToRecord == 0 )
+		{
+			Msg( "Recorded %d criteria sets for rr_benchmark.\n", g_BenchmarkSets.Count() );
+		}
+	}
+
 	int iDbgResponse = rr_debugresponses.GetInt();
 	bool showRules = ( iDbgResponse == 2 );
 	bool showResult = ( iDbgResponse == 1 || iDbgResponse == 2 );
@@ -2607,6 +2882,7 @@ void CResponseSystem::ParseRule( void )
 	if ( validRule )
 	{
 		m_Rules.Insert( ruleName, newRule );
+		m_bRuleIndexDirty = true;
 	}
 	else
 	{
@@ -2804,6 +3080,7 @@ void CResponseSystem::CopyRuleFrom( Rule *pSrcRule, int iRule, CResponseSystem *
 
 	// Add rule.
 	pCustomSystem->m_Rules.Insert( m_Rules.GetElementName( iRule ), dstRule );
+	pCustomSystem->m_bRuleIndexDirty = true;
 }
 
 //-----------------------------------------------------------------------------
@@ -3051,6 +3328,27 @@ CON_COMMAND( rr_reloadresponsesystems, "Reload all response system scripts." )
 #endif
 }
 
+CON_COMMAND( rr_benchmark_record, "Record the criteria sets of the next speech queries for rr_benchmark. Usage: rr_benchmark_record [count]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_BenchmarkSets.PurgeAndDeleteElements();
+	g_pBenchmarkSystem = &defaultresponsesytem;
+	g_nBenchmarkSetsToRecord = ( args.ArgC() > 1 ) ? MAX( atoi( args[ 1 ] ), 1 ) : 256;
+
+	Msg( "Recording the next %d criteria sets.\n", g_nBenchmarkSetsToRecord );
+}
+
+CON_COMMAND( rr_benchmark, "Replay the criteria sets recorded with rr_benchmark_record against the response rules, scoring every rule and through the rule index. Usage: rr_benchmark [repetitions]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nReps = ( args.ArgC() > 1 ) ? MAX( atoi( args[ 1 ] ), 1 ) : 10;
+	defaultresponsesytem.Benchmark( g_BenchmarkSets, nReps );
+}
+
 static short RESPONSESYSTEM_SAVE_RESTORE_VERSION = 1;
 
 // note:  this won't save/restore settings from instanced response systems.  Could add that with a CDefSaveRestoreOps implementation if needed
@@ -145,6 +145,9 @@ public:
 	virtual	void	DispatchAnimEvents ( CBaseAnimating *eventHandler );
 	virtual void	GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Quaternion q[], int boneMask );
 
+	// For each order, the index of the layer GetSkeleton() blends at it, or MAX_OVERLAYS
+	static void		SortSkeletonLayers( int nLayers, const int *pOrders, const bool *pBlended, int *pLayerAtOrder );
+
 	int		AddGestureSequence( int sequence, bool autokill = true );
 	int		AddGestureSequence( int sequence, float flDuration, bool autokill = true );
 	int		AddGesture( Activity activity, bool autokill = true );
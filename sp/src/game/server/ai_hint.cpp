@@ -24,6 +24,9 @@
 #define REPORTFAILURE(text) if ( hintCriteria.HasFlag( bits_HINT_NODE_REPORT_FAILURES ) ) \
 								NDebugOverlay::Text( GetAbsOrigin(), text, false, 60 )
 
+ConVar ai_hint_grid( "ai_hint_grid", "1", 0, "Search hints through a spatial grid instead of scanning every hint of the requested types" );
+ConVar ai_hint_grid_check( "ai_hint_grid_check", "0", 0, "Repeat every grid hint search as a scan of every hint and report when the two find different hints" );
+
 //==================================================
 // CHintCriteria
 //==================================================
@@ -255,6 +258,211 @@ CAIHintVector CAI_HintManager::gm_AllHints;
 CUtlMap< int,  CAIHintVector >	CAI_HintManager::gm_TypedHints( 0, 0, DefLessFunc( int ) );
 CAI_Hint*	CAI_HintManager::gm_pLastFoundHints[ CAI_HintManager::HINT_HISTORY ];
 int			CAI_HintManager::gm_nFoundHintIndex = 0;
+CAI_HintGrid CAI_HintManager::gm_AllHintsGrid;
+CUtlMap< int, CAI_HintGrid * >	CAI_HintManager::gm_TypedHintGrids( 0, 0, DefLessFunc( int ) );
+bool		CAI_HintManager::gm_bHintGridsDirty = true;
+int			CAI_HintManager::gm_nHintGridsCheckTick = -1;
+
+//==================================================
+// CAI_HintGrid
+//==================================================
+
+#define HINT_GRID_CELL_SIZE	512.0f
+
+struct HintGridEntry_t
+{
+	unsigned int key;
+	int index;
+};
+
+static int __cdecl HintGridEntryCompare( const HintGridEntry_t *pLeft, const HintGridEntry_t *pRight )
+{
+	if ( pLeft->key != pRight->key )
+		return ( pLeft->key < pRight->key ) ? -1 : 1;
+	return pLeft->index - pRight->index;
+}
+
+static int __cdecl HintIndexCompare( const int *pLeft, const int *pRight )
+{
+	return *pLeft - *pRight;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the cell column or row containing the coordinate
+//-----------------------------------------------------------------------------
+int CAI_HintGrid::CellCoord( float flCoord )
+{
+	// Search radii can be anything, keep the cell in range of the key
+	flCoord = clamp( flCoord, MIN_COORD_FLOAT * 2, MAX_COORD_FLOAT * 2 );
+	return (int)floor( flCoord * ( 1.0f / HINT_GRID_CELL_SIZE ) );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the index of the cell with the given key, or -1
+//-----------------------------------------------------------------------------
+int CAI_HintGrid::FindCell( unsigned int key ) const
+{
+	int lo = 0;
+	int hi = m_Cells.Count() - 1;
+	while ( lo <= hi )
+	{
+		int mid = ( lo + hi ) / 2;
+		if ( m_Cells[mid].key < key )
+			lo = mid + 1;
+		else if ( m_Cells[mid].key > key )
+			hi = mid - 1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Buckets the hints by their current position
+//-----------------------------------------------------------------------------
+void CAI_HintGrid::Build( const CAIHintVector &hints )
+{
+	m_Cells.RemoveAll();
+	m_HintIndices.RemoveAll();
+	m_Unbucketed.RemoveAll();
+	m_BuildOrigins.SetCount( hints.Count() );
+
+	CUtlVector< HintGridEntry_t > entries;
+	entries.EnsureCapacity( hints.Count() );
+
+	FOR_EACH_VEC( hints, i )
+	{
+		if ( hints[i]->GetMoveParent() )
+		{
+			m_Unbucketed.AddToTail( i );
+			m_BuildOrigins[i] = vec3_invalid;
+			continue;
+		}
+
+		const Vector &origin = hints[i]->GetAbsOrigin();
+		m_BuildOrigins[i] = origin;
+		HintGridEntry_t &entry = entries[ entries.AddToTail() ];
+		entry.key = CellKey( CellCoord( origin.x ), CellCoord( origin.y ) );
+		entry.index = i;
+	}
+
+	entries.Sort( HintGridEntryCompare );
+
+	m_HintIndices.EnsureCapacity( entries.Count() );
+	FOR_EACH_VEC( entries, i )
+	{
+		if ( !m_Cells.Count() || m_Cells.Tail().key != entries[i].key )
+		{
+			Cell_t &cell = m_Cells[ m_Cells.AddToTail() ];
+			cell.key = entries[i].key;
+			cell.iFirst = m_HintIndices.Count();
+			cell.nHints = 0;
+		}
+
+		m_HintIndices.AddToTail( entries[i].index );
+		m_Cells.Tail().nHints++;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Checks the hints against the positions they were bucketed at. 
+//			Hints that gained or lost a move parent count as moved too.
+//-----------------------------------------------------------------------------
+bool CAI_HintGrid::HasMovedHints( const CAIHintVector &hints ) const
+{
+	if ( hints.Count() != m_BuildOrigins.Count() )
+		return true;
+
+	FOR_EACH_VEC( hints, i )
+	{
+		bool bUnbucketed = ( m_BuildOrigins[i] == vec3_invalid );
+		if ( ( hints[i]->GetMoveParent() != NULL ) != bUnbucketed )
+			return true;
+
+		if ( !bUnbucketed && hints[i]->GetAbsOrigin() != m_BuildOrigins[i] )
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects the hints in the cells overlapping the include zones. 
+//			Without include zones the search is unbounded and every hint is a
+//			candidate.
+//-----------------------------------------------------------------------------
+void CAI_HintGrid::GetCandidates( const CHintCriteria &hintCriteria, int nHints, CUtlVector<int> *pResult ) const
+{
+	pResult->RemoveAll();
+
+	if ( !hintCriteria.HasIncludeZones() )
+	{
+		pResult->EnsureCapacity( nHints );
+		for ( int i = 0; i < nHints; ++i )
+		{
+			pResult->AddToTail( i );
+		}
+		return;
+	}
+
+	pResult->AddVectorToTail( m_Unbucketed );
+
+	for ( int iZone = 0; iZone < hintCriteria.NumIncludeZones(); ++iZone )
+	{
+		const Vector &center = hintCriteria.GetIncludeZonePosition( iZone );
+		float flRadius = sqrt( hintCriteria.GetIncludeZoneRadiusSqr( iZone ) );
+
+		int xMin = CellCoord( center.x - flRadius );
+		int xMax = CellCoord( center.x + flRadius );
+		int yMin = CellCoord( center.y - flRadius );
+		int yMax = CellCoord( center.y + flRadius );
+
+		if ( ( xMax - xMin + 1 ) * ( yMax - yMin + 1 ) <= m_Cells.Count() )
+		{
+			// Small zone, look up each cell it covers
+			for ( int x = xMin; x <= xMax; ++x )
+			{
+				for ( int y = yMin; y <= yMax; ++y )
+				{
+					int iCell = FindCell( CellKey( x, y ) );
+					if ( iCell != -1 )
+					{
+						pResult->AddMultipleToTail( m_Cells[iCell].nHints, &m_HintIndices[ m_Cells[iCell].iFirst ] );
+					}
+				}
+			}
+		}
+		else
+		{
+			// Large zone, cheaper to walk the occupied cells
+			FOR_EACH_VEC( m_Cells, iCell )
+			{
+				int x = CellKeyX( m_Cells[iCell].key );
+				int y = CellKeyY( m_Cells[iCell].key );
+				if ( x >= xMin && x <= xMax && y >= yMin && y <= yMax )
+				{
+					pResult->AddMultipleToTail( m_Cells[iCell].nHints, &m_HintIndices[ m_Cells[iCell].iFirst ] );
+				}
+			}
+		}
+	}
+
+	// Back into list order, dropping hints reached through more than one zone
+	pResult->Sort( HintIndexCompare );
+
+	int nUnique = 0;
+	FOR_EACH_VEC( *pResult, i )
+	{
+		if ( !nUnique || pResult->Element( nUnique - 1 ) != pResult->Element( i ) )
+		{
+			pResult->Element( nUnique++ ) = pResult->Element( i );
+		}
+	}
+	pResult->SetCountNonDestructively( nUnique );
+}
+
+//==================================================
+// CAI_HintManager
+//==================================================
 
 CAI_Hint *CAI_HintManager::AddFoundHint( CAI_Hint *hint )
 {
@@ -368,6 +576,206 @@ static void AppendTimer( int idx, char *buf, size_t bufsize, CFastTimer& timer )
 }
 #endif
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the grid of the given hint type, creating it if needed
+//-----------------------------------------------------------------------------
+CAI_HintGrid *CAI_HintManager::GetHintGrid( int hintType )
+{
+	int slot = gm_TypedHintGrids.Find( hintType );
+	if ( slot == gm_TypedHintGrids.InvalidIndex() )
+	{
+		slot = gm_TypedHintGrids.Insert( hintType, new CAI_HintGrid );
+	}
+	return gm_TypedHintGrids[ slot ];
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds the hint grids if hints were added, removed, retyped or
+//			moved since the last search
+//-----------------------------------------------------------------------------
+void CAI_HintManager::UpdateHintGrids()
+{
+	// Hints can be teleported or moved by other code without telling the
+	// hint manager, so check their positions once per tick
+	if ( !gm_bHintGridsDirty && gm_nHintGridsCheckTick != gpGlobals->tickcount )
+	{
+		gm_nHintGridsCheckTick = gpGlobals->tickcount;
+		gm_bHintGridsDirty = gm_AllHintsGrid.HasMovedHints( gm_AllHints );
+	}
+
+	if ( !gm_bHintGridsDirty )
+		return;
+
+	gm_AllHintsGrid.Build( gm_AllHints );
+
+	for ( int i = gm_TypedHints.FirstInorder(); i != gm_TypedHints.InvalidIndex(); i = gm_TypedHints.NextInorder( i ) )
+	{
+		GetHintGrid( gm_TypedHints.Key( i ) )->Build( gm_TypedHints[i] );
+	}
+
+	gm_bHintGridsDirty = false;
+}
+
+struct HintCandidate_t
+{
+	CAI_Hint	*pHint;
+	float		flDistance;	// as HintMatchesCriteria() computes it, so ties are the same
+	int			iOrder;		// position in the lists
+};
+
+static int __cdecl HintCandidateCompare( const HintCandidate_t *pLeft, const HintCandidate_t *pRight )
+{
+	if ( pLeft->flDistance != pRight->flDistance )
+		return ( pLeft->flDistance < pRight->flDistance ) ? -1 : 1;
+
+	// Of equally near hints the linear search settles on the last one
+	return pRight->iOrder - pLeft->iOrder;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The long search of FindHint(), visiting every hint in the lists
+//-----------------------------------------------------------------------------
+CAI_Hint *CAI_HintManager::FindHintInLists( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria, const CUtlVector< CAIHintVector * > &lists, bool bIgnoreHintType, int *pVisited )
+{
+	bool lookingForNearest = hintCriteria.HasFlag( bits_HINT_NODE_NEAREST );
+
+	CAI_Hint *pBestHint = NULL;
+	float flBestDistance = MAX_TRACE_LENGTH;
+
+	for ( int listNum = 0; listNum < lists.Count(); ++listNum )
+	{
+		const CAIHintVector *list = lists[ listNum ];
+		int count = list->Count();
+		// -------------------------------------------
+		//  If we have no hints, bail
+		// -------------------------------------------
+		if ( !count )
+			continue;
+
+		//  Now loop till we find a valid hint or return to the start
+		for ( int i = 0 ; i < count; ++i )
+		{
+			CAI_Hint *pTestHint = list->Element( i );
+			Assert( pTestHint );
+
+			++(*pVisited);
+
+			Assert( dynamic_cast<CAI_Hint *>(pTestHint) != NULL );
+			if ( pTestHint->HintMatchesCriteria( pNPC, hintCriteria, position, &flBestDistance, false, bIgnoreHintType ) )
+			{
+				// If we were searching for the nearest, just note that this is now the nearest node
+				if ( lookingForNearest )
+				{
+					pBestHint = pTestHint;
+				}
+				else 
+				{
+					// If we're not looking for the nearest, we're done
+					return pTestHint;
+				}
+			}
+		} 
+	}
+
+	return pBestHint;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The long search of FindHint(), only visiting the hints the grids
+//			place inside the include zones, and finding the same hint as
+//			FindHintInLists().
+//
+//			The scan keeps the distance of every hint that got as far as the
+//			distance test in HintMatchesCriteria(), even one that then failed
+//			the line of sight or visibility tests, and a later hint only
+//			matches if it is no farther.  So the scan ends on the last hint in
+//			list order that matched with no nearer hint before it reaching the
+//			distance test.  Of two such hints the nearer one comes later, so
+//			testing the candidates nearest first the first one found is the
+//			answer, and the tests are skipped for candidates already beaten by
+//			a nearer, earlier hint.
+//-----------------------------------------------------------------------------
+CAI_Hint *CAI_HintManager::FindHintInGrids( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria, const CUtlVector< CAIHintVector * > &lists, const CUtlVector< CAI_HintGrid * > &grids, bool bIgnoreHintType, int *pVisited )
+{
+	bool lookingForNearest = hintCriteria.HasFlag( bits_HINT_NODE_NEAREST );
+
+	CUtlVector< int > indices;
+	CUtlVector< HintCandidate_t > candidates;
+	int nOrder = 0;
+
+	for ( int listNum = 0; listNum < lists.Count(); ++listNum )
+	{
+		const CAIHintVector *list = lists[ listNum ];
+		grids[ listNum ]->GetCandidates( hintCriteria, list->Count(), &indices );
+
+		if ( !lookingForNearest )
+		{
+			// The first match in list order, as the linear search finds
+			FOR_EACH_VEC( indices, i )
+			{
+				CAI_Hint *pTestHint = list->Element( indices[i] );
+				Assert( dynamic_cast<CAI_Hint *>(pTestHint) != NULL );
+
+				++(*pVisited);
+
+				float flDistance = MAX_TRACE_LENGTH;
+				if ( pTestHint->HintMatchesCriteria( pNPC, hintCriteria, position, &flDistance, false, bIgnoreHintType ) )
+					return pTestHint;
+			}
+			continue;
+		}
+
+		FOR_EACH_VEC( indices, i )
+		{
+			HintCandidate_t &candidate = candidates[ candidates.AddToTail() ];
+			candidate.pHint = list->Element( indices[i] );
+			candidate.flDistance = ( candidate.pHint->GetAbsOrigin() - position ).Length();
+			candidate.iOrder = nOrder + indices[i];
+		}
+		nOrder += list->Count();
+	}
+
+	if ( !lookingForNearest )
+		return NULL;
+
+	candidates.Sort( HintCandidateCompare );
+
+	// First list position of the hints reaching the distance test, of those
+	// strictly nearer than the current candidate and of those as near
+	int iFirstNearer = INT_MAX;
+	int iFirstAsNear = INT_MAX;
+
+	FOR_EACH_VEC( candidates, i )
+	{
+		if ( i > 0 && candidates[i].flDistance != candidates[i-1].flDistance )
+		{
+			iFirstNearer = MIN( iFirstNearer, iFirstAsNear );
+			iFirstAsNear = INT_MAX;
+		}
+
+		// A nearer hint before it in the lists beats it in the scan whether
+		// or not that hint matched
+		if ( candidates[i].iOrder > iFirstNearer )
+			continue;
+
+		CAI_Hint *pTestHint = candidates[i].pHint;
+		Assert( dynamic_cast<CAI_Hint *>(pTestHint) != NULL );
+
+		++(*pVisited);
+
+		float flDistance = MAX_TRACE_LENGTH;
+		if ( pTestHint->HintMatchesCriteria( pNPC, hintCriteria, position, &flDistance, false, bIgnoreHintType ) )
+			return pTestHint;
+
+		if ( flDistance != MAX_TRACE_LENGTH )
+		{
+			iFirstAsNear = MIN( iFirstAsNear, candidates[i].iOrder );
+		}
+	}
+
+	return NULL;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *hintCriteria - 
@@ -383,13 +791,21 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 	bool lookingForNearest = hintCriteria.HasFlag( bits_HINT_NODE_NEAREST );
 	bool bIgnoreHintType = true;
 
+	bool useGrids = ai_hint_grid.GetBool();
+	if ( useGrids )
+	{
+		UpdateHintGrids();
+	}
+
 	CUtlVector< CAIHintVector * > lists;
+	CUtlVector< CAI_HintGrid * > grids;
 	if ( singleType )
 	{
 		int slot = CAI_HintManager::gm_TypedHints.Find( hintCriteria.GetFirstHintType() );
 		if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
 		{
 			lists.AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
+			grids.AddToTail( GetHintGrid( hintCriteria.GetFirstHintType() ) );
 		}
 	}
 	else
@@ -403,6 +819,7 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 				if ( slot != CAI_HintManager::gm_TypedHints.InvalidIndex() )
 				{
 					lists.AddToTail( &CAI_HintManager::gm_TypedHints[ slot ] );
+					grids.AddToTail( GetHintGrid( hintCriteria.GetHintType( listType ) ) );
 				}
 			}
 		}
@@ -410,6 +827,7 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 		{
 			// Still need to check hint type in this case
 			lists.AddToTail( &CAI_HintManager::gm_AllHints );
+			grids.AddToTail( &CAI_HintManager::gm_AllHintsGrid );
 			bIgnoreHintType = false;
 		}
 	}
@@ -452,47 +870,34 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 		}
 	}
 
-	// Longer search, reset best distance
-	flBestDistance = MAX_TRACE_LENGTH;
-
-	for ( int listNum = 0; listNum < listCount; ++listNum )
+	// Longer search
+	if ( useGrids )
 	{
-		CAIHintVector *list = lists[ listNum ];
-		count = list->Count();
-		// -------------------------------------------
-		//  If we have no hints, bail
-		// -------------------------------------------
-		if ( !count )
-			continue;
+		pBestHint = FindHintInGrids( pNPC, position, hintCriteria, lists, grids, bIgnoreHintType, &visited );
 
-		//  Now loop till we find a valid hint or return to the start
-		for ( i = 0 ; i < count; ++i )
+		if ( ai_hint_grid_check.GetBool() )
 		{
-			pTestHint = list->Element( i );
-			Assert( pTestHint );
+			static int nChecked = 0;
+			static int nMismatches = 0;
 
-			++visited;
+			int linearVisited = 0;
+			CAI_Hint *pLinearHint = FindHintInLists( pNPC, position, hintCriteria, lists, bIgnoreHintType, &linearVisited );
 
-			Assert( dynamic_cast<CAI_Hint *>(pTestHint) != NULL );
-			if ( pTestHint->HintMatchesCriteria( pNPC, hintCriteria, position, &flBestDistance, false, bIgnoreHintType ) )
+			++nChecked;
+			if ( pLinearHint != pBestHint )
 			{
-				// If we were searching for the nearest, just note that this is now the nearest node
-				if ( lookingForNearest )
-				{
-					pBestHint = pTestHint;
-				}
-				else 
-				{
-					// If we're not looking for the nearest, we're done
-					CAI_HintManager::AddFoundHint( pTestHint );
-#if defined( HINT_PROFILING )
-					Msg( "visited %d\n", visited );
-#endif
-					return pTestHint;
-				}
+				++nMismatches;
+				Msg( "Hint search mismatch (%d of %d searches) for %s at %.0f %.0f %.0f: grid found %d, scan found %d\n", 
+					nMismatches, nChecked, pNPC ? pNPC->GetDebugName() : "no NPC", position.x, position.y, position.z, 
+					pBestHint ? pBestHint->entindex() : -1, pLinearHint ? pLinearHint->entindex() : -1 );
 			}
-		} 
+		}
 	}
+	else
+	{
+		pBestHint = FindHintInLists( pNPC, position, hintCriteria, lists, bIgnoreHintType, &visited );
+	}
+
 	// Return the nearest node that we found
 	if ( pBestHint )
 	{
@@ -502,7 +907,12 @@ CAI_Hint *CAI_HintManager::FindHint( CAI_BaseNPC *pNPC, const Vector &position,
 #if defined( HINT_PROFILING )
 	timer.End();
 
-	Msg( "visited %d\n", visited );
+	int total = 0;
+	for ( int listNum = 0; listNum < listCount; ++listNum )
+	{
+		total += lists[ listNum ]->Count();
+	}
+	Msg( "visited %d of %d%s\n", visited, total, useGrids ? " (grid)" : "" );
 	if ( !pBestHint )
 	{
 		Msg( "%i search failed for [%d] at pos %.3f %.3f %.3f [%.4f msec ~ %.4f msec per node]\n",
@@ -643,6 +1053,7 @@ void CAI_HintManager::AddHintByType( CAI_Hint *pHint )
 		slot = CAI_HintManager::gm_TypedHints.Insert( type);
 	}
 	CAI_HintManager::gm_TypedHints[ slot ].AddToTail( pHint );
+	CAI_HintManager::gm_bHintGridsDirty = true;
 }
 
 void CAI_HintManager::RemoveHintByType( CAI_Hint *pHintToRemove )
@@ -652,6 +1063,7 @@ void CAI_HintManager::RemoveHintByType( CAI_Hint *pHintToRemove )
 	{
 		CAI_HintManager::gm_TypedHints[ slot ].FindAndRemove( pHintToRemove );
 	}
+	CAI_HintManager::gm_bHintGridsDirty = true;
 }
 
 //------------------------------------------------------------------------------
@@ -151,6 +151,10 @@ public:
 	bool		InIncludedZone( const Vector &testPosition ) const;
 	bool		InExcludedZone( const Vector &testPosition ) const;
 
+	int			NumIncludeZones( void ) const				{ return m_zoneInclude.Count(); }
+	const Vector &GetIncludeZonePosition( int idx ) const	{ return m_zoneInclude[idx].position; }
+	float		GetIncludeZoneRadiusSqr( int idx ) const	{ return m_zoneInclude[idx].radiussqr; }
+
 	int			NumHintTypes() const;
 	int			GetHintType( int idx ) const;
 
@@ -205,6 +209,48 @@ public:
 	}
 };
 
+//-----------------------------------------------------------------------------
+// CAI_HintGrid
+//
+// Purpose: Buckets the hints of one hint list by position so that searches
+//			bounded by include zones only visit the hints near those zones.
+//			Positions are taken when the grid is built, so hints with a move
+//			parent aren't bucketed and are always visited, and the grids are
+//			rebuilt once a bucketed hint moves (see HasMovedHints).
+//-----------------------------------------------------------------------------
+
+class CAI_HintGrid
+{
+public:
+	void				Build( const CAIHintVector &hints );
+
+	// Indices into the hint list of every hint that could be inside the
+	// include zones of the criteria, in list order
+	void				GetCandidates( const CHintCriteria &hintCriteria, int nHints, CUtlVector<int> *pResult ) const;
+
+	// True if a bucketed hint was teleported or parented since the grid was built
+	bool				HasMovedHints( const CAIHintVector &hints ) const;
+
+private:
+	struct Cell_t
+	{
+		unsigned int	key;
+		int				iFirst;
+		int				nHints;
+	};
+
+	static int			CellCoord( float flCoord );
+	static unsigned int	CellKey( int x, int y )			{ return ( (unsigned int)( x + 0x8000 ) << 16 ) | (unsigned int)( y + 0x8000 ); }
+	static int			CellKeyX( unsigned int key )	{ return (int)( key >> 16 ) - 0x8000; }
+	static int			CellKeyY( unsigned int key )	{ return (int)( key & 0xffff ) - 0x8000; }
+	int					FindCell( unsigned int key ) const;
+
+	CUtlVector<Cell_t>	m_Cells;						// sorted by key
+	CUtlVector<int>		m_HintIndices;					// grouped by cell
+	CUtlVector<int>		m_Unbucketed;
+	CUtlVector<Vector>	m_BuildOrigins;					// per hint, vec3_invalid if unbucketed
+};
+
 class CAI_HintManager
 {
 	friend class CAI_Hint;
@@ -253,10 +299,19 @@ private:
 	static void			ResetFoundHints();
 	static bool			IsInFoundHintList( CAI_Hint *hint );
 
+	static CAI_Hint		*FindHintInLists( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria, const CUtlVector< CAIHintVector * > &lists, bool bIgnoreHintType, int *pVisited );
+	static CAI_Hint		*FindHintInGrids( CAI_BaseNPC *pNPC, const Vector &position, const CHintCriteria &hintCriteria, const CUtlVector< CAIHintVector * > &lists, const CUtlVector< CAI_HintGrid * > &grids, bool bIgnoreHintType, int *pVisited );
+	static CAI_HintGrid	*GetHintGrid( int hintType );
+	static void			UpdateHintGrids();
+
 	static int			gm_nFoundHintIndex;
 	static CAI_Hint		*gm_pLastFoundHints[ HINT_HISTORY ];			// Last used hint 
 	static CAIHintVector gm_AllHints;				// A linked list of all hints
 	static CUtlMap< int,  CAIHintVector >	gm_TypedHints;
+	static CAI_HintGrid	gm_AllHintsGrid;
+	static CUtlMap< int, CAI_HintGrid * >	gm_TypedHintGrids;
+	static bool			gm_bHintGridsDirty;		// rebuild the grids before the next search
+	static int			gm_nHintGridsCheckTick;	// last tick the grids were checked for moved hints
 };
 
 //-----------------------------------------------------------------------------
@@ -16,12 +16,17 @@
 #include "ai_navigator.h"
 #include "ai_networkmanager.h"
 #include "ai_hint.h"
+#include "tier1/utlhashtable.h"
+#include "tier1/generichash.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
 ConVar ai_find_lateral_cover( "ai_find_lateral_cover", "1" );
 ConVar ai_find_lateral_los( "ai_find_lateral_los", "1" );
+ConVar ai_node_test_cache( "ai_node_test_cache", "1", 0, "Share the cover and line of sight tests of node searches between NPCs for ai_node_test_cache_time seconds" );
+ConVar ai_node_test_cache_time( "ai_node_test_cache_time", "0.5" );
+ConVar ai_node_test_cache_report( "ai_node_test_cache_report", "0", 0, "Report the node tests done and taken from the cache by each cover and line of sight search" );
 
 #ifdef _DEBUG
 ConVar ai_debug_cover( "ai_debug_cover", "0" );
@@ -321,6 +326,140 @@ int CAI_TacticalServices::FindBackAwayNode(const Vector &vecThreat )
 	return NO_NODE;
 }
 
+//-----------------------------------------------------------------------------
+// Node test cache
+//
+// Squad members fighting the same enemy search the same nodes against nearly
+// the same threat position, so the result of each cover or shoot position test
+// is kept for a short time.  A result is shared between NPCs of the same class,
+// weapon and enemy, testing from the same position at the node against a
+// threat in the same cell.  The whole cache is dropped every
+// ai_node_test_cache_time seconds.
+//-----------------------------------------------------------------------------
+
+#define AI_NODE_TEST_CACHE_CELL	16.0f
+
+struct AI_NodeTestKey_t
+{
+	int			iNode;
+	int			iHull;
+	int			threatCell[3];		// threat eye position
+	int			testOffset[3];		// tested position, relative to the node
+	string_t	iszClass;
+	string_t	iszWeapon;
+	int			hEnemy;
+	int			bCover;
+};
+
+struct AI_NodeTestKeyHashFunctor
+{
+	unsigned int operator()( const AI_NodeTestKey_t &key ) const { return HashBlock( &key, sizeof( key ) ); }
+};
+
+struct AI_NodeTestKeyEqualFunctor
+{
+	bool operator()( const AI_NodeTestKey_t &a, const AI_NodeTestKey_t &b ) const { return memcmp( &a, &b, sizeof( a ) ) == 0; }
+};
+
+static CUtlHashtable< AI_NodeTestKey_t, bool, AI_NodeTestKeyHashFunctor, AI_NodeTestKeyEqualFunctor > g_AINodeTestCache;
+static float g_flAINodeTestCacheStart = -1.0f;
+
+static void AI_MakeNodeTestKey( CAI_BaseNPC *pOuter, bool bCover, int iNode, const Vector &vNodeOrigin, const Vector &vTestPos, const Vector &vThreatEyePos, AI_NodeTestKey_t *pKey )
+{
+	// Padding is hashed and compared too
+	memset( pKey, 0, sizeof( *pKey ) );
+
+	pKey->iNode = iNode;
+	pKey->iHull = pOuter->GetHullType();
+	for ( int i = 0; i < 3; i++ )
+	{
+		pKey->threatCell[i] = (int)floor( vThreatEyePos[i] * ( 1.0f / AI_NODE_TEST_CACHE_CELL ) );
+		pKey->testOffset[i] = RoundFloatToInt( vTestPos[i] - vNodeOrigin[i] );
+	}
+	pKey->iszClass = pOuter->m_iClassname;
+	pKey->iszWeapon = ( pOuter->GetActiveWeapon() ) ? pOuter->GetActiveWeapon()->m_iClassname : NULL_STRING;
+	pKey->hEnemy = pOuter->GetEnemy() ? pOuter->GetEnemy()->GetRefEHandle().ToInt() : 0;
+	pKey->bCover = bCover;
+}
+
+//-------------------------------------
+
+bool CAI_TacticalServices::LookupNodeTest( bool bCover, int iNode, const Vector &vNodeOrigin, const Vector &vTestPos, const Vector &vThreatEyePos, bool *pResult )
+{
+	if ( !ai_node_test_cache.GetBool() )
+		return false;
+
+	// Drop the cache when it has aged out, or the map changed under it
+	if ( gpGlobals->curtime < g_flAINodeTestCacheStart || gpGlobals->curtime >= g_flAINodeTestCacheStart + ai_node_test_cache_time.GetFloat() )
+	{
+		g_AINodeTestCache.RemoveAll();
+		g_flAINodeTestCacheStart = gpGlobals->curtime;
+		return false;
+	}
+
+	AI_NodeTestKey_t key;
+	AI_MakeNodeTestKey( GetOuter(), bCover, iNode, vNodeOrigin, vTestPos, vThreatEyePos, &key );
+
+	const bool *pCached = g_AINodeTestCache.GetPtr( key );
+	if ( !pCached )
+		return false;
+
+	*pResult = *pCached;
+	return true;
+}
+
+//-------------------------------------
+
+void CAI_TacticalServices::StoreNodeTest( bool bCover, int iNode, const Vector &vNodeOrigin, const Vector &vTestPos, const Vector &vThreatEyePos, bool bResult )
+{
+	if ( !ai_node_test_cache.GetBool() )
+		return;
+
+	AI_NodeTestKey_t key;
+	AI_MakeNodeTestKey( GetOuter(), bCover, iNode, vNodeOrigin, vTestPos, vThreatEyePos, &key );
+	g_AINodeTestCache.Insert( key, bResult );
+}
+
+//-------------------------------------
+// Does the NPC's eye at the node have cover from the threat?
+//-------------------------------------
+
+bool CAI_TacticalServices::IsCoverNode( int iNode, const Vector &vNodeOrigin, const Vector &vEyePos, const Vector &vThreatEyePos, int *pTests, int *pCacheHits )
+{
+	++(*pTests);
+
+	bool bResult;
+	if ( LookupNodeTest( true, iNode, vNodeOrigin, vEyePos, vThreatEyePos, &bResult ) )
+	{
+		++(*pCacheHits);
+		return bResult;
+	}
+
+	bResult = GetOuter()->IsCoverPosition( vThreatEyePos, vEyePos );
+	StoreNodeTest( true, iNode, vNodeOrigin, vEyePos, vThreatEyePos, bResult );
+	return bResult;
+}
+
+//-------------------------------------
+// Can the NPC shoot the threat from the node?
+//-------------------------------------
+
+bool CAI_TacticalServices::IsShootNode( int iNode, const Vector &vNodeOrigin, const Vector &vThreatEyePos, int *pTests, int *pCacheHits )
+{
+	++(*pTests);
+
+	bool bResult;
+	if ( LookupNodeTest( false, iNode, vNodeOrigin, vNodeOrigin, vThreatEyePos, &bResult ) )
+	{
+		++(*pCacheHits);
+		return bResult;
+	}
+
+	bResult = GetOuter()->TestShootPosition( vNodeOrigin, vThreatEyePos );
+	StoreNodeTest( false, iNode, vNodeOrigin, vNodeOrigin, vThreatEyePos, bResult );
+	return bResult;
+}
+
 //-------------------------------------
 // FindCover - tries to find a nearby node that will hide
 // the caller from its enemy. 
@@ -385,6 +524,9 @@ int CAI_TacticalServices::FindCoverNode(const Vector &vNearPos, const Vector &vT
 
 	static int nSearchRandomizer = 0;		// tries to ensure the links are searched in a different order each time;
 
+	int nTests = 0;
+	int nCacheHits = 0;
+
 	// Search until the list is empty
 	while( list.Count() )
 	{
@@ -404,7 +546,7 @@ int CAI_TacticalServices::FindCoverNode(const Vector &vNearPos, const Vector &vT
 			if ( GetOuter()->IsValidCover( nodeOrigin, pNode->GetHint() ) )
 			{
 				// Check if this location will block the threat's line of sight to me
-				if (GetOuter()->IsCoverPosition(vThreatEyePos, vEyePos))
+				if ( IsCoverNode( nodeIndex, nodeOrigin, vEyePos, vThreatEyePos, &nTests, &nCacheHits ) )
 				{
 					// --------------------------------------------------------
 					// Don't let anyone else use this node for a while
@@ -425,6 +567,11 @@ int CAI_TacticalServices::FindCoverNode(const Vector &vNearPos, const Vector &vT
 					// The next NPC who searches should use a slight different pattern
 					nSearchRandomizer = nodeIndex;
 					DebugFindCover( pNode->GetId(), vEyePos, vThreatEyePos, 0, 255, 0 );
+
+					if ( ai_node_test_cache_report.GetBool() )
+					{
+						DevMsg( "%s FindCoverNode: found node %d, %d cover tests, %d from cache\n", GetEntClassname(), nodeIndex, nTests, nCacheHits );
+					}
 					return nodeIndex;
 				}
 				else
@@ -478,6 +625,11 @@ int CAI_TacticalServices::FindCoverNode(const Vector &vNearPos, const Vector &vT
 		}
 	}
 
+	if ( ai_node_test_cache_report.GetBool() )
+	{
+		DevMsg( "%s FindCoverNode: failed, %d cover tests, %d from cache\n", GetEntClassname(), nTests, nCacheHits );
+	}
+
 	// We failed.  Not cover node was found
 	// Clear hint node used to set ducking
 	GetOuter()->ClearHintNode();
@@ -531,6 +683,9 @@ int CAI_TacticalServices::FindLosNode(const Vector &vThreatPos, const Vector &vT
 
 	static int nSearchRandomizer = 0;		// tries to ensure the links are searched in a different order each time;
 
+	int nTests = 0;
+	int nCacheHits = 0;
+
 	while ( list.Count() )
 	{
 		int nodeIndex = list.ElementAtHead().nodeIndex;
@@ -595,7 +750,7 @@ int CAI_TacticalServices::FindLosNode(const Vector &vThreatPos, const Vector &vT
 					CAI_Node *pNode = GetNetwork()->GetNode(nodeIndex);
 					if ( GetOuter()->IsValidShootPosition( nodeOrigin, pNode, pNode->GetHint() ) )
 					{
-						if (GetOuter()->TestShootPosition(nodeOrigin,vThreatEyePos))
+						if ( IsShootNode( nodeIndex, nodeOrigin, vThreatEyePos, &nTests, &nCacheHits ) )
 						{
 							// Note when this node was used, so we don't try 
 							// to use it again right away.
@@ -623,6 +778,11 @@ int CAI_TacticalServices::FindLosNode(const Vector &vThreatPos, const Vector &vT
 
 							// The next NPC who searches should use a slight different pattern
 							nSearchRandomizer = nodeIndex;
+
+							if ( ai_node_test_cache_report.GetBool() )
+							{
+								DevMsg( "%s FindLosNode: found node %d, %d shoot tests, %d from cache\n", GetEntClassname(), nodeIndex, nTests, nCacheHits );
+							}
 							return nodeIndex;
 						}
 						else
@@ -672,6 +832,11 @@ int CAI_TacticalServices::FindLosNode(const Vector &vThreatPos, const Vector &vT
 			}
 		}
 	}
+	if ( ai_node_test_cache_report.GetBool() )
+	{
+		DevMsg( "%s FindLosNode: failed, %d shoot tests, %d from cache\n", GetEntClassname(), nTests, nCacheHits );
+	}
+
 	// We failed.  No range attack node node was found
 	return NO_NODE;
 }
@@ -58,6 +58,12 @@ private:
 	int				FindCoverNode( const Vector &vThreatPos, const Vector &vThreatEyePos, float flMinDist, float flMaxDist );
 	int				FindCoverNode( const Vector &vNearPos, const Vector &vThreatPos, const Vector &vThreatEyePos, float flMinDist, float flMaxDist );
 	int				FindLosNode( const Vector &vThreatPos, const Vector &vThreatEyePos, float flMinThreatDist, float flMaxThreatDist, float flBlockTime, FlankType_t eFlankType, const Vector &vThreatFacing, float flFlankParam );
+
+	// Cover and shoot position tests on nodes, shared between searches for a short time
+	bool			IsCoverNode( int iNode, const Vector &vNodeOrigin, const Vector &vEyePos, const Vector &vThreatEyePos, int *pTests, int *pCacheHits );
+	bool			IsShootNode( int iNode, const Vector &vNodeOrigin, const Vector &vThreatEyePos, int *pTests, int *pCacheHits );
+	bool			LookupNodeTest( bool bCover, int iNode, const Vector &vNodeOrigin, const Vector &vTestPos, const Vector &vThreatEyePos, bool *pResult );
+	void			StoreNodeTest( bool bCover, int iNode, const Vector &vNodeOrigin, const Vector &vTestPos, const Vector &vThreatEyePos, bool bResult );
 	
 	Vector			GetNodePos( int );
 
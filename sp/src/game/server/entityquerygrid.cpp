@@ -0,0 +1,651 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: A loose 2D grid of the bounds of every edict entity, used to
+//			answer UTIL_EntitiesInBox, UTIL_EntitiesInSphere and
+//			gEntList.FindEntityInSphere.
+//
+//			Every entry keeps the bounds the spatial partition was last given
+//			for it, so box and sphere queries return exactly what the
+//			partition's PARTITION_ENGINE_NON_STATIC_EDICTS list would, and a
+//			box around its collision origin that holds its collision box at
+//			any angles, so FindEntityInSphere only has to run its exact test
+//			on the entities near the sphere. Entries are placed again when
+//			the collision property updates the partition; ones moved since
+//			then are kept in a list that every query checks.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "entityquerygrid.h"
+#include "collisionutils.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_entity_query_grid( "sv_entity_query_grid", "1", 0, "Answer box and sphere entity queries from a grid of entity bounds instead of the spatial partition and the entity list." );
+ConVar sv_entity_query_cache( "sv_entity_query_cache", "1", 0, "Reuse the results of entity queries repeated within a tick, as long as no entity has moved since." );
+
+CEntityQueryGrid g_EntityQueryGrid;
+
+static const char *s_pQueryTypeNames[] =
+{
+	"box",
+	"sphere",
+	"find in sphere",
+	"boxes",
+};
+
+
+//-----------------------------------------------------------------------------
+// Constructor
+//-----------------------------------------------------------------------------
+CEntityQueryGrid::CEntityQueryGrid()
+{
+	for ( int i = 0; i < MAX_EDICTS; ++i )
+	{
+		m_Entries[i].m_pEntity = NULL;
+		m_Entries[i].m_iList = LIST_NONE;
+		m_Entries[i].m_iPrev = m_Entries[i].m_iNext = -1;
+	}
+
+	for ( int i = 0; i < LIST_COUNT; ++i )
+	{
+		m_ListHead[i] = -1;
+	}
+
+	for ( int i = 0; i < ENTITY_QUERY_CACHE_SIZE; ++i )
+	{
+		m_Cache[i].m_nTick = -1;
+	}
+
+	memset( m_CellStamp, 0, sizeof( m_CellStamp ) );
+	m_nStamp = 0;
+	m_nNextSequence = 1;
+	m_nGeneration = 0;
+	m_nNextCacheSlot = 0;
+	ClearStats();
+}
+
+
+//-----------------------------------------------------------------------------
+// Lists
+//-----------------------------------------------------------------------------
+void CEntityQueryGrid::Link( int iEntry, int iList )
+{
+	Entry_t &entry = m_Entries[iEntry];
+	Assert( entry.m_iList == LIST_NONE );
+
+	entry.m_iList = iList;
+	entry.m_iPrev = -1;
+	entry.m_iNext = m_ListHead[iList];
+	if ( entry.m_iNext >= 0 )
+	{
+		m_Entries[entry.m_iNext].m_iPrev = iEntry;
+	}
+	m_ListHead[iList] = iEntry;
+}
+
+void CEntityQueryGrid::Unlink( int iEntry )
+{
+	Entry_t &entry = m_Entries[iEntry];
+	if ( entry.m_iList == LIST_NONE )
+		return;
+
+	if ( entry.m_iPrev >= 0 )
+	{
+		m_Entries[entry.m_iPrev].m_iNext = entry.m_iNext;
+	}
+	else
+	{
+		m_ListHead[entry.m_iList] = entry.m_iNext;
+	}
+
+	if ( entry.m_iNext >= 0 )
+	{
+		m_Entries[entry.m_iNext].m_iPrev = entry.m_iPrev;
+	}
+
+	entry.m_iList = LIST_NONE;
+	entry.m_iPrev = entry.m_iNext = -1;
+}
+
+int CEntityQueryGrid::GetEntryIndex( CBaseEntity *pEntity ) const
+{
+	int iEntry = pEntity->GetRefEHandle().GetEntryIndex();
+	if ( iEntry < 0 || iEntry >= MAX_EDICTS || m_Entries[iEntry].m_pEntity != pEntity )
+		return -1;
+	return iEntry;
+}
+
+
+//-----------------------------------------------------------------------------
+// Called by the entity list as entities are added and removed
+//-----------------------------------------------------------------------------
+void CEntityQueryGrid::AddEntity( CBaseEntity *pEntity, int iEntIndex )
+{
+	if ( iEntIndex < 0 || iEntIndex >= MAX_EDICTS || !pEntity->edict() )
+		return;
+
+	Entry_t &entry = m_Entries[iEntIndex];
+	Assert( !entry.m_pEntity );
+	Unlink( iEntIndex );
+
+	// The partition handle is usually made later, but catch the ones made before
+	CCollisionProperty *pCollision = pEntity->CollisionProp();
+	entry.m_pEntity = pEntity;
+	entry.m_nSequence = m_nNextSequence++;
+	entry.m_bHasPartitionBounds = false;
+	entry.m_bInPartition = ( iEntIndex != 0 ) && ( pCollision->GetPartitionHandle() != PARTITION_INVALID_HANDLE ) &&
+		( pCollision->IsSolid() || pCollision->IsSolidFlagSet( FSOLID_TRIGGER ) || pEntity->IsEFlagSet( EFL_USE_PARTITION_WHEN_NOT_SOLID ) );
+
+	// Nothing is known about where it is until the collision property updates the partition
+	Link( iEntIndex, LIST_UNPLACED );
+	++m_nGeneration;
+}
+
+void CEntityQueryGrid::RemoveEntity( int iEntIndex )
+{
+	if ( iEntIndex < 0 || iEntIndex >= MAX_EDICTS || !m_Entries[iEntIndex].m_pEntity )
+		return;
+
+	Unlink( iEntIndex );
+	m_Entries[iEntIndex].m_pEntity = NULL;
+	++m_nGeneration;
+}
+
+
+//-----------------------------------------------------------------------------
+// Called by the collision property as it keeps the partition up to date
+//-----------------------------------------------------------------------------
+void CEntityQueryGrid::MarkEntityDirty( CBaseEntity *pEntity )
+{
+	int iEntry = GetEntryIndex( pEntity );
+	if ( iEntry < 0 || m_Entries[iEntry].m_iList == LIST_UNPLACED )
+		return;
+
+	// Its collision box may be anywhere now, but the partition keeps the
+	// old bounds until it's updated, and so do we
+	Unlink( iEntry );
+	Link( iEntry, LIST_UNPLACED );
+	++m_nGeneration;
+}
+
+void CEntityQueryGrid::ElementMoved( CBaseEntity *pEntity, const Vector &mins, const Vector &maxs )
+{
+	int iEntry = GetEntryIndex( pEntity );
+	if ( iEntry < 0 )
+		return;
+
+	Entry_t &entry = m_Entries[iEntry];
+	entry.m_vecPartitionMins = mins;
+	entry.m_vecPartitionMaxs = maxs;
+	entry.m_bHasPartitionBounds = true;
+	++m_nGeneration;
+}
+
+void CEntityQueryGrid::UpdateEntity( CBaseEntity *pEntity )
+{
+	int iEntry = GetEntryIndex( pEntity );
+	if ( iEntry < 0 )
+		return;
+
+	Entry_t &entry = m_Entries[iEntry];
+
+	// The collision box at any angles stays within its bounding sphere
+	CCollisionProperty *pCollision = pEntity->CollisionProp();
+	Vector vecSize = pCollision->OBBMaxs() - pCollision->OBBMins();
+	float flExtent = pCollision->OBBCenter().Length() + vecSize.Length() * 0.5f;
+	Vector vecExtent( flExtent, flExtent, flExtent );
+	entry.m_vecBoundsMins = pCollision->GetCollisionOrigin() - vecExtent;
+	entry.m_vecBoundsMaxs = pCollision->GetCollisionOrigin() + vecExtent;
+
+	if ( entry.m_bInPartition && entry.m_bHasPartitionBounds )
+	{
+		VectorMin( entry.m_vecBoundsMins, entry.m_vecPartitionMins, entry.m_vecBoundsMins );
+		VectorMax( entry.m_vecBoundsMaxs, entry.m_vecPartitionMaxs, entry.m_vecBoundsMaxs );
+	}
+
+	int iList;
+	Vector vecHalfSize = ( entry.m_vecBoundsMaxs - entry.m_vecBoundsMins ) * 0.5f;
+	if ( vecHalfSize.x > ENTITY_GRID_CELL_SIZE * 0.5f || vecHalfSize.y > ENTITY_GRID_CELL_SIZE * 0.5f )
+	{
+		iList = LIST_OVERSIZED;
+	}
+	else
+	{
+		Vector vecCenter = entry.m_vecBoundsMins + vecHalfSize;
+		iList = GetCellCoord( vecCenter.y ) * ENTITY_GRID_CELLS_PER_SIDE + GetCellCoord( vecCenter.x );
+	}
+
+	Unlink( iEntry );
+	Link( iEntry, iList );
+	++m_nGeneration;
+}
+
+void CEntityQueryGrid::SetEntityInPartition( CBaseEntity *pEntity, bool bInPartition )
+{
+	int iEntry = GetEntryIndex( pEntity );
+	if ( iEntry < 0 || m_Entries[iEntry].m_bInPartition == bInPartition )
+		return;
+
+	Entry_t &entry = m_Entries[iEntry];
+	entry.m_bInPartition = bInPartition;
+	++m_nGeneration;
+
+	// Entities are taken out and put back in whenever their solid type may
+	// have changed, so only move it when its bounds in the partition weren't
+	// part of what it was placed by. Until it's placed again every query checks it,
+	// as they do the oversized ones.
+	if ( !bInPartition || !entry.m_bHasPartitionBounds || entry.m_iList == LIST_UNPLACED || entry.m_iList == LIST_OVERSIZED )
+		return;
+
+	if ( !IsPointInBox( entry.m_vecPartitionMins, entry.m_vecBoundsMins, entry.m_vecBoundsMaxs ) ||
+		!IsPointInBox( entry.m_vecPartitionMaxs, entry.m_vecBoundsMins, entry.m_vecBoundsMaxs ) )
+	{
+		Unlink( iEntry );
+		Link( iEntry, LIST_UNPLACED );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Queries have to be made on the main thread, since they share scratch space
+//-----------------------------------------------------------------------------
+bool CEntityQueryGrid::IsEnabled() const
+{
+	return sv_entity_query_grid.GetBool() && ThreadInMainThread();
+}
+
+bool CEntityQueryGrid::HasEntity( CBaseEntity *pEntity ) const
+{
+	return GetEntryIndex( pEntity ) >= 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Cells
+//-----------------------------------------------------------------------------
+int CEntityQueryGrid::GetCellCoord( float flCoord ) const
+{
+	int nCoord = Floor2Int( ( flCoord - MIN_COORD_INTEGER ) * ( 1.0f / ENTITY_GRID_CELL_SIZE ) );
+	return clamp( nCoord, 0, ENTITY_GRID_CELLS_PER_SIDE - 1 );
+}
+
+void CEntityQueryGrid::GetCellRange( const Vector &mins, const Vector &maxs, int *pMinX, int *pMinY, int *pMaxX, int *pMaxY ) const
+{
+	// Entries are in the cell of their center, and are at most half a cell across
+	const float flBloat = ENTITY_GRID_CELL_SIZE * 0.5f;
+	*pMinX = GetCellCoord( mins.x - flBloat );
+	*pMinY = GetCellCoord( mins.y - flBloat );
+	*pMaxX = GetCellCoord( maxs.x + flBloat );
+	*pMaxY = GetCellCoord( maxs.y + flBloat );
+}
+
+void CEntityQueryGrid::GatherListCandidates( int iList, CUtlVector< int > &candidates )
+{
+	for ( int iEntry = m_ListHead[iList]; iEntry >= 0; iEntry = m_Entries[iEntry].m_iNext )
+	{
+		candidates.AddToTail( iEntry );
+	}
+}
+
+void CEntityQueryGrid::GatherCellCandidates( const Vector &mins, const Vector &maxs, CUtlVector< int > &candidates )
+{
+	int nMinX, nMinY, nMaxX, nMaxY;
+	GetCellRange( mins, maxs, &nMinX, &nMinY, &nMaxX, &nMaxY );
+
+	for ( int y = nMinY; y <= nMaxY; ++y )
+	{
+		for ( int x = nMinX; x <= nMaxX; ++x )
+		{
+			int iCell = y * ENTITY_GRID_CELLS_PER_SIDE + x;
+			if ( m_CellStamp[iCell] == m_nStamp )
+				continue;
+
+			m_CellStamp[iCell] = m_nStamp;
+			GatherListCandidates( iCell, candidates );
+		}
+	}
+}
+
+void CEntityQueryGrid::GatherCandidates( const Vector &mins, const Vector &maxs, CUtlVector< int > &candidates )
+{
+	++m_nStamp;
+	GatherCellCandidates( mins, maxs, candidates );
+	GatherListCandidates( LIST_OVERSIZED, candidates );
+	GatherListCandidates( LIST_UNPLACED, candidates );
+}
+
+
+//-----------------------------------------------------------------------------
+// Tests
+//-----------------------------------------------------------------------------
+bool CEntityQueryGrid::IsInPartitionBox( const Entry_t &entry, const Vector &mins, const Vector &maxs ) const
+{
+	if ( !entry.m_bInPartition || !entry.m_bHasPartitionBounds )
+		return false;
+	return IsBoxIntersectingBox( entry.m_vecPartitionMins, entry.m_vecPartitionMaxs, mins, maxs );
+}
+
+bool CEntityQueryGrid::IsInPartitionSphere( const Entry_t &entry, const Vector &center, float radius ) const
+{
+	if ( !entry.m_bInPartition || !entry.m_bHasPartitionBounds )
+		return false;
+	return IsBoxIntersectingSphere( entry.m_vecPartitionMins, entry.m_vecPartitionMaxs, center, radius );
+}
+
+// The same test CGlobalEntityList::FindEntityInSphere makes
+bool CEntityQueryGrid::IsInCollisionSphere( const Entry_t &entry, const Vector &center, float radius ) const
+{
+	CBaseEntity *pEntity = entry.m_pEntity;
+	if ( !pEntity->edict() )
+		return false;
+
+	Vector vecRelativeCenter;
+	pEntity->CollisionProp()->WorldToCollisionSpace( center, &vecRelativeCenter );
+	return IsBoxIntersectingSphere( pEntity->CollisionProp()->OBBMins(), pEntity->CollisionProp()->OBBMaxs(), vecRelativeCenter, radius );
+}
+
+
+//-----------------------------------------------------------------------------
+// Query cache. Entries are only good for the tick they were made in, and
+// only until anything in the grid changes.
+//-----------------------------------------------------------------------------
+CEntityQueryGrid::CachedQuery_t *CEntityQueryGrid::FindCachedQuery( QueryType_t nType, const Vector &vecMins, const Vector &vecMaxs, float flRadius )
+{
+	if ( !sv_entity_query_cache.GetBool() )
+		return NULL;
+
+	for ( int i = 0; i < ENTITY_QUERY_CACHE_SIZE; ++i )
+	{
+		CachedQuery_t &query = m_Cache[i];
+		if ( query.m_nTick != gpGlobals->tickcount || query.m_nGeneration != m_nGeneration || query.m_nType != nType )
+			continue;
+
+		if ( query.m_vecMins == vecMins && query.m_vecMaxs == vecMaxs && query.m_flRadius == flRadius )
+			return &query;
+	}
+
+	return NULL;
+}
+
+CEntityQueryGrid::CachedQuery_t *CEntityQueryGrid::AddCachedQuery( QueryType_t nType, const Vector &vecMins, const Vector &vecMaxs, float flRadius )
+{
+	if ( !sv_entity_query_cache.GetBool() )
+		return NULL;
+
+	CachedQuery_t &query = m_Cache[m_nNextCacheSlot];
+	m_nNextCacheSlot = ( m_nNextCacheSlot + 1 ) % ENTITY_QUERY_CACHE_SIZE;
+
+	query.m_nType = nType;
+	query.m_vecMins = vecMins;
+	query.m_vecMaxs = vecMaxs;
+	query.m_flRadius = flRadius;
+	query.m_nTick = gpGlobals->tickcount;
+	query.m_nGeneration = m_nGeneration;
+	query.m_Entries.RemoveAll();
+	return &query;
+}
+
+
+//-----------------------------------------------------------------------------
+// Entries in a box or sphere of the partition. The enumerator's filter isn't
+// part of the key, so the same volume asked for different flags is shared.
+//-----------------------------------------------------------------------------
+const CUtlVector< int > &CEntityQueryGrid::FindPartitionEntries( QueryType_t nType, const Vector &vecMins, const Vector &vecMaxs, float flRadius )
+{
+	QueryStats_t &stats = m_Stats[nType];
+	++stats.m_nQueries;
+
+	CachedQuery_t *pQuery = FindCachedQuery( nType, vecMins, vecMaxs, flRadius );
+	if ( pQuery )
+	{
+		++stats.m_nCacheHits;
+		return pQuery->m_Entries;
+	}
+
+	m_Candidates.RemoveAll();
+	if ( nType == QUERY_SPHERE )
+	{
+		Vector vecRadius( flRadius, flRadius, flRadius );
+		GatherCandidates( vecMins - vecRadius, vecMins + vecRadius, m_Candidates );
+	}
+	else
+	{
+		GatherCandidates( vecMins, vecMaxs, m_Candidates );
+	}
+	stats.m_nCandidates += m_Candidates.Count();
+
+	pQuery = AddCachedQuery( nType, vecMins, vecMaxs, flRadius );
+	CUtlVector< int > &entries = pQuery ? pQuery->m_Entries : m_Results;
+	entries.RemoveAll();
+	for ( int i = 0; i < m_Candidates.Count(); ++i )
+	{
+		const Entry_t &entry = m_Entries[m_Candidates[i]];
+		bool bInside = ( nType == QUERY_SPHERE ) ? IsInPartitionSphere( entry, vecMins, flRadius ) : IsInPartitionBox( entry, vecMins, vecMaxs );
+		if ( bInside )
+		{
+			entries.AddToTail( m_Candidates[i] );
+		}
+	}
+
+	stats.m_nResults += entries.Count();
+	return entries;
+}
+
+int CEntityQueryGrid::EntitiesInBox( const Vector &mins, const Vector &maxs, CFlaggedEntitiesEnum *pEnum )
+{
+	// Same as the partition does before every query
+	UpdateDirtySpatialPartitionEntities();
+
+	const CUtlVector< int > &entries = FindPartitionEntries( QUERY_BOX, mins, maxs, 0.0f );
+	for ( int i = 0; i < entries.Count(); ++i )
+	{
+		if ( pEnum->EnumElement( m_Entries[entries[i]].m_pEntity ) == ITERATION_STOP )
+			break;
+	}
+
+	return pEnum->GetCount();
+}
+
+int CEntityQueryGrid::EntitiesInSphere( const Vector &center, float radius, CFlaggedEntitiesEnum *pEnum )
+{
+	UpdateDirtySpatialPartitionEntities();
+
+	const CUtlVector< int > &entries = FindPartitionEntries( QUERY_SPHERE, center, vec3_origin, radius );
+	for ( int i = 0; i < entries.Count(); ++i )
+	{
+		if ( pEnum->EnumElement( m_Entries[entries[i]].m_pEntity ) == ITERATION_STOP )
+			break;
+	}
+
+	return pEnum->GetCount();
+}
+
+
+//-----------------------------------------------------------------------------
+// Gathers the cells of all the boxes in one pass, then tests each candidate
+// against every box. Returns the total count of all the enumerators.
+//-----------------------------------------------------------------------------
+int CEntityQueryGrid::EntitiesInBoxes( int nBoxes, const Vector *pMins, const Vector *pMaxs, CFlaggedEntitiesEnum **ppEnums )
+{
+	UpdateDirtySpatialPartitionEntities();
+
+	QueryStats_t &stats = m_Stats[QUERY_BOXES];
+	++stats.m_nQueries;
+
+	m_Candidates.RemoveAll();
+	++m_nStamp;
+	for ( int i = 0; i < nBoxes; ++i )
+	{
+		GatherCellCandidates( pMins[i], pMaxs[i], m_Candidates );
+	}
+	GatherListCandidates( LIST_OVERSIZED, m_Candidates );
+	GatherListCandidates( LIST_UNPLACED, m_Candidates );
+	stats.m_nCandidates += m_Candidates.Count();
+
+	int nCount = 0;
+	for ( int i = 0; i < nBoxes; ++i )
+	{
+		for ( int j = 0; j < m_Candidates.Count(); ++j )
+		{
+			const Entry_t &entry = m_Entries[m_Candidates[j]];
+			if ( !IsInPartitionBox( entry, pMins[i], pMaxs[i] ) )
+				continue;
+
+			++stats.m_nResults;
+			if ( ppEnums[i]->EnumElement( entry.m_pEntity ) == ITERATION_STOP )
+				break;
+		}
+		nCount += ppEnums[i]->GetCount();
+	}
+
+	return nCount;
+}
+
+
+//-----------------------------------------------------------------------------
+// Entries that may touch the sphere, in the order of the entity list. Entries
+// that have moved since they were placed are always included, since where
+// they are now isn't known.
+//-----------------------------------------------------------------------------
+int CEntityQueryGrid::SequenceLessFunc( const int *pLeft, const int *pRight )
+{
+	unsigned int nLeft = g_EntityQueryGrid.m_Entries[*pLeft].m_nSequence;
+	unsigned int nRight = g_EntityQueryGrid.m_Entries[*pRight].m_nSequence;
+	if ( nLeft != nRight )
+		return ( nLeft < nRight ) ? -1 : 1;
+	return 0;
+}
+
+const CUtlVector< int > &CEntityQueryGrid::FindSphereCandidates( const Vector &vecCenter, float flRadius )
+{
+	QueryStats_t &stats = m_Stats[QUERY_FIND_IN_SPHERE];
+	CachedQuery_t *pQuery = FindCachedQuery( QUERY_FIND_IN_SPHERE, vecCenter, vec3_origin, flRadius );
+	if ( pQuery )
+	{
+		++stats.m_nCacheHits;
+		return pQuery->m_Entries;
+	}
+
+	m_Candidates.RemoveAll();
+	Vector vecRadius( flRadius, flRadius, flRadius );
+	GatherCandidates( vecCenter - vecRadius, vecCenter + vecRadius, m_Candidates );
+	stats.m_nCandidates += m_Candidates.Count();
+
+	pQuery = AddCachedQuery( QUERY_FIND_IN_SPHERE, vecCenter, vec3_origin, flRadius );
+	CUtlVector< int > &entries = pQuery ? pQuery->m_Entries : m_Results;
+	entries.RemoveAll();
+	for ( int i = 0; i < m_Candidates.Count(); ++i )
+	{
+		const Entry_t &entry = m_Entries[m_Candidates[i]];
+		if ( entry.m_iList == LIST_UNPLACED || IsBoxIntersectingSphere( entry.m_vecBoundsMins, entry.m_vecBoundsMaxs, vecCenter, flRadius ) )
+		{
+			entries.AddToTail( m_Candidates[i] );
+		}
+	}
+
+	entries.Sort( SequenceLessFunc );
+	return entries;
+}
+
+//-----------------------------------------------------------------------------
+// The next entity after pStartEntity in the entity list whose collision box
+// touches the sphere. Only the candidates are cached, since an entity can turn
+// without moving its bounds; the exact test is made on every call.
+//-----------------------------------------------------------------------------
+CBaseEntity *CEntityQueryGrid::FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius )
+{
+	QueryStats_t &stats = m_Stats[QUERY_FIND_IN_SPHERE];
+	++stats.m_nQueries;
+
+	unsigned int nStartSequence = 0;
+	if ( pStartEntity )
+	{
+		int iStart = GetEntryIndex( pStartEntity );
+		Assert( iStart >= 0 );
+		nStartSequence = m_Entries[iStart].m_nSequence;
+	}
+
+	const CUtlVector< int > &entries = FindSphereCandidates( vecCenter, flRadius );
+
+	// Find the first entry after the start entity
+	int nLow = 0;
+	int nHigh = entries.Count();
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) >> 1;
+		if ( m_Entries[entries[nMid]].m_nSequence <= nStartSequence )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	for ( int i = nLow; i < entries.Count(); ++i )
+	{
+		const Entry_t &entry = m_Entries[entries[i]];
+		if ( IsInCollisionSphere( entry, vecCenter, flRadius ) )
+		{
+			++stats.m_nResults;
+			return entry.m_pEntity;
+		}
+	}
+
+	return NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Stats
+//-----------------------------------------------------------------------------
+void CEntityQueryGrid::PrintStats()
+{
+	int nEntities = 0;
+	int nOversized = 0;
+	int nUnplaced = 0;
+	for ( int i = 0; i < MAX_EDICTS; ++i )
+	{
+		if ( !m_Entries[i].m_pEntity )
+			continue;
+
+		++nEntities;
+		if ( m_Entries[i].m_iList == LIST_OVERSIZED )
+		{
+			++nOversized;
+		}
+		else if ( m_Entries[i].m_iList == LIST_UNPLACED )
+		{
+			++nUnplaced;
+		}
+	}
+
+	Msg( "Entity query grid: %d entities, %d too big for a cell, %d moved since placed\n", nEntities, nOversized, nUnplaced );
+	Msg( "  %-16s %8s %8s %12s %12s\n", "query", "count", "cached", "candidates", "results" );
+	for ( int i = 0; i < QUERY_TYPE_COUNT; ++i )
+	{
+		const QueryStats_t &stats = m_Stats[i];
+		int nSearches = MAX( stats.m_nQueries - stats.m_nCacheHits, 1 );
+		int nQueries = MAX( stats.m_nQueries, 1 );
+		Msg( "  %-16s %8d %8d %12.1f %12.1f\n", s_pQueryTypeNames[i], stats.m_nQueries, stats.m_nCacheHits,
+			(float)stats.m_nCandidates / nSearches, (float)stats.m_nResults / nQueries );
+	}
+}
+
+void CEntityQueryGrid::ClearStats()
+{
+	memset( m_Stats, 0, sizeof( m_Stats ) );
+}
+
+CON_COMMAND( sv_entity_query_grid_stats, "Prints how many entity queries the grid answered since the last call, and how many entities they looked at." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	g_EntityQueryGrid.PrintStats();
+	g_EntityQueryGrid.ClearStats();
+}
@@ -0,0 +1,161 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: A loose 2D grid of the bounds of every edict entity, kept up to
+//			date from the collision property's partition updates, that answers
+//			the game's box and sphere entity queries without going through
+//			the engine's spatial partition or walking the entity list.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef ENTITYQUERYGRID_H
+#define ENTITYQUERYGRID_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "utlvector.h"
+
+class CBaseEntity;
+class CFlaggedEntitiesEnum;
+
+#define ENTITY_GRID_CELL_SIZE		512
+#define ENTITY_GRID_CELLS_PER_SIDE	( ( MAX_COORD_INTEGER * 2 ) / ENTITY_GRID_CELL_SIZE )
+#define ENTITY_GRID_CELL_COUNT		( ENTITY_GRID_CELLS_PER_SIDE * ENTITY_GRID_CELLS_PER_SIDE )
+
+// Recently repeated queries remembered by the grid
+#define ENTITY_QUERY_CACHE_SIZE		16
+
+//-----------------------------------------------------------------------------
+// Purpose: Entities are kept in the cell holding the center of their bounds,
+//			so a query only has to look half a cell beyond its own bounds.
+//			Entities too big for that, and ones whose bounds are being changed
+//			and haven't been placed again, are kept in lists every query checks.
+//-----------------------------------------------------------------------------
+class CEntityQueryGrid
+{
+public:
+	CEntityQueryGrid();
+
+	// Called by the entity list and the collision property
+	void			AddEntity( CBaseEntity *pEntity, int iEntIndex );
+	void			RemoveEntity( int iEntIndex );
+	void			MarkEntityDirty( CBaseEntity *pEntity );
+	void			ElementMoved( CBaseEntity *pEntity, const Vector &mins, const Vector &maxs );
+	void			UpdateEntity( CBaseEntity *pEntity );
+	void			SetEntityInPartition( CBaseEntity *pEntity, bool bInPartition );
+
+	bool			IsEnabled() const;
+	bool			HasEntity( CBaseEntity *pEntity ) const;
+
+	// Same results as the engine's partition queries of PARTITION_ENGINE_NON_STATIC_EDICTS
+	int				EntitiesInBox( const Vector &mins, const Vector &maxs, CFlaggedEntitiesEnum *pEnum );
+	int				EntitiesInSphere( const Vector &center, float radius, CFlaggedEntitiesEnum *pEnum );
+
+	// Several boxes at once, with the entities in box i going to ppEnums[i]
+	int				EntitiesInBoxes( int nBoxes, const Vector *pMins, const Vector *pMaxs, CFlaggedEntitiesEnum **ppEnums );
+
+	// Same results, in the same order, as walking the entity list
+	CBaseEntity		*FindEntityInSphere( CBaseEntity *pStartEntity, const Vector &vecCenter, float flRadius );
+
+	void			PrintStats();
+	void			ClearStats();
+
+private:
+	enum
+	{
+		LIST_NONE = -1,
+		LIST_OVERSIZED = ENTITY_GRID_CELL_COUNT,	// bigger than a cell
+		LIST_UNPLACED,								// moved since it was last placed
+		LIST_COUNT
+	};
+
+	enum QueryType_t
+	{
+		QUERY_BOX = 0,
+		QUERY_SPHERE,
+		QUERY_FIND_IN_SPHERE,
+		QUERY_BOXES,
+
+		QUERY_TYPE_COUNT
+	};
+
+	struct Entry_t
+	{
+		CBaseEntity	*m_pEntity;
+		unsigned int m_nSequence;		// order in the entity list
+		int			m_iList;
+		int			m_iPrev;
+		int			m_iNext;
+		bool		m_bInPartition;		// in PARTITION_ENGINE_NON_STATIC_EDICTS
+		bool		m_bHasPartitionBounds;
+
+		// What the partition was last told, and that joined with the
+		// bounds of the collision box at any angles
+		Vector		m_vecPartitionMins;
+		Vector		m_vecPartitionMaxs;
+		Vector		m_vecBoundsMins;
+		Vector		m_vecBoundsMaxs;
+	};
+
+	struct CachedQuery_t
+	{
+		QueryType_t	m_nType;
+		Vector		m_vecMins;			// or the center
+		Vector		m_vecMaxs;
+		float		m_flRadius;
+		int			m_nTick;
+		unsigned int m_nGeneration;
+		CUtlVector< int >	m_Entries;
+	};
+
+	struct QueryStats_t
+	{
+		int			m_nQueries;
+		int			m_nCacheHits;
+		int			m_nCandidates;
+		int			m_nResults;
+	};
+
+	void			Link( int iEntry, int iList );
+	void			Unlink( int iEntry );
+	int				GetEntryIndex( CBaseEntity *pEntity ) const;
+	int				GetCellCoord( float flCoord ) const;
+	void			GetCellRange( const Vector &mins, const Vector &maxs, int *pMinX, int *pMinY, int *pMaxX, int *pMaxY ) const;
+
+	// Adds the entries of the lists that may touch the box, visiting each cell once per stamp
+	void			GatherCandidates( const Vector &mins, const Vector &maxs, CUtlVector< int > &candidates );
+	void			GatherCellCandidates( const Vector &mins, const Vector &maxs, CUtlVector< int > &candidates );
+	void			GatherListCandidates( int iList, CUtlVector< int > &candidates );
+
+	bool			IsInPartitionBox( const Entry_t &entry, const Vector &mins, const Vector &maxs ) const;
+	bool			IsInPartitionSphere( const Entry_t &entry, const Vector &center, float radius ) const;
+	bool			IsInCollisionSphere( const Entry_t &entry, const Vector &center, float radius ) const;
+
+	// Entries of the last few queries made this tick, reused until the grid changes
+	const CUtlVector< int > &FindPartitionEntries( QueryType_t nType, const Vector &vecMins, const Vector &vecMaxs, float flRadius );
+	const CUtlVector< int > &FindSphereCandidates( const Vector &vecCenter, float flRadius );
+	CachedQuery_t	*FindCachedQuery( QueryType_t nType, const Vector &vecMins, const Vector &vecMaxs, float flRadius );
+	CachedQuery_t	*AddCachedQuery( QueryType_t nType, const Vector &vecMins, const Vector &vecMaxs, float flRadius );
+	static int		SequenceLessFunc( const int *pLeft, const int *pRight );
+
+	Entry_t			m_Entries[ MAX_EDICTS ];
+	int				m_ListHead[ LIST_COUNT ];
+	unsigned int	m_nNextSequence;
+
+	// Bumped by any change to the grid, so cached queries know when they are stale
+	unsigned int	m_nGeneration;
+	CachedQuery_t	m_Cache[ ENTITY_QUERY_CACHE_SIZE ];
+	int				m_nNextCacheSlot;
+
+	int				m_CellStamp[ ENTITY_GRID_CELL_COUNT ];
+	int				m_nStamp;
+	CUtlVector< int >	m_Candidates;
+	CUtlVector< int >	m_Results;
+
+	QueryStats_t	m_Stats[ QUERY_TYPE_COUNT ];
+};
+
+extern CEntityQueryGrid g_EntityQueryGrid;
+
+#endif // ENTITYQUERYGRID_H
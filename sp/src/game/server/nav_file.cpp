@@ -176,11 +176,129 @@ PlaceDirectory placeDirectory;
 #if defined( _X360 )
 	#define FORMAT_BSPFILE "maps\\%s.360.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.360.nav"
+	#define FORMAT_COMPILEDNAVFILE "maps\\%s.360.navc"
 #else
 	#define FORMAT_BSPFILE "maps\\%s.bsp"
 	#define FORMAT_NAVFILE "maps\\%s.nav"
+	#define FORMAT_COMPILEDNAVFILE "maps\\%s.navc"
 #endif
 
+ConVar nav_compiled_mesh( "nav_compiled_mesh", "0", FCVAR_GAMEDLL, "If nonzero, a compiled copy of the nav file (.navc) is written alongside it, and loaded instead of parsing the nav file while it is up to date." );
+
+
+//--------------------------------------------------------------------------------------------------------------
+//
+// The compiled nav file is an optional copy of the .nav laid out as flat arrays of fixed size
+// records, so it can be loaded with a single read and no per-field parsing.  Each array is found
+// through an offset from the start of the file, and areas refer to their connections, hiding
+// spots, encounters and visible areas by index range into the shared arrays.
+//
+// It is only a cache of the .nav: it remembers the size and time of the .nav it was compiled
+// from, and is ignored whenever those no longer match.  Meshes with custom data (a non-zero
+// sub-version) always use the .nav.
+//
+#define NAV_COMPILED_MAGIC_NUMBER 0xFEEDC0DE
+
+const int NavCompiledVersion = 1;
+
+struct NavCompiledSection_t
+{
+	unsigned int offset;						// from the start of the file
+	unsigned int count;							// number of records, or bytes for sections stored as in the .nav
+};
+
+struct NavCompiledHeader_t
+{
+	unsigned int magic;
+	unsigned int version;						// NavCompiledVersion
+	unsigned int navVersion;					// NavCurrentVersion when compiled
+	unsigned int navSize;						// size of the .nav this was compiled from
+	unsigned int navTime;						// modification time of the .nav this was compiled from
+	unsigned int bspSize;						// size of the bsp the .nav was built from
+	unsigned int isAnalyzed;
+
+	NavCompiledSection_t places;				// the place directory, as stored in the .nav
+	NavCompiledSection_t areas;					// NavCompiledArea_t
+	NavCompiledSection_t connections;			// area IDs
+	NavCompiledSection_t hidingSpots;			// NavCompiledHidingSpot_t
+	NavCompiledSection_t encounters;			// NavCompiledEncounter_t
+	NavCompiledSection_t spotOrders;			// NavCompiledSpotOrder_t
+	NavCompiledSection_t ladderConnections;		// ladder IDs
+	NavCompiledSection_t visibleAreas;			// NavCompiledVisibleArea_t
+	NavCompiledSection_t ladders;				// ladder count followed by the ladders, as stored in the .nav
+};
+
+struct NavCompiledArea_t
+{
+	unsigned int id;
+	int attributeFlags;
+	Vector nwCorner;
+	Vector seCorner;
+	float neZ;
+	float swZ;
+	float earliestOccupyTime[ MAX_NAV_TEAMS ];
+	float lightIntensity[ NUM_CORNERS ];
+	unsigned int inheritVisibilityFrom;			// area ID
+	unsigned int place;							// place directory index
+
+	unsigned int firstConnection;				// connections for each direction follow each other, NORTH first
+	unsigned int connectionCount[ NUM_DIRECTIONS ];
+	unsigned int firstHidingSpot;
+	unsigned int hidingSpotCount;
+	unsigned int firstEncounter;
+	unsigned int encounterCount;
+	unsigned int firstLadderConnection;			// LADDER_UP connections, then LADDER_DOWN
+	unsigned int ladderConnectionCount[ CNavLadder::NUM_LADDER_DIRECTIONS ];
+	unsigned int firstVisibleArea;
+	unsigned int visibleAreaCount;
+};
+
+struct NavCompiledHidingSpot_t
+{
+	unsigned int id;
+	Vector pos;
+	unsigned int flags;
+};
+
+struct NavCompiledEncounter_t
+{
+	unsigned int fromArea;						// area ID
+	unsigned int toArea;						// area ID
+	unsigned int fromDir;
+	unsigned int toDir;
+	unsigned int firstSpotOrder;
+	unsigned int spotOrderCount;
+};
+
+struct NavCompiledSpotOrder_t
+{
+	unsigned int spotID;
+	float t;
+};
+
+struct NavCompiledVisibleArea_t
+{
+	unsigned int areaID;
+	unsigned int attributes;
+};
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Report that the nav mesh doesn't match the bsp it is being loaded for
+ */
+static void WarnNavMeshOutOfDate( void )
+{
+	if ( engine->IsDedicatedServer() )
+	{
+		// Warning doesn't print to the dedicated server console, so we'll use Msg instead
+		DevMsg( "The Navigation Mesh was built using a different version of this map.\n" );
+	}
+	else
+	{
+		DevWarning( "The Navigation Mesh was built using a different version of this map.\n" );
+	}
+}
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Replace extension with "bsp"
@@ -384,34 +502,26 @@ void CNavArea::Save( CUtlBuffer &fileBuffer, unsigned int version ) const
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Load a navigation area from the file
+ * Set the area's ID as read from a file
  */
-NavErrorType CNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion )
+void CNavArea::LoadID( unsigned int id )
 {
-	// load ID
-	m_id = fileBuffer.GetUnsignedInt();
+	m_id = id;
 
 	// update nextID to avoid collisions
 	if (m_id >= m_nextID)
 		m_nextID = m_id+1;
+}
 
-	// load attribute flags
-	if ( version <= 8 )
-	{
-		m_attributeFlags = fileBuffer.GetUnsignedChar();
-	}
-	else if ( version < 13 )
-	{
-		m_attributeFlags = fileBuffer.GetUnsignedShort();
-	}
-	else
-	{
-		m_attributeFlags = fileBuffer.GetInt();
-	}
 
-	// load extent of area
-	fileBuffer.Get( &m_nwCorner, 3*sizeof(float) );
-	fileBuffer.Get( &m_seCorner, 3*sizeof(float) );
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Set the area's corners as read from a file, and everything derived from them
+ */
+void CNavArea::LoadExtent( const Vector &nwCorner, const Vector &seCorner, float neZ, float swZ )
+{
+	m_nwCorner = nwCorner;
+	m_seCorner = seCorner;
 
 	m_center.x = (m_nwCorner.x + m_seCorner.x)/2.0f;
 	m_center.y = (m_nwCorner.y + m_seCorner.y)/2.0f;
@@ -430,11 +540,80 @@ NavErrorType CNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, unsig
 			m_id, m_center.x, m_center.y, m_center.z );
 	}
 
-	// load heights of implicit corners
-	m_neZ = fileBuffer.GetFloat();
-	m_swZ = fileBuffer.GetFloat();
+	m_neZ = neZ;
+	m_swZ = swZ;
 
 	CheckWaterLevel();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add a connection (ID) to an adjacent area as read from a file
+ */
+void CNavArea::LoadConnection( NavDirType dir, unsigned int id )
+{
+	// don't allow self-referential connections
+	if ( id != m_id )
+	{
+		NavConnect connect;
+		connect.id = id;
+		m_connect[dir].AddToTail( connect );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add a ladder connection (ID) as read from a file
+ */
+void CNavArea::LoadLadderConnection( CNavLadder::LadderDirectionType dir, unsigned int id )
+{
+	FOR_EACH_VEC( m_ladder[dir], j )
+	{
+		if ( m_ladder[dir][j].id == id )
+			return;
+	}
+
+	NavLadderConnect connect;
+	connect.id = id;
+	m_ladder[dir].AddToTail( connect );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load a navigation area from the file
+ */
+NavErrorType CNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion )
+{
+	// load ID
+	LoadID( fileBuffer.GetUnsignedInt() );
+
+	// load attribute flags
+	if ( version <= 8 )
+	{
+		m_attributeFlags = fileBuffer.GetUnsignedChar();
+	}
+	else if ( version < 13 )
+	{
+		m_attributeFlags = fileBuffer.GetUnsignedShort();
+	}
+	else
+	{
+		m_attributeFlags = fileBuffer.GetInt();
+	}
+
+	// load extent of area
+	Vector nwCorner, seCorner;
+	fileBuffer.Get( &nwCorner, 3*sizeof(float) );
+	fileBuffer.Get( &seCorner, 3*sizeof(float) );
+
+	// load heights of implicit corners
+	float neZ = fileBuffer.GetFloat();
+	float swZ = fileBuffer.GetFloat();
+
+	LoadExtent( nwCorner, seCorner, neZ, swZ );
 
 	// load connections (IDs) to adjacent areas
 	// in the enum order NORTH, EAST, SOUTH, WEST
@@ -447,15 +626,10 @@ NavErrorType CNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, unsig
 		m_connect[d].EnsureCapacity( count );
 		for( unsigned int i=0; i<count; ++i )
 		{
-			NavConnect connect;
-			connect.id = fileBuffer.GetUnsignedInt();
+			unsigned int id = fileBuffer.GetUnsignedInt();
 			Assert( fileBuffer.IsValid() );
 
-			// don't allow self-referential connections
-			if ( connect.id != m_id )
-			{
-				m_connect[d].AddToTail( connect );
-			}
+			LoadConnection( (NavDirType)d, id );
 		}
 	}
 
@@ -598,23 +772,7 @@ NavErrorType CNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, unsig
 		count = fileBuffer.GetUnsignedInt();
 		for( unsigned int i=0; i<count; ++i )
 		{
-			NavLadderConnect connect;
-			connect.id = fileBuffer.GetUnsignedInt();
-
-			bool alreadyConnected = false;
-			FOR_EACH_VEC( m_ladder[dir], j )
-			{
-				if ( m_ladder[dir][j].id == connect.id )
-				{
-					alreadyConnected = true;
-					break;
-				}
-			}
-
-			if ( !alreadyConnected )
-			{
-				m_ladder[dir].AddToTail( connect );
-			}
+			LoadLadderConnection( (CNavLadder::LadderDirectionType)dir, fileBuffer.GetUnsignedInt() );
 		}
 	}
 
@@ -1194,6 +1352,11 @@ bool CNavMesh::Save( void ) const
 	unsigned int navSize = filesystem->Size( filename );
 	DevMsg( "Size of nav file '%s' is %u bytes.\n", filename, navSize );
 
+	if ( nav_compiled_mesh.GetBool() )
+	{
+		SaveCompiled( bspSize );
+	}
+
 	return true;
 }
 
@@ -1397,6 +1560,13 @@ NavErrorType CNavMesh::Load( void )
 	char filename[256];
 	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
 
+	// use the compiled copy of the nav file while it is up to date
+	NavErrorType compiledResult;
+	if ( LoadCompiled( filename, &compiledResult ) )
+	{
+		return compiledResult;
+	}
+
 	bool navIsInBsp = false;
 	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::READ_ONLY );
 	if ( !filesystem->ReadFile( filename, "MOD", fileBuffer ) )	// this ignores .nav files embedded in the .bsp ...
@@ -1448,10 +1618,11 @@ NavErrorType CNavMesh::Load( void )
 		}
 	}
 
+	unsigned int saveBspSize = 0;
 	if ( version >= 4 )
 	{
 		// get size of source bsp file and verify that the bsp hasn't changed
-		unsigned int saveBspSize = fileBuffer.GetUnsignedInt();
+		saveBspSize = fileBuffer.GetUnsignedInt();
 
 		// verify size
 		char *bspFilename = GetBspFilename( filename );
@@ -1464,15 +1635,7 @@ NavErrorType CNavMesh::Load( void )
 
 		if ( bspSize != saveBspSize && !navIsInBsp )
 		{
-			if ( engine->IsDedicatedServer() )
-			{
-				// Warning doesn't print to the dedicated server console, so we'll use Msg instead
-				DevMsg( "The Navigation Mesh was built using a different version of this map.\n" );
-			}
-			else
-			{
-				DevWarning( "The Navigation Mesh was built using a different version of this map.\n" );
-			}
+			WarnNavMeshOutOfDate();
 			m_isOutOfDate = true;
 		}
 	}
@@ -1575,10 +1738,522 @@ NavErrorType CNavMesh::Load( void )
 
 	WarnIfMeshNeedsAnalysis( version );
 
+	// there was no up to date compiled copy, so make one for next time
+	if ( loadResult == NAV_OK && nav_compiled_mesh.GetBool() && !navIsInBsp && version >= 4 )
+	{
+		SaveCompiled( saveBspSize );
+	}
+
 	return loadResult;
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Append a section to a compiled nav file, keeping every section 4-byte aligned
+ */
+static void PutCompiledSection( CUtlBuffer &fileBuffer, NavCompiledSection_t *section, const void *data, int size, unsigned int count )
+{
+	while ( fileBuffer.TellPut() & 3 )
+	{
+		fileBuffer.PutUnsignedChar( 0 );
+	}
+
+	section->offset = fileBuffer.TellPut();
+	section->count = count;
+
+	if ( size > 0 )
+	{
+		fileBuffer.Put( data, size );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if a section of a compiled nav file lies entirely within the file
+ */
+static bool IsCompiledSectionValid( const NavCompiledSection_t &section, unsigned int recordSize, unsigned int fileSize )
+{
+	return ( section.offset & 3 ) == 0 && (uint64)section.offset + (uint64)section.count * recordSize <= fileSize;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the index range lies within an array of the given size
+ */
+inline bool IsCompiledRangeValid( unsigned int first, uint64 count, unsigned int total )
+{
+	return (uint64)first + count <= total;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store a compiled copy of the nav file alongside it, to be loaded instead of the nav file while
+ * it is up to date.  Must be called after the nav file has been written, since the compiled file
+ * records the size and time of the nav file.  'bspSize' is the bsp size stored in the nav file.
+ */
+bool CNavMesh::SaveCompiled( unsigned int bspSize ) const
+{
+	if ( IsX360() || GetSubVersionNumber() != 0 )
+		return false;
+
+	char navFilename[256];
+	Q_snprintf( navFilename, sizeof( navFilename ), FORMAT_NAVFILE, STRING( gpGlobals->mapname ) );
+
+	NavCompiledHeader_t header;
+	V_memset( &header, 0, sizeof( header ) );
+	header.magic = NAV_COMPILED_MAGIC_NUMBER;
+	header.version = NavCompiledVersion;
+	header.navVersion = NavCurrentVersion;
+	header.navSize = filesystem->Size( navFilename, "MOD" );
+	header.navTime = (unsigned int)filesystem->GetFileTime( navFilename, "MOD" );
+	header.bspSize = bspSize;
+	header.isAnalyzed = m_isAnalyzed;
+
+	if ( header.navSize == 0 )
+	{
+		// the compiled file can only be validated against a nav file on disk
+		return false;
+	}
+
+	//
+	// Build a directory of the Places in this map
+	//
+	placeDirectory.Reset();
+
+	FOR_EACH_VEC( TheNavAreas, nit )
+	{
+		placeDirectory.AddPlace( TheNavAreas[ nit ]->GetPlace() );
+	}
+
+	CUtlBuffer placeBuffer;
+	placeDirectory.Save( placeBuffer );
+
+	//
+	// Flatten the areas and everything they own into shared arrays
+	//
+	CUtlVector< NavCompiledArea_t > areas;
+	CUtlVector< unsigned int > connections;
+	CUtlVector< NavCompiledHidingSpot_t > hidingSpots;
+	CUtlVector< NavCompiledEncounter_t > encounters;
+	CUtlVector< NavCompiledSpotOrder_t > spotOrders;
+	CUtlVector< unsigned int > ladderConnections;
+	CUtlVector< NavCompiledVisibleArea_t > visibleAreas;
+
+	areas.SetCount( TheNavAreas.Count() );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *area = TheNavAreas[ it ];
+		NavCompiledArea_t &record = areas[ it ];
+
+		record.id = area->m_id;
+		record.attributeFlags = area->m_attributeFlags;
+		record.nwCorner = area->m_nwCorner;
+		record.seCorner = area->m_seCorner;
+		record.neZ = area->m_neZ;
+		record.swZ = area->m_swZ;
+		V_memcpy( record.earliestOccupyTime, area->m_earliestOccupyTime, sizeof( record.earliestOccupyTime ) );
+		V_memcpy( record.lightIntensity, area->m_lightIntensity, sizeof( record.lightIntensity ) );
+		record.inheritVisibilityFrom = ( area->m_inheritVisibilityFrom.area ) ? area->m_inheritVisibilityFrom.area->GetID() : 0;
+		record.place = placeDirectory.GetIndex( area->GetPlace() );
+
+		record.firstConnection = connections.Count();
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			record.connectionCount[d] = area->m_connect[d].Count();
+
+			FOR_EACH_VEC( area->m_connect[d], c )
+			{
+				connections.AddToTail( area->m_connect[d][c].area->GetID() );
+			}
+		}
+
+		// the nav file stores at most 255 hiding spots per area
+		record.firstHidingSpot = hidingSpots.Count();
+		record.hidingSpotCount = MIN( area->m_hidingSpots.Count(), 255 );
+		for( unsigned int h=0; h<record.hidingSpotCount; ++h )
+		{
+			const HidingSpot *spot = area->m_hidingSpots[ h ];
+
+			NavCompiledHidingSpot_t spotRecord;
+			spotRecord.id = spot->m_id;
+			spotRecord.pos = spot->m_pos;
+			spotRecord.flags = spot->m_flags;
+			hidingSpots.AddToTail( spotRecord );
+		}
+
+		record.firstEncounter = encounters.Count();
+		record.encounterCount = area->m_spotEncounters.Count();
+		FOR_EACH_VEC( area->m_spotEncounters, e )
+		{
+			const SpotEncounter *spote = area->m_spotEncounters[ e ];
+
+			NavCompiledEncounter_t encounterRecord;
+			encounterRecord.fromArea = ( spote->from.area ) ? spote->from.area->GetID() : 0;
+			encounterRecord.toArea = ( spote->to.area ) ? spote->to.area->GetID() : 0;
+			encounterRecord.fromDir = spote->fromDir;
+			encounterRecord.toDir = spote->toDir;
+			encounterRecord.firstSpotOrder = spotOrders.Count();
+			encounterRecord.spotOrderCount = MIN( spote->spots.Count(), 255 );
+
+			for( unsigned int s=0; s<encounterRecord.spotOrderCount; ++s )
+			{
+				const SpotOrder *order = &spote->spots[ s ];
+
+				// match the precision of the nav file, so both loads give the same mesh
+				NavCompiledSpotOrder_t orderRecord;
+				orderRecord.spotID = ( order->spot ) ? order->spot->GetID() : 0;
+				orderRecord.t = (float)(unsigned char)( 255 * order->t ) / 255.0f;
+				spotOrders.AddToTail( orderRecord );
+			}
+
+			encounters.AddToTail( encounterRecord );
+		}
+
+		record.firstLadderConnection = ladderConnections.Count();
+		for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			record.ladderConnectionCount[dir] = area->m_ladder[dir].Count();
+
+			FOR_EACH_VEC( area->m_ladder[dir], l )
+			{
+				ladderConnections.AddToTail( area->m_ladder[dir][l].ladder->GetID() );
+			}
+		}
+
+		record.firstVisibleArea = visibleAreas.Count();
+		record.visibleAreaCount = area->m_potentiallyVisibleAreas.Count();
+		FOR_EACH_VEC( area->m_potentiallyVisibleAreas, v )
+		{
+			const CNavArea::AreaBindInfo &info = area->m_potentiallyVisibleAreas[ v ];
+
+			NavCompiledVisibleArea_t visibleRecord;
+			visibleRecord.areaID = ( info.area ) ? info.area->GetID() : 0;
+			visibleRecord.attributes = info.attributes;
+			visibleAreas.AddToTail( visibleRecord );
+		}
+	}
+
+	CUtlBuffer ladderBuffer;
+	ladderBuffer.PutUnsignedInt( m_ladders.Count() );
+	FOR_EACH_VEC( m_ladders, lit )
+	{
+		m_ladders[ lit ]->Save( ladderBuffer, NavCurrentVersion );
+	}
+
+	//
+	// Lay out the file: the header, then each section
+	//
+	CUtlBuffer fileBuffer( 4096, 1024*1024 );
+	fileBuffer.Put( &header, sizeof( header ) );	// rewritten once the sections are placed
+
+	PutCompiledSection( fileBuffer, &header.places, placeBuffer.Base(), placeBuffer.TellPut(), placeBuffer.TellPut() );
+	PutCompiledSection( fileBuffer, &header.areas, areas.Base(), areas.Count() * sizeof( NavCompiledArea_t ), areas.Count() );
+	PutCompiledSection( fileBuffer, &header.connections, connections.Base(), connections.Count() * sizeof( unsigned int ), connections.Count() );
+	PutCompiledSection( fileBuffer, &header.hidingSpots, hidingSpots.Base(), hidingSpots.Count() * sizeof( NavCompiledHidingSpot_t ), hidingSpots.Count() );
+	PutCompiledSection( fileBuffer, &header.encounters, encounters.Base(), encounters.Count() * sizeof( NavCompiledEncounter_t ), encounters.Count() );
+	PutCompiledSection( fileBuffer, &header.spotOrders, spotOrders.Base(), spotOrders.Count() * sizeof( NavCompiledSpotOrder_t ), spotOrders.Count() );
+	PutCompiledSection( fileBuffer, &header.ladderConnections, ladderConnections.Base(), ladderConnections.Count() * sizeof( unsigned int ), ladderConnections.Count() );
+	PutCompiledSection( fileBuffer, &header.visibleAreas, visibleAreas.Base(), visibleAreas.Count() * sizeof( NavCompiledVisibleArea_t ), visibleAreas.Count() );
+	PutCompiledSection( fileBuffer, &header.ladders, ladderBuffer.Base(), ladderBuffer.TellPut(), ladderBuffer.TellPut() );
+
+	V_memcpy( fileBuffer.Base(), &header, sizeof( header ) );
+
+	// filename is local to game dir for Steam, so we need to prepend game dir for regular file save
+	char gamePath[256];
+	engine->GetGameDir( gamePath, 256 );
+
+	char filename[256];
+	Q_snprintf( filename, sizeof( filename ), "%s\\" FORMAT_COMPILEDNAVFILE, gamePath, STRING( gpGlobals->mapname ) );
+	COM_FixSlashes( filename );
+
+	if ( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
+	{
+		Warning( "Unable to save %d bytes to %s\n", fileBuffer.Size(), filename );
+		return false;
+	}
+
+	DevMsg( "Size of compiled nav file '%s' is %u bytes.\n", filename, fileBuffer.TellPut() );
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the compiled copy of the given nav file instead of parsing it.  Returns false, having
+ * changed nothing, if there is no compiled file or it is out of date, so the caller can fall back
+ * to the nav file.  Otherwise returns true, with the result of the load in 'result'.
+ */
+bool CNavMesh::LoadCompiled( const char *navFilename, NavErrorType *result )
+{
+	if ( !nav_compiled_mesh.GetBool() || IsX360() || GetSubVersionNumber() != 0 )
+		return false;
+
+	char filename[256];
+	Q_snprintf( filename, sizeof( filename ), FORMAT_COMPILEDNAVFILE, STRING( gpGlobals->mapname ) );
+
+	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::READ_ONLY );
+	if ( !filesystem->ReadFile( filename, "MOD", fileBuffer ) )
+		return false;
+
+	const byte *base = (const byte *)fileBuffer.Base();
+	unsigned int size = fileBuffer.TellPut();
+
+	if ( size < sizeof( NavCompiledHeader_t ) )
+	{
+		Msg( "Invalid compiled navigation file '%s'.\n", filename );
+		return false;
+	}
+
+	const NavCompiledHeader_t *header = (const NavCompiledHeader_t *)base;
+	if ( header->magic != NAV_COMPILED_MAGIC_NUMBER || header->version != NavCompiledVersion || header->navVersion != NavCurrentVersion )
+	{
+		DevMsg( "Ignoring compiled navigation file '%s' from a different version.\n", filename );
+		return false;
+	}
+
+	// the compiled file is only a cache of the nav file it was built from
+	unsigned int navSize = filesystem->Size( navFilename, "MOD" );
+	unsigned int navTime = (unsigned int)filesystem->GetFileTime( navFilename, "MOD" );
+	if ( navSize == 0 || navSize != header->navSize || navTime != header->navTime )
+	{
+		DevMsg( "Compiled navigation file '%s' is out of date.\n", filename );
+		return false;
+	}
+
+	char *bspFilename = GetBspFilename( navFilename );
+	if ( bspFilename == NULL )
+		return false;
+
+	//
+	// Validate every section, and every range the records refer to, before creating anything
+	//
+	if ( !IsCompiledSectionValid( header->places, 1, size ) ||
+		 !IsCompiledSectionValid( header->areas, sizeof( NavCompiledArea_t ), size ) ||
+		 !IsCompiledSectionValid( header->connections, sizeof( unsigned int ), size ) ||
+		 !IsCompiledSectionValid( header->hidingSpots, sizeof( NavCompiledHidingSpot_t ), size ) ||
+		 !IsCompiledSectionValid( header->encounters, sizeof( NavCompiledEncounter_t ), size ) ||
+		 !IsCompiledSectionValid( header->spotOrders, sizeof( NavCompiledSpotOrder_t ), size ) ||
+		 !IsCompiledSectionValid( header->ladderConnections, sizeof( unsigned int ), size ) ||
+		 !IsCompiledSectionValid( header->visibleAreas, sizeof( NavCompiledVisibleArea_t ), size ) ||
+		 !IsCompiledSectionValid( header->ladders, 1, size ) ||
+		 header->areas.count == 0 || header->ladders.count < sizeof( unsigned int ) )
+	{
+		Msg( "Invalid compiled navigation file '%s'.\n", filename );
+		return false;
+	}
+
+	const NavCompiledArea_t *areas = (const NavCompiledArea_t *)( base + header->areas.offset );
+	const unsigned int *connections = (const unsigned int *)( base + header->connections.offset );
+	const NavCompiledHidingSpot_t *hidingSpots = (const NavCompiledHidingSpot_t *)( base + header->hidingSpots.offset );
+	const NavCompiledEncounter_t *encounters = (const NavCompiledEncounter_t *)( base + header->encounters.offset );
+	const NavCompiledSpotOrder_t *spotOrders = (const NavCompiledSpotOrder_t *)( base + header->spotOrders.offset );
+	const unsigned int *ladderConnections = (const unsigned int *)( base + header->ladderConnections.offset );
+	const NavCompiledVisibleArea_t *visibleAreas = (const NavCompiledVisibleArea_t *)( base + header->visibleAreas.offset );
+
+	unsigned int i;
+	for( i=0; i<header->areas.count; ++i )
+	{
+		const NavCompiledArea_t &record = areas[i];
+
+		uint64 connectionCount = 0;
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			connectionCount += record.connectionCount[d];
+		}
+
+		uint64 ladderConnectionCount = 0;
+		for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			ladderConnectionCount += record.ladderConnectionCount[dir];
+		}
+
+		if ( !IsCompiledRangeValid( record.firstConnection, connectionCount, header->connections.count ) ||
+			 !IsCompiledRangeValid( record.firstHidingSpot, record.hidingSpotCount, header->hidingSpots.count ) ||
+			 !IsCompiledRangeValid( record.firstEncounter, record.encounterCount, header->encounters.count ) ||
+			 !IsCompiledRangeValid( record.firstLadderConnection, ladderConnectionCount, header->ladderConnections.count ) ||
+			 !IsCompiledRangeValid( record.firstVisibleArea, record.visibleAreaCount, header->visibleAreas.count ) )
+		{
+			Msg( "Invalid compiled navigation file '%s'.\n", filename );
+			return false;
+		}
+	}
+
+	for( i=0; i<header->encounters.count; ++i )
+	{
+		if ( !IsCompiledRangeValid( encounters[i].firstSpotOrder, encounters[i].spotOrderCount, header->spotOrders.count ) )
+		{
+			Msg( "Invalid compiled navigation file '%s'.\n", filename );
+			return false;
+		}
+	}
+
+	// each ladder takes at least its ID, so this bounds a corrupt count
+	CUtlBuffer ladderBuffer( base + header->ladders.offset, header->ladders.count, CUtlBuffer::READ_ONLY );
+	unsigned int ladderCount = ladderBuffer.GetUnsignedInt();
+	if ( (uint64)ladderCount * sizeof( unsigned int ) > header->ladders.count )
+	{
+		Msg( "Invalid compiled navigation file '%s'.\n", filename );
+		return false;
+	}
+
+	//
+	// The file is good, build the mesh from it
+	//
+	if ( filesystem->Size( bspFilename ) != header->bspSize )
+	{
+		WarnNavMeshOutOfDate();
+		m_isOutOfDate = true;
+	}
+
+	m_isAnalyzed = header->isAnalyzed != 0;
+
+	CUtlBuffer placeBuffer( base + header->places.offset, header->places.count, CUtlBuffer::READ_ONLY );
+	placeDirectory.Load( placeBuffer, NavCurrentVersion );
+
+	Extent extent;
+	extent.lo.x = 9999999999.9f;
+	extent.lo.y = 9999999999.9f;
+	extent.hi.x = -9999999999.9f;
+	extent.hi.y = -9999999999.9f;
+
+	// create the areas and compute total extent, as CNavArea::Load() does
+	TheNavMesh->PreLoadAreas( header->areas.count );
+	Extent areaExtent;
+	for( i=0; i<header->areas.count; ++i )
+	{
+		const NavCompiledArea_t &record = areas[i];
+		CNavArea *area = TheNavMesh->CreateArea();
+
+		area->LoadID( record.id );
+		area->m_attributeFlags = record.attributeFlags;
+		area->LoadExtent( record.nwCorner, record.seCorner, record.neZ, record.swZ );
+
+		const unsigned int *connection = &connections[ record.firstConnection ];
+		for( int d=0; d<NUM_DIRECTIONS; d++ )
+		{
+			area->m_connect[d].EnsureCapacity( record.connectionCount[d] );
+			for( unsigned int c=0; c<record.connectionCount[d]; ++c )
+			{
+				area->LoadConnection( (NavDirType)d, *connection++ );
+			}
+		}
+
+		area->m_hidingSpots.EnsureCapacity( record.hidingSpotCount );
+		for( unsigned int h=0; h<record.hidingSpotCount; ++h )
+		{
+			const NavCompiledHidingSpot_t &spotRecord = hidingSpots[ record.firstHidingSpot + h ];
+
+			// create new hiding spot and put on master list
+			HidingSpot *spot = CreateHidingSpot();
+			spot->Load( spotRecord.id, spotRecord.pos, (unsigned char)spotRecord.flags );
+
+			area->m_hidingSpots.AddToTail( spot );
+		}
+
+		for( unsigned int e=0; e<record.encounterCount; ++e )
+		{
+			const NavCompiledEncounter_t &encounterRecord = encounters[ record.firstEncounter + e ];
+
+			SpotEncounter *encounter = new SpotEncounter;
+			encounter->from.id = encounterRecord.fromArea;
+			encounter->fromDir = static_cast<NavDirType>( encounterRecord.fromDir );
+			encounter->to.id = encounterRecord.toArea;
+			encounter->toDir = static_cast<NavDirType>( encounterRecord.toDir );
+
+			encounter->spots.EnsureCapacity( encounterRecord.spotOrderCount );
+			for( unsigned int s=0; s<encounterRecord.spotOrderCount; ++s )
+			{
+				const NavCompiledSpotOrder_t &orderRecord = spotOrders[ encounterRecord.firstSpotOrder + s ];
+
+				SpotOrder order;
+				order.id = orderRecord.spotID;
+				order.t = orderRecord.t;
+				encounter->spots.AddToTail( order );
+			}
+
+			area->m_spotEncounters.AddToTail( encounter );
+		}
+
+		area->SetPlace( placeDirectory.IndexToPlace( (PlaceDirectory::IndexType)record.place ) );
+
+		const unsigned int *ladderConnection = &ladderConnections[ record.firstLadderConnection ];
+		for ( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			for( unsigned int l=0; l<record.ladderConnectionCount[dir]; ++l )
+			{
+				area->LoadLadderConnection( (CNavLadder::LadderDirectionType)dir, *ladderConnection++ );
+			}
+		}
+
+		V_memcpy( area->m_earliestOccupyTime, record.earliestOccupyTime, sizeof( area->m_earliestOccupyTime ) );
+		V_memcpy( area->m_lightIntensity, record.lightIntensity, sizeof( area->m_lightIntensity ) );
+
+		area->m_potentiallyVisibleAreas.EnsureCapacity( record.visibleAreaCount );
+		for( unsigned int v=0; v<record.visibleAreaCount; ++v )
+		{
+			const NavCompiledVisibleArea_t &visibleRecord = visibleAreas[ record.firstVisibleArea + v ];
+
+			CNavArea::AreaBindInfo info;
+			info.id = visibleRecord.areaID;
+			info.attributes = (unsigned char)visibleRecord.attributes;
+
+			area->m_potentiallyVisibleAreas.AddToTail( info );
+		}
+
+		area->m_inheritVisibilityFrom.id = record.inheritVisibilityFrom;
+
+		TheNavAreas.AddToTail( area );
+
+		area->GetExtent( &areaExtent );
+
+		if (areaExtent.lo.x < extent.lo.x)
+			extent.lo.x = areaExtent.lo.x;
+		if (areaExtent.lo.y < extent.lo.y)
+			extent.lo.y = areaExtent.lo.y;
+		if (areaExtent.hi.x > extent.hi.x)
+			extent.hi.x = areaExtent.hi.x;
+		if (areaExtent.hi.y > extent.hi.y)
+			extent.hi.y = areaExtent.hi.y;
+	}
+
+	// add the areas to the grid
+	AllocateGrid( extent.lo.x, extent.hi.x, extent.lo.y, extent.hi.y );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		AddNavArea( TheNavAreas[ it ] );
+	}
+
+	// load the ladders
+	m_ladders.EnsureCapacity( ladderCount );
+	for( i=0; i<ladderCount; ++i )
+	{
+		CNavLadder *ladder = new CNavLadder;
+		ladder->Load( ladderBuffer, NavCurrentVersion );
+		m_ladders.AddToTail( ladder );
+	}
+
+	MarkStairAreas();
+
+	//
+	// Bind pointers, etc
+	//
+	*result = PostLoad( NavCurrentVersion );
+
+	WarnIfMeshNeedsAnalysis( NavCurrentVersion );
+
+	DevMsg( "Loaded compiled navigation file '%s'.\n", filename );
+
+	return true;
+}
+
+
 struct OneWayLink_t
 {
 	CNavArea *destArea;
@@ -17,6 +17,7 @@
 #include "viewport_panel_names.h"
 //#include "terror/TerrorShared.h"
 #include "fmtstr.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "func_simpleladder.h"
@@ -3262,6 +3263,13 @@ int CNavMesh::BuildArea( CNavNode *node, int width, int height )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::ProcessTestAreaTask( TestAreaTask &task )
+{
+	task.canBuild = TestArea( task.node, task.width, task.height );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * This function uses the CNavNodes that have been sampled from the map to
@@ -3279,10 +3287,49 @@ void CNavMesh::CreateNavAreasFromNodes( void )
 	int tryHeight = tryWidth;
 	int uncoveredNodes = CNavNode::GetListLength();
 
+	CUtlVector< TestAreaTask > tasks;
+	CUtlVector< CNavNode * > candidates;
+
 	while( uncoveredNodes > 0 )
 	{
-		for( CNavNode *node = CNavNode::GetFirst(); node; node = node->GetNext() )
+		candidates.RemoveAll();
+		if ( m_generationMode == GENERATE_INCREMENTAL )
 		{
+			// overlap tests against the existing mesh are not safe to run on worker threads
+			for( CNavNode *node = CNavNode::GetFirst(); node; node = node->GetNext() )
+			{
+				if (!node->IsCovered())
+					candidates.AddToTail( node );
+			}
+		}
+		else
+		{
+			// Covering nodes can only make TestArea() fail, never pass, so test every uncovered
+			// node on worker threads first and only re-test the ones that passed as areas are built.
+			tasks.RemoveAll();
+			for( CNavNode *node = CNavNode::GetFirst(); node; node = node->GetNext() )
+			{
+				if (node->IsCovered())
+					continue;
+
+				TestAreaTask &task = tasks[ tasks.AddToTail() ];
+				task.node = node;
+				task.width = tryWidth;
+				task.height = tryHeight;
+			}
+
+			ParallelProcess( "CNavMesh::TestArea", tasks.Base(), tasks.Count(), this, &CNavMesh::ProcessTestAreaTask );
+
+			FOR_EACH_VEC( tasks, it )
+			{
+				if ( tasks[ it ].canBuild )
+					candidates.AddToTail( tasks[ it ].node );
+			}
+		}
+
+		FOR_EACH_VEC( candidates, it )
+		{
+			CNavNode *node = candidates[ it ];
 			if (node->IsCovered())
 				continue;
 
@@ -3628,14 +3675,23 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case SAMPLE_WALKABLE_SPACE:
 		{
-			AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
-			m_sampleTick = ( m_sampleTick + 1 ) % 1000;
-
-			while ( SampleStep() )
+			if ( m_isBatchGenerating )
 			{
-				if ( Plat_FloatTime() - startTime > maxTime )
+				Msg( "Sampling walkable space...\n" );
+				SampleWalkableSpaceInBatch();
+				Msg( "Sampling walkable space...DONE (%d nodes)\n", CNavNode::GetListLength() );
+			}
+			else
+			{
+				AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
+				m_sampleTick = ( m_sampleTick + 1 ) % 1000;
+
+				while ( SampleStep() )
 				{
-					return true;
+					if ( Plat_FloatTime() - startTime > maxTime )
+					{
+						return true;
+					}
 				}
 			}
 
@@ -3826,6 +3882,12 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			bool shouldSkipLightComputation = true;
 #endif
 
+			if ( m_isBatchGenerating )
+			{
+				// lighting is sampled by moving the listen server host around over many frames
+				shouldSkipLightComputation = true;
+			}
+
 			if ( shouldSkipLightComputation )
 			{
 				m_generationState = CUSTOM;	// no light intensity calcs for incremental generation or dedicated servers
@@ -4036,6 +4098,72 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 	return false;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Run a full generation to completion in one call, without spreading it across frames.
+ * Sampling and area building are spread across worker threads.  Intended for generating
+ * meshes on a dedicated server, e.g. "+map <name> +nav_generate_batch quit".
+ */
+void CNavMesh::GenerateInBatch( bool quitWhenFinished )
+{
+	static const char *phaseName[] =
+	{
+		"Sampling walkable space",
+		"Creating areas",
+		"Finding hiding spots",
+		"Finding encounter spots",
+		"Finding sniper spots",
+		"Finding earliest occupy times",
+		"Finding light intensity",
+		"Computing mesh visibility",
+		"Custom analysis",
+		"Saving",
+	};
+	COMPILE_TIME_ASSERT( ARRAYSIZE( phaseName ) == NUM_GENERATION_STATES );
+
+	BeginGeneration();
+
+	if ( !IsGenerating() )
+	{
+		if ( quitWhenFinished )
+		{
+			engine->ServerCommand( "quit\n" );
+		}
+		return;
+	}
+
+	m_isBatchGenerating = true;
+	m_bQuitWhenFinished = quitWhenFinished;
+
+	double phaseTime[ NUM_GENERATION_STATES ] = { 0 };
+
+	bool isGenerating = true;
+	while( isGenerating )
+	{
+		GenerationStateType state = m_generationState;
+		double phaseStartTime = Plat_FloatTime();
+
+		isGenerating = UpdateGeneration( FLT_MAX );
+
+		phaseTime[ state ] += Plat_FloatTime() - phaseStartTime;
+	}
+
+	m_isBatchGenerating = false;
+
+	double totalTime = 0.0;
+	Msg( "Batch generation phase times:\n" );
+	for( int i=0; i<NUM_GENERATION_STATES; ++i )
+	{
+		if ( phaseTime[i] > 0.0 )
+		{
+			Msg( "  %-32s %8.2f seconds\n", phaseName[i], phaseTime[i] );
+			totalTime += phaseTime[i];
+		}
+	}
+	Msg( "  %-32s %8.2f seconds\n", "Total", totalTime );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Define the name of player spawn entities
@@ -4072,17 +4200,39 @@ const char *CNavMesh::GetPlayerSpawnName( void ) const
  */
 CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement, 
 							float obstacleHeight, float obstacleStartDist, float obstacleEndDist )
+{
+	bool useNew;
+	CNavNode *node = ConnectNode( destPos, normal, dir, source, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist, &useNew );
+
+	if (useNew)
+	{
+		// new node becomes current node
+		m_currentNode = node;
+	}
+
+	CheckNodeAttributes( node );
+
+	return node;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find or create the nav node at the given position, and connect the source node to it.
+ * Sets isNew if the node was created.
+ */
+CNavNode *CNavMesh::ConnectNode( const Vector &destPos, const Vector &normal, NavDirType dir, CNavNode *source, bool isOnDisplacement, 
+								float obstacleHeight, float obstacleStartDist, float obstacleEndDist, bool *isNew )
 {
 	// check if a node exists at this location
 	CNavNode *node = CNavNode::GetNode( destPos );
 	
 	// if no node exists, create one
-	bool useNew = false;
+	*isNew = false;
 	if (node == NULL)
 	{
 		node = new CNavNode( destPos, normal, source, isOnDisplacement );
 		OnNodeAdded( node );
-		useNew = true;
+		*isNew = true;
 	}
 
 	// connect source node to new node
@@ -4102,12 +4252,16 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 		node->MarkAsVisited( OppositeDirection( dir ) );
 	}
 
-	if (useNew)
-	{
-		// new node becomes current node
-		m_currentNode = node;
-	}
+	return node;
+}
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Determine the crouch and cliff attributes of a node.  Only traces from the node itself,
+ * so it may be run on worker threads.
+ */
+void CNavMesh::CheckNodeAttributes( CNavNode *node )
+{
 	node->CheckCrouch();
 
 	// determine if there's a cliff nearby and set an attribute on this node
@@ -4120,8 +4274,6 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 			break;
 		}
 	}
-
-	return node;
 }
 
 //--------------------------------------------------------------------------------------------------------------
@@ -4331,6 +4483,266 @@ static bool IsNodeOverlapped( const Vector& pos, const Vector& offset )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the next walkable seed to sample from.  Once the seeds are exhausted, continue
+ * the search from the ends of ladders.  Returns NULL when sampling is complete.
+ */
+CNavNode *CNavMesh::GetNextSampleStartNode( void )
+{
+	CNavNode *node = GetNextWalkableSeedNode();
+	if ( node )
+		return node;
+
+	if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
+		return NULL;
+
+	// search is exhausted - continue search from ends of ladders
+	for ( int i=0; i<m_ladders.Count(); ++i )
+	{
+		CNavLadder *ladder = m_ladders[i];
+
+		// check ladder bottom
+		if ((node = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
+			return node;
+
+		// check ladder top
+		if ((node = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
+			return node;
+	}
+
+	return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace one "step" from the given position in a cardinal direction.
+ * Returns false if we can't move there, otherwise fills in where the step lands.
+ * Only reads the map and the mesh, so it may be run on worker threads.
+ */
+bool CNavMesh::TestSampleStep( const Vector &from, NavDirType dir, SampleStepResult *step )
+{
+	// start at the given position
+	Vector pos = from;
+
+	// snap to grid
+	int cx = SnapToGrid( pos.x );
+	int cy = SnapToGrid( pos.y );
+
+	// attempt to move to adjacent node
+	switch( dir )
+	{
+		case NORTH:		cy -= GenerationStepSize; break;
+		case SOUTH:		cy += GenerationStepSize; break;
+		case EAST:		cx += GenerationStepSize; break;
+		case WEST:		cx -= GenerationStepSize; break;
+	}
+
+	pos.x = cx;
+	pos.y = cy;
+
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
+
+		if ( !inRange )
+		{
+			return false;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( pos ) )
+		{
+			return false;
+		}
+	}
+
+	// test if we can move to new position
+	trace_t result;
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to, toNormal;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
+				{
+					break;
+				}
+
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
+
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
+				{
+					break;
+				}
+
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
+				{
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
+					{
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
+						{
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
+							{
+								obstacleEndDist = GenerationStepSize;
+							}
+						}								
+					}
+				}
+			}
+		}
+
+		if ( !success )
+		{
+			return false;
+		}
+	}
+
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return false;
+	}
+
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+	{
+		return false;
+	}
+
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
+
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
+			}
+		}
+
+		if ( !bValid )
+			return false;
+	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	float deltaZ = to.z - from.z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
+
+	step->to = to;
+	step->normal = toNormal;
+	step->isOnDisplacement = isOnDisplacement;
+	step->obstacleHeight = obstacleHeight;
+	step->obstacleStartDist = obstacleStartDist;
+	step->obstacleEndDist = obstacleEndDist;
+
+	return true;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Search the world and build a map of possible movements.
@@ -4349,34 +4761,12 @@ bool CNavMesh::SampleStep( void )
 		if (m_currentNode == NULL)
 		{
 			// sampling is complete from current seed, try next one
-			m_currentNode = GetNextWalkableSeedNode();
+			m_currentNode = GetNextSampleStartNode();
 
 			if (m_currentNode == NULL)
 			{
-				if ( m_generationMode == GENERATE_INCREMENTAL || m_generationMode == GENERATE_SIMPLIFY )
-				{
-					return false;
-				}
-
-				// search is exhausted - continue search from ends of ladders
-				for ( int i=0; i<m_ladders.Count(); ++i )
-				{
-					CNavLadder *ladder = m_ladders[i];
-
-					// check ladder bottom
-					if ((m_currentNode = LadderEndSearch( &ladder->m_bottom, ladder->GetDir() )) != 0)
-						break;
-
-					// check ladder top
-					if ((m_currentNode = LadderEndSearch( &ladder->m_top, ladder->GetDir() )) != 0)
-						break;
-				}
-
-				if (m_currentNode == NULL)
-				{
-					// all seeds exhausted, sampling complete
-					return false;
-				}
+				// all seeds exhausted, sampling complete
+				return false;
 			}
 		}
 
@@ -4388,233 +4778,123 @@ bool CNavMesh::SampleStep( void )
 			if (!m_currentNode->HasVisited( (NavDirType)dir ))
 			{
 				// have not searched in this direction yet
-
-				// start at current node position
-				Vector pos = *m_currentNode->GetPosition();
-
-				// snap to grid
-				int cx = SnapToGrid( pos.x );
-				int cy = SnapToGrid( pos.y );
-
-				// attempt to move to adjacent node
-				switch( dir )
-				{
-					case NORTH:		cy -= GenerationStepSize; break;
-					case SOUTH:		cy += GenerationStepSize; break;
-					case EAST:		cx += GenerationStepSize; break;
-					case WEST:		cx -= GenerationStepSize; break;
-				}
-
-				pos.x = cx;
-				pos.y = cy;
-
 				m_generationDir = (NavDirType)dir;
 
 				// mark direction as visited
 				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+				SampleStepResult step;
+				if ( TestSampleStep( *m_currentNode->GetPosition(), m_generationDir, &step ) )
 				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
-
-					if ( !inRange )
-					{
-						return true;
-					}
+					// we can move here
+					// create a new navigation node, and update current node pointer
+					AddNode( step.to, step.normal, m_generationDir, m_currentNode, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist );
 				}
 
-				if ( m_generationMode == GENERATE_SIMPLIFY )
-				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
-				}
+				return true;
+			}
+		}
 
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to, toNormal;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
-				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
-				}
-				else
-				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
-						{
-							if ( !StayOnFloor( &tr ) )
-							{
-								break;
-							}
+		// all directions have been searched from this node - pop back to its parent and continue
+		m_currentNode = m_currentNode->GetParent();
+	}
+}
 
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
 
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::ProcessSampleStepTask( SampleStepTask &task )
+{
+	task.canMove = TestSampleStep( *task.node->GetPosition(), task.dir, &task.result );
+}
 
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
 
-					if ( !success )
-					{
-						return true;
-					}
-				}
+//--------------------------------------------------------------------------------------------------------------
+void CNavMesh::ProcessNodeAttributes( CNavNode *&node )
+{
+	CheckNodeAttributes( node );
+}
 
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
-				{
-					return true;
-				}
 
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
-				{
-					return true;
-				}
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Sample the whole map in one call.  Each wave gathers the unexplored directions of the
+ * nodes found by the previous wave, traces them on worker threads, and then connects the
+ * results in the order they were gathered.  The crouch and cliff checks of every node that
+ * was stepped onto are done at the end, also on worker threads.
+ */
+void CNavMesh::SampleWalkableSpaceInBatch( void )
+{
+	CUtlVector< CNavNode * > wave;
+	CUtlVector< SampleStepTask > tasks;
+	CUtlVector< CNavNode * > steppedOnNodes;
+	CUtlVector< bool > isSteppedOn;		// indexed by node ID
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
+	while( true )
+	{
+		if ( wave.Count() == 0 )
+		{
+			// sampling is complete from current seed, try next one
+			CNavNode *startNode = GetNextSampleStartNode();
+			if ( startNode == NULL )
+			{
+				// all seeds exhausted, sampling complete
+				break;
+			}
 
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
+			wave.AddToTail( startNode );
+		}
 
-					if ( !bValid )
-						return true;
-				}
+		// gather every direction this wave hasn't searched yet
+		tasks.RemoveAll();
+		FOR_EACH_VEC( wave, it )
+		{
+			CNavNode *node = wave[ it ];
+			for( int dir = NORTH; dir < NUM_DIRECTIONS; dir++ )
+			{
+				if ( !node->HasVisited( (NavDirType)dir ) )
+				{
+					node->MarkAsVisited( (NavDirType)dir );
 
+					SampleStepTask &task = tasks[ tasks.AddToTail() ];
+					task.node = node;
+					task.dir = (NavDirType)dir;
+				}
+			}
+		}
 
-				bool isOnDisplacement = result.IsDispSurface();
+		ParallelProcess( "CNavMesh::SampleStep", tasks.Base(), tasks.Count(), this, &CNavMesh::ProcessSampleStepTask );
 
-				if ( nav_displacement_test.GetInt() > 0 )
-				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
-					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
-						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
-							{
-								return true;
-							}
-						}
-					}
-				}
+		// connect the steps in order, the nodes they create form the next wave
+		wave.RemoveAll();
+		FOR_EACH_VEC( tasks, it )
+		{
+			const SampleStepTask &task = tasks[ it ];
+			if ( !task.canMove )
+				continue;
 
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
-				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
-				}
+			const SampleStepResult &step = task.result;
+			bool isNew;
+			CNavNode *node = ConnectNode( step.to, step.normal, task.dir, task.node, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist, &isNew );
+			if ( isNew )
+			{
+				wave.AddToTail( node );
+			}
 
-				// we can move here
-				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+			unsigned int id = node->GetID();
+			while ( (unsigned int)isSteppedOn.Count() <= id )
+			{
+				isSteppedOn.AddToTail( false );
+			}
 
-				return true;
+			if ( !isSteppedOn[ id ] )
+			{
+				isSteppedOn[ id ] = true;
+				steppedOnNodes.AddToTail( node );
 			}
 		}
-
-		// all directions have been searched from this node - pop back to its parent and continue
-		m_currentNode = m_currentNode->GetParent();
 	}
+
+	ParallelProcess( "CNavNode::CheckCrouch", steppedOnNodes.Base(), steppedOnNodes.Count(), this, &CNavMesh::ProcessNodeAttributes );
 }
 
 
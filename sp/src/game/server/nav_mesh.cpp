@@ -62,6 +62,7 @@ CNavMesh::CNavMesh( void )
 	m_gridCellSize = 300.0f;
 	m_editMode = NORMAL;
 	m_bQuitWhenFinished = false;
+	m_isBatchGenerating = false;
 	m_hostThreadModeRestoreValue = 0;
 	m_placeCount = 0;
 	m_placeName = NULL;
@@ -2604,6 +2605,19 @@ void CommandNavGenerateIncremental( void )
 static ConCommand nav_generate_incremental( "nav_generate_incremental", CommandNavGenerateIncremental, "Generate a Navigation Mesh for the current map and save it to disk.", FCVAR_GAMEDLL | FCVAR_CHEAT );
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavGenerateBatch( const CCommand &args )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	bool quitWhenFinished = ( args.ArgC() > 1 && !Q_stricmp( args[1], "quit" ) );
+
+	TheNavMesh->GenerateInBatch( quitWhenFinished );
+}
+static ConCommand nav_generate_batch( "nav_generate_batch", CommandNavGenerateBatch, "Generate a Navigation Mesh for the current map in one pass using worker threads, save it to disk, and report the time spent in each phase.  'nav_generate_batch quit' exits when finished.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
 //--------------------------------------------------------------------------------------------------------------
 void CommandNavAnalyze( void )
 {
@@ -3058,11 +3072,23 @@ void HidingSpot::Save( CUtlBuffer &fileBuffer, unsigned int version ) const
 //--------------------------------------------------------------------------------------------------------------
 void HidingSpot::Load( CUtlBuffer &fileBuffer, unsigned int version )
 {
-	m_id = fileBuffer.GetUnsignedInt();
-	m_pos.x = fileBuffer.GetFloat();
-	m_pos.y = fileBuffer.GetFloat();
-	m_pos.z = fileBuffer.GetFloat();
-	m_flags = fileBuffer.GetUnsignedChar();
+	unsigned int id = fileBuffer.GetUnsignedInt();
+	Vector pos;
+	pos.x = fileBuffer.GetFloat();
+	pos.y = fileBuffer.GetFloat();
+	pos.z = fileBuffer.GetFloat();
+	unsigned char flags = fileBuffer.GetUnsignedChar();
+
+	Load( id, pos, flags );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void HidingSpot::Load( unsigned int id, const Vector &pos, unsigned char flags )
+{
+	m_id = id;
+	m_pos = pos;
+	m_flags = flags;
 
 	// update next ID to avoid ID collisions by later spots
 	if (m_id >= m_nextID)
@@ -0,0 +1,459 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// nav_pathfind.cpp
+// Re-entrant path queries over the Navigation Mesh, and recording and replay of path requests
+
+#include "cbase.h"
+#include "filesystem.h"
+#include "utlbuffer.h"
+#include "vstdlib/jobthread.h"
+#include "nav_mesh.h"
+#include "nav_pathfind.h"
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+/**
+ * The query NavAreaBuildPath() searches with on the main thread
+ */
+CNavPathQuery TheNavPathQuery;
+
+int g_nRunningNavPathQueries = 0;
+static CThreadLocalPtr< CNavPathQuery > s_runningNavPathQuery;
+
+ConVar nav_record_path_requests( "nav_record_path_requests", "0", FCVAR_GAMEDLL | FCVAR_CHEAT, "Set to one to record every NavAreaBuildPath() request, for nav_save_path_requests and nav_bench_pathfind." );
+
+
+//--------------------------------------------------------------------------------------------------------------
+const NavPathQueryArea_t *FindRunningNavPathQueryArea( const CNavArea *area )
+{
+	const CNavPathQuery *query = s_runningNavPathQuery;
+	return query ? query->FindState( area ) : NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavPathQuery::CNavPathQuery( void )
+{
+	m_generation = 1;
+	m_openOrder = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Start a new search, and make it the one the CNavArea accessors see on this thread until it returns
+ */
+CNavPathQuery::CRunningSearch::CRunningSearch( CNavPathQuery *query )
+{
+	query->m_openList.RemoveAll();
+	query->m_reached.RemoveAll();
+	query->m_openOrder = 0;
+
+	// a generation of zero is what new states start with, so wrapping around has to reset them all
+	if ( ++query->m_generation == 0 )
+	{
+		FOR_EACH_VEC( query->m_states, it )
+		{
+			query->m_states[ it ].generation = 0;
+		}
+		query->m_generation = 1;
+	}
+
+	m_prevQuery = s_runningNavPathQuery;
+	s_runningNavPathQuery = query;
+	ThreadInterlockedIncrement( &g_nRunningNavPathQueries );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavPathQuery::CRunningSearch::~CRunningSearch()
+{
+	ThreadInterlockedDecrement( &g_nRunningNavPathQueries );
+	s_runningNavPathQuery = m_prevQuery;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQuery::GrowStates( unsigned int id )
+{
+	// area IDs are compact after loading, so this usually happens once per mesh
+	int oldCount = m_states.Count();
+	m_states.AddMultipleToTail( id + 1 - oldCount );
+	for( int i = oldCount; i < m_states.Count(); ++i )
+	{
+		m_states[i].generation = 0;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavArea *CNavPathQuery::GetParent( const CNavArea *area ) const
+{
+	const NavPathQueryArea_t *state = FindState( area );
+	return state ? state->parent : NULL;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+NavTraverseType CNavPathQuery::GetParentHow( const CNavArea *area ) const
+{
+	const NavPathQueryArea_t *state = FindState( area );
+	return state ? state->parentHow : NUM_TRAVERSE_TYPES;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+float CNavPathQuery::GetCostSoFar( const CNavArea *area ) const
+{
+	const NavPathQueryArea_t *state = FindState( area );
+	return state ? state->costSoFar : 0.0f;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQuery::CopyResultsToAreas( void ) const
+{
+	FOR_EACH_VEC( m_reached, it )
+	{
+		CNavArea *area = m_reached[ it ];
+		const NavPathQueryArea_t &state = m_states[ area->GetID() ];
+
+		area->SetParent( state.parent, state.parentHow );
+		area->SetTotalCost( state.totalCost );
+		area->SetCostSoFar( state.costSoFar );
+		area->SetPathLengthSoFar( state.pathLengthSoFar );
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQuery::AddToOpenList( CNavArea *area, NavPathQueryArea_t *state )
+{
+	Assert( state->openIndex < 0 );
+
+	state->openOrder = m_openOrder++;
+	state->openIndex = m_openList.Count();
+
+	OpenEntry_t &entry = m_openList[ m_openList.AddToTail() ];
+	entry.totalCost = state->totalCost;
+	entry.order = state->openOrder;
+	entry.area = area;
+
+	SiftUp( state->openIndex );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQuery::UpdateOnOpenList( NavPathQueryArea_t *state )
+{
+	// since value can only decrease, the entry can only move toward the top
+	Assert( state->openIndex >= 0 && state->totalCost <= m_openList[ state->openIndex ].totalCost );
+
+	m_openList[ state->openIndex ].totalCost = state->totalCost;
+	SiftUp( state->openIndex );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavArea *CNavPathQuery::PopOpenList( void )
+{
+	Assert( !IsOpenListEmpty() );
+
+	CNavArea *area = m_openList[0].area;
+	m_states[ area->GetID() ].openIndex = NAV_PATH_QUERY_UNLISTED;
+
+	int last = m_openList.Count() - 1;
+	if ( last > 0 )
+	{
+		m_openList[0] = m_openList[ last ];
+		m_states[ m_openList[0].area->GetID() ].openIndex = 0;
+		m_openList.FastRemove( last );
+		SiftDown( 0 );
+	}
+	else
+	{
+		m_openList.RemoveAll();
+	}
+
+	return area;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQuery::SiftUp( int index )
+{
+	OpenEntry_t entry = m_openList[ index ];
+	while( index > 0 )
+	{
+		int parent = ( index - 1 ) / 2;
+		if ( !IsOpenEntryLess( entry, m_openList[ parent ] ) )
+			break;
+
+		m_openList[ index ] = m_openList[ parent ];
+		m_states[ m_openList[ index ].area->GetID() ].openIndex = index;
+		index = parent;
+	}
+
+	m_openList[ index ] = entry;
+	m_states[ entry.area->GetID() ].openIndex = index;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavPathQuery::SiftDown( int index )
+{
+	OpenEntry_t entry = m_openList[ index ];
+	int count = m_openList.Count();
+	while( true )
+	{
+		int child = index * 2 + 1;
+		if ( child >= count )
+			break;
+
+		if ( child + 1 < count && IsOpenEntryLess( m_openList[ child + 1 ], m_openList[ child ] ) )
+		{
+			++child;
+		}
+
+		if ( !IsOpenEntryLess( m_openList[ child ], entry ) )
+			break;
+
+		m_openList[ index ] = m_openList[ child ];
+		m_states[ m_openList[ index ].area->GetID() ].openIndex = index;
+		index = child;
+	}
+
+	m_openList[ index ] = entry;
+	m_states[ entry.area->GetID() ].openIndex = index;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Path requests recorded from NavAreaBuildPath(), by area ID so they can be saved and replayed
+ */
+struct NavPathRequest
+{
+	unsigned int startID;
+	unsigned int goalID;										// zero if the request was for a position
+	Vector goalPos;
+	bool hasGoalPos;
+};
+
+static CUtlVector< NavPathRequest > s_recordedPathRequests;
+
+//--------------------------------------------------------------------------------------------------------------
+void RecordNavPathRequest( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos )
+{
+	if ( startArea == NULL || ( goalArea == NULL && goalPos == NULL ) )
+		return;
+
+	NavPathRequest &request = s_recordedPathRequests[ s_recordedPathRequests.AddToTail() ];
+	request.startID = startArea->GetID();
+	request.goalID = goalArea ? goalArea->GetID() : 0;
+	request.goalPos = goalPos ? *goalPos : vec3_origin;
+	request.hasGoalPos = ( goalPos != NULL );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+static void GetPathRequestFilename( char *filename, int size )
+{
+	// filename is local to game dir for Steam, so we need to prepend game dir for regular file save
+	char gamePath[256];
+	engine->GetGameDir( gamePath, 256 );
+
+	Q_snprintf( filename, size, "%s\\maps\\%s_paths.txt", gamePath, STRING( gpGlobals->mapname ) );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_save_path_requests, "Write the path requests recorded with nav_record_path_requests to a file, for nav_bench_pathfind.", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::TEXT_BUFFER );
+
+	FOR_EACH_VEC( s_recordedPathRequests, it )
+	{
+		const NavPathRequest &request = s_recordedPathRequests[ it ];
+		fileBuffer.Printf( "%u %u %d %f %f %f\n", request.startID, request.goalID, request.hasGoalPos ? 1 : 0, request.goalPos.x, request.goalPos.y, request.goalPos.z );
+	}
+
+	char filename[256];
+	GetPathRequestFilename( filename, sizeof( filename ) );
+
+	if ( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
+	{
+		Warning( "Unable to save %d bytes to %s\n", fileBuffer.Size(), filename );
+	}
+	else
+	{
+		DevMsg( "Wrote %d path requests to '%s'.\n", s_recordedPathRequests.Count(), filename );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A request resolved to areas, and what searching for it found
+ */
+struct NavPathBenchRequest
+{
+	CNavArea *startArea;
+	CNavArea *goalArea;
+	Vector goalPos;
+	bool hasGoalPos;
+
+	bool pathExists;
+	CNavArea *closestArea;
+	float cost;
+};
+
+/**
+ * The requests one thread searches for, with its own query
+ */
+struct NavPathBenchChunk
+{
+	NavPathBenchRequest *requests;
+	int requestCount;
+	int reps;
+	CNavPathQuery query;
+};
+
+//--------------------------------------------------------------------------------------------------------------
+static void RunPathBenchChunk( NavPathBenchChunk &chunk )
+{
+	ShortestPathCost costFunc;
+	for( int r=0; r<chunk.reps; ++r )
+	{
+		for( int i=0; i<chunk.requestCount; ++i )
+		{
+			NavPathBenchRequest &request = chunk.requests[i];
+			request.pathExists = chunk.query.BuildPath( request.startArea, request.goalArea, request.hasGoalPos ? &request.goalPos : NULL, costFunc, &request.closestArea );
+			request.cost = chunk.query.GetCostSoFar( request.closestArea );
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Replay the path requests saved by nav_save_path_requests (or random ones between areas of the
+ * current mesh if there are none), on the main thread and then split across worker threads,
+ * and check that both find the same paths.
+ */
+CON_COMMAND_F( nav_bench_pathfind, "Time path finding on the current mesh with the requests saved by nav_save_path_requests, on one and then several threads. Arguments: [thread count] [repeat count]", FCVAR_GAMEDLL | FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( TheNavAreas.Count() == 0 )
+	{
+		Warning( "No navigation mesh loaded.\n" );
+		return;
+	}
+
+	int threadCount = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 4;
+	int reps = ( args.ArgC() > 2 ) ? MAX( atoi( args[2] ), 1 ) : 4;
+
+	CUtlVector< NavPathBenchRequest > requests;
+
+	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::TEXT_BUFFER );
+	char filename[256];
+	GetPathRequestFilename( filename, sizeof( filename ) );
+
+	if ( filesystem->ReadFile( filename, "MOD", fileBuffer ) )
+	{
+		while( true )
+		{
+			unsigned int startID, goalID;
+			int hasGoalPos;
+			Vector goalPos;
+			if ( fileBuffer.Scanf( "%u %u %d %f %f %f", &startID, &goalID, &hasGoalPos, &goalPos.x, &goalPos.y, &goalPos.z ) < 6 )
+			{
+				break;
+			}
+
+			NavPathBenchRequest &request = requests[ requests.AddToTail() ];
+			request.startArea = TheNavMesh->GetNavAreaByID( startID );
+			request.goalArea = goalID ? TheNavMesh->GetNavAreaByID( goalID ) : NULL;
+			request.goalPos = goalPos;
+			request.hasGoalPos = ( hasGoalPos != 0 );
+
+			// worker threads need a goal area, so position requests use the area under the position
+			if ( request.goalArea == NULL && request.hasGoalPos )
+			{
+				request.goalArea = TheNavMesh->GetNavArea( goalPos );
+			}
+
+			if ( request.startArea == NULL || request.goalArea == NULL )
+			{
+				requests.FastRemove( requests.Count() - 1 );
+			}
+		}
+
+		DevMsg( "Loaded %d path requests from '%s'.\n", requests.Count(), filename );
+	}
+	else
+	{
+		const int randomRequestCount = 1000;
+		for( int i=0; i<randomRequestCount; ++i )
+		{
+			NavPathBenchRequest &request = requests[ requests.AddToTail() ];
+			request.startArea = TheNavAreas[ RandomInt( 0, TheNavAreas.Count()-1 ) ];
+			request.goalArea = TheNavAreas[ RandomInt( 0, TheNavAreas.Count()-1 ) ];
+			request.hasGoalPos = false;
+		}
+
+		DevMsg( "No path requests in '%s', using %d random ones.\n", filename, requests.Count() );
+	}
+
+	if ( requests.Count() == 0 )
+		return;
+
+	// one query on the main thread
+	CUtlVector< NavPathBenchChunk > chunks;
+	chunks.SetCount( 1 );
+	chunks[0].requests = requests.Base();
+	chunks[0].requestCount = requests.Count();
+	chunks[0].reps = reps;
+
+	float start = Plat_FloatTime();
+	RunPathBenchChunk( chunks[0] );
+	float singleTime = Plat_FloatTime() - start;
+
+	CUtlVector< NavPathBenchRequest > singleResults;
+	singleResults.CopyArray( requests.Base(), requests.Count() );
+
+	// the same requests split across worker threads, each with its own query
+	chunks.RemoveAll();
+	chunks.SetCount( MIN( threadCount, requests.Count() ) );
+	int firstRequest = 0;
+	FOR_EACH_VEC( chunks, it )
+	{
+		int lastRequest = requests.Count() * ( it + 1 ) / chunks.Count();
+		chunks[ it ].requests = requests.Base() + firstRequest;
+		chunks[ it ].requestCount = lastRequest - firstRequest;
+		chunks[ it ].reps = reps;
+		firstRequest = lastRequest;
+	}
+
+	start = Plat_FloatTime();
+	ParallelProcess( "nav_bench_pathfind", chunks.Base(), chunks.Count(), &RunPathBenchChunk );
+	float threadedTime = Plat_FloatTime() - start;
+
+	int pathCount = 0;
+	int mismatchCount = 0;
+	FOR_EACH_VEC( requests, it )
+	{
+		const NavPathBenchRequest &single = singleResults[ it ];
+		const NavPathBenchRequest &threaded = requests[ it ];
+
+		pathCount += single.pathExists ? 1 : 0;
+		if ( single.pathExists != threaded.pathExists || single.closestArea != threaded.closestArea || single.cost != threaded.cost )
+		{
+			++mismatchCount;
+		}
+	}
+
+	float searchCount = (float)requests.Count() * reps;
+	Msg( "%d path requests x %d, %d with paths.\n", requests.Count(), reps, pathCount );
+	Msg( "  main thread:  %2.2f ms, %2.2f us per path\n", singleTime * 1000.0f, singleTime * 1000000.0f / searchCount );
+	Msg( "  %d threads:    %2.2f ms, %2.2f us per path, %2.2fx\n", chunks.Count(), threadedTime * 1000.0f, threadedTime * 1000000.0f / searchCount, singleTime / MAX( threadedTime, 0.000001f ) );
+	Msg( "  %d results differ between the main thread and the worker threads.\n", mismatchCount );
+}
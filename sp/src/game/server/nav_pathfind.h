@@ -87,33 +87,148 @@ public:
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Find path from startArea to goalArea via an A* search, using supplied cost heuristic.
- * If cost functor returns -1 for an area, that area is considered a dead end.
- * This doesn't actually build a path, but the path is defined by following parent
- * pointers back from goalArea to startArea.
- * If 'closestArea' is non-NULL, the closest area to the goal is returned (useful if the path fails).
- * If 'goalArea' is NULL, will compute a path as close as possible to 'goalPos'.
- * If 'goalPos' is NULL, will use the center of 'goalArea' as the goal position.
- * If 'maxPathLength' is nonzero, path building will stop when this length is reached.
- * Returns true if a path exists.
+ * An A* search over the navigation mesh that keeps all of its state to itself: a binary heap for the
+ * open list and a per-area state array indexed by area ID, stamped with a generation so a new search
+ * doesn't have to clear it. Each query can search on its own thread while others do the same.
+ * While a query is searching, the search state accessors of CNavArea (GetCostSoFar(), GetParent(), ...)
+ * return the query's state on that thread, so existing cost functors work unchanged.
  */
-#define IGNORE_NAV_BLOCKERS true
+class CNavPathQuery
+{
+public:
+	CNavPathQuery( void );
+
+	/**
+	 * Same as NavAreaBuildPath(), but the path is defined by following this query's GetParent() back
+	 * from the goal. Searches without a goal area test containment against 'goalPos', which is only
+	 * safe on the main thread.
+	 */
+	template< typename CostFunctor >
+	bool BuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false );
+
+	// results of the last search, for the areas it reached
+	bool WasReached( const CNavArea *area ) const	{ return FindState( area ) != NULL; }
+	CNavArea *GetParent( const CNavArea *area ) const;
+	NavTraverseType GetParentHow( const CNavArea *area ) const;
+	float GetCostSoFar( const CNavArea *area ) const;
+
+	void CopyResultsToAreas( void ) const;			// store the results on the areas themselves, where NavAreaBuildPath() leaves them
+
+	const NavPathQueryArea_t *FindState( const CNavArea *area ) const;	// NULL if the last search didn't reach the area
+
+private:
+	enum
+	{
+		NAV_PATH_QUERY_CLOSED = -1,					// NavPathQueryArea_t::openIndex of a searched area
+		NAV_PATH_QUERY_UNLISTED = -2,				// ... and of a reached area on neither list
+	};
+
+	struct OpenEntry_t
+	{
+		float totalCost;
+		unsigned int order;
+		CNavArea *area;
+	};
+
+	// keeps this query findable by the CNavArea accessors while it searches
+	class CRunningSearch
+	{
+	public:
+		CRunningSearch( CNavPathQuery *query );
+		~CRunningSearch();
+
+	private:
+		CNavPathQuery *m_prevQuery;
+	};
+
+	NavPathQueryArea_t *Reach( const CNavArea *area );	// the area's state, reset if the area hasn't been reached by this search yet
+	void GrowStates( unsigned int id );
+
+	bool IsOpenListEmpty( void ) const	{ return m_openList.Count() == 0; }
+	void AddToOpenList( CNavArea *area, NavPathQueryArea_t *state );
+	void UpdateOnOpenList( NavPathQueryArea_t *state );	// the area's total cost went down
+	CNavArea *PopOpenList( void );
+	bool IsOpenEntryLess( const OpenEntry_t &a, const OpenEntry_t &b ) const;
+	void SiftUp( int index );
+	void SiftDown( int index );
+
+	CUtlVector< NavPathQueryArea_t > m_states;			// indexed by area ID
+	CUtlVector< OpenEntry_t > m_openList;				// binary heap, cheapest first
+	CUtlVector< CNavArea * > m_reached;				// areas reached by the last search, for CopyResultsToAreas()
+	unsigned int m_generation;
+	unsigned int m_openOrder;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+inline const NavPathQueryArea_t *CNavPathQuery::FindState( const CNavArea *area ) const
+{
+	unsigned int id = area->GetID();
+	if ( id >= (unsigned int)m_states.Count() || m_states[ id ].generation != m_generation )
+		return NULL;
+
+	return &m_states[ id ];
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline NavPathQueryArea_t *CNavPathQuery::Reach( const CNavArea *area )
+{
+	unsigned int id = area->GetID();
+	if ( id >= (unsigned int)m_states.Count() )
+	{
+		GrowStates( id );
+	}
+
+	NavPathQueryArea_t *state = &m_states[ id ];
+	if ( state->generation != m_generation )
+	{
+		state->generation = m_generation;
+		state->openIndex = NAV_PATH_QUERY_UNLISTED;
+		state->openOrder = 0;
+		state->totalCost = 0.0f;
+		state->costSoFar = 0.0f;
+		state->pathLengthSoFar = 0.0f;
+		state->parent = NULL;
+		state->parentHow = NUM_TRAVERSE_TYPES;
+		m_reached.AddToTail( const_cast< CNavArea * >( area ) );
+	}
+
+	return state;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline bool CNavPathQuery::IsOpenEntryLess( const OpenEntry_t &a, const OpenEntry_t &b ) const
+{
+	// ties go to the area opened first, like the sorted list NavAreaBuildPath() used to keep
+	if ( a.totalCost != b.totalCost )
+		return a.totalCost < b.totalCost;
+
+	return a.order < b.order;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
 template< typename CostFunctor >
-bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+bool CNavPathQuery::BuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea, float maxPathLength, int teamID, bool ignoreNavBlockers )
 {
 	VPROF_BUDGET( "NavAreaBuildPath", "NextBotSpiky" );
 
+	// containment tests go through the mesh's search marker, which only the main thread may use
+	Assert( goalArea || ThreadInMainThread() );
+
+	CRunningSearch running( this );
+
 	if ( closestArea )
 	{
 		*closestArea = startArea;
 	}
 
-	bool isDebug = ( g_DebugPathfindCounter-- > 0 );
+	bool isDebug = ThreadInMainThread() && ( g_DebugPathfindCounter-- > 0 );
 
 	if (startArea == NULL)
 		return false;
 
-	startArea->SetParent( NULL );
+	NavPathQueryArea_t *startState = Reach( startArea );
 
 	if (goalArea != NULL && goalArea->IsBlocked( teamID, ignoreNavBlockers ))
 		goalArea = NULL;
@@ -130,29 +245,27 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 	// determine actual goal position
 	Vector actualGoalPos = (goalPos) ? *goalPos : goalArea->GetCenter();
 
-	// start search
-	CNavArea::ClearSearchLists();
-
 	// compute estimate of path length
 	/// @todo Cost might work as "manhattan distance"
-	startArea->SetTotalCost( (startArea->GetCenter() - actualGoalPos).Length() );
+	startState->totalCost = (startArea->GetCenter() - actualGoalPos).Length();
 
 	float initCost = costFunc( startArea, NULL, NULL, NULL, -1.0f );	
 	if (initCost < 0.0f)
 		return false;
-	startArea->SetCostSoFar( initCost );
-	startArea->SetPathLengthSoFar( 0.0 );
+	startState->costSoFar = initCost;
+	startState->pathLengthSoFar = 0.0f;
 
-	startArea->AddToOpenList();
+	AddToOpenList( startArea, startState );
 
 	// keep track of the area we visit that is closest to the goal
-	float closestAreaDist = startArea->GetTotalCost();
+	float closestAreaDist = startState->totalCost;
 
 	// do A* search
-	while( !CNavArea::IsOpenListEmpty() )
+	while( !IsOpenListEmpty() )
 	{
 		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
+		CNavArea *area = PopOpenList();
+		NavPathQueryArea_t *areaState = Reach( area );
 
 		if ( isDebug )
 		{
@@ -329,7 +442,7 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// don't backtrack
 			Assert( newArea );
-			if ( newArea == area->GetParent() )
+			if ( newArea == areaState->parent )
 				continue;
 			if ( newArea == area ) // self neighbor?
 				continue;
@@ -339,6 +452,10 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 				continue;
 
 			float newCostSoFar = costFunc( newArea, area, ladder, elevator, length );
+
+			// reaching the new area can grow the state array, so find both states afterwards
+			NavPathQueryArea_t *newState = Reach( newArea );
+			areaState = Reach( area );
 			
 			// check if cost functor says this area is a dead-end
 			if ( newCostSoFar < 0.0f )
@@ -346,13 +463,13 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// Safety check against a bogus functor.  The cost of the path
 			// A...B, C should always be at least as big as the path A...B.
-			Assert( newCostSoFar >= area->GetCostSoFar() );
+			Assert( newCostSoFar >= areaState->costSoFar );
 
 			// And now that we've asserted, let's be a bit more defensive.
 			// Make sure that any jump to a new area incurs some pathfinsing
 			// cost, to avoid us spinning our wheels over insignificant cost
 			// benefit, floating point precision bug, or busted cost functor.
-			float minNewCostSoFar = area->GetCostSoFar() * 1.00001 + 0.00001;
+			float minNewCostSoFar = areaState->costSoFar * 1.00001 + 0.00001;
 			newCostSoFar = Max( newCostSoFar, minNewCostSoFar );
 				
 			// stop if path length limit reached
@@ -360,14 +477,14 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 			{
 				// keep track of path length so far
 				float deltaLength = ( newArea->GetCenter() - area->GetCenter() ).Length();
-				float newLengthSoFar = area->GetPathLengthSoFar() + deltaLength;
+				float newLengthSoFar = areaState->pathLengthSoFar + deltaLength;
 				if ( newLengthSoFar > maxPathLength )
 					continue;
 				
-				newArea->SetPathLengthSoFar( newLengthSoFar );
+				newState->pathLengthSoFar = newLengthSoFar;
 			}
 
-			if ( ( newArea->IsOpen() || newArea->IsClosed() ) && newArea->GetCostSoFar() <= newCostSoFar )
+			if ( newState->openIndex != NAV_PATH_QUERY_UNLISTED && newState->costSoFar <= newCostSoFar )
 			{
 				// this is a worse path - skip it
 				continue;
@@ -385,36 +502,67 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 					closestAreaDist = newCostRemaining;
 				}
 				
-				newArea->SetCostSoFar( newCostSoFar );
-				newArea->SetTotalCost( newCostSoFar + newCostRemaining );
+				newState->costSoFar = newCostSoFar;
+				newState->totalCost = newCostSoFar + newCostRemaining;
 
-				if ( newArea->IsClosed() )
+				if ( newState->openIndex >= 0 )
 				{
-					newArea->RemoveFromClosedList();
-				}
-
-				if ( newArea->IsOpen() )
-				{
-					// area already on open list, update the list order to keep costs sorted
-					newArea->UpdateOnOpenList();
+					// area already on open list, update the heap to keep costs sorted
+					UpdateOnOpenList( newState );
 				}
 				else
 				{
-					newArea->AddToOpenList();
+					// closed areas are reopened
+					AddToOpenList( newArea, newState );
 				}
 
-				newArea->SetParent( area, how );
+				newState->parent = area;
+				newState->parentHow = how;
 			}
 		}
 
 		// we have searched this area
-		area->AddToClosedList();
+		areaState->openIndex = NAV_PATH_QUERY_CLOSED;
 	}
 
 	return false;
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find path from startArea to goalArea via an A* search, using supplied cost heuristic.
+ * If cost functor returns -1 for an area, that area is considered a dead end.
+ * This doesn't actually build a path, but the path is defined by following parent
+ * pointers back from goalArea to startArea.
+ * If 'closestArea' is non-NULL, the closest area to the goal is returned (useful if the path fails).
+ * If 'goalArea' is NULL, will compute a path as close as possible to 'goalPos'.
+ * If 'goalPos' is NULL, will use the center of 'goalArea' as the goal position.
+ * If 'maxPathLength' is nonzero, path building will stop when this length is reached.
+ * Returns true if a path exists.
+ * Searches with the main thread's CNavPathQuery, use a query of your own on other threads.
+ */
+extern CNavPathQuery TheNavPathQuery;
+extern void RecordNavPathRequest( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos );
+extern ConVar nav_record_path_requests;
+
+#define IGNORE_NAV_BLOCKERS true
+template< typename CostFunctor >
+bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+{
+	Assert( ThreadInMainThread() );
+
+	if ( nav_record_path_requests.GetBool() )
+	{
+		RecordNavPathRequest( startArea, goalArea, goalPos );
+	}
+
+	bool pathExists = TheNavPathQuery.BuildPath( startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID, ignoreNavBlockers );
+	TheNavPathQuery.CopyResultsToAreas();
+	return pathExists;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Compute distance between two areas. Return -1 if can't reach 'endArea' from 'startArea'.
@@ -10,9 +10,13 @@
 #include "igamesystem.h"
 #include "ilagcompensationmanager.h"
 #include "inetchannelinfo.h"
-#include "utllinkedlist.h"
 #include "BaseAnimatingOverlay.h"
 #include "tier0/vprof.h"
+#include "mathlib/ssemath.h"
+#include "studio.h"
+#include "bone_setup.h"
+#include "collisionutils.h"
+#include "datacache/imdlcache.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -37,6 +41,19 @@ ConVar sv_showlagcompensation( "sv_showlagcompensation", "0", FCVAR_CHEAT, "Show
 
 ConVar sv_unlag_fixstuck( "sv_unlag_fixstuck", "0", FCVAR_DEVELOPMENTONLY, "Disallow backtracking a player for lag compensation if it will cause them to become stuck" );
 
+ConVar sv_unlag_cull( "sv_unlag_cull", "1", FCVAR_DEVELOPMENTONLY, "Don't backtrack players whose lag compensation history is entirely outside a cone around the shooter's aim" );
+ConVar sv_unlag_cull_angle( "sv_unlag_cull_angle", "30", FCVAR_DEVELOPMENTONLY, "Half angle, in degrees, of the aim cone used by sv_unlag_cull", true, 0.0f, true, 180.0f );
+ConVar sv_unlag_stats( "sv_unlag_stats", "0", FCVAR_DEVELOPMENTONLY, "Print how many players lag compensation considered, culled, backtracked and restored, once a second" );
+ConVar sv_unlag_snapshot( "sv_unlag_snapshot", "0", FCVAR_DEVELOPMENTONLY, "Trace bullets against snapshots of the players' past hitboxes instead of moving the players back in time" );
+ConVar sv_unlag_snapshot_validate( "sv_unlag_snapshot_validate", "0", FCVAR_DEVELOPMENTONLY, "Also build the lag compensation snapshot for every command, and check its poses and aim traces against the backtracked players" );
+
+// Hitboxes reach a little outside the collision bounds
+#define LAG_COMPENSATION_CULL_PADDING	24.0f
+
+// How far the tick sent by a player may be from the latency based one before it's
+// ignored, so the history has to reach this much further back than sv_maxunlag
+#define LAG_COMPENSATION_MAX_TICK_DELTA	0.2f
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -79,6 +96,7 @@ public:
 		m_flSimulationTime = -1;
 		m_masterSequence = 0;
 		m_masterCycle = 0;
+		m_flMoveDistSqr = 0;
 	}
 
 	LagRecord( const LagRecord& src )
@@ -95,6 +113,7 @@ public:
 		}
 		m_masterSequence = src.m_masterSequence;
 		m_masterCycle = src.m_masterCycle;
+		m_flMoveDistSqr = src.m_flMoveDistSqr;
 	}
 
 	// Did player die this frame
@@ -112,6 +131,174 @@ public:
 	LayerRecord				m_layerRecords[MAX_LAYER_RECORDS];
 	int						m_masterSequence;
 	float					m_masterCycle;
+
+	// 2D distance squared moved since the previous (older) record
+	float					m_flMoveDistSqr;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: A player's lag records in a ring buffer, newest first.  Simulation
+//			times decrease from the head, so the record for a target time is
+//			found with a binary search.  Serial numbers count the records ever
+//			added, and anything that loses track of the player (death or a
+//			teleport) moves up the oldest serial that can still be reached
+//			from the head.
+//-----------------------------------------------------------------------------
+class CLagRecordTrack
+{
+public:
+	CLagRecordTrack() : m_nHead( 0 ), m_nCount( 0 ), m_nSerial( 0 ), m_nOldestValidSerial( 0 )
+	{
+	}
+
+	int Count() const
+	{
+		return m_nCount;
+	}
+
+	// 0 is the newest record
+	LagRecord &Element( int i )
+	{
+		Assert( i >= 0 && i < m_nCount );
+		int index = m_nHead + i;
+		if ( index >= m_Records.Count() )
+			index -= m_Records.Count();
+		return m_Records[ index ];
+	}
+
+	// Returns the new head to fill in, dropping the tail if the buffer is full
+	LagRecord &AddToHead()
+	{
+		if ( !m_Records.Count() )
+		{
+			// Enough for every tick of the longest sv_maxunlag, and the slack
+			// allowed for the tick sent by the player
+			float flMaxUnlag = 1.0f;
+			sv_maxunlag.GetMax( flMaxUnlag );
+			m_Records.SetCount( TIME_TO_TICKS( flMaxUnlag + LAG_COMPENSATION_MAX_TICK_DELTA ) + 2 );
+		}
+
+		m_nHead = ( m_nHead > 0 ) ? m_nHead - 1 : m_Records.Count() - 1;
+		if ( m_nCount < m_Records.Count() )
+		{
+			++m_nCount;
+		}
+		++m_nSerial;
+		return m_Records[ m_nHead ];
+	}
+
+	// Call once the new head has been filled in
+	void LinkHead( float flTeleportDistanceSqr )
+	{
+		LagRecord &head = Element( 0 );
+		head.m_flMoveDistSqr = ( m_nCount > 1 ) ? ( head.m_vecOrigin - Element( 1 ).m_vecOrigin ).Length2DSqr() : 0.0f;
+		LinkRecord( head, m_nSerial, flTeleportDistanceSqr );
+	}
+
+	// Rebuilds the oldest valid serial when the teleport distance changes
+	void Relink( float flTeleportDistanceSqr )
+	{
+		m_nOldestValidSerial = 0;
+		for ( int i = m_nCount - 1; i >= 0; --i )
+		{
+			LinkRecord( Element( i ), m_nSerial - i, flTeleportDistanceSqr );
+		}
+	}
+
+	void RemoveTail()
+	{
+		Assert( m_nCount > 0 );
+		--m_nCount;
+	}
+
+	void RemoveAll()
+	{
+		m_nCount = 0;
+	}
+
+	void Purge()
+	{
+		m_Records.Purge();
+		m_nHead = 0;
+		m_nCount = 0;
+	}
+
+	// Index of the newest record at or before flTime, or the oldest record if they are all newer
+	int Find( float flTime )
+	{
+		Assert( m_nCount > 0 );
+		int low = 0;
+		int high = m_nCount - 1;
+		while ( low < high )
+		{
+			int mid = ( low + high ) / 2;
+			if ( Element( mid ).m_flSimulationTime <= flTime )
+			{
+				high = mid;
+			}
+			else
+			{
+				low = mid + 1;
+			}
+		}
+		return low;
+	}
+
+	// Can the player be followed back from the head to record i?
+	bool IsReachable( int i ) const
+	{
+		return ( m_nSerial - i ) >= m_nOldestValidSerial;
+	}
+
+private:
+	void LinkRecord( const LagRecord &record, int nSerial, float flTeleportDistanceSqr )
+	{
+		if ( !(record.m_fFlags & LC_ALIVE) )
+		{
+			// player must be alive, nothing at or before here can be used
+			m_nOldestValidSerial = nSerial + 1;
+		}
+		else if ( record.m_flMoveDistSqr > flTeleportDistanceSqr )
+		{
+			// too much difference, nothing before here can be used
+			m_nOldestValidSerial = nSerial;
+		}
+	}
+
+	CUtlVector< LagRecord >	m_Records;
+	int						m_nHead;
+	int						m_nCount;
+	int						m_nSerial;
+	int						m_nOldestValidSerial;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: A player's hitboxes posed at a past tick, without moving the player
+//-----------------------------------------------------------------------------
+struct LagSnapshot_t
+{
+	CBasePlayer		*m_pPlayer;
+	int				m_nTargetTick;
+	bool			m_bValid;			// false if the player couldn't be backtracked
+
+	// Where the player was when the snapshot was built.  BacktrackPlayer keeps
+	// the live position when it's close, so the snapshot depends on it, and
+	// isn't reused once the player has moved.  Pose parameters, bone
+	// controllers and layer flags are read live too but aren't compared, so a
+	// snapshot is stale if only they change between two commands of a tick.
+	Vector			m_vecLiveOrigin;
+	QAngle			m_vecLiveAngles;
+
+	CStudioHdr		*m_pStudioHdr;
+	int				m_nHitboxSet;
+	Vector			m_vecOrigin;
+	float			m_flModelScale;
+
+	// Bounds of all the hitboxes, to skip rays that miss the player
+	Vector			m_vecHitboxMins;
+	Vector			m_vecHitboxMaxs;
+
+	matrix3x4_t		m_BoneToWorld[ MAXSTUDIOBONES ];
 };
 
 
@@ -172,6 +359,8 @@ class CLagCompensationManager : public CAutoGameSystemPerFrame, public ILagCompe
 public:
 	CLagCompensationManager( char const *name ) : CAutoGameSystemPerFrame( name ), m_flTeleportDistanceSqr( 64 *64 )
 	{
+		ClearStats();
+		ClearSnapshots();
 	}
 
 	// IServerSystem stuff
@@ -194,17 +383,89 @@ public:
 	void			StartLagCompensation( CBasePlayer *player, CUserCmd *cmd );
 	void			FinishLagCompensation( CBasePlayer *player );
 
+	// Poses the players in the past without moving them, and traces against them
+	void			PrepareSnapshot( CBasePlayer *player, CUserCmd *cmd );
+	bool			TraceSnapshot( CBasePlayer *player, const Ray_t &ray, unsigned int fContentsMask, trace_t *pTrace );
+	bool			IsInSnapshot( CBasePlayer *player, CBaseEntity *pEntity );
+
 private:
+	bool			WantsLagCompensation( CBasePlayer *player );
+	int				GetTargetTick( CBasePlayer *player, CUserCmd *cmd );
+	int				GetPlayersToCompensate( CBasePlayer *player, CUserCmd *cmd, int *pPlayers );
+	bool			GetPastRecord( CBasePlayer *pPlayer, float flTargetTime, LagRecord *pWanted );
 	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
+	int				CullPlayers( CBasePlayer *player, CUserCmd *cmd, int *pPlayers, int nPlayers );
+	void			UpdateCullBounds( int pl_index );
+
+	void			BuildSnapshots( CBasePlayer *player, int targettick, const int *pPlayers, int nPlayers );
+	int				BuildSnapshot( CBasePlayer *pPlayer, int targettick );
+	void			ValidateSnapshots( CBasePlayer *player, CUserCmd *cmd, const int *pPlayers, int nPlayers );
 
 	void ClearHistory()
 	{
 		for ( int i=0; i<MAX_PLAYERS; i++ )
 			m_PlayerTrack[i].Purge();
+
+		ClearSnapshots();
+		m_Snapshots.PurgeAndDeleteElements();
+	}
+
+	void ClearSnapshots()
+	{
+		m_nSnapshots = 0;
+		m_nSnapshotTick = -1;
+		for ( int i=0; i<MAX_PLAYERS; i++ )
+		{
+			m_PlayerSnapshots[i].RemoveAll();
+			m_ShooterSnapshots[i].RemoveAll();
+		}
+	}
+
+	void ClearStats()
+	{
+		m_nStatCommands = 0;
+		m_nStatConsidered = 0;
+		m_nStatCulled = 0;
+		m_nStatBacktracked = 0;
+		m_nStatRestored = 0;
+		m_nStatSnapshotPoses = 0;
+		m_nStatSnapshotPoseErrors = 0;
+		m_nStatSnapshotShots = 0;
+		m_nStatSnapshotShotErrors = 0;
+		m_flNextStatsTime = 0;
 	}
 
 	// keep a list of lag records for each player
-	CUtlFixedLinkedList< LagRecord >	m_PlayerTrack[ MAX_PLAYERS ];
+	CLagRecordTrack			m_PlayerTrack[ MAX_PLAYERS ];
+
+	// Bounding sphere of each player's lag records
+	Vector					m_vecCullCenter[ MAX_PLAYERS ];
+	float					m_flCullRadius[ MAX_PLAYERS ];
+
+	// Scratchpad for culling the players of a command four at a time
+	fltx4					m_CullX[ ( MAX_PLAYERS + 3 ) / 4 ];
+	fltx4					m_CullY[ ( MAX_PLAYERS + 3 ) / 4 ];
+	fltx4					m_CullZ[ ( MAX_PLAYERS + 3 ) / 4 ];
+	fltx4					m_CullRadius[ ( MAX_PLAYERS + 3 ) / 4 ];
+
+	// sv_unlag_stats counts
+	int						m_nStatCommands;
+	int						m_nStatConsidered;
+	int						m_nStatCulled;
+	int						m_nStatBacktracked;
+	int						m_nStatRestored;
+	int						m_nStatSnapshotPoses;
+	int						m_nStatSnapshotPoseErrors;
+	int						m_nStatSnapshotShots;
+	int						m_nStatSnapshotShotErrors;
+	float					m_flNextStatsTime;
+
+	// Snapshots built this tick, reused from tick to tick
+	CUtlVector< LagSnapshot_t * >	m_Snapshots;
+	int						m_nSnapshots;
+	int						m_nSnapshotTick;
+	CUtlVector< int >		m_PlayerSnapshots[ MAX_PLAYERS ];	// each player's snapshots, one per target tick
+	CUtlVector< int >		m_ShooterSnapshots[ MAX_PLAYERS ];	// the snapshots each shooter's command can hit
 
 	// Scratchpad for determining what needs to be restored
 	CBitVec<MAX_PLAYERS>	m_RestorePlayer;
@@ -233,19 +494,43 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 		return;
 	}
 	
-	m_flTeleportDistanceSqr = sv_lagcompensation_teleport_dist.GetFloat() * sv_lagcompensation_teleport_dist.GetFloat();
+	float flTeleportDistanceSqr = sv_lagcompensation_teleport_dist.GetFloat() * sv_lagcompensation_teleport_dist.GetFloat();
+	if ( flTeleportDistanceSqr != m_flTeleportDistanceSqr )
+	{
+		m_flTeleportDistanceSqr = flTeleportDistanceSqr;
+		for ( int i = 0; i < MAX_PLAYERS; i++ )
+		{
+			m_PlayerTrack[i].Relink( m_flTeleportDistanceSqr );
+		}
+	}
 
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
 
+	if ( sv_unlag_stats.GetBool() && gpGlobals->curtime >= m_flNextStatsTime )
+	{
+		if ( m_nStatCommands )
+		{
+			Msg( "Lag compensation: %d commands, %d players considered, %d culled, %d backtracked, %d restored\n",
+				m_nStatCommands, m_nStatConsidered, m_nStatCulled, m_nStatBacktracked, m_nStatRestored );
+		}
+		if ( m_nStatSnapshotPoses || m_nStatSnapshotShots )
+		{
+			Msg( "Lag compensation snapshot: %d of %d poses and %d of %d aim traces differ from the backtracked players\n",
+				m_nStatSnapshotPoseErrors, m_nStatSnapshotPoses, m_nStatSnapshotShotErrors, m_nStatSnapshotShots );
+		}
+		ClearStats();
+		m_flNextStatsTime = gpGlobals->curtime + 1.0f;
+	}
+
 	// remove all records before that time:
-	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
+	float flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat() - LAG_COMPENSATION_MAX_TICK_DELTA;
 
 	// Iterate all active players
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
 
-		CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[i-1];
+		CLagRecordTrack *track = &m_PlayerTrack[i-1];
 
 		if ( !pPlayer )
 		{
@@ -257,35 +542,34 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 			continue;
 		}
 
-		Assert( track->Count() < 1000 ); // insanity check
-
 		// remove tail records that are too old
-		int tailIndex = track->Tail();
-		while ( track->IsValidIndex( tailIndex ) )
+		while ( track->Count() > 0 )
 		{
-			LagRecord &tail = track->Element( tailIndex );
+			LagRecord &tail = track->Element( track->Count() - 1 );
 
 			// if tail is within limits, stop
 			if ( tail.m_flSimulationTime >= flDeadtime )
 				break;
 			
 			// remove tail, get new tail
-			track->Remove( tailIndex );
-			tailIndex = track->Tail();
+			track->RemoveTail();
 		}
 
 		// check if head has same simulation time
 		if ( track->Count() > 0 )
 		{
-			LagRecord &head = track->Element( track->Head() );
+			LagRecord &head = track->Element( 0 );
 
 			// check if player changed simulation time since last time updated
 			if ( head.m_flSimulationTime >= pPlayer->GetSimulationTime() )
+			{
+				UpdateCullBounds( i-1 );
 				continue; // don't add new entry for same or older time
+			}
 		}
 
 		// add new record to player track
-		LagRecord &record = track->Element( track->AddToHead() );
+		LagRecord &record = track->AddToHead();
 
 		record.m_fFlags = 0;
 		if ( pPlayer->IsAlive() )
@@ -313,43 +597,133 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 		}
 		record.m_masterSequence = pPlayer->GetSequence();
 		record.m_masterCycle = pPlayer->GetCycle();
+
+		track->LinkHead( m_flTeleportDistanceSqr );
+
+		UpdateCullBounds( i-1 );
 	}
 
 	//Clear the current player.
 	m_pCurrentPlayer = NULL;
 }
 
-// Called during player movement to set up/restore after lag compensation
-void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCmd *cmd )
+//-----------------------------------------------------------------------------
+// Purpose: Updates the sphere around everywhere a player can be backtracked to
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::UpdateCullBounds( int pl_index )
 {
-	//DONT LAG COMP AGAIN THIS FRAME IF THERES ALREADY ONE IN PROGRESS
-	//IF YOU'RE HITTING THIS THEN IT MEANS THERES A CODE BUG
-	if ( m_pCurrentPlayer )
+	CLagRecordTrack *track = &m_PlayerTrack[ pl_index ];
+
+	Vector mins, maxs;
+	ClearBounds( mins, maxs );
+	for ( int i = 0; i < track->Count(); i++ )
 	{
-		Assert( m_pCurrentPlayer == NULL );
-		Warning( "Trying to start a new lag compensation session while one is already active!\n" );
-		return;
+		const LagRecord &record = track->Element( i );
+		AddPointToBounds( record.m_vecOrigin + record.m_vecMinsPreScaled, mins, maxs );
+		AddPointToBounds( record.m_vecOrigin + record.m_vecMaxsPreScaled, mins, maxs );
 	}
 
-	// Assume no players need to be restored
-	m_RestorePlayer.ClearAll();
-	m_bNeedToRestore = false;
+	m_vecCullCenter[ pl_index ] = ( mins + maxs ) * 0.5f;
+	m_flCullRadius[ pl_index ] = ( maxs - mins ).Length() * 0.5f + LAG_COMPENSATION_CULL_PADDING;
+}
 
-	m_pCurrentPlayer = player;
-	
+//-----------------------------------------------------------------------------
+// Purpose: Removes the players that the command's shots can't reach wherever
+//			they are backtracked to, testing the bounding sphere of each
+//			player's records against the cone around the shooter's aim, four
+//			players at a time.  Returns how many players are left.
+//-----------------------------------------------------------------------------
+int CLagCompensationManager::CullPlayers( CBasePlayer *player, CUserCmd *cmd, int *pPlayers, int nPlayers )
+{
+	VPROF_BUDGET( "CullPlayers", "CLagCompensationManager" );
+
+	Vector vecEye = player->EyePosition();
+	Vector vecForward;
+	AngleVectors( cmd->viewangles + player->GetPunchAngle(), &vecForward );
+
+	float flSin, flCos;
+	SinCos( DEG2RAD( sv_unlag_cull_angle.GetFloat() ), &flSin, &flCos );
+
+	// Gather the spheres relative to the eye, the last group padded with empty spheres
+	int nGroups = ( nPlayers + 3 ) / 4;
+	for ( int i = 0; i < nGroups * 4; i++ )
+	{
+		int group = i / 4;
+		int lane = i & 3;
+		if ( i < nPlayers )
+		{
+			int pl_index = pPlayers[i] - 1;
+			SubFloat( m_CullX[group], lane ) = m_vecCullCenter[pl_index].x - vecEye.x;
+			SubFloat( m_CullY[group], lane ) = m_vecCullCenter[pl_index].y - vecEye.y;
+			SubFloat( m_CullZ[group], lane ) = m_vecCullCenter[pl_index].z - vecEye.z;
+			SubFloat( m_CullRadius[group], lane ) = m_flCullRadius[pl_index];
+		}
+		else
+		{
+			SubFloat( m_CullX[group], lane ) = 0.0f;
+			SubFloat( m_CullY[group], lane ) = 0.0f;
+			SubFloat( m_CullZ[group], lane ) = 0.0f;
+			SubFloat( m_CullRadius[group], lane ) = 0.0f;
+		}
+	}
+
+	fltx4 forwardX = ReplicateX4( vecForward.x );
+	fltx4 forwardY = ReplicateX4( vecForward.y );
+	fltx4 forwardZ = ReplicateX4( vecForward.z );
+	fltx4 sinAngle = ReplicateX4( flSin );
+	fltx4 cosAngle = ReplicateX4( flCos );
+
+	int nKept = 0;
+	for ( int group = 0; group < nGroups; group++ )
+	{
+		// Distance along the aim and away from it
+		fltx4 along = MulSIMD( m_CullX[group], forwardX );
+		along = MaddSIMD( m_CullY[group], forwardY, along );
+		along = MaddSIMD( m_CullZ[group], forwardZ, along );
+		fltx4 lengthSqr = MulSIMD( m_CullX[group], m_CullX[group] );
+		lengthSqr = MaddSIMD( m_CullY[group], m_CullY[group], lengthSqr );
+		lengthSqr = MaddSIMD( m_CullZ[group], m_CullZ[group], lengthSqr );
+		fltx4 away = SqrtSIMD( MaxSIMD( MsubSIMD( along, along, lengthSqr ), Four_Zeros ) );
+
+		// Distance from the center to the cone.  Behind the eye this
+		// underestimates, which only keeps more players.
+		fltx4 distance = SubSIMD( MulSIMD( away, cosAngle ), MulSIMD( along, sinAngle ) );
+		int nHitMask = TestSignSIMD( CmpLeSIMD( distance, m_CullRadius[group] ) );
+
+		for ( int lane = 0; lane < 4; lane++ )
+		{
+			int i = group * 4 + lane;
+			if ( i < nPlayers && ( nHitMask & ( 1 << lane ) ) )
+			{
+				pPlayers[nKept++] = pPlayers[i];
+			}
+		}
+	}
+
+	return nKept;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Does this player's command get the other players moved back?
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::WantsLagCompensation( CBasePlayer *player )
+{
 	if ( !player->m_bLagCompensation		// Player not wanting lag compensation
 		 || (gpGlobals->maxClients <= 1)	// no lag compensation in single player
 		 || !sv_unlag.GetBool()				// disabled by server admin
 		 || player->IsBot() 				// not for bots
 		 || player->IsObserver()			// not for spectators
 		)
-		return;
+		return false;
 
-	// NOTE: Put this here so that it won't show up in single player mode.
-	VPROF_BUDGET( "StartLagCompensation", VPROF_BUDGETGROUP_OTHER_NETWORKING );
-	Q_memset( m_RestoreData, 0, sizeof( m_RestoreData ) );
-	Q_memset( m_ChangeData, 0, sizeof( m_ChangeData ) );
+	return true;
+}
 
+//-----------------------------------------------------------------------------
+// Purpose: The tick the player was seeing when the command was sent
+//-----------------------------------------------------------------------------
+int CLagCompensationManager::GetTargetTick( CBasePlayer *player, CUserCmd *cmd )
+{
 	// Get true latency
 
 	// correct is the amout of time we have to correct game time
@@ -378,14 +752,24 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 	// calc difference between tick send by player and our latency based tick
 	float deltaTime =  correct - TICKS_TO_TIME(gpGlobals->tickcount - targettick);
 
-	if ( fabs( deltaTime ) > 0.2f )
+	if ( fabs( deltaTime ) > LAG_COMPENSATION_MAX_TICK_DELTA )
 	{
 		// difference between cmd time and latency is too big > 200ms, use time correction based on latency
 		// DevMsg("StartLagCompensation: delta too big (%.3f)\n", deltaTime );
 		targettick = gpGlobals->tickcount - TIME_TO_TICKS( correct );
 	}
-	
+
+	return targettick;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fills in the entity indices of the players to move back for this
+//			command, and returns how many there are
+//-----------------------------------------------------------------------------
+int CLagCompensationManager::GetPlayersToCompensate( CBasePlayer *player, CUserCmd *cmd, int *pPlayers )
+{
 	// Iterate all active players
+	int nPlayers = 0;
 	const CBitVec<MAX_EDICTS> *pEntityTransmitBits = engine->GetEntityTransmitBitsForClient( player->entindex() - 1 );
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
@@ -406,78 +790,106 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		if ( !player->WantsLagCompensationOnEntity( pPlayer, cmd, pEntityTransmitBits ) )
 			continue;
 
-		// Move other player back in time
-		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
+		pPlayers[ nPlayers++ ] = i;
 	}
-}
 
-void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
-{
-	Vector org;
-	Vector minsPreScaled;
-	Vector maxsPreScaled;
-	QAngle ang;
+	m_nStatConsidered += nPlayers;
 
-	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
-	int pl_index = pPlayer->entindex() - 1;
+	// Skip the players that are nowhere near where this command is aiming
+	if ( sv_unlag_cull.GetBool() && nPlayers > 0 )
+	{
+		int nKept = CullPlayers( player, cmd, pPlayers, nPlayers );
+		m_nStatCulled += nPlayers - nKept;
+		nPlayers = nKept;
+	}
 
-	// get track history of this player
-	CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[ pl_index ];
+	return nPlayers;
+}
 
-	// check if we have at leat one entry
-	if ( track->Count() <= 0 )
+// Called during player movement to set up/restore after lag compensation
+void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCmd *cmd )
+{
+	//DONT LAG COMP AGAIN THIS FRAME IF THERES ALREADY ONE IN PROGRESS
+	//IF YOU'RE HITTING THIS THEN IT MEANS THERES A CODE BUG
+	if ( m_pCurrentPlayer )
+	{
+		Assert( m_pCurrentPlayer == NULL );
+		Warning( "Trying to start a new lag compensation session while one is already active!\n" );
 		return;
+	}
 
-	int curr = track->Head();
+	// Assume no players need to be restored
+	m_RestorePlayer.ClearAll();
+	m_bNeedToRestore = false;
 
-	LagRecord *prevRecord = NULL;
-	LagRecord *record = NULL;
+	m_pCurrentPlayer = player;
+	
+	if ( !WantsLagCompensation( player ) )
+		return;
+
+	// NOTE: Put this here so that it won't show up in single player mode.
+	VPROF_BUDGET( "StartLagCompensation", VPROF_BUDGETGROUP_OTHER_NETWORKING );
+	Q_memset( m_RestoreData, 0, sizeof( m_RestoreData ) );
+	Q_memset( m_ChangeData, 0, sizeof( m_ChangeData ) );
 
-	Vector prevOrg = pPlayer->GetLocalOrigin();
+	int targettick = GetTargetTick( player, cmd );
 	
-	// Walk context looking for any invalidating event
-	while( track->IsValidIndex(curr) )
+	++m_nStatCommands;
+
+	int players[ MAX_PLAYERS ];
+	int nPlayers = GetPlayersToCompensate( player, cmd, players );
+
+	// The snapshot has to be posed from the players before they are moved
+	bool bValidateSnapshot = sv_unlag_snapshot_validate.GetBool();
+	if ( bValidateSnapshot )
 	{
-		// remember last record
-		prevRecord = record;
+		BuildSnapshots( player, targettick, players, nPlayers );
+	}
 
-		// get next record
-		record = &track->Element( curr );
+	for ( int i = 0; i < nPlayers; i++ )
+	{
+		// Move other player back in time
+		BacktrackPlayer( UTIL_PlayerByIndex( players[i] ), TICKS_TO_TIME( targettick ) );
+	}
 
-		if ( !(record->m_fFlags & LC_ALIVE) )
-		{
-			// player most be alive, lost track
-			return;
-		}
+	if ( bValidateSnapshot )
+	{
+		ValidateSnapshots( player, cmd, players, nPlayers );
+	}
+}
 
-		Vector delta = record->m_vecOrigin - prevOrg;
-		if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
-		{
-			// lost track, too much difference
-			return; 
-		}
+//-----------------------------------------------------------------------------
+// Purpose: Works out where a player was at the target time from their lag
+//			records, interpolating between the two records around it.
+//			Returns false if the records lost track of the player.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::GetPastRecord( CBasePlayer *pPlayer, float flTargetTime, LagRecord *pWanted )
+{
+	int pl_index = pPlayer->entindex() - 1;
 
-		// did we find a context smaller than target time ?
-		if ( record->m_flSimulationTime <= flTargetTime )
-			break; // hurra, stop
+	// get track history of this player
+	CLagRecordTrack *track = &m_PlayerTrack[ pl_index ];
 
-		prevOrg = record->m_vecOrigin;
+	// check if we have at leat one entry
+	if ( track->Count() <= 0 )
+		return false;
 
-		// go one step back
-		curr = track->Next( curr );
+	Vector delta = track->Element( 0 ).m_vecOrigin - pPlayer->GetLocalOrigin();
+	if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
+	{
+		// lost track, too much difference
+		return false; 
 	}
 
-	Assert( record );
+	// find a context smaller than target time
+	int iRecord = track->Find( flTargetTime );
 
-	if ( !record )
-	{
-		if ( sv_unlag_debug.GetBool() )
-		{
-			DevMsg( "No valid positions in history for BacktrackPlayer client ( %s )\n", pPlayer->GetPlayerName() );
-		}
+	// the player must have been alive and not teleported since then
+	if ( !track->IsReachable( iRecord ) )
+		return false;
 
-		return; // that should never happen
-	}
+	LagRecord *record = &track->Element( iRecord );
+	LagRecord *prevRecord = ( iRecord > 0 ) ? &track->Element( iRecord - 1 ) : NULL;
 
 	float frac = 0.0f;
 	if ( prevRecord && 
@@ -496,21 +908,105 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 
 		Assert( frac > 0 && frac < 1 ); // should never extrapolate
 
-		ang				= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
-		org				= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
-		minsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
-		maxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
+		pWanted->m_vecAngles		= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
+		pWanted->m_vecOrigin		= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
+		pWanted->m_vecMinsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
+		pWanted->m_vecMaxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
 	}
 	else
 	{
 		// we found the exact record or no other record to interpolate with
 		// just copy these values since they are the best we have
-		org				= record->m_vecOrigin;
-		ang				= record->m_vecAngles;
-		minsPreScaled	= record->m_vecMinsPreScaled;
-		maxsPreScaled	= record->m_vecMaxsPreScaled;
+		pWanted->m_vecOrigin		= record->m_vecOrigin;
+		pWanted->m_vecAngles		= record->m_vecAngles;
+		pWanted->m_vecMinsPreScaled	= record->m_vecMinsPreScaled;
+		pWanted->m_vecMaxsPreScaled	= record->m_vecMaxsPreScaled;
 	}
 
+	pWanted->m_fFlags = record->m_fFlags;
+	pWanted->m_flSimulationTime = flTargetTime;
+
+	bool interpolationAllowed = false;
+	if( prevRecord && (record->m_masterSequence == prevRecord->m_masterSequence) )
+	{
+		// If the master state changes, all layers will be invalid too, so don't interp (ya know, interp barely ever happens anyway)
+		interpolationAllowed = true;
+	}
+	
+	////////////////////////
+	// First do the master settings
+	pWanted->m_masterSequence = record->m_masterSequence;
+	pWanted->m_masterCycle = record->m_masterCycle;
+	if( frac > 0.0f && interpolationAllowed )
+	{
+		if( record->m_masterCycle > prevRecord->m_masterCycle )
+		{
+			// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
+			// add one to the newer so it is lerping from .9 to 1.1 instead of .9 to .1, for example.
+			float newCycle = Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle + 1 );
+			pWanted->m_masterCycle = newCycle < 1 ? newCycle : newCycle - 1;// and make sure .9 to 1.2 does not end up 1.05
+		}
+		else
+		{
+			pWanted->m_masterCycle = Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle );
+		}
+	}
+
+	////////////////////////
+	// Now do all the layers
+	int layerCount = pPlayer->GetNumAnimOverlays();
+	for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
+	{
+		LayerRecord &recordsLayerRecord = record->m_layerRecords[layerIndex];
+		LayerRecord &wantedLayerRecord = pWanted->m_layerRecords[layerIndex];
+
+		//Either no interp, or interp failed.  Just use record.
+		wantedLayerRecord = recordsLayerRecord;
+
+		if( (frac > 0.0f)  &&  interpolationAllowed )
+		{
+			LayerRecord &prevRecordsLayerRecord = prevRecord->m_layerRecords[layerIndex];
+			if( (recordsLayerRecord.m_order == prevRecordsLayerRecord.m_order)
+				&& (recordsLayerRecord.m_sequence == prevRecordsLayerRecord.m_sequence)
+				)
+			{
+				// We can't interpolate across a sequence or order change
+				if( recordsLayerRecord.m_cycle > prevRecordsLayerRecord.m_cycle )
+				{
+					// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
+					// add one to the newer so it is lerping from .9 to 1.1 instead of .9 to .1, for example.
+					float newCycle = Lerp( frac, recordsLayerRecord.m_cycle, prevRecordsLayerRecord.m_cycle + 1 );
+					wantedLayerRecord.m_cycle = newCycle < 1 ? newCycle : newCycle - 1;// and make sure .9 to 1.2 does not end up 1.05
+				}
+				else
+				{
+					wantedLayerRecord.m_cycle = Lerp( frac, recordsLayerRecord.m_cycle, prevRecordsLayerRecord.m_cycle  );
+				}
+				wantedLayerRecord.m_weight = Lerp( frac, recordsLayerRecord.m_weight, prevRecordsLayerRecord.m_weight  );
+			}
+		}
+	}
+
+	return true;
+}
+
+void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
+{
+	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
+	int pl_index = pPlayer->entindex() - 1;
+
+	// work out where the player was at the target time
+	LagRecord wanted;
+	if ( !GetPastRecord( pPlayer, flTargetTime, &wanted ) )
+		return;
+
+	++m_nStatBacktracked;
+
+	Vector org = wanted.m_vecOrigin;
+	Vector minsPreScaled = wanted.m_vecMinsPreScaled;
+	Vector maxsPreScaled = wanted.m_vecMaxsPreScaled;
+	QAngle ang = wanted.m_vecAngles;
+
 	// See if this is still a valid position for us to teleport to
 	if ( sv_unlag_fixstuck.GetBool() )
 	{
@@ -619,39 +1115,8 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	restore->m_masterSequence = pPlayer->GetSequence();
 	restore->m_masterCycle = pPlayer->GetCycle();
 
-	bool interpolationAllowed = false;
-	if( prevRecord && (record->m_masterSequence == prevRecord->m_masterSequence) )
-	{
-		// If the master state changes, all layers will be invalid too, so don't interp (ya know, interp barely ever happens anyway)
-		interpolationAllowed = true;
-	}
-	
-	////////////////////////
-	// First do the master settings
-	bool interpolatedMasters = false;
-	if( frac > 0.0f && interpolationAllowed )
-	{
-		interpolatedMasters = true;
-		pPlayer->SetSequence( Lerp( frac, record->m_masterSequence, prevRecord->m_masterSequence ) );
-		pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
-
-		if( record->m_masterCycle > prevRecord->m_masterCycle )
-		{
-			// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
-			// add one to the newer so it is lerping from .9 to 1.1 instead of .9 to .1, for example.
-			float newCycle = Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle + 1 );
-			pPlayer->SetCycle(newCycle < 1 ? newCycle : newCycle - 1 );// and make sure .9 to 1.2 does not end up 1.05
-		}
-		else
-		{
-			pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
-		}
-	}
-	if( !interpolatedMasters )
-	{
-		pPlayer->SetSequence(record->m_masterSequence);
-		pPlayer->SetCycle(record->m_masterCycle);
-	}
+	pPlayer->SetSequence( wanted.m_masterSequence );
+	pPlayer->SetCycle( wanted.m_masterCycle );
 
 	////////////////////////
 	// Now do all the layers
@@ -666,41 +1131,10 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 			restore->m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
 			restore->m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
 
-			bool interpolated = false;
-			if( (frac > 0.0f)  &&  interpolationAllowed )
-			{
-				LayerRecord &recordsLayerRecord = record->m_layerRecords[layerIndex];
-				LayerRecord &prevRecordsLayerRecord = prevRecord->m_layerRecords[layerIndex];
-				if( (recordsLayerRecord.m_order == prevRecordsLayerRecord.m_order)
-					&& (recordsLayerRecord.m_sequence == prevRecordsLayerRecord.m_sequence)
-					)
-				{
-					// We can't interpolate across a sequence or order change
-					interpolated = true;
-					if( recordsLayerRecord.m_cycle > prevRecordsLayerRecord.m_cycle )
-					{
-						// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
-						// add one to the newer so it is lerping from .9 to 1.1 instead of .9 to .1, for example.
-						float newCycle = Lerp( frac, recordsLayerRecord.m_cycle, prevRecordsLayerRecord.m_cycle + 1 );
-						currentLayer->m_flCycle = newCycle < 1 ? newCycle : newCycle - 1;// and make sure .9 to 1.2 does not end up 1.05
-					}
-					else
-					{
-						currentLayer->m_flCycle = Lerp( frac, recordsLayerRecord.m_cycle, prevRecordsLayerRecord.m_cycle  );
-					}
-					currentLayer->m_nOrder = recordsLayerRecord.m_order;
-					currentLayer->m_nSequence = recordsLayerRecord.m_sequence;
-					currentLayer->m_flWeight = Lerp( frac, recordsLayerRecord.m_weight, prevRecordsLayerRecord.m_weight  );
-				}
-			}
-			if( !interpolated )
-			{
-				//Either no interp, or interp failed.  Just use record.
-				currentLayer->m_flCycle = record->m_layerRecords[layerIndex].m_cycle;
-				currentLayer->m_nOrder = record->m_layerRecords[layerIndex].m_order;
-				currentLayer->m_nSequence = record->m_layerRecords[layerIndex].m_sequence;
-				currentLayer->m_flWeight = record->m_layerRecords[layerIndex].m_weight;
-			}
+			currentLayer->m_flCycle = wanted.m_layerRecords[layerIndex].m_cycle;
+			currentLayer->m_nOrder = wanted.m_layerRecords[layerIndex].m_order;
+			currentLayer->m_nSequence = wanted.m_layerRecords[layerIndex].m_sequence;
+			currentLayer->m_flWeight = wanted.m_layerRecords[layerIndex].m_weight;
 		}
 	}
 	
@@ -747,6 +1181,8 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 			continue;
 		}
 
+		++m_nStatRestored;
+
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
 		if ( !pPlayer )
 		{
@@ -828,4 +1264,343 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Sets up the hitbox bones of a player in a past pose, the way
+//			CBaseAnimatingOverlay::GetSkeleton and CBaseAnimating::SetupBones
+//			would once BacktrackPlayer had moved them, without touching the
+//			player.  Players don't use IK or bone merging, so neither is done.
+//-----------------------------------------------------------------------------
+static void SetupPastBones( CBasePlayer *pPlayer, CStudioHdr *pStudioHdr, const LagRecord &wanted, const Vector &vecOrigin, const QAngle &angles, matrix3x4_t *pBoneToWorld )
+{
+	Vector pos[MAXSTUDIOBONES];
+	Quaternion q[MAXSTUDIOBONES];
+
+	IBoneSetup boneSetup( pStudioHdr, BONE_USED_BY_HITBOX, pPlayer->GetPoseParameterArray() );
+	boneSetup.InitPose( pos, q );
+
+	boneSetup.AccumulatePose( pos, q, wanted.m_masterSequence, wanted.m_masterCycle, 1.0, gpGlobals->curtime, NULL );
+
+	// sort the layers as GetSkeleton does once BacktrackPlayer has set their
+	// order and weight; their flags aren't recorded, so those are live
+	int layerCount = pPlayer->GetNumAnimOverlays();
+	int order[MAX_LAYER_RECORDS] = {};
+	bool blended[MAX_LAYER_RECORDS] = {};
+	int layer[MAX_LAYER_RECORDS] = {};
+	int i;
+	for ( i = 0; i < layerCount; i++ )
+	{
+		CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay( i );
+		const LayerRecord &layerRecord = wanted.m_layerRecords[i];
+		order[i] = layerRecord.m_order;
+		blended[i] = currentLayer && ( layerRecord.m_weight > 0 ) && currentLayer->IsActive();
+	}
+	CBaseAnimatingOverlay::SortSkeletonLayers( layerCount, order, blended, layer );
+	for ( i = 0; i < layerCount; i++ )
+	{
+		if ( layer[i] >= 0 && layer[i] < layerCount )
+		{
+			const LayerRecord &layerRecord = wanted.m_layerRecords[layer[i]];
+			boneSetup.AccumulatePose( pos, q, layerRecord.m_sequence, layerRecord.m_cycle, layerRecord.m_weight, gpGlobals->curtime, NULL );
+		}
+	}
+
+	boneSetup.CalcAutoplaySequences( pos, q, gpGlobals->curtime, NULL );
+	boneSetup.CalcBoneAdj( pos, q, pPlayer->GetEncodedControllerArray() );
+
+	Studio_BuildMatrices( 
+		pStudioHdr, 
+		angles, 
+		vecOrigin, 
+		pos, 
+		q, 
+		-1,
+		pPlayer->GetModelScale(), // Scaling
+		pBoneToWorld,
+		BONE_USED_BY_HITBOX );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Poses a player at the target tick into a new snapshot and returns
+//			its index
+//-----------------------------------------------------------------------------
+int CLagCompensationManager::BuildSnapshot( CBasePlayer *pPlayer, int targettick )
+{
+	VPROF_BUDGET( "BuildSnapshot", "CLagCompensationManager" );
+
+	if ( m_nSnapshots == m_Snapshots.Count() )
+	{
+		m_Snapshots.AddToTail( new LagSnapshot_t );
+	}
+
+	int iSnapshot = m_nSnapshots++;
+	LagSnapshot_t *pSnapshot = m_Snapshots[ iSnapshot ];
+	pSnapshot->m_pPlayer = pPlayer;
+	pSnapshot->m_nTargetTick = targettick;
+	pSnapshot->m_bValid = false;
+	pSnapshot->m_vecLiveOrigin = pPlayer->GetLocalOrigin();
+	pSnapshot->m_vecLiveAngles = pPlayer->GetLocalAngles();
+
+	m_PlayerSnapshots[ pPlayer->entindex() - 1 ].AddToTail( iSnapshot );
+
+	LagRecord wanted;
+	if ( !GetPastRecord( pPlayer, TICKS_TO_TIME( targettick ), &wanted ) )
+		return iSnapshot;
+
+	MDLCACHE_CRITICAL_SECTION();
+
+	CStudioHdr *pStudioHdr = pPlayer->GetModelPtr();
+	if ( !pStudioHdr || pPlayer->GetMoveParent() )
+		return iSnapshot;
+
+	mstudiohitboxset_t *set = pStudioHdr->pHitboxSet( pPlayer->GetHitboxSet() );
+	if ( !set || !set->numhitboxes )
+		return iSnapshot;
+
+	// BacktrackPlayer leaves the player alone when the change is this small
+	Vector vecOrigin = wanted.m_vecOrigin;
+	if ( ( pPlayer->GetLocalOrigin() - vecOrigin ).LengthSqr() <= LAG_COMPENSATION_EPS_SQR )
+	{
+		vecOrigin = pPlayer->GetLocalOrigin();
+	}
+	QAngle angles = wanted.m_vecAngles;
+	if ( ( pPlayer->GetLocalAngles() - angles ).LengthSqr() <= LAG_COMPENSATION_EPS_SQR )
+	{
+		angles = pPlayer->GetLocalAngles();
+	}
+
+	SetupPastBones( pPlayer, pStudioHdr, wanted, vecOrigin, angles, pSnapshot->m_BoneToWorld );
+
+	ClearBounds( pSnapshot->m_vecHitboxMins, pSnapshot->m_vecHitboxMaxs );
+	for ( int i = 0; i < set->numhitboxes; i++ )
+	{
+		mstudiobbox_t *pbox = set->pHitbox( i );
+		Vector mins, maxs;
+		TransformAABB( pSnapshot->m_BoneToWorld[ pbox->bone ], pbox->bbmin, pbox->bbmax, mins, maxs );
+		AddPointToBounds( mins, pSnapshot->m_vecHitboxMins, pSnapshot->m_vecHitboxMaxs );
+		AddPointToBounds( maxs, pSnapshot->m_vecHitboxMins, pSnapshot->m_vecHitboxMaxs );
+	}
+
+	pSnapshot->m_pStudioHdr = pStudioHdr;
+	pSnapshot->m_nHitboxSet = pPlayer->GetHitboxSet();
+	pSnapshot->m_vecOrigin = vecOrigin;
+	pSnapshot->m_flModelScale = pPlayer->GetModelScale();
+	pSnapshot->m_bValid = true;
+	return iSnapshot;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gives the shooter the snapshots of the players at the target tick,
+//			building the ones no other command this tick has needed yet, or
+//			that were built before the player moved
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::BuildSnapshots( CBasePlayer *player, int targettick, const int *pPlayers, int nPlayers )
+{
+	if ( m_nSnapshotTick != gpGlobals->tickcount )
+	{
+		ClearSnapshots();
+		m_nSnapshotTick = gpGlobals->tickcount;
+	}
+
+	CUtlVector< int > &shooterSnapshots = m_ShooterSnapshots[ player->entindex() - 1 ];
+	shooterSnapshots.RemoveAll();
+
+	for ( int i = 0; i < nPlayers; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( pPlayers[i] );
+		CUtlVector< int > &playerSnapshots = m_PlayerSnapshots[ pPlayers[i] - 1 ];
+
+		int iSnapshot = -1;
+		for ( int j = playerSnapshots.Count() - 1; j >= 0; j-- )
+		{
+			const LagSnapshot_t *pSnapshot = m_Snapshots[ playerSnapshots[j] ];
+			if ( pSnapshot->m_nTargetTick == targettick &&
+				 pSnapshot->m_vecLiveOrigin == pPlayer->GetLocalOrigin() &&
+				 pSnapshot->m_vecLiveAngles == pPlayer->GetLocalAngles() )
+			{
+				iSnapshot = playerSnapshots[j];
+				break;
+			}
+		}
+
+		if ( iSnapshot < 0 )
+		{
+			iSnapshot = BuildSnapshot( pPlayer, targettick );
+		}
+
+		if ( m_Snapshots[ iSnapshot ]->m_bValid )
+		{
+			shooterSnapshots.AddToTail( iSnapshot );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Snapshots the players the command would move back, without moving
+//			them.  Call from the main thread before TraceSnapshot.
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::PrepareSnapshot( CBasePlayer *player, CUserCmd *cmd )
+{
+	VPROF_BUDGET( "PrepareSnapshot", VPROF_BUDGETGROUP_OTHER_NETWORKING );
+
+	if ( !WantsLagCompensation( player ) )
+	{
+		BuildSnapshots( player, 0, NULL, 0 );
+		return;
+	}
+
+	int targettick = GetTargetTick( player, cmd );
+
+	++m_nStatCommands;
+
+	int players[ MAX_PLAYERS ];
+	int nPlayers = GetPlayersToCompensate( player, cmd, players );
+
+	BuildSnapshots( player, targettick, players, nPlayers );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Traces a ray against the hitboxes in the player's snapshot.  It
+//			only reads the snapshot, so traces for different shooters can run
+//			at the same time until the next PrepareSnapshot.
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::TraceSnapshot( CBasePlayer *player, const Ray_t &ray, unsigned int fContentsMask, trace_t *pTrace )
+{
+	Q_memset( pTrace, 0, sizeof( *pTrace ) );
+	pTrace->fraction = 1.0f;
+	pTrace->endpos = ray.m_Start + ray.m_Delta;
+
+	if ( m_nSnapshotTick != gpGlobals->tickcount )
+		return false;
+
+	const CUtlVector< int > &shooterSnapshots = m_ShooterSnapshots[ player->entindex() - 1 ];
+	for ( int i = 0; i < shooterSnapshots.Count(); i++ )
+	{
+		const LagSnapshot_t *pSnapshot = m_Snapshots[ shooterSnapshots[i] ];
+		if ( !IsBoxIntersectingRay( pSnapshot->m_vecHitboxMins, pSnapshot->m_vecHitboxMaxs, ray ) )
+			continue;
+
+		matrix3x4_t *hitboxbones[MAXSTUDIOBONES];
+		for ( int j = 0; j < pSnapshot->m_pStudioHdr->numbones(); j++ )
+		{
+			hitboxbones[j] = const_cast< matrix3x4_t * >( &pSnapshot->m_BoneToWorld[j] );
+		}
+
+		trace_t tr;
+		Q_memset( &tr, 0, sizeof( tr ) );
+		mstudiohitboxset_t *set = pSnapshot->m_pStudioHdr->pHitboxSet( pSnapshot->m_nHitboxSet );
+		if ( TraceToStudio( physprops, ray, pSnapshot->m_pStudioHdr, set, hitboxbones, fContentsMask, pSnapshot->m_vecOrigin, pSnapshot->m_flModelScale, tr ) &&
+			 tr.fraction < pTrace->fraction )
+		{
+			*pTrace = tr;
+			pTrace->startpos = ray.m_Start;
+			pTrace->m_pEnt = pSnapshot->m_pPlayer;
+		}
+	}
+
+	return pTrace->fraction < 1.0f;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns true if the entity is posed in the player's snapshot
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::IsInSnapshot( CBasePlayer *player, CBaseEntity *pEntity )
+{
+	if ( !pEntity || !pEntity->IsPlayer() || m_nSnapshotTick != gpGlobals->tickcount )
+		return false;
+
+	const CUtlVector< int > &shooterSnapshots = m_ShooterSnapshots[ player->entindex() - 1 ];
+	for ( int i = 0; i < shooterSnapshots.Count(); i++ )
+	{
+		if ( m_Snapshots[ shooterSnapshots[i] ]->m_pPlayer == pEntity )
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: sv_unlag_snapshot_validate - checks the snapshot of this command
+//			against the players BacktrackPlayer just moved: the hitbox bones of
+//			each player, and what a shot along the aim hits.
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::ValidateSnapshots( CBasePlayer *player, CUserCmd *cmd, const int *pPlayers, int nPlayers )
+{
+	VPROF_BUDGET( "ValidateSnapshots", "CLagCompensationManager" );
+
+	const CUtlVector< int > &shooterSnapshots = m_ShooterSnapshots[ player->entindex() - 1 ];
+	for ( int i = 0; i < shooterSnapshots.Count(); i++ )
+	{
+		const LagSnapshot_t *pSnapshot = m_Snapshots[ shooterSnapshots[i] ];
+		CBasePlayer *pPlayer = pSnapshot->m_pPlayer;
+		if ( !m_RestorePlayer.Get( pPlayer->entindex() - 1 ) )
+			continue;
+
+		CBoneCache *pcache = pPlayer->GetBoneCache();
+		if ( !pcache )
+			continue;
+
+		mstudiohitboxset_t *set = pSnapshot->m_pStudioHdr->pHitboxSet( pSnapshot->m_nHitboxSet );
+		float flMaxErrorSqr = 0.0f;
+		for ( int j = 0; j < set->numhitboxes; j++ )
+		{
+			int bone = set->pHitbox( j )->bone;
+			matrix3x4_t *pBone = pcache->GetCachedBone( bone );
+			if ( !pBone )
+				continue;
+
+			Vector vecLive, vecSnapshot;
+			MatrixGetColumn( *pBone, 3, vecLive );
+			MatrixGetColumn( pSnapshot->m_BoneToWorld[bone], 3, vecSnapshot );
+			flMaxErrorSqr = MAX( flMaxErrorSqr, vecLive.DistToSqr( vecSnapshot ) );
+		}
+
+		++m_nStatSnapshotPoses;
+		if ( flMaxErrorSqr > 1.0f )
+		{
+			++m_nStatSnapshotPoseErrors;
+			if ( sv_unlag_debug.GetBool() )
+			{
+				DevMsg( "Lag compensation snapshot of %s is %.1f units off\n", pPlayer->GetPlayerName(), FastSqrt( flMaxErrorSqr ) );
+			}
+		}
+	}
 
+	// What the moved players stop along the aim
+	Vector vecForward;
+	AngleVectors( cmd->viewangles + player->GetPunchAngle(), &vecForward );
+	Vector vecStart = player->EyePosition();
+	Ray_t ray;
+	ray.Init( vecStart, vecStart + vecForward * MAX_TRACE_LENGTH );
+
+	trace_t liveTrace;
+	Q_memset( &liveTrace, 0, sizeof( liveTrace ) );
+	liveTrace.fraction = 1.0f;
+	for ( int i = 0; i < nPlayers; i++ )
+	{
+		CBasePlayer *pPlayer = UTIL_PlayerByIndex( pPlayers[i] );
+
+		trace_t tr;
+		Q_memset( &tr, 0, sizeof( tr ) );
+		if ( pPlayer->TestHitboxes( ray, MASK_SHOT, tr ) && tr.fraction < liveTrace.fraction )
+		{
+			liveTrace = tr;
+			liveTrace.m_pEnt = pPlayer;
+		}
+	}
+
+	trace_t snapshotTrace;
+	TraceSnapshot( player, ray, MASK_SHOT, &snapshotTrace );
+
+	++m_nStatSnapshotShots;
+	if ( liveTrace.m_pEnt != snapshotTrace.m_pEnt ||
+		 liveTrace.hitbox != snapshotTrace.hitbox ||
+		 fabs( liveTrace.fraction - snapshotTrace.fraction ) * MAX_TRACE_LENGTH > 1.0f )
+	{
+		++m_nStatSnapshotShotErrors;
+		if ( sv_unlag_debug.GetBool() )
+		{
+			DevMsg( "Lag compensation snapshot trace for %s hit %s hitbox %d, backtracked players hit %s hitbox %d\n", player->GetPlayerName(),
+				snapshotTrace.m_pEnt ? ToBasePlayer( snapshotTrace.m_pEnt )->GetPlayerName() : "nothing", snapshotTrace.hitbox,
+				liveTrace.m_pEnt ? ToBasePlayer( liveTrace.m_pEnt )->GetPlayerName() : "nothing", liveTrace.hitbox );
+		}
+	}
+}
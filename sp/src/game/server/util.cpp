@@ -36,6 +36,7 @@
 #include "datacache/imdlcache.h"
 #include "util.h"
 #include "cdll_int.h"
+#include "entityquerygrid.h"
 
 #ifdef PORTAL
 #include "PortalSimulation.h"
@@ -279,10 +280,31 @@ float UTIL_GetSimulationInterval()
 //-----------------------------------------------------------------------------
 int UTIL_EntitiesInBox( const Vector &mins, const Vector &maxs, CFlaggedEntitiesEnum *pEnum )
 {
+	if ( g_EntityQueryGrid.IsEnabled() )
+		return g_EntityQueryGrid.EntitiesInBox( mins, maxs, pEnum );
+
 	partition->EnumerateElementsInBox( PARTITION_ENGINE_NON_STATIC_EDICTS, mins, maxs, false, pEnum );
 	return pEnum->GetCount();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Finds the entities in several boxes at once, the entities in box i
+//			going to ppEnums[i]. Returns the total count of all the enumerators.
+//-----------------------------------------------------------------------------
+int UTIL_EntitiesInBoxes( int nBoxes, const Vector *pMins, const Vector *pMaxs, CFlaggedEntitiesEnum **ppEnums )
+{
+	if ( g_EntityQueryGrid.IsEnabled() )
+		return g_EntityQueryGrid.EntitiesInBoxes( nBoxes, pMins, pMaxs, ppEnums );
+
+	int nCount = 0;
+	for ( int i = 0; i < nBoxes; ++i )
+	{
+		partition->EnumerateElementsInBox( PARTITION_ENGINE_NON_STATIC_EDICTS, pMins[i], pMaxs[i], false, ppEnums[i] );
+		nCount += ppEnums[i]->GetCount();
+	}
+	return nCount;
+}
+
 int UTIL_EntitiesAlongRay( const Ray_t &ray, CFlaggedEntitiesEnum *pEnum )
 {
 	partition->EnumerateElementsAlongRay( PARTITION_ENGINE_NON_STATIC_EDICTS, ray, false, pEnum );
@@ -291,6 +313,9 @@ int UTIL_EntitiesAlongRay( const Ray_t &ray, CFlaggedEntitiesEnum *pEnum )
 
 int UTIL_EntitiesInSphere( const Vector &center, float radius, CFlaggedEntitiesEnum *pEnum )
 {
+	if ( g_EntityQueryGrid.IsEnabled() )
+		return g_EntityQueryGrid.EntitiesInSphere( center, radius, pEnum );
+
 	partition->EnumerateElementsInSphere( PARTITION_ENGINE_NON_STATIC_EDICTS, center, radius, false, pEnum );
 	return pEnum->GetCount();
 }
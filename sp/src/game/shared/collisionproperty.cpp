@@ -24,6 +24,7 @@
 #include "baseanimating.h"
 #include "sendproxy.h"
 #include "hierarchy.h"
+#include "entityquerygrid.h"
 #endif
 
 #include "predictable_entity.h"
@@ -1298,6 +1299,9 @@ void CCollisionProperty::DestroyPartitionHandle()
 	{
 		partition->DestroyHandle( m_Partition );
 		m_Partition = PARTITION_INVALID_HANDLE;
+#ifndef CLIENT_DLL
+		g_EntityQueryGrid.SetEntityInPartition( m_pOuter, false );
+#endif
 	}
 }
 
@@ -1315,6 +1319,7 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 	// Remove it from whatever lists it may be in at the moment
 	// We'll re-add it below if we need to.
 	partition->Remove( handle );
+	g_EntityQueryGrid.SetEntityInPartition( m_pOuter, false );
 
 	// Don't bother with deleted things
 	if ( !m_pOuter->edict() )
@@ -1329,6 +1334,7 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 	if ( bIsSolid || m_pOuter->IsEFlagSet(EFL_USE_PARTITION_WHEN_NOT_SOLID) )
 	{
 		partition->Insert( PARTITION_ENGINE_NON_STATIC_EDICTS, handle );
+		g_EntityQueryGrid.SetEntityInPartition( m_pOuter, true );
 	}
 
 	if ( !bIsSolid )
@@ -1364,6 +1370,9 @@ void CCollisionProperty::MarkPartitionHandleDirty()
 	{
 		m_pOuter->AddEFlags( EFL_DIRTY_SPATIAL_PARTITION );
 		s_DirtyKDTree.AddEntity( m_pOuter );
+#ifndef CLIENT_DLL
+		g_EntityQueryGrid.MarkEntityDirty( m_pOuter );
+#endif
 	}
 
 #ifdef CLIENT_DLL
@@ -1410,12 +1419,22 @@ void CCollisionProperty::UpdatePartition( )
 				vecSurroundMins -= Vector( 1, 1, 1 );
 				vecSurroundMaxs += Vector( 1, 1, 1 );
 				partition->ElementMoved( GetPartitionHandle(), vecSurroundMins,  vecSurroundMaxs );
+#ifndef CLIENT_DLL
+				g_EntityQueryGrid.ElementMoved( m_pOuter, vecSurroundMins, vecSurroundMaxs );
+#endif
 			}
 			else
 			{
 				partition->ElementMoved( GetPartitionHandle(), GetCollisionOrigin(),  GetCollisionOrigin() );
+#ifndef CLIENT_DLL
+				g_EntityQueryGrid.ElementMoved( m_pOuter, GetCollisionOrigin(), GetCollisionOrigin() );
+#endif
 			}
 		}
+
+#ifndef CLIENT_DLL
+		g_EntityQueryGrid.UpdateEntity( m_pOuter );
+#endif
 	}
 }
 
@@ -652,6 +652,7 @@ enum FireBulletsFlags_t
 	FIRE_BULLETS_DONT_HIT_UNDERWATER = 0x2,		// If the shot hits its target underwater, don't damage it
 	FIRE_BULLETS_ALLOW_WATER_SURFACE_IMPACTS = 0x4,	// If the shot hits water surface, still call DoImpactEffect
 	FIRE_BULLETS_TEMPORARY_DANGER_SOUND = 0x8,		// Danger sounds added from this impact can be stomped immediately if another is queued
+	FIRE_BULLETS_LAG_COMPENSATION_SNAPSHOT = 0x10,	// Server only: hit the players in the shooter's lag compensation snapshot instead of the live players
 };
 
 
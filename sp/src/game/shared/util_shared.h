@@ -358,6 +358,11 @@ void		UTIL_StringToIntArray( int *pVector, int count, const char *pString );
 void		UTIL_StringToFloatArray( float *pVector, int count, const char *pString );
 void		UTIL_StringToColor32( color32 *color, const char *pString );
 
+// Loads a script through a binary cache of its parsed tree, kept under kvcache/ in
+// the write path. For scripts that get reparsed at every level change.
+class KeyValues;
+bool		UTIL_LoadKeyValuesCached( KeyValues *pKeyValues, const char *pszFilename, const char *pszPathID = NULL );
+
 CBasePlayer *UTIL_PlayerByIndex( int entindex );
 
 //=============================================================================
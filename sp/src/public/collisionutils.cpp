@@ -133,6 +133,77 @@ float IntersectRayWithTriangle( const Ray_t& ray,
 	return clamp( t, 0.f, 1.f );
 }
 
+//-----------------------------------------------------------------------------
+// Intersects a swept box against four triangles at once. This follows
+// IntersectRayWithTriangle operation for operation (separate multiplies and
+// adds, a real divide) so that each lane rounds exactly like the scalar code.
+//-----------------------------------------------------------------------------
+static FORCEINLINE fltx4 DotProductSIMD( const FourVectors &a, const FourVectors &b )
+{
+	return AddSIMD( AddSIMD( MulSIMD( a.x, b.x ), MulSIMD( a.y, b.y ) ), MulSIMD( a.z, b.z ) );
+}
+
+static FORCEINLINE void CrossProductSIMD( const FourVectors &a, const FourVectors &b, FourVectors &result )
+{
+	result.x = SubSIMD( MulSIMD( a.y, b.z ), MulSIMD( a.z, b.y ) );
+	result.y = SubSIMD( MulSIMD( a.z, b.x ), MulSIMD( a.x, b.z ) );
+	result.z = SubSIMD( MulSIMD( a.x, b.y ), MulSIMD( a.y, b.x ) );
+}
+
+fltx4 IntersectRayWithFourTriangles( const Ray_t& ray, 
+		const FourVectors& v1, const FourVectors& v2, const FourVectors& v3, bool oneSided )
+{
+	FourVectors edge1 = v2;
+	edge1 -= v1;
+	FourVectors edge2 = v3;
+	edge2 -= v1;
+
+	FourVectors delta;
+	delta.DuplicateVector( ray.m_Delta );
+
+	// Lanes which have missed so far
+	fltx4 miss = Four_Zeros;
+
+	// Cull out one-sided stuff
+	if (oneSided)
+	{
+		FourVectors normal;
+		CrossProductSIMD( edge1, edge2, normal );
+		miss = CmpGeSIMD( DotProductSIMD( normal, delta ), Four_Zeros );
+	}
+
+	FourVectors dirCrossEdge2, orgCrossEdge1;
+	CrossProductSIMD( delta, edge2, dirCrossEdge2 );
+
+	// The scalar version compares against 1e-6 in double precision; 1e-6f
+	// is the largest float below that, hence <= instead of <
+	fltx4 denom = DotProductSIMD( dirCrossEdge2, edge1 );
+	miss = OrSIMD( miss, CmpLeSIMD( fabs( denom ), ReplicateX4( 1e-6f ) ) );
+	denom = DivSIMD( Four_Ones, denom );
+
+	// u has to lie in the range of 0 to 1
+	FourVectors org;
+	org.DuplicateVector( ray.m_Start );
+	org -= v1;
+	fltx4 u = MulSIMD( DotProductSIMD( dirCrossEdge2, org ), denom );
+	miss = OrSIMD( miss, OrSIMD( CmpLtSIMD( u, Four_Zeros ), CmpGtSIMD( u, Four_Ones ) ) );
+
+	// In barycentric coords, u + v < 1
+	CrossProductSIMD( org, edge1, orgCrossEdge1 );
+	fltx4 v = MulSIMD( DotProductSIMD( orgCrossEdge1, delta ), denom );
+	miss = OrSIMD( miss, OrSIMD( CmpLtSIMD( v, Four_Zeros ), CmpGtSIMD( AddSIMD( v, u ), Four_Ones ) ) );
+
+	// The swept box fudge only depends on the ray
+	float boxt = ComputeBoxOffset( ray );
+	fltx4 t = MulSIMD( DotProductSIMD( orgCrossEdge1, edge2 ), denom );
+	miss = OrSIMD( miss, OrSIMD( CmpLtSIMD( t, ReplicateX4( -boxt ) ), CmpGtSIMD( t, ReplicateX4( 1.0f + boxt ) ) ) );
+
+	// Clamp with the bound as the first operand so that -0 and NaN pass 
+	// through the same way they do through clamp()
+	t = MinSIMD( Four_Ones, MaxSIMD( Four_Zeros, t ) );
+	return MaskedAssign( miss, Four_NegativeOnes, t );
+}
+
 //-----------------------------------------------------------------------------
 // computes the barycentric coordinates of an intersection
 //-----------------------------------------------------------------------------
@@ -1294,6 +1365,267 @@ bool IntersectRayWithOBB( const Vector &vecRayStart, const Vector &vecRayDelta,
 }
 
 
+//-----------------------------------------------------------------------------
+// Intersects four rays against four boxes, one pair per lane. This walks the
+// six faces in the same order and with the same arithmetic as the scalar
+// IntersectRayWithBox, so t1, t2 and hitside come out identical.
+//-----------------------------------------------------------------------------
+int IntersectFourRaysWithFourBoxes( const FourVectors &vecRayStart, const FourVectors &vecRayDelta, 
+	const FourVectors &boxMins, const FourVectors &boxMaxs, float flTolerance, BoxTraceInfo_t *pTraces )
+{
+	fltx4 fl4Tolerance = ReplicateX4( flTolerance );
+	fltx4 t1 = Four_NegativeOnes;
+	fltx4 t2 = Four_Ones;
+	fltx4 hitside = Four_NegativeOnes;
+	fltx4 startsolid = LoadAlignedSIMD( g_SIMD_AllOnesMask );
+	fltx4 miss = Four_Zeros;
+
+	for ( int i = 0; i < 6; ++i )
+	{
+		fltx4 d1, d2;
+		if ( i >= 3 )
+		{
+			d1 = SubSIMD( vecRayStart[i-3], boxMaxs[i-3] );
+			d2 = AddSIMD( d1, vecRayDelta[i-3] );
+		}
+		else
+		{
+			d1 = SubSIMD( boxMins[i], vecRayStart[i] );
+			d2 = SubSIMD( d1, vecRayDelta[i] );
+		}
+
+		// if completely in front of face, no intersection. Lanes that miss
+		// stop updating, as the scalar version returns at that point.
+		fltx4 d1Out = CmpGtSIMD( d1, Four_Zeros );
+		fltx4 d2Out = CmpGtSIMD( d2, Four_Zeros );
+		miss = OrSIMD( miss, AndSIMD( d1Out, d2Out ) );
+		if ( TestSignSIMD( miss ) == 0xf )
+			break;
+
+		// starting in front of any face means we didn't start solid
+		startsolid = AndNotSIMD( d1Out, startsolid );
+
+		// faces we're completely inside of don't clip the ray
+		fltx4 crosses = AndNotSIMD( miss, OrSIMD( d1Out, d2Out ) );
+		fltx4 denom = SubSIMD( d1, d2 );
+		fltx4 enter = AndSIMD( crosses, CmpGtSIMD( d1, d2 ) );
+		fltx4 leave = AndNotSIMD( enter, crosses );
+
+		fltx4 f = MaxSIMD( Four_Zeros, SubSIMD( d1, fl4Tolerance ) );
+		f = DivSIMD( f, denom );
+		fltx4 updateT1 = AndSIMD( enter, CmpGtSIMD( f, t1 ) );
+		t1 = MaskedAssign( updateT1, f, t1 );
+		hitside = MaskedAssign( updateT1, ReplicateX4( (float)i ), hitside );
+
+		f = DivSIMD( AddSIMD( d1, fl4Tolerance ), denom );
+		t2 = MaskedAssign( AndSIMD( leave, CmpLtSIMD( f, t2 ) ), f, t2 );
+	}
+
+	startsolid = AndNotSIMD( miss, startsolid );
+	fltx4 clipped = AndSIMD( CmpLtSIMD( t1, t2 ), CmpGeSIMD( t1, Four_Zeros ) );
+	fltx4 hit = AndNotSIMD( miss, OrSIMD( startsolid, clipped ) );
+
+	if ( pTraces )
+	{
+		int nStartSolid = TestSignSIMD( startsolid );
+		for ( int j = 0; j < 4; ++j )
+		{
+			pTraces[j].t1 = SubFloat( t1, j );
+			pTraces[j].t2 = SubFloat( t2, j );
+			pTraces[j].hitside = (int)SubFloat( hitside, j );
+			pTraces[j].startsolid = ( nStartSolid & ( 1 << j ) ) != 0;
+		}
+	}
+
+	return TestSignSIMD( hit );
+}
+
+
+//-----------------------------------------------------------------------------
+// Loads up to four Vectors starting at pVecs[i]. FourVectors::LoadAndSwizzle
+// reads 16 bytes per vector, so the last group goes through an aligned copy 
+// rather than reading past the end of the array; lanes past nCount repeat 
+// the last vector.
+//-----------------------------------------------------------------------------
+static FORCEINLINE void LoadFourVectors( const Vector *pVecs, int i, int nCount, FourVectors &out )
+{
+	if ( i + 4 < nCount )
+	{
+		out.LoadAndSwizzle( pVecs[i], pVecs[i+1], pVecs[i+2], pVecs[i+3] );
+		return;
+	}
+
+	VectorAligned tmp[4];
+	for ( int j = 0; j < 4; ++j )
+	{
+		tmp[j] = pVecs[ MIN( i + j, nCount - 1 ) ];
+	}
+	out.LoadAndSwizzleAligned( tmp[0], tmp[1], tmp[2], tmp[3] );
+}
+
+static FORCEINLINE int AccumulateHitMask( int nLaneMask, int i, int nCount, uint32 *pHitMask )
+{
+	// Drop the padding lanes of the last group
+	if ( nCount - i < 4 )
+	{
+		nLaneMask &= ( 1 << ( nCount - i ) ) - 1;
+	}
+
+	if ( pHitMask )
+	{
+		// i is a multiple of 4, so a group never straddles two words
+		pHitMask[i >> 5] |= nLaneMask << ( i & 31 );
+	}
+
+	static const int s_nBitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	return s_nBitCount[nLaneMask];
+}
+
+static FORCEINLINE void CopyFourTraces( const BoxTraceInfo_t *pSrc, int i, int nCount, BoxTraceInfo_t *pTraces )
+{
+	int nLanes = MIN( nCount - i, 4 );
+	for ( int j = 0; j < nLanes; ++j )
+	{
+		pTraces[i+j] = pSrc[j];
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Intersects one ray against many boxes
+//-----------------------------------------------------------------------------
+int IntersectRayWithBoxes( const Vector &vecRayStart, const Vector &vecRayDelta, 
+	const Vector *pBoxMins, const Vector *pBoxMaxs, int nCount, float flTolerance,
+	BoxTraceInfo_t *pTraces, uint32 *pHitMask )
+{
+	if ( pHitMask )
+	{
+		memset( pHitMask, 0, ( ( nCount + 31 ) >> 5 ) * sizeof( uint32 ) );
+	}
+
+	FourVectors rayStart, rayDelta;
+	rayStart.DuplicateVector( vecRayStart );
+	rayDelta.DuplicateVector( vecRayDelta );
+
+	int nHits = 0;
+	BoxTraceInfo_t traces[4];
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		FourVectors boxMins, boxMaxs;
+		LoadFourVectors( pBoxMins, i, nCount, boxMins );
+		LoadFourVectors( pBoxMaxs, i, nCount, boxMaxs );
+
+		int nLaneMask = IntersectFourRaysWithFourBoxes( rayStart, rayDelta, boxMins, boxMaxs, flTolerance, pTraces ? traces : NULL );
+		nHits += AccumulateHitMask( nLaneMask, i, nCount, pHitMask );
+		if ( pTraces )
+		{
+			CopyFourTraces( traces, i, nCount, pTraces );
+		}
+	}
+
+	return nHits;
+}
+
+
+//-----------------------------------------------------------------------------
+// Intersects many rays against one box
+//-----------------------------------------------------------------------------
+int IntersectRaysWithBox( const Vector *pRayStarts, const Vector *pRayDeltas, int nCount,
+	const Vector &vecBoxMins, const Vector &vecBoxMaxs, float flTolerance,
+	BoxTraceInfo_t *pTraces, uint32 *pHitMask )
+{
+	if ( pHitMask )
+	{
+		memset( pHitMask, 0, ( ( nCount + 31 ) >> 5 ) * sizeof( uint32 ) );
+	}
+
+	FourVectors boxMins, boxMaxs;
+	boxMins.DuplicateVector( vecBoxMins );
+	boxMaxs.DuplicateVector( vecBoxMaxs );
+
+	int nHits = 0;
+	BoxTraceInfo_t traces[4];
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		FourVectors rayStart, rayDelta;
+		LoadFourVectors( pRayStarts, i, nCount, rayStart );
+		LoadFourVectors( pRayDeltas, i, nCount, rayDelta );
+
+		int nLaneMask = IntersectFourRaysWithFourBoxes( rayStart, rayDelta, boxMins, boxMaxs, flTolerance, pTraces ? traces : NULL );
+		nHits += AccumulateHitMask( nLaneMask, i, nCount, pHitMask );
+		if ( pTraces )
+		{
+			CopyFourTraces( traces, i, nCount, pTraces );
+		}
+	}
+
+	return nHits;
+}
+
+
+//-----------------------------------------------------------------------------
+// Intersects one ray against many OBBs. The ray goes into the space of each
+// OBB with the same arithmetic as VectorITransform / VectorIRotate.
+//-----------------------------------------------------------------------------
+int IntersectRayWithOBBs( const Vector &vecRayStart, const Vector &vecRayDelta, 
+	const matrix3x4_t * const *ppOBBToWorld, const Vector *pOBBMins, const Vector *pOBBMaxs, int nCount,
+	float flTolerance, BoxTraceInfo_t *pTraces, uint32 *pHitMask )
+{
+	if ( pHitMask )
+	{
+		memset( pHitMask, 0, ( ( nCount + 31 ) >> 5 ) * sizeof( uint32 ) );
+	}
+
+	FourVectors rayStart, rayDelta;
+	rayStart.DuplicateVector( vecRayStart );
+	rayDelta.DuplicateVector( vecRayDelta );
+
+	int nHits = 0;
+	BoxTraceInfo_t traces[4];
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		// mat[row][column], one OBB per lane
+		fltx4 mat[3][4];
+		const matrix3x4_t *pMat[4];
+		for ( int j = 0; j < 4; ++j )
+		{
+			pMat[j] = ppOBBToWorld[ MIN( i + j, nCount - 1 ) ];
+		}
+		for ( int nRow = 0; nRow < 3; ++nRow )
+		{
+			mat[nRow][0] = LoadUnalignedSIMD( (*pMat[0])[nRow] );
+			mat[nRow][1] = LoadUnalignedSIMD( (*pMat[1])[nRow] );
+			mat[nRow][2] = LoadUnalignedSIMD( (*pMat[2])[nRow] );
+			mat[nRow][3] = LoadUnalignedSIMD( (*pMat[3])[nRow] );
+			TransposeSIMD( mat[nRow][0], mat[nRow][1], mat[nRow][2], mat[nRow][3] );
+		}
+
+		FourVectors offset, localStart, localDelta;
+		offset.x = SubSIMD( rayStart.x, mat[0][3] );
+		offset.y = SubSIMD( rayStart.y, mat[1][3] );
+		offset.z = SubSIMD( rayStart.z, mat[2][3] );
+		for ( int nCol = 0; nCol < 3; ++nCol )
+		{
+			localStart[nCol] = AddSIMD( AddSIMD( MulSIMD( offset.x, mat[0][nCol] ), MulSIMD( offset.y, mat[1][nCol] ) ), MulSIMD( offset.z, mat[2][nCol] ) );
+			localDelta[nCol] = AddSIMD( AddSIMD( MulSIMD( rayDelta.x, mat[0][nCol] ), MulSIMD( rayDelta.y, mat[1][nCol] ) ), MulSIMD( rayDelta.z, mat[2][nCol] ) );
+		}
+
+		FourVectors boxMins, boxMaxs;
+		LoadFourVectors( pOBBMins, i, nCount, boxMins );
+		LoadFourVectors( pOBBMaxs, i, nCount, boxMaxs );
+
+		int nLaneMask = IntersectFourRaysWithFourBoxes( localStart, localDelta, boxMins, boxMaxs, flTolerance, pTraces ? traces : NULL );
+		nHits += AccumulateHitMask( nLaneMask, i, nCount, pHitMask );
+		if ( pTraces )
+		{
+			CopyFourTraces( traces, i, nCount, pTraces );
+		}
+	}
+
+	return nHits;
+}
+
+
 
 //-----------------------------------------------------------------------------
 // Intersects a ray against an OBB
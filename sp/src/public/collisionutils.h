@@ -45,6 +45,20 @@ float IntersectRayWithTriangle( const Ray_t& ray,
 		                        const Vector& v1, const Vector& v2, const Vector& v3, 
 								bool oneSided );
 
+//-----------------------------------------------------------------------------
+//
+// IntersectRayWithFourTriangles
+//
+// Four-wide IntersectRayWithTriangle: each lane of v1, v2, v3 holds one 
+// triangle. Returns t along the ray for each lane, less than zero in lanes
+// which were not hit. Every lane gives exactly the result the scalar version
+// would, so the two can be mixed freely.
+//
+//-----------------------------------------------------------------------------
+fltx4 IntersectRayWithFourTriangles( const Ray_t& ray, 
+									const FourVectors& v1, const FourVectors& v2, const FourVectors& v3, 
+									bool oneSided );
+
 //-----------------------------------------------------------------------------
 //
 // ComputeIntersectionBarycentricCoordinates
@@ -166,6 +180,37 @@ bool IntersectRayWithOBB( const Vector &vecRayStart, const Vector &vecRayDelta,
 	const matrix3x4_t &matOBBToWorld, const Vector &vecOBBMins, const Vector &vecOBBMaxs, 
 	float flTolerance, BoxTraceInfo_t *pTrace );
 
+//-----------------------------------------------------------------------------
+// Batched ray vs. box queries
+//
+// IntersectFourRaysWithFourBoxes tests four ray/box pairs at once, one pair
+// per lane; replicate the ray to test one ray against four boxes, or the box
+// to test four rays against one box. It returns a 4 bit mask of the lanes 
+// that hit, and each BoxTraceInfo_t (if requested) holds exactly what the 
+// scalar IntersectRayWithBox would have returned for that lane.
+//
+// The array versions below run that kernel over AoS inputs and return the
+// number of hits. pHitMask, if not NULL, receives one bit per box (or ray) 
+// and must hold ( nCount + 31 ) / 32 words; pTraces, if not NULL, holds 
+// nCount entries.
+//-----------------------------------------------------------------------------
+int IntersectFourRaysWithFourBoxes( const FourVectors &vecRayStart, const FourVectors &vecRayDelta, 
+	const FourVectors &boxMins, const FourVectors &boxMaxs, float flTolerance, BoxTraceInfo_t *pTraces = NULL );
+
+int IntersectRayWithBoxes( const Vector &vecRayStart, const Vector &vecRayDelta, 
+	const Vector *pBoxMins, const Vector *pBoxMaxs, int nCount, float flTolerance,
+	BoxTraceInfo_t *pTraces, uint32 *pHitMask );
+
+int IntersectRaysWithBox( const Vector *pRayStarts, const Vector *pRayDeltas, int nCount,
+	const Vector &boxMins, const Vector &boxMaxs, float flTolerance,
+	BoxTraceInfo_t *pTraces, uint32 *pHitMask );
+
+// Same as IntersectRayWithOBB with a BoxTraceInfo_t for each OBB; the ray is
+// transformed into the space of four OBBs at a time
+int IntersectRayWithOBBs( const Vector &vecRayStart, const Vector &vecRayDelta, 
+	const matrix3x4_t * const *ppOBBToWorld, const Vector *pOBBMins, const Vector *pOBBMaxs, int nCount,
+	float flTolerance, BoxTraceInfo_t *pTraces, uint32 *pHitMask );
+
 //-----------------------------------------------------------------------------
 // 
 // IsSphereIntersectingSphere
@@ -41,6 +41,10 @@ extern double g_flDispCollSweepTimer;
 extern double g_flDispCollIntersectTimer;
 extern double g_flDispCollInCallTimer;
 
+// Test leaf triangles four at a time in ray casts and hull sweeps; results are
+// identical either way, the scalar path is kept for comparison
+extern bool g_bDispCollFourWideTris;
+
 struct RayDispOutput_t
 {
 	short	ndxVerts[4];	// 3 verts and a pad
@@ -265,6 +269,7 @@ protected:
 	void AABBTree_TreeTrisRayBarycentricTest( const Ray_t &ray, const Vector &vecInvDelta, int iNode, RayDispOutput_t &output, CDispCollTri **pImpactTri );
 
 	int FORCEINLINE BuildRayLeafList( int iNode, rayleaflist_t &list );
+	void FORCEINLINE GatherLeafTris( const rayleaflist_t &list, int listIndex, CDispCollTri **ppTris, FourVectors &v1, FourVectors &v2, FourVectors &v3 );
 
 	struct AABBTree_TreeTrisSweepTest_Args_t
 	{
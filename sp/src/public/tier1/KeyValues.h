@@ -214,6 +214,12 @@ public:
 	bool WriteAsBinary( CUtlBuffer &buffer );
 	bool ReadAsBinary( CUtlBuffer &buffer, int nStackDepth = 0 );
 
+	// Loads a text file through a binary cache of its parsed tree, saving the tokenizing
+	// on later loads. The cache (cacheName in cachePathID) is a WriteAsBinary() stream
+	// behind a header recording the text file's size, timestamp and CRC, and gets rewritten
+	// whenever they don't match. Files using #include or #base are never cached.
+	bool LoadFromFileCached( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, const char *cacheName, const char *cachePathID = NULL );
+
 	// Allocate & create a new copy of the keys
 	KeyValues *MakeCopy( void ) const;
 
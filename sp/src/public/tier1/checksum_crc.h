@@ -17,6 +17,15 @@ void CRC32_ProcessBuffer( CRC32_t *pulCRC, const void *p, int len );
 void CRC32_Final( CRC32_t *pulCRC );
 CRC32_t	CRC32_GetTableEntry( unsigned int slot );
 
+// Returns the CRC of the concatenation of two buffers, given their finalized CRCs
+// and the length of the second one.
+CRC32_t CRC32_Combine( CRC32_t crc1, CRC32_t crc2, int len2 );
+
+// Same result as CRC32_ProcessBuffer, but very large buffers (several MB) are split
+// across threads. Use for one-off hashes of big files, not from code that's already
+// running on a job thread.
+void CRC32_ProcessBufferParallel( CRC32_t *pulCRC, const void *p, int len );
+
 inline CRC32_t CRC32_ProcessSingleBuffer( const void *p, int len )
 {
 	CRC32_t crc;
@@ -28,6 +28,7 @@
 #include "utlhash.h"
 #include "UtlSortVector.h"
 #include "convar.h"
+#include "checksum_crc.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include <tier0/memdbgon.h>
@@ -568,6 +569,46 @@ const char *KeyValues::ReadToken( CUtlBuffer &buf, bool &wasQuoted, bool &wasCon
 	bool bReportedError = false;
 	bool bConditionalStart = false;
 	int nCount = 0;
+
+	// Fast path: when the rest of the buffer is in memory, scan it directly
+	// instead of peeking and seeking a single char at a time.
+	int nRemaining = buf.GetBytesRemaining();
+	const char *pStart = ( nRemaining > 0 ) ? (const char*)buf.PeekGet( nRemaining, 0 ) : NULL;
+	if ( pStart )
+	{
+		const char *pEnd = pStart + nRemaining;
+		const char *p = pStart;
+		for ( ; p < pEnd; ++p )
+		{
+			char ch = *p;
+
+			// end of file, control character or whitespace ends the token
+			if ( ch == 0 || ch == '"' || ch == '{' || ch == '}' || isspace( ch ) )
+				break;
+
+			if ( ch == '[' )
+			{
+				bConditionalStart = true;
+			}
+			else if ( ch == ']' && bConditionalStart )
+			{
+				wasConditional = true;
+			}
+		}
+
+		nCount = p - pStart;
+		if ( nCount > KEYVALUES_TOKEN_SIZE - 1 )
+		{
+			nCount = KEYVALUES_TOKEN_SIZE - 1;
+			g_KeyValuesErrorStack.ReportError(" ReadToken overflow" );
+		}
+
+		Q_memcpy( s_pTokenBuf, pStart, nCount );
+		s_pTokenBuf[ nCount ] = 0;
+		buf.SeekGet( CUtlBuffer::SEEK_CURRENT, p - pStart );
+		return s_pTokenBuf;
+	}
+
 	while ( ( c = (const char*)buf.PeekGet( sizeof(char), 0 ) ) )
 	{
 		// end of file
@@ -666,6 +707,124 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 	return bRetOK;
 }
 
+//-----------------------------------------------------------------------------
+// Binary cache of a parsed text file, see LoadFromFileCached()
+//-----------------------------------------------------------------------------
+#define KEYVALUES_CACHE_ID			(('C'<<24)|('B'<<16)|('V'<<8)|'K')
+#define KEYVALUES_CACHE_VERSION		2
+
+#if defined( _X360 )
+#define KEYVALUES_CACHE_PLATFORM	3
+#elif defined( OSX )
+#define KEYVALUES_CACHE_PLATFORM	2
+#elif defined( POSIX )
+#define KEYVALUES_CACHE_PLATFORM	1
+#else
+#define KEYVALUES_CACHE_PLATFORM	0
+#endif
+
+struct KeyValuesCacheHeader_t
+{
+	int		m_nId;
+	int		m_nVersion;
+	int		m_nPlatform;		// [$WIN32] etc. conditionals were evaluated for this platform
+	int		m_nParseFlags;		// escape sequences / conditionals settings used to parse
+	int		m_nSourceSize;
+	int		m_nSourceTime;
+	CRC32_t	m_nSourceCRC;		// size and time alone miss an edit within the timestamp granularity
+};
+
+static void BuildKeyValuesCacheHeader( KeyValuesCacheHeader_t &header, int nParseFlags, int nSourceSize, long nSourceTime, CRC32_t nSourceCRC )
+{
+	header.m_nId = KEYVALUES_CACHE_ID;
+	header.m_nVersion = KEYVALUES_CACHE_VERSION;
+	header.m_nPlatform = KEYVALUES_CACHE_PLATFORM;
+	header.m_nParseFlags = nParseFlags;
+	header.m_nSourceSize = nSourceSize;
+	header.m_nSourceTime = (int)nSourceTime;
+	header.m_nSourceCRC = nSourceCRC;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Load keyValues from disk through a binary cache of the parsed tree
+//-----------------------------------------------------------------------------
+bool KeyValues::LoadFromFileCached( IBaseFileSystem *filesystem, const char *resourceName, const char *pathID, const char *cacheName, const char *cachePathID )
+{
+	Assert( filesystem );
+
+	// The text is always read, the cache saves the tokenizing
+	CUtlBuffer textBuf;
+	if ( !filesystem->ReadFile( resourceName, pathID, textBuf ) )
+		return false;
+
+	long nSourceTime = filesystem->GetFileTime( resourceName, pathID );
+	int nSourceSize = textBuf.TellPut();
+	int nParseFlags = ( m_bHasEscapeSequences ? 1 : 0 ) | ( m_bEvaluateConditionals ? 2 : 0 );
+
+	KeyValuesCacheHeader_t expected;
+	BuildKeyValuesCacheHeader( expected, nParseFlags, nSourceSize, nSourceTime, CRC32_ProcessSingleBuffer( textBuf.Base(), nSourceSize ) );
+
+	CUtlBuffer cacheBuf;
+	if ( nSourceSize > 0 && filesystem->ReadFile( cacheName, cachePathID, cacheBuf ) )
+	{
+		KeyValuesCacheHeader_t header;
+		header.m_nId = cacheBuf.GetInt();
+		header.m_nVersion = cacheBuf.GetInt();
+		header.m_nPlatform = cacheBuf.GetInt();
+		header.m_nParseFlags = cacheBuf.GetInt();
+		header.m_nSourceSize = cacheBuf.GetInt();
+		header.m_nSourceTime = cacheBuf.GetInt();
+		header.m_nSourceCRC = cacheBuf.GetUnsignedInt();
+
+		if ( cacheBuf.IsValid() && !Q_memcmp( &header, &expected, sizeof(header) ) )
+		{
+			// ReadAsBinary resets our parse settings, keep them for the caller
+			bool bResult = ReadAsBinary( cacheBuf );
+			if ( !bResult )
+			{
+				DevMsg( 1, "KeyValues::LoadFromFileCached: \"%s\" is corrupt, reparsing \"%s\".\n", cacheName, resourceName );
+
+				RemoveEverything();
+				Init();
+			}
+
+			m_bHasEscapeSequences = ( nParseFlags & 1 ) != 0;
+			m_bEvaluateConditionals = ( nParseFlags & 2 ) != 0;
+			if ( bResult )
+				return true;
+		}
+	}
+
+	// Cache is missing or stale, parse the text
+	s_LastFileLoadingFrom = (char*)resourceName;
+
+	textBuf.PutChar( 0 );	// null terminate file as EOF
+	textBuf.PutChar( 0 );	// double NULL terminating in case this is a unicode file
+	const char *pText = (const char *)textBuf.Base();
+	if ( !LoadFromBuffer( resourceName, pText, filesystem ) )
+		return false;
+
+	// The cache can't tell when an #include'd or #base file changes
+	if ( Q_stristr( pText, "#include" ) || Q_stristr( pText, "#base" ) )
+		return true;
+
+	cacheBuf.Purge();
+	cacheBuf.PutInt( expected.m_nId );
+	cacheBuf.PutInt( expected.m_nVersion );
+	cacheBuf.PutInt( expected.m_nPlatform );
+	cacheBuf.PutInt( expected.m_nParseFlags );
+	cacheBuf.PutInt( expected.m_nSourceSize );
+	cacheBuf.PutInt( expected.m_nSourceTime );
+	cacheBuf.PutUnsignedInt( expected.m_nSourceCRC );
+	if ( WriteAsBinary( cacheBuf ) )
+	{
+		filesystem->WriteFile( cacheName, cachePathID, cacheBuf );
+	}
+
+	return true;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Save the keyvalues to disk
 //			Creates the path to the file if it doesn't exist 
@@ -2465,7 +2624,15 @@ bool KeyValues::WriteAsBinary( CUtlBuffer &buffer )
 		{
 		case TYPE_NONE:
 			{
-				dat->m_pSub->WriteAsBinary( buffer );
+				if ( dat->m_pSub )
+				{
+					dat->m_pSub->WriteAsBinary( buffer );
+				}
+				else
+				{
+					// empty section, just the end of peers marker
+					buffer.PutUnsignedChar( TYPE_NUMTYPES );
+				}
 				break;
 			}
 		case TYPE_STRING:
@@ -2547,6 +2714,7 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 
 	KeyValues	*dat = this;
 	types_t		type = (types_t)buffer.GetUnsignedChar();
+	char		token[KEYVALUES_TOKEN_SIZE];
 	
 	// loop through all our peers
 	while ( true )
@@ -2556,8 +2724,8 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 
 		dat->m_iDataType = type;
 
+		if ( dat == this )
 		{
-			char token[KEYVALUES_TOKEN_SIZE];
 			buffer.GetString( token, KEYVALUES_TOKEN_SIZE-1 );
 			token[KEYVALUES_TOKEN_SIZE-1] = 0;
 			dat->SetName( token );
@@ -2567,13 +2735,20 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 		{
 		case TYPE_NONE:
 			{
+				// An empty section is written as just the end of peers marker
+				const unsigned char *pPeek = (const unsigned char *)buffer.PeekGet( sizeof(unsigned char), 0 );
+				if ( pPeek && *pPeek == TYPE_NUMTYPES )
+				{
+					buffer.GetUnsignedChar();
+					break;
+				}
+
 				dat->m_pSub = new KeyValues("");
 				dat->m_pSub->ReadAsBinary( buffer, nStackDepth + 1 );
 				break;
 			}
 		case TYPE_STRING:
 			{
-				char token[KEYVALUES_TOKEN_SIZE];
 				buffer.GetString( token, KEYVALUES_TOKEN_SIZE-1 );
 				token[KEYVALUES_TOKEN_SIZE-1] = 0;
 
@@ -2632,8 +2807,10 @@ bool KeyValues::ReadAsBinary( CUtlBuffer &buffer, int nStackDepth )
 		if ( type == TYPE_NUMTYPES )
 			break;
 
-		// new peer follows
-		dat->m_pPeer = new KeyValues("");
+		// new peer follows, its name comes first
+		buffer.GetString( token, KEYVALUES_TOKEN_SIZE-1 );
+		token[KEYVALUES_TOKEN_SIZE-1] = 0;
+		dat->m_pPeer = new KeyValues( token );
 		dat = dat->m_pPeer;
 	}
 
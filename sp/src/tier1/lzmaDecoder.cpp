@@ -9,6 +9,7 @@
 
 #include "tier0/platform.h"
 #include "tier0/dbg.h"
+#include "tier0/threadtools.h"
 #include "tier1/lzmaDecoder.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -85,9 +86,7 @@ typedef struct _CLzmaProperties
 	int lc;
 	int lp;
 	int pb;
-#ifdef _LZMA_OUT_READ
 	UInt32 DictionarySize;
-#endif
 }CLzmaProperties;
 
 int LzmaDecodeProperties(CLzmaProperties *propsRes, const unsigned char *propsData, int size);
@@ -106,7 +105,7 @@ typedef struct _CLzmaDecoderState
 	const unsigned char *BufferLim;
 #endif
 
-#ifdef _LZMA_OUT_READ
+	/* _LZMA_OUT_READ decoding only */
 	unsigned char *Dictionary;
 	UInt32 Range;
 	UInt32 Code;
@@ -117,20 +116,13 @@ typedef struct _CLzmaDecoderState
 	int State;
 	int RemainLen;
 	unsigned char TempDictionary[4];
-#endif
+	int InputFinished;	/* nonzero once the rest of the stream is in the input buffer */
 } CLzmaDecoderState;
 
-#ifdef _LZMA_OUT_READ
 #define LzmaDecoderInit(vs) { (vs)->RemainLen = kLzmaNeedInitId; }
-#endif
 
-int LzmaDecode(CLzmaDecoderState *vs,
-#ifdef _LZMA_IN_CB
-			   ILzmaInCallback *inCallback,
-#else
-			   const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
-#endif
-			   unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed);
+/* Worst case input consumed by one symbol */
+#define LZMA_REQUIRED_INPUT_MAX 20
 
 #define kNumTopBits 24
 #define kTopValue ((UInt32)1 << kNumTopBits)
@@ -174,7 +166,7 @@ int LzmaDecode(CLzmaDecoderState *vs,
 
 #define RangeDecoderBitTreeDecode(probs, numLevels, res) \
 { int i = numLevels; res = 1; \
-	do { CProb *p = probs + res; RC_GET_BIT(p, res) } while(--i != 0); \
+	do { CProb *pTreeProb = probs + res; RC_GET_BIT(pTreeProb, res) } while(--i != 0); \
 	res -= (1 << numLevels); }
 
 
@@ -248,7 +240,6 @@ int LzmaDecodeProperties(CLzmaProperties *propsRes, const unsigned char *propsDa
 		*/
 	}
 
-#ifdef _LZMA_OUT_READ
 	{
 		int i;
 		propsRes->DictionarySize = 0;
@@ -257,472 +248,227 @@ int LzmaDecodeProperties(CLzmaProperties *propsRes, const unsigned char *propsDa
 		if (propsRes->DictionarySize == 0)
 			propsRes->DictionarySize = 1;
 	}
-#endif
 	return LZMA_RESULT_OK;
 }
 
 #define kLzmaStreamWasFinishedId (-1)
 
-int LzmaDecode(CLzmaDecoderState *vs,
-#ifdef _LZMA_IN_CB
-			   ILzmaInCallback *InCallback,
-#else
-			   const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
-#endif
-			   unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed)
-{
-	CProb *p = vs->Probs;
-	SizeT nowPos = 0;
-	Byte previousByte = 0;
-	UInt32 posStateMask = (1 << (vs->Properties.pb)) - 1;
-	UInt32 literalPosMask = (1 << (vs->Properties.lp)) - 1;
-	int lc = vs->Properties.lc;
+// LzmaDecode decodes a whole stream straight into the output buffer.
+#define LZMA_DECODE_FUNCTION LzmaDecode
+#include "lzmaDecoder_decode.h"
+#undef LZMA_DECODE_FUNCTION
 
-#ifdef _LZMA_OUT_READ
+// LzmaDecodeOutRead decodes through vs->Dictionary and can stop and resume
+// at any output position, or at a symbol boundary when input runs short.
+#define _LZMA_OUT_READ
+#define LZMA_DECODE_FUNCTION LzmaDecodeOutRead
+#include "lzmaDecoder_decode.h"
+#undef LZMA_DECODE_FUNCTION
+#undef _LZMA_OUT_READ
 
-	UInt32 Range = vs->Range;
-	UInt32 Code = vs->Code;
-#ifdef _LZMA_IN_CB
-	const Byte *Buffer = vs->Buffer;
-	const Byte *BufferLim = vs->BufferLim;
-#else
-	const Byte *Buffer = inStream;
-	const Byte *BufferLim = inStream + inSize;
-#endif
-	int state = vs->State;
-	UInt32 rep0 = vs->Reps[0], rep1 = vs->Reps[1], rep2 = vs->Reps[2], rep3 = vs->Reps[3];
-	int len = vs->RemainLen;
-	UInt32 globalPos = vs->GlobalPos;
-	UInt32 distanceLimit = vs->DistanceLimit;
+//-----------------------------------------------------------------------------
+// Returns true if buffer is compressed.
+//-----------------------------------------------------------------------------
+bool CLZMA::IsCompressed( unsigned char *pInput )
+{
+	lzma_header_t *pHeader = (lzma_header_t *)pInput;
+	if ( pHeader && ( pHeader->id == LZMA_ID || pHeader->id == LZMA_CHUNKED_ID ) )
+	{
+		return true;
+	}
 
-	Byte *dictionary = vs->Dictionary;
-	UInt32 dictionarySize = vs->Properties.DictionarySize;
-	UInt32 dictionaryPos = vs->DictionaryPos;
+	// unrecognized
+	return false;
+}
 
-	Byte tempDictionary[4];
+//-----------------------------------------------------------------------------
+// Returns true if buffer is a chunked container of independent streams.
+//-----------------------------------------------------------------------------
+bool CLZMA::IsChunked( unsigned char *pInput )
+{
+	lzma_chunked_header_t *pHeader = (lzma_chunked_header_t *)pInput;
+	return pHeader && pHeader->id == LZMA_CHUNKED_ID;
+}
 
-#ifndef _LZMA_IN_CB
-	*inSizeProcessed = 0;
-#endif
-	*outSizeProcessed = 0;
-	if (len == kLzmaStreamWasFinishedId)
-		return LZMA_RESULT_OK;
+//-----------------------------------------------------------------------------
+// Returns uncompressed size of compressed input buffer. Used for allocating output
+// buffer for decompression. Returns 0 if input buffer is not compressed.
+//-----------------------------------------------------------------------------
+unsigned int CLZMA::GetActualSize( unsigned char *pInput )
+{
+	lzma_header_t *pHeader = (lzma_header_t *)pInput;
+	if ( pHeader && pHeader->id == LZMA_ID )
+	{
+		return LittleLong( pHeader->actualSize );
+	}
 
-	if (dictionarySize == 0)
+	if ( IsChunked( pInput ) )
 	{
-		dictionary = tempDictionary;
-		dictionarySize = 1;
-		tempDictionary[0] = vs->TempDictionary[0];
+		return LittleLong( ((lzma_chunked_header_t *)pInput)->actualSize );
 	}
 
-	if (len == kLzmaNeedInitId)
+	// unrecognized
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Returns the number of independently decodable chunks, 1 for a single
+// stream and 0 if input buffer is not compressed.
+//-----------------------------------------------------------------------------
+unsigned int CLZMA::GetNumChunks( unsigned char *pInput )
+{
+	if ( IsChunked( pInput ) )
 	{
-		{
-			UInt32 numProbs = Literal + ((UInt32)LZMA_LIT_SIZE << (lc + vs->Properties.lp));
-			UInt32 i;
-			for (i = 0; i < numProbs; i++)
-				p[i] = kBitModelTotal >> 1; 
-			rep0 = rep1 = rep2 = rep3 = 1;
-			state = 0;
-			globalPos = 0;
-			distanceLimit = 0;
-			dictionaryPos = 0;
-			dictionary[dictionarySize - 1] = 0;
-#ifdef _LZMA_IN_CB
-			RC_INIT;
-#else
-			RC_INIT(inStream, inSize);
-#endif
-		}
-		len = 0;
+		return LittleLong( ((lzma_chunked_header_t *)pInput)->numChunks );
 	}
-	while(len != 0 && nowPos < outSize)
+
+	return IsCompressed( pInput ) ? 1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Locates a chunk's stream and where its output goes. Returns NULL if the
+// chunk does not exist or the container is inconsistent.
+//-----------------------------------------------------------------------------
+unsigned char *CLZMA::GetChunk( unsigned char *pInput, unsigned int nChunk, unsigned int *pOutputOffset, unsigned int *pOutputSize )
+{
+	if ( !IsChunked( pInput ) )
 	{
-		UInt32 pos = dictionaryPos - rep0;
-		if (pos >= dictionarySize)
-			pos += dictionarySize;
-		outStream[nowPos++] = dictionary[dictionaryPos] = dictionary[pos];
-		if (++dictionaryPos == dictionarySize)
-			dictionaryPos = 0;
-		len--;
+		if ( nChunk != 0 || !IsCompressed( pInput ) )
+			return NULL;
+
+		*pOutputOffset = 0;
+		*pOutputSize = GetActualSize( pInput );
+		return pInput;
 	}
-	if (dictionaryPos == 0)
-		previousByte = dictionary[dictionarySize - 1];
-	else
-		previousByte = dictionary[dictionaryPos - 1];
-
-#else /* if !_LZMA_OUT_READ */
-
-	int state = 0;
-	UInt32 rep0 = 1, rep1 = 1, rep2 = 1, rep3 = 1;
-	int len = 0;
-	const Byte *Buffer;
-	const Byte *BufferLim;
-	UInt32 Range;
-	UInt32 Code;
 
-#ifndef _LZMA_IN_CB
-	*inSizeProcessed = 0;
-#endif
-	*outSizeProcessed = 0;
+	lzma_chunked_header_t *pHeader = (lzma_chunked_header_t *)pInput;
+	unsigned int actualSize = LittleLong( pHeader->actualSize );
+	unsigned int chunkSize = LittleLong( pHeader->chunkSize );
+	unsigned int numChunks = LittleLong( pHeader->numChunks );
+	if ( nChunk >= numChunks || !chunkSize || nChunk > ( actualSize - 1 ) / chunkSize )
+		return NULL;
+
+	unsigned int *pOffsets = (unsigned int *)( pHeader + 1 );
+	unsigned int start = LittleLong( pOffsets[nChunk] );
+	unsigned int end = LittleLong( pOffsets[nChunk + 1] );
+	if ( end < start || end - start < sizeof( lzma_header_t ) )
+		return NULL;
+
+	lzma_header_t *pChunk = (lzma_header_t *)( pInput + start );
+	if ( pChunk->id != LZMA_ID || LittleLong( pChunk->lzmaSize ) > end - start - sizeof( lzma_header_t ) )
+		return NULL;
+
+	*pOutputOffset = nChunk * chunkSize;
+	*pOutputSize = MIN( chunkSize, actualSize - *pOutputOffset );
+	return (unsigned char *)pChunk;
+}
 
+//-----------------------------------------------------------------------------
+// Uncompress one chunk into its place in the output buffer, which is sized
+// for the whole payload. Returns the chunk's uncompressed size, 0 on failure.
+// Touches nothing but the chunk's input and output ranges, so different
+// chunks can be decoded concurrently.
+//-----------------------------------------------------------------------------
+unsigned int CLZMA::UncompressChunk( unsigned char *pInput, unsigned int nChunk, unsigned char *pOutput )
+{
+	unsigned int outputOffset, outputSize;
+	unsigned char *pChunk = GetChunk( pInput, nChunk, &outputOffset, &outputSize );
+	if ( !pChunk || GetActualSize( pChunk ) != outputSize )
 	{
-		UInt32 i;
-		UInt32 numProbs = Literal + ((UInt32)LZMA_LIT_SIZE << (lc + vs->Properties.lp));
-		for (i = 0; i < numProbs; i++)
-			p[i] = kBitModelTotal >> 1;
+		Assert( 0 );
+		return 0;
 	}
 
-#ifdef _LZMA_IN_CB
-	RC_INIT;
-#else
-	RC_INIT(inStream, inSize);
-#endif
+	return Uncompress( pChunk, pOutput + outputOffset );
+}
 
-#endif /* _LZMA_OUT_READ */
+//-----------------------------------------------------------------------------
+// Decodes the chunks of a large container on several threads, each thread
+// taking the next undecoded chunk until none are left
+//-----------------------------------------------------------------------------
+#define LZMA_PARALLEL_MIN_BYTES		( 256 * 1024 )
+#define LZMA_PARALLEL_MAX_THREADS	8
 
-	while(nowPos < outSize)
+struct LZMAParallelJob_t
+{
+	unsigned char *m_pInput;
+	unsigned char *m_pOutput;
+	unsigned int m_nChunks;
+	long volatile m_nNextChunk;
+	bool m_bFailed;
+};
+
+static unsigned LZMA_ParallelChunkThread( void *pParam )
+{
+	LZMAParallelJob_t *pJob = (LZMAParallelJob_t *)pParam;
+	CLZMA lzma;
+	while ( true )
 	{
-		CProb *prob;
-		UInt32 bound;
-		int posState = (int)(
-			(nowPos 
-#ifdef _LZMA_OUT_READ
-			+ globalPos
-#endif
-			)
-			& posStateMask);
+		unsigned int nChunk = (unsigned int)ThreadInterlockedIncrement( &pJob->m_nNextChunk ) - 1;
+		if ( nChunk >= pJob->m_nChunks )
+			break;
 
-		prob = p + IsMatch + (state << kNumPosBitsMax) + posState;
-		IfBit0(prob)
+		if ( !lzma.UncompressChunk( pJob->m_pInput, nChunk, pJob->m_pOutput ) )
 		{
-			int symbol = 1;
-			UpdateBit0(prob)
-				prob = p + Literal + (LZMA_LIT_SIZE * 
-				(((
-				(nowPos 
-#ifdef _LZMA_OUT_READ
-				+ globalPos
-#endif
-				)
-				& literalPosMask) << lc) + (previousByte >> (8 - lc))));
-
-			if (state >= kNumLitStates)
-			{
-				int matchByte;
-#ifdef _LZMA_OUT_READ
-				UInt32 pos = dictionaryPos - rep0;
-				if (pos >= dictionarySize)
-					pos += dictionarySize;
-				matchByte = dictionary[pos];
-#else
-				matchByte = outStream[nowPos - rep0];
-#endif
-				do
-				{
-					int bit;
-					CProb *probLit;
-					matchByte <<= 1;
-					bit = (matchByte & 0x100);
-					probLit = prob + 0x100 + bit + symbol;
-					RC_GET_BIT2(probLit, symbol, if (bit != 0) break, if (bit == 0) break)
-				}
-				while (symbol < 0x100);
-			}
-			while (symbol < 0x100)
-			{
-				CProb *probLit = prob + symbol;
-				RC_GET_BIT(probLit, symbol)
-			}
-			previousByte = (Byte)symbol;
-
-			outStream[nowPos++] = previousByte;
-#ifdef _LZMA_OUT_READ
-			if (distanceLimit < dictionarySize)
-				distanceLimit++;
-
-			dictionary[dictionaryPos] = previousByte;
-			if (++dictionaryPos == dictionarySize)
-				dictionaryPos = 0;
-#endif
-			if (state < 4) state = 0;
-			else if (state < 10) state -= 3;
-			else state -= 6;
+			pJob->m_bFailed = true;
 		}
-else             
+	}
+	return 0;
+}
+
+unsigned int CLZMA::UncompressChunked( unsigned char *pInput, unsigned char *pOutput )
 {
-	UpdateBit1(prob);
-	prob = p + IsRep + state;
-	IfBit0(prob)
+	lzma_chunked_header_t *pHeader = (lzma_chunked_header_t *)pInput;
+	unsigned int actualSize = LittleLong( pHeader->actualSize );
+	unsigned int chunkSize = LittleLong( pHeader->chunkSize );
+	unsigned int numChunks = LittleLong( pHeader->numChunks );
+	if ( !chunkSize || numChunks != ( actualSize - 1 ) / chunkSize + 1 )
 	{
-		UpdateBit0(prob);
-		rep3 = rep2;
-		rep2 = rep1;
-		rep1 = rep0;
-		state = state < kNumLitStates ? 0 : 3;
-		prob = p + LenCoder;
+		// chunks would not cover the output exactly
+		Assert( 0 );
+		return 0;
 	}
-	  else
-	  {
-		  UpdateBit1(prob);
-		  prob = p + IsRepG0 + state;
-		  IfBit0(prob)
-		  {
-			  UpdateBit0(prob);
-			  prob = p + IsRep0Long + (state << kNumPosBitsMax) + posState;
-			  IfBit0(prob)
-			  {
-#ifdef _LZMA_OUT_READ
-				  UInt32 pos;
-#endif
-				  UpdateBit0(prob);
-
-#ifdef _LZMA_OUT_READ
-				  if (distanceLimit == 0)
-#else
-				  if (nowPos == 0)
-#endif
-					  return LZMA_RESULT_DATA_ERROR;
-
-				  state = state < kNumLitStates ? 9 : 11;
-#ifdef _LZMA_OUT_READ
-				  pos = dictionaryPos - rep0;
-				  if (pos >= dictionarySize)
-					  pos += dictionarySize;
-				  previousByte = dictionary[pos];
-				  dictionary[dictionaryPos] = previousByte;
-				  if (++dictionaryPos == dictionarySize)
-					  dictionaryPos = 0;
-#else
-				  previousByte = outStream[nowPos - rep0];
-#endif
-				  outStream[nowPos++] = previousByte;
-#ifdef _LZMA_OUT_READ
-				  if (distanceLimit < dictionarySize)
-					  distanceLimit++;
-#endif
 
-				  continue;
-			  }
-		  else
-		  {
-			  UpdateBit1(prob);
-		  }
-		  }
-		else
-		{
-			UInt32 distance;
-			UpdateBit1(prob);
-			prob = p + IsRepG1 + state;
-			IfBit0(prob)
-			{
-				UpdateBit0(prob);
-				distance = rep1;
-			}
-		  else 
-		  {
-			  UpdateBit1(prob);
-			  prob = p + IsRepG2 + state;
-			  IfBit0(prob)
-			  {
-				  UpdateBit0(prob);
-				  distance = rep2;
-			  }
-			else
-			{
-				UpdateBit1(prob);
-				distance = rep3;
-				rep3 = rep2;
-			}
-			rep2 = rep1;
-		  }
-		  rep1 = rep0;
-		  rep0 = distance;
-		}
-		state = state < kNumLitStates ? 8 : 11;
-		prob = p + RepLenCoder;
-	  }
-	  {
-		  int numBits, offset;
-		  CProb *probLen = prob + LenChoice;
-		  IfBit0(probLen)
-		  {
-			  UpdateBit0(probLen);
-			  probLen = prob + LenLow + (posState << kLenNumLowBits);
-			  offset = 0;
-			  numBits = kLenNumLowBits;
-		  }
-		else
-		{
-			UpdateBit1(probLen);
-			probLen = prob + LenChoice2;
-			IfBit0(probLen)
-			{
-				UpdateBit0(probLen);
-				probLen = prob + LenMid + (posState << kLenNumMidBits);
-				offset = kLenNumLowSymbols;
-				numBits = kLenNumMidBits;
-			}
-		  else
-		  {
-			  UpdateBit1(probLen);
-			  probLen = prob + LenHigh;
-			  offset = kLenNumLowSymbols + kLenNumMidSymbols;
-			  numBits = kLenNumHighBits;
-		  }
-		}
-		RangeDecoderBitTreeDecode(probLen, numBits, len);
-		len += offset;
-	  }
-
-	  if (state < 4)
-	  {
-		  int posSlot;
-		  state += kNumLitStates;
-		  prob = p + PosSlot +
-			  ((len < kNumLenToPosStates ? len : kNumLenToPosStates - 1) << 
-			  kNumPosSlotBits);
-		  RangeDecoderBitTreeDecode(prob, kNumPosSlotBits, posSlot);
-		  if (posSlot >= kStartPosModelIndex)
-		  {
-			  int numDirectBits = ((posSlot >> 1) - 1);
-			  rep0 = (2 | ((UInt32)posSlot & 1));
-			  if (posSlot < kEndPosModelIndex)
-			  {
-				  rep0 <<= numDirectBits;
-				  prob = p + SpecPos + rep0 - posSlot - 1;
-			  }
-			  else
-			  {
-				  numDirectBits -= kNumAlignBits;
-				  do
-				  {
-					  RC_NORMALIZE
-						  Range >>= 1;
-					  rep0 <<= 1;
-					  if (Code >= Range)
-					  {
-						  Code -= Range;
-						  rep0 |= 1;
-					  }
-				  }
-				  while (--numDirectBits != 0);
-				  prob = p + Align;
-				  rep0 <<= kNumAlignBits;
-				  numDirectBits = kNumAlignBits;
-			  }
-			  {
-				  int i = 1;
-				  int mi = 1;
-				  do
-				  {
-					  CProb *prob3 = prob + mi;
-					  RC_GET_BIT2(prob3, mi, ; , rep0 |= i);
-					  i <<= 1;
-				  }
-				  while(--numDirectBits != 0);
-			  }
-		  }
-		  else
-			  rep0 = posSlot;
-		  if (++rep0 == (UInt32)(0))
-		  {
-			  /* it's for stream version */
-			  len = kLzmaStreamWasFinishedId;
-			  break;
-		  }
-	  }
-
-	  len += kMatchMinLen;
-#ifdef _LZMA_OUT_READ
-	  if (rep0 > distanceLimit) 
-#else
-	  if (rep0 > nowPos)
-#endif
-		  return LZMA_RESULT_DATA_ERROR;
+	LZMAParallelJob_t job;
+	job.m_pInput = pInput;
+	job.m_pOutput = pOutput;
+	job.m_nChunks = numChunks;
+	job.m_nNextChunk = 0;
+	job.m_bFailed = false;
 
-#ifdef _LZMA_OUT_READ
-	  if (dictionarySize - distanceLimit > (UInt32)len)
-		  distanceLimit += len;
-	  else
-		  distanceLimit = dictionarySize;
-#endif
+	int nThreads = MIN( GetCPUInformation()->m_nLogicalProcessors, LZMA_PARALLEL_MAX_THREADS );
+	nThreads = MIN( nThreads, (int)numChunks );
+	if ( actualSize < LZMA_PARALLEL_MIN_BYTES )
+	{
+		nThreads = 1;
+	}
 
-	  do
-	  {
-#ifdef _LZMA_OUT_READ
-		  UInt32 pos = dictionaryPos - rep0;
-		  if (pos >= dictionarySize)
-			  pos += dictionarySize;
-		  previousByte = dictionary[pos];
-		  dictionary[dictionaryPos] = previousByte;
-		  if (++dictionaryPos == dictionarySize)
-			  dictionaryPos = 0;
-#else
-		  previousByte = outStream[nowPos - rep0];
-#endif
-		  len--;
-		  outStream[nowPos++] = previousByte;
-	  }
-	  while(len != 0 && nowPos < outSize);
-}
+	// This thread decodes too
+	ThreadHandle_t hThreads[LZMA_PARALLEL_MAX_THREADS];
+	int i;
+	for ( i = 1; i < nThreads; i++ )
+	{
+		hThreads[i] = CreateSimpleThread( LZMA_ParallelChunkThread, &job );
 	}
-	RC_NORMALIZE;
-
-#ifdef _LZMA_OUT_READ
-	vs->Range = Range;
-	vs->Code = Code;
-	vs->DictionaryPos = dictionaryPos;
-	vs->GlobalPos = globalPos + (UInt32)nowPos;
-	vs->DistanceLimit = distanceLimit;
-	vs->Reps[0] = rep0;
-	vs->Reps[1] = rep1;
-	vs->Reps[2] = rep2;
-	vs->Reps[3] = rep3;
-	vs->State = state;
-	vs->RemainLen = len;
-	vs->TempDictionary[0] = tempDictionary[0];
-#endif
 
-#ifdef _LZMA_IN_CB
-	vs->Buffer = Buffer;
-	vs->BufferLim = BufferLim;
-#else
-	*inSizeProcessed = (SizeT)(Buffer - inStream);
-#endif
-	*outSizeProcessed = nowPos;
-	return LZMA_RESULT_OK;
-}
+	LZMA_ParallelChunkThread( &job );
 
-//-----------------------------------------------------------------------------
-// Returns true if buffer is compressed.
-//-----------------------------------------------------------------------------
-bool CLZMA::IsCompressed( unsigned char *pInput )
-{
-	lzma_header_t *pHeader = (lzma_header_t *)pInput;
-	if ( pHeader && pHeader->id == LZMA_ID )
+	for ( i = 1; i < nThreads; i++ )
 	{
-		return true;
+		if ( hThreads[i] )
+		{
+			ThreadJoin( hThreads[i] );
+			ReleaseThreadHandle( hThreads[i] );
+		}
 	}
 
-	// unrecognized
-	return false;
-}
-
-//-----------------------------------------------------------------------------
-// Returns uncompressed size of compressed input buffer. Used for allocating output
-// buffer for decompression. Returns 0 if input buffer is not compressed.
-//-----------------------------------------------------------------------------
-unsigned int CLZMA::GetActualSize( unsigned char *pInput )
-{
-	lzma_header_t *pHeader = (lzma_header_t *)pInput;
-	if ( pHeader && pHeader->id == LZMA_ID )
+	if ( job.m_bFailed )
 	{
-		return LittleLong( pHeader->actualSize );
+		Assert( 0 );
+		return 0;
 	}
 
-	// unrecognized
-	return 0;
+	return actualSize;
 }
 
 //-----------------------------------------------------------------------------
@@ -738,6 +484,11 @@ unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 		return 0;
 	}
 
+	if ( IsChunked( pInput ) )
+	{
+		return UncompressChunked( pInput, pOutput );
+	}
+
 	CLzmaDecoderState state;
 	if ( LzmaDecodeProperties( &state.Properties, ((lzma_header_t *)pInput)->properties, LZMA_PROPERTIES_SIZE ) != LZMA_RESULT_OK )
 	{
@@ -762,3 +513,149 @@ unsigned int CLZMA::Uncompress( unsigned char *pInput, unsigned char *pOutput )
 	return outProcessed;
 }
 
+//-----------------------------------------------------------------------------
+// Streaming decoder
+//-----------------------------------------------------------------------------
+#define LZMA_STREAM_INPUT_SIZE	( 64 * 1024 )
+
+CLZMAStream::CLZMAStream() : m_pDecoderState( NULL ), m_pInputBuffer( NULL )
+{
+	Reset();
+}
+
+CLZMAStream::~CLZMAStream()
+{
+	FreeDecoder();
+	free( m_pInputBuffer );
+}
+
+void CLZMAStream::FreeDecoder()
+{
+	if ( m_pDecoderState )
+	{
+		free( m_pDecoderState->Probs );
+		free( m_pDecoderState->Dictionary );
+		delete m_pDecoderState;
+		m_pDecoderState = NULL;
+	}
+}
+
+void CLZMAStream::Reset()
+{
+	FreeDecoder();
+	m_nInputStart = 0;
+	m_nInputEnd = 0;
+	m_bHeaderParsed = false;
+	m_nActualSize = 0;
+	// Until the header is in, only take the header
+	m_nCompressedLeft = sizeof( lzma_header_t );
+	m_nOutputBytes = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Sets up the decoder from the buffered lzma_header_t
+//-----------------------------------------------------------------------------
+bool CLZMAStream::ParseHeader()
+{
+	lzma_header_t *pHeader = (lzma_header_t *)( m_pInputBuffer + m_nInputStart );
+	if ( pHeader->id != LZMA_ID )
+	{
+		// chunked containers are decoded chunk by chunk, through CLZMA
+		return false;
+	}
+
+	CLzmaDecoderState *pState = new CLzmaDecoderState;
+	memset( pState, 0, sizeof( *pState ) );
+	if ( LzmaDecodeProperties( &pState->Properties, pHeader->properties, LZMA_PROPERTIES_SIZE ) != LZMA_RESULT_OK )
+	{
+		delete pState;
+		return false;
+	}
+
+	m_nActualSize = LittleLong( pHeader->actualSize );
+	m_nCompressedLeft = LittleLong( pHeader->lzmaSize );
+
+	// Matches never reach back further than the start of the output
+	UInt32 dictionarySize = MIN( pState->Properties.DictionarySize, (UInt32)m_nActualSize );
+	pState->Properties.DictionarySize = MAX( dictionarySize, 1 );
+	pState->Probs = (CProb *)malloc( LzmaGetNumProbs( &pState->Properties ) * sizeof( CProb ) );
+	pState->Dictionary = (unsigned char *)malloc( pState->Properties.DictionarySize );
+	LzmaDecoderInit( pState );
+
+	m_pDecoderState = pState;
+	m_nInputStart += sizeof( lzma_header_t );
+	m_bHeaderParsed = true;
+	return true;
+}
+
+bool CLZMAStream::Read( unsigned char *pInput, unsigned int nMaxInputBytes,
+						unsigned char *pOutput, unsigned int nMaxOutputBytes,
+						unsigned int &nCompressedBytesRead, unsigned int &nOutputBytesWritten )
+{
+	nCompressedBytesRead = 0;
+	nOutputBytesWritten = 0;
+
+	if ( !m_pInputBuffer )
+	{
+		m_pInputBuffer = (unsigned char *)malloc( LZMA_STREAM_INPUT_SIZE );
+	}
+
+	while ( true )
+	{
+		// Move what the decoder left to the front and top up from the caller
+		if ( m_nInputStart )
+		{
+			memmove( m_pInputBuffer, m_pInputBuffer + m_nInputStart, m_nInputEnd - m_nInputStart );
+			m_nInputEnd -= m_nInputStart;
+			m_nInputStart = 0;
+		}
+
+		unsigned int nCopy = MIN( nMaxInputBytes - nCompressedBytesRead, m_nCompressedLeft );
+		nCopy = MIN( nCopy, LZMA_STREAM_INPUT_SIZE - m_nInputEnd );
+		if ( nCopy )
+		{
+			memcpy( m_pInputBuffer + m_nInputEnd, pInput + nCompressedBytesRead, nCopy );
+			m_nInputEnd += nCopy;
+			nCompressedBytesRead += nCopy;
+			m_nCompressedLeft -= nCopy;
+		}
+
+		unsigned int nAvailable = m_nInputEnd;
+		if ( !m_bHeaderParsed )
+		{
+			if ( nAvailable < sizeof( lzma_header_t ) )
+				return true;
+
+			if ( !ParseHeader() )
+				return false;
+
+			// Now that the stream size is known, take in the stream itself
+			continue;
+		}
+
+		unsigned int nOutputSize = MIN( nMaxOutputBytes - nOutputBytesWritten, m_nActualSize - m_nOutputBytes );
+		if ( !nOutputSize )
+			return true;
+
+		// Unless the whole remainder of the stream is buffered the decoder
+		// wants a symbol's worth of input, which the caller has to supply
+		m_pDecoderState->InputFinished = ( m_nCompressedLeft == 0 );
+		if ( !m_pDecoderState->InputFinished && nAvailable < LZMA_REQUIRED_INPUT_MAX )
+			return true;
+
+		SizeT inProcessed;
+		SizeT outProcessed;
+		int result = LzmaDecodeOutRead( m_pDecoderState, m_pInputBuffer, nAvailable, &inProcessed, pOutput + nOutputBytesWritten, nOutputSize, &outProcessed );
+		if ( result != LZMA_RESULT_OK )
+			return false;
+
+		// With a whole symbol buffered the decoder always gets somewhere,
+		// otherwise the stream ended early or is truncated
+		if ( !inProcessed && !outProcessed )
+			return false;
+
+		m_nInputStart = inProcessed;
+		m_nOutputBytes += outProcessed;
+		nOutputBytesWritten += outProcessed;
+	}
+}
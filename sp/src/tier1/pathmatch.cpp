@@ -55,7 +55,9 @@
 #include <utime.h>
 #include <map>
 #include <string>
+#include <vector>
 #include <time.h>
+#include <pthread.h>
 
 // Enable to do pathmatch caching. Beware: this code isn't threadsafe.
 // #define DO_PATHMATCH_CACHE
@@ -370,6 +372,142 @@ private:
 };
 
 
+// Lookup counters. Dumped to stderr at exit when PATHMATCH_STATS is set in the
+// environment.
+struct PathMatchStats_t
+{
+	uint32_t m_nLookups;				// pathmatch() calls with ENABLE_PATHMATCH set
+	uint32_t m_nUnchanged;				// path existed as supplied
+	uint32_t m_nLowered;				// path existed once lowercased
+	uint32_t m_nDescends;				// needed a directory walk
+	uint32_t m_nFailed;					// no match found
+	uint32_t m_nDirIndexHits;			// directory walk step served from the index cache
+	uint32_t m_nDirIndexBuilds;			// directory read to (re)build its index
+	uint32_t m_nDirIndexInvalidations;	// cached index was stale
+	uint32_t m_nDirentsRead;			// total entries read by readdir()
+};
+
+static PathMatchStats_t s_PathMatchStats;
+#define PATHMATCH_STAT_INC( field ) __sync_fetch_and_add( &s_PathMatchStats.field, 1 )
+
+static void SpewPathMatchStats()
+{
+	const PathMatchStats_t &stats = s_PathMatchStats;
+	fprintf( stderr, "pathmatch: %u lookups, %u unchanged, %u lowered, %u descends, %u failed\n",
+		stats.m_nLookups, stats.m_nUnchanged, stats.m_nLowered, stats.m_nDescends, stats.m_nFailed );
+	fprintf( stderr, "pathmatch: dir index %u hits, %u builds, %u invalidations, %u dirents read\n",
+		stats.m_nDirIndexHits, stats.m_nDirIndexBuilds, stats.m_nDirIndexInvalidations, stats.m_nDirentsRead );
+}
+
+// Hash of a name as strcasecmp sees it, so names that compare equal hash equal.
+static uint32_t FoldedNameHash( const char *pszName )
+{
+	uint32_t nHash = 2166136261u;
+#ifdef UTF8_PATHMATCH
+	uint32_t *pFolded = fold_utf8( pszName );
+	for ( const uint32_t *p = pFolded; *p; p++ )
+	{
+		nHash = ( nHash ^ *p ) * 16777619u;
+	}
+	delete[] pFolded;
+#else
+	for ( const char *p = pszName; *p; p++ )
+	{
+		nHash = ( nHash ^ (uint8_t)tolower( (unsigned char)*p ) ) * 16777619u;
+	}
+#endif
+	return nHash;
+}
+
+// Case folded index of a directory's entries. Descend used to readdir() every
+// directory along a mismatched path for each lookup, which is very slow when
+// loose files are being loaded; now each directory is read once and the index
+// reused for as long as the directory's inode and mtime are unchanged (any
+// create, delete or rename in a directory updates its mtime).
+struct DirIndex_t
+{
+	dev_t m_Dev;
+	ino_t m_Ino;
+	struct timespec m_MTime;
+	std::multimap<uint32_t, std::string> m_Names;
+};
+
+typedef std::map<std::string, DirIndex_t> dirIndexCache_t;
+static dirIndexCache_t s_DirIndexCache;
+static pthread_mutex_t s_DirIndexMutex = PTHREAD_MUTEX_INITIALIZER;
+static const size_t k_cMaxCachedDirIndexes = 4096;
+
+static bool DirIndexIsCurrent( const DirIndex_t &index, const struct stat &st )
+{
+	return index.m_Dev == st.st_dev && index.m_Ino == st.st_ino &&
+		index.m_MTime.tv_sec == st.st_mtim.tv_sec && index.m_MTime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+// Fills candidates with the entries in pszDir that match pszComponent case
+// insensitively but not exactly, in readdir order.
+static void GetCaseMismatchedEntries( const char *pszDir, const char *pszComponent, std::vector<std::string> &candidates )
+{
+	CDirPtr spDir( __real_opendir( pszDir ) );
+	if ( !spDir )
+		return;
+
+	// fstat rather than stat so we don't come back through the wrapped stat
+	struct stat st;
+	if ( fstat( dirfd( spDir ), &st ) != 0 )
+		return;
+
+	pthread_mutex_lock( &s_DirIndexMutex );
+	dirIndexCache_t::iterator it = s_DirIndexCache.find( pszDir );
+	if ( it == s_DirIndexCache.end() || !DirIndexIsCurrent( it->second, st ) )
+	{
+		if ( it != s_DirIndexCache.end() )
+		{
+			PATHMATCH_STAT_INC( m_nDirIndexInvalidations );
+		}
+		pthread_mutex_unlock( &s_DirIndexMutex );
+
+		// Read the directory without holding the lock. st was taken before reading,
+		// so if the directory changes underneath us the index is simply rebuilt next time.
+		DirIndex_t index;
+		index.m_Dev = st.st_dev;
+		index.m_Ino = st.st_ino;
+		index.m_MTime = st.st_mtim;
+		while ( struct dirent *pEntry = readdir( spDir ) )
+		{
+			PATHMATCH_STAT_INC( m_nDirentsRead );
+			index.m_Names.insert( std::make_pair( FoldedNameHash( pEntry->d_name ), std::string( pEntry->d_name ) ) );
+		}
+		PATHMATCH_STAT_INC( m_nDirIndexBuilds );
+
+		pthread_mutex_lock( &s_DirIndexMutex );
+		if ( s_DirIndexCache.size() >= k_cMaxCachedDirIndexes )
+		{
+			s_DirIndexCache.clear();
+		}
+		it = s_DirIndexCache.insert( std::make_pair( std::string( pszDir ), DirIndex_t() ) ).first;
+		it->second = index;
+	}
+	else
+	{
+		PATHMATCH_STAT_INC( m_nDirIndexHits );
+	}
+
+	typedef std::multimap<uint32_t, std::string>::const_iterator nameItr_t;
+	std::pair<nameItr_t, nameItr_t> range = it->second.m_Names.equal_range( FoldedNameHash( pszComponent ) );
+	for ( nameItr_t itName = range.first; itName != range.second; ++itName )
+	{
+		// the candidate must match the target, but not be a case-identical match (we would
+		// have looked there in the short-circuit code in Descend, so don't look again)
+		const char *pszName = itName->second.c_str();
+		if ( strcasecmp( pszComponent, pszName ) == 0 && strcmp( pszComponent, pszName ) != 0 )
+		{
+			candidates.push_back( itName->second );
+		}
+	}
+	pthread_mutex_unlock( &s_DirIndexMutex );
+}
+
+
 enum PathMod_t
 {
 	kPathUnchanged,
@@ -411,58 +549,48 @@ static bool Descend( char *pPath, size_t nStartIdx, bool bAllowBasenameMismatch,
 			return true;
 	}
 
-	// Start enumerating dirents
-	CDirPtr spDir;
+	// Look up the dirents that match the component
+	std::string dir;
 	if ( nStartIdx )
 	{
 		// we have a path
-		spDir = __real_opendir( CDirTrimmer( pPath, nStartIdx ) );
+		dir.assign( pPath, nStartIdx );
 		nStartIdx++;
 	}
 	else
 	{
 		// we either start at root or cwd
-		const char *pRoot = ".";
+		dir = ".";
 		if ( *pPath == '/' )
 		{
-		    pRoot = "/";
+		    dir = "/";
 		    nStartIdx++;
 		}
-		spDir = __real_opendir( pRoot );
 	}
 
-    errno = 0;
-    struct dirent *pEntry = spDir ? readdir( spDir ) : NULL;
     char *pszComponent = pPath + nStartIdx;
     size_t cbComponent = nNextSlash - nStartIdx;
-    while ( pEntry )
+    std::vector<std::string> candidates;
+    GetCaseMismatchedEntries( dir.c_str(), CDirTrimmer(pszComponent, cbComponent), candidates );
+    for ( size_t iCandidate = 0; iCandidate < candidates.size(); iCandidate++ )
     {
-        DEBUG_MSG( "\t(%zu) comparing %s with %s\n", nLevel, pEntry->d_name, (const char *)CDirTrimmer(pszComponent, cbComponent) );
+        DEBUG_MSG( "\t(%zu) matched %s with %s\n", nLevel, candidates[iCandidate].c_str(), (const char *)CDirTrimmer(pszComponent, cbComponent) );
 
-        // the candidate must match the target, but not be a case-identical match (we would
-        // have looked there in the short-circuit code above, so don't look again)
-        bool bMatches = ( strcasecmp( CDirTrimmer(pszComponent, cbComponent), pEntry->d_name ) == 0 &&
-                          strcmp( CDirTrimmer(pszComponent, cbComponent), pEntry->d_name ) != 0 );
-
-        if ( bMatches )
+        const char *pSrc = candidates[iCandidate].c_str();
+        char *pDst = &pPath[nStartIdx];
+        // found a match; copy it in.
+        while ( *pSrc && (*pSrc != '/') )
         {
-            char *pSrc = pEntry->d_name;
-            char *pDst = &pPath[nStartIdx];
-            // found a match; copy it in.
-            while ( *pSrc && (*pSrc != '/') )
-            {
-                *pDst++ = *pSrc++;
-            }
+            *pDst++ = *pSrc++;
+        }
 
-            if ( !bIsDir )
-                return true;
+        if ( !bIsDir )
+            return true;
 
-            if ( Descend( pPath, nNextSlash, bAllowBasenameMismatch, nLevel+1 ) )
-                return true;
+        if ( Descend( pPath, nNextSlash, bAllowBasenameMismatch, nLevel+1 ) )
+            return true;
 
-            // If descend fails, try more directories
-        }
-        pEntry = readdir( spDir );
+        // If descend fails, try more directories
     }
 
     if ( bIsDir )
@@ -501,10 +629,17 @@ PathMod_t pathmatch( const char *pszIn, char **ppszOut, bool bAllowBasenameMisma
 
 	s_bShowDiag = ( s_pszDbgPathMatch != NULL );
 
+	static bool s_bSpewStats = ( getenv( "PATHMATCH_STATS" ) != NULL && atexit( SpewPathMatchStats ) == 0 );
+	(void)s_bSpewStats;
+
 	*ppszOut = NULL;
 
+	PATHMATCH_STAT_INC( m_nLookups );
 	if ( __real_access( pszIn, F_OK ) == 0 )
+	{
+		PATHMATCH_STAT_INC( m_nUnchanged );
 		return kPathUnchanged;
+	}
 
 #ifdef DO_PATHMATCH_CACHE
 	resultCacheItr_t cachedResult = resultCache.find( pszIn );
@@ -591,6 +726,7 @@ PathMod_t pathmatch( const char *pszIn, char **ppszOut, bool bAllowBasenameMisma
 		{
 			*ppszOut = pPath;
 			DEBUG_MSG( "Lowered '%s' -> '%s'\n", pszIn, pPath );
+			PATHMATCH_STAT_INC( m_nLowered );
 			return kPathLowered;
 		}
 
@@ -611,6 +747,7 @@ PathMod_t pathmatch( const char *pszIn, char **ppszOut, bool bAllowBasenameMisma
 			DEBUG_BREAK();
 		}
 
+		PATHMATCH_STAT_INC( m_nDescends );
 		bool bSuccess = Descend( pPath, 0, bAllowBasenameMismatch );
 		if ( bSuccess )
 		{
@@ -619,6 +756,7 @@ PathMod_t pathmatch( const char *pszIn, char **ppszOut, bool bAllowBasenameMisma
 		}
 		else
 		{
+			PATHMATCH_STAT_INC( m_nFailed );
 			DEBUG_MSG( "Unmatched %s\n", pszIn );
 		}
 
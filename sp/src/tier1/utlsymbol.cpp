@@ -15,6 +15,7 @@
 #include "stringpool.h"
 #include "utlhashtable.h"
 #include "utlstring.h"
+#include "tier1/utlcommon.h"
 
 // Ensure that everybody has the right compiler version installed. The version
 // number can be obtained by looking at the compiler output when you type 'cl'
@@ -36,8 +37,6 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
-#define INVALID_STRING_INDEX CStringPoolIndex( 0xFFFF, 0xFFFF )
-
 #define MIN_STRING_POOL_SIZE	2048
 
 //-----------------------------------------------------------------------------
@@ -126,37 +125,20 @@ bool CUtlSymbol::operator==( const char* pStr ) const
 // symbol table stuff
 //-----------------------------------------------------------------------------
 
-inline const char* CUtlSymbolTable::StringFromIndex( const CStringPoolIndex &index ) const
+inline unsigned int CUtlSymbolTable::HashString( const char *pString ) const
 {
-	Assert( index.m_iPool < m_StringPools.Count() );
-	Assert( index.m_iOffset < m_StringPools[index.m_iPool]->m_TotalLen );
-
-	return &m_StringPools[index.m_iPool]->m_Data[index.m_iOffset];
+	return m_bInsensitive ? CaselessStringHashFunctor()( pString ) : StringHashFunctor()( pString );
 }
 
+inline bool CUtlSymbolTable::StringsMatch( const char *pString1, const char *pString2 ) const
+{
+	return m_bInsensitive ? ( V_stricmp( pString1, pString2 ) == 0 ) : ( V_strcmp( pString1, pString2 ) == 0 );
+}
 
-bool CUtlSymbolTable::CLess::operator()( const CStringPoolIndex &i1, const CStringPoolIndex &i2 ) const
+inline const CUtlSymbolTable::SymbolEntry_t &CUtlSymbolTable::Entry( UtlSymId_t id ) const
 {
-	// Need to do pointer math because CUtlSymbolTable is used in CUtlVectors, and hence
-	// can be arbitrarily moved in memory on a realloc. Yes, this is portable. In reality,
-	// right now at least, because m_LessFunc is the first member of CUtlRBTree, and m_Lookup
-	// is the first member of CUtlSymbolTabke, this == pTable
-	CUtlSymbolTable *pTable = (CUtlSymbolTable *)( (byte *)this - offsetof(CUtlSymbolTable::CTree, m_LessFunc) ) - offsetof(CUtlSymbolTable, m_Lookup );
-	const char* str1 = (i1 == INVALID_STRING_INDEX) ? pTable->m_pUserSearchString :
-													  pTable->StringFromIndex( i1 );
-	const char* str2 = (i2 == INVALID_STRING_INDEX) ? pTable->m_pUserSearchString :
-													  pTable->StringFromIndex( i2 );
-
-	if ( !str1 && str2 )
-		return false;
-	if ( !str2 && str1 )
-		return true;
-	if ( !str1 && !str2 )
-		return false;
-	if ( !pTable->m_bInsensitive )
-		return V_strcmp( str1, str2 ) < 0;
-	else
-		return V_stricmp( str1, str2 ) < 0;
+	Assert( id < m_nSymbols );
+	return m_pSymbolSegments[ id >> SYMBOL_SEGMENT_BITS ][ id & ( SYMBOL_SEGMENT_SIZE - 1 ) ];
 }
 
 
@@ -164,8 +146,9 @@ bool CUtlSymbolTable::CLess::operator()( const CStringPoolIndex &i1, const CStri
 // constructor, destructor
 //-----------------------------------------------------------------------------
 CUtlSymbolTable::CUtlSymbolTable( int growSize, int initSize, bool caseInsensitive ) : 
-	m_Lookup( growSize, initSize ), m_bInsensitive( caseInsensitive ), m_StringPools( 8 )
+	m_nSymbols( 0 ), m_pLookup( NULL ), m_nInitSize( initSize ), m_bInsensitive( caseInsensitive ), m_StringPools( 8 )
 {
+	memset( (void *)m_pSymbolSegments, 0, sizeof( m_pSymbolSegments ) );
 }
 
 CUtlSymbolTable::~CUtlSymbolTable()
@@ -179,35 +162,86 @@ CUtlSymbol CUtlSymbolTable::Find( const char* pString ) const
 {	
 	if (!pString)
 		return CUtlSymbol();
-	
-	// Store a special context used to help with insertion
-	m_pUserSearchString = pString;
-	
-	// Passing this special invalid symbol makes the comparison function
-	// use the string passed in the context
-	UtlSymId_t idx = m_Lookup.Find( INVALID_STRING_INDEX );
 
-#ifdef _DEBUG
-	m_pUserSearchString = NULL;
-#endif
+	// The table pointer is read once; if a writer swaps in a bigger one we just
+	// finish the probe in the old one, which stays valid.
+	const LookupTable_t *pLookup = m_pLookup;
+	if ( !pLookup )
+		return CUtlSymbol();
 
-	return CUtlSymbol( idx );
+	unsigned int nHash = HashString( pString );
+	for ( unsigned int i = nHash & pLookup->m_nMask; ; i = ( i + 1 ) & pLookup->m_nMask )
+	{
+		UtlSymId_t id = pLookup->m_Slots[i];
+		if ( id == UTL_INVAL_SYMBOL )
+			return CUtlSymbol();
+
+		const SymbolEntry_t &entry = Entry( id );
+		if ( entry.m_nHash == nHash && StringsMatch( entry.m_pString, pString ) )
+			return CUtlSymbol( id );
+	}
 }
 
 
-int CUtlSymbolTable::FindPoolWithSpace( int len )	const
+//-----------------------------------------------------------------------------
+// Copies a string into the current pool, starting a new pool if it doesn't fit.
+// Only the newest pool is filled; scanning all of them for space made adding
+// strings O(pools).
+//-----------------------------------------------------------------------------
+const char *CUtlSymbolTable::CopyToPool( const char *pString, int len )
 {
-	for ( int i=0; i < m_StringPools.Count(); i++ )
+	StringPool_t *pPool = m_StringPools.Count() ? m_StringPools.Tail() : NULL;
+	if ( !pPool || ( pPool->m_TotalLen - pPool->m_SpaceUsed ) < len )
 	{
-		StringPool_t *pPool = m_StringPools[i];
+		// Add a new pool.
+		int newPoolSize = max( len, MIN_STRING_POOL_SIZE );
+		pPool = (StringPool_t*)malloc( sizeof( StringPool_t ) + newPoolSize - 1 );
+		pPool->m_TotalLen = newPoolSize;
+		pPool->m_SpaceUsed = 0;
+		m_StringPools.AddToTail( pPool );
+	}
 
-		if ( (pPool->m_TotalLen - pPool->m_SpaceUsed) >= len )
+	char *pDest = &pPool->m_Data[pPool->m_SpaceUsed];
+	memcpy( pDest, pString, len );
+	pPool->m_SpaceUsed += len;
+	return pDest;
+}
+
+
+//-----------------------------------------------------------------------------
+// Replaces the lookup table with one twice the size. The old table is kept
+// until RemoveAll since lock-free readers may still be probing it.
+//-----------------------------------------------------------------------------
+void CUtlSymbolTable::GrowLookup()
+{
+	unsigned int nSlots = m_pLookup ? ( m_pLookup->m_nMask + 1 ) * 2 : 16;
+	while ( nSlots < (unsigned int)m_nInitSize * 2 )
+	{
+		nSlots *= 2;
+	}
+
+	LookupTable_t *pLookup = (LookupTable_t *)malloc( sizeof( LookupTable_t ) + ( nSlots - 1 ) * sizeof( UtlSymId_t ) );
+	pLookup->m_nMask = nSlots - 1;
+	memset( pLookup->m_Slots, 0xFF, nSlots * sizeof( UtlSymId_t ) );
+
+	for ( int id = 0; id < m_nSymbols; ++id )
+	{
+		unsigned int i = Entry( id ).m_nHash & pLookup->m_nMask;
+		while ( pLookup->m_Slots[i] != UTL_INVAL_SYMBOL )
 		{
-			return i;
+			i = ( i + 1 ) & pLookup->m_nMask;
 		}
+		pLookup->m_Slots[i] = (UtlSymId_t)id;
 	}
 
-	return -1;
+	// Publish the filled table
+	ThreadMemoryBarrier();
+	LookupTable_t *pOldLookup = m_pLookup;
+	if ( pOldLookup )
+	{
+		m_RetiredLookups.AddToTail( pOldLookup );
+	}
+	m_pLookup = pLookup;
 }
 
 
@@ -225,37 +259,44 @@ CUtlSymbol CUtlSymbolTable::AddString( const char* pString )
 	if (id.IsValid())
 		return id;
 
-	int len = strlen(pString) + 1;
+	// UTL_INVAL_SYMBOL is the last id, so one less than that fits
+	int nId = m_nSymbols;
+	if ( nId >= UTL_INVAL_SYMBOL )
+	{
+		Assert( !"CUtlSymbolTable is full" );
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+	}
 
-	// Find a pool with space for this string, or allocate a new one.
-	int iPool = FindPoolWithSpace( len );
-	if ( iPool == -1 )
+	// Keep the table at most 3/4 full so probes stay short
+	if ( !m_pLookup || ( nId + 1 ) * 4 > (int)( m_pLookup->m_nMask + 1 ) * 3 )
 	{
-		// Add a new pool.
-		int newPoolSize = max( len, MIN_STRING_POOL_SIZE );
-		StringPool_t *pPool = (StringPool_t*)malloc( sizeof( StringPool_t ) + newPoolSize - 1 );
-		pPool->m_TotalLen = newPoolSize;
-		pPool->m_SpaceUsed = 0;
-		iPool = m_StringPools.AddToTail( pPool );
+		GrowLookup();
 	}
 
-	// Copy the string in.
-	StringPool_t *pPool = m_StringPools[iPool];
-	Assert( pPool->m_SpaceUsed < 0xFFFF );	// This should never happen, because if we had a string > 64k, it
-											// would have been given its entire own pool.
-	
-	unsigned short iStringOffset = pPool->m_SpaceUsed;
+	// Fill in the entry for the new id, then make it visible through the lookup table
+	SymbolEntry_t *pSegment = m_pSymbolSegments[ nId >> SYMBOL_SEGMENT_BITS ];
+	if ( !pSegment )
+	{
+		pSegment = (SymbolEntry_t *)malloc( SYMBOL_SEGMENT_SIZE * sizeof( SymbolEntry_t ) );
+		m_pSymbolSegments[ nId >> SYMBOL_SEGMENT_BITS ] = pSegment;
+	}
 
-	memcpy( &pPool->m_Data[pPool->m_SpaceUsed], pString, len );
-	pPool->m_SpaceUsed += len;
+	int len = strlen(pString) + 1;
+	SymbolEntry_t &entry = pSegment[ nId & ( SYMBOL_SEGMENT_SIZE - 1 ) ];
+	entry.m_pString = CopyToPool( pString, len );
+	entry.m_nHash = HashString( pString );
+	m_nSymbols = nId + 1;
 
-	// didn't find, insert the string into the vector.
-	CStringPoolIndex index;
-	index.m_iPool = iPool;
-	index.m_iOffset = iStringOffset;
+	unsigned int i = entry.m_nHash & m_pLookup->m_nMask;
+	while ( m_pLookup->m_Slots[i] != UTL_INVAL_SYMBOL )
+	{
+		i = ( i + 1 ) & m_pLookup->m_nMask;
+	}
+
+	ThreadMemoryBarrier();
+	m_pLookup->m_Slots[i] = (UtlSymId_t)nId;
 
-	UtlSymId_t idx = m_Lookup.Insert( index );
-	return CUtlSymbol( idx );
+	return CUtlSymbol( (UtlSymId_t)nId );
 }
 
 
@@ -268,8 +309,8 @@ const char* CUtlSymbolTable::String( CUtlSymbol id ) const
 	if (!id.IsValid()) 
 		return "";
 	
-	Assert( m_Lookup.IsValidIndex((UtlSymId_t)id) );
-	return StringFromIndex( m_Lookup[id] );
+	Assert( (UtlSymId_t)id < m_nSymbols );
+	return Entry( id ).m_pString;
 }
 
 
@@ -279,7 +320,19 @@ const char* CUtlSymbolTable::String( CUtlSymbol id ) const
 
 void CUtlSymbolTable::RemoveAll()
 {
-	m_Lookup.Purge();
+	m_nSymbols = 0;
+
+	free( m_pLookup );
+	m_pLookup = NULL;
+	for ( int i = 0; i < m_RetiredLookups.Count(); i++ )
+		free( m_RetiredLookups[i] );
+	m_RetiredLookups.Purge();
+
+	for ( int i = 0; i < SYMBOL_SEGMENT_COUNT; i++ )
+	{
+		free( m_pSymbolSegments[i] );
+		m_pSymbolSegments[i] = NULL;
+	}
 	
 	for ( int i=0; i < m_StringPools.Count(); i++ )
 		free( m_StringPools[i] );
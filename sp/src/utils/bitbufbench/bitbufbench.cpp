@@ -0,0 +1,583 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Measures bf_write/bf_read throughput on entity deltas laid out
+//			like the DT_BaseEntity / DT_BasePlayer send tables, comparing
+//			the single-value calls against the batched ones, and checks
+//			that both produce the same bits.
+//
+// $NoKeywords: $
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "tier0/platform.h"
+#include "tier1/bitbuf.h"
+#include "tier1/strtools.h"
+#include "mathlib/vector.h"
+#include "const.h"
+
+#define DEFAULT_ENTITY_COUNT	256
+#define DEFAULT_TICK_COUNT		64
+#define BUFFER_SIZE				( 4 * 1024 * 1024 )
+#define MAX_ARRAY_ELEMENTS		32
+
+void Usage( void )
+{
+	printf( "Usage: bitbufbench [-ents <count>] [-ticks <count>] [-reps <count>]\n" );
+	exit( -1 );
+}
+
+static unsigned int s_nSeed = 0x12345678;
+
+static unsigned int RandomInt()
+{
+	s_nSeed = s_nSeed * 1664525 + 1013904223;
+	return s_nSeed >> 8;
+}
+
+static float RandomFloat( float flMin, float flMax )
+{
+	return flMin + ( flMax - flMin ) * ( RandomInt() & 0xFFFF ) / 65535.0f;
+}
+
+//-----------------------------------------------------------------------------
+// Send table description. Each entry is encoded the way the matching
+// SendProp flags encode it (SPROP_COORD vectors as three bit coords,
+// SPROP_VARINT arrays as varints, and so on).
+//-----------------------------------------------------------------------------
+enum BenchPropType_t
+{
+	BENCHPROP_INT,			// SendPropInt with a fixed bit count
+	BENCHPROP_VARINT,		// SendPropInt with SPROP_VARINT
+	BENCHPROP_VARINT_ARRAY,	// SendPropArray3 of SPROP_VARINT ints
+	BENCHPROP_COORD,		// SendPropFloat with SPROP_COORD
+	BENCHPROP_VECTOR_COORD,	// SendPropVector with SPROP_COORD
+	BENCHPROP_VECTOR_NORMAL,// SendPropVector with SPROP_NORMAL
+	BENCHPROP_NOSCALE,		// SendPropFloat with SPROP_NOSCALE
+};
+
+struct BenchProp_t
+{
+	const char		*m_pName;
+	BenchPropType_t	m_Type;
+	int				m_nBits;		// BENCHPROP_INT only
+	int				m_nElements;	// BENCHPROP_VARINT_ARRAY only
+	bool			m_bChangesOften;
+};
+
+static const BenchProp_t s_Props[] =
+{
+	// DT_BaseEntity
+	{ "m_flSimulationTime",		BENCHPROP_INT,				8,							0,				true },
+	{ "m_vecOrigin",			BENCHPROP_VECTOR_COORD,		0,							0,				true },
+	{ "m_ubInterpolationFrame",	BENCHPROP_INT,				2,							0,				false },
+	{ "m_nModelIndex",			BENCHPROP_INT,				SP_MODEL_INDEX_BITS,		0,				false },
+	{ "m_nRenderFX",			BENCHPROP_INT,				8,							0,				false },
+	{ "m_fEffects",				BENCHPROP_INT,				10,							0,				false },
+	{ "m_clrRender",			BENCHPROP_INT,				32,							0,				false },
+	{ "m_iTeamNum",				BENCHPROP_INT,				6,							0,				false },
+	{ "m_flElasticity",			BENCHPROP_COORD,			0,							0,				false },
+	{ "m_hOwnerEntity",			BENCHPROP_INT,				NUM_NETWORKED_EHANDLE_BITS,	0,				false },
+	{ "moveparent",				BENCHPROP_INT,				NUM_NETWORKED_EHANDLE_BITS,	0,				false },
+	{ "m_angRotation",			BENCHPROP_VECTOR_COORD,		0,							0,				true },
+
+	// DT_BasePlayer
+	{ "m_iHealth",				BENCHPROP_VARINT,			0,							0,				true },
+	{ "m_fFlags",				BENCHPROP_INT,				PLAYER_FLAG_BITS,			0,				true },
+	{ "m_hGroundEntity",		BENCHPROP_INT,				NUM_NETWORKED_EHANDLE_BITS,	0,				true },
+
+	// DT_LocalPlayerExclusive
+	{ "m_iAmmo",				BENCHPROP_VARINT_ARRAY,		0,							MAX_ARRAY_ELEMENTS, false },
+	{ "m_nTickBase",			BENCHPROP_VARINT,			0,							0,				true },
+	{ "m_vecVelocity",			BENCHPROP_NOSCALE,			0,							0,				true },
+	{ "m_vecBaseVelocity",		BENCHPROP_VECTOR_COORD,		0,							0,				false },
+	{ "m_vecConstraintCenter",	BENCHPROP_VECTOR_COORD,		0,							0,				false },
+	{ "m_vecLadderNormal",		BENCHPROP_VECTOR_NORMAL,	0,							0,				false },
+};
+
+#define NUM_PROPS ARRAYSIZE( s_Props )
+
+struct BenchPropValue_t
+{
+	Vector	m_vec;
+	float	m_fl;
+	uint32	m_nInt;
+	uint32	m_Array[MAX_ARRAY_ELEMENTS];
+};
+
+// One entity's changed props for one tick
+struct BenchDelta_t
+{
+	int					m_nChanged;
+	int					m_Changed[NUM_PROPS];
+	BenchPropValue_t	m_Values[NUM_PROPS];
+};
+
+static void BuildDelta( BenchDelta_t &delta )
+{
+	delta.m_nChanged = 0;
+	for ( int i = 0; i < NUM_PROPS; ++i )
+	{
+		const BenchProp_t &prop = s_Props[i];
+		if ( ( RandomInt() % 100 ) >= ( prop.m_bChangesOften ? 90u : 10u ) )
+			continue;
+
+		delta.m_Changed[ delta.m_nChanged++ ] = i;
+		BenchPropValue_t &value = delta.m_Values[i];
+		switch ( prop.m_Type )
+		{
+		case BENCHPROP_INT:
+			value.m_nInt = RandomInt() & ( prop.m_nBits < 32 ? ( 1u << prop.m_nBits ) - 1 : ~0u );
+			break;
+		case BENCHPROP_VARINT:
+			value.m_nInt = RandomInt() >> ( RandomInt() % 24 );
+			break;
+		case BENCHPROP_VARINT_ARRAY:
+			for ( int j = 0; j < prop.m_nElements; ++j )
+				value.m_Array[j] = RandomInt() % 256;
+			break;
+		case BENCHPROP_COORD:
+		case BENCHPROP_NOSCALE:
+			value.m_fl = RandomFloat( -4096.0f, 4096.0f );
+			break;
+		case BENCHPROP_VECTOR_COORD:
+			value.m_vec.Init( RandomFloat( -16384.0f, 16384.0f ), RandomFloat( -16384.0f, 16384.0f ), ( RandomInt() & 1 ) ? 0.0f : RandomFloat( -512.0f, 512.0f ) );
+			break;
+		case BENCHPROP_VECTOR_NORMAL:
+			value.m_vec.Init( RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ), 0.0f );
+			value.m_vec.NormalizeInPlace();
+			break;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Delta encoding: changed prop indices go out as UBitVar deltas, each
+// followed by the value. The batched path hands vectors and arrays to the
+// array calls instead of writing one component at a time.
+//-----------------------------------------------------------------------------
+static void WriteDelta( bf_write &buf, const BenchDelta_t &delta, bool bBatched )
+{
+	int iLast = -1;
+	for ( int i = 0; i < delta.m_nChanged; ++i )
+	{
+		int iProp = delta.m_Changed[i];
+		const BenchProp_t &prop = s_Props[iProp];
+		const BenchPropValue_t &value = delta.m_Values[iProp];
+
+		buf.WriteUBitVar( iProp - iLast - 1 );
+		iLast = iProp;
+
+		switch ( prop.m_Type )
+		{
+		case BENCHPROP_INT:
+			buf.WriteUBitLong( value.m_nInt, prop.m_nBits );
+			break;
+		case BENCHPROP_VARINT:
+			buf.WriteVarInt32( value.m_nInt );
+			break;
+		case BENCHPROP_VARINT_ARRAY:
+			if ( bBatched )
+			{
+				buf.WriteVarInt32s( value.m_Array, prop.m_nElements );
+			}
+			else
+			{
+				for ( int j = 0; j < prop.m_nElements; ++j )
+					buf.WriteVarInt32( value.m_Array[j] );
+			}
+			break;
+		case BENCHPROP_COORD:
+			buf.WriteBitCoord( value.m_fl );
+			break;
+		case BENCHPROP_VECTOR_COORD:
+			if ( bBatched )
+			{
+				buf.WriteBitCoords( value.m_vec.Base(), 3 );
+			}
+			else
+			{
+				buf.WriteBitCoord( value.m_vec.x );
+				buf.WriteBitCoord( value.m_vec.y );
+				buf.WriteBitCoord( value.m_vec.z );
+			}
+			break;
+		case BENCHPROP_VECTOR_NORMAL:
+			if ( bBatched )
+			{
+				buf.WriteBitVec3Normals( &value.m_vec, 1 );
+			}
+			else
+			{
+				buf.WriteBitVec3Normal( value.m_vec );
+			}
+			break;
+		case BENCHPROP_NOSCALE:
+			buf.WriteBitFloat( value.m_fl );
+			break;
+		}
+	}
+
+	// Terminator
+	buf.WriteUBitVar( NUM_PROPS - iLast - 1 );
+}
+
+static void ReadDelta( bf_read &buf, BenchDelta_t &delta, bool bBatched )
+{
+	delta.m_nChanged = 0;
+	int iProp = -1;
+	while ( true )
+	{
+		iProp += buf.ReadUBitVar() + 1;
+		if ( iProp >= NUM_PROPS || buf.IsOverflowed() )
+			break;
+
+		const BenchProp_t &prop = s_Props[iProp];
+		BenchPropValue_t &value = delta.m_Values[iProp];
+		delta.m_Changed[ delta.m_nChanged++ ] = iProp;
+
+		switch ( prop.m_Type )
+		{
+		case BENCHPROP_INT:
+			value.m_nInt = buf.ReadUBitLong( prop.m_nBits );
+			break;
+		case BENCHPROP_VARINT:
+			value.m_nInt = buf.ReadVarInt32();
+			break;
+		case BENCHPROP_VARINT_ARRAY:
+			if ( bBatched )
+			{
+				buf.ReadVarInt32s( value.m_Array, prop.m_nElements );
+			}
+			else
+			{
+				for ( int j = 0; j < prop.m_nElements; ++j )
+					value.m_Array[j] = buf.ReadVarInt32();
+			}
+			break;
+		case BENCHPROP_COORD:
+			value.m_fl = buf.ReadBitCoord();
+			break;
+		case BENCHPROP_VECTOR_COORD:
+			if ( bBatched )
+			{
+				buf.ReadBitCoords( value.m_vec.Base(), 3 );
+			}
+			else
+			{
+				value.m_vec.x = buf.ReadBitCoord();
+				value.m_vec.y = buf.ReadBitCoord();
+				value.m_vec.z = buf.ReadBitCoord();
+			}
+			break;
+		case BENCHPROP_VECTOR_NORMAL:
+			if ( bBatched )
+			{
+				buf.ReadBitVec3Normals( &value.m_vec, 1 );
+			}
+			else
+			{
+				buf.ReadBitVec3Normal( value.m_vec );
+			}
+			break;
+		case BENCHPROP_NOSCALE:
+			value.m_fl = buf.ReadBitFloat();
+			break;
+		}
+	}
+}
+
+static bool DeltasMatch( const BenchDelta_t &a, const BenchDelta_t &b )
+{
+	if ( a.m_nChanged != b.m_nChanged )
+		return false;
+
+	for ( int i = 0; i < a.m_nChanged; ++i )
+	{
+		int iProp = a.m_Changed[i];
+		if ( iProp != b.m_Changed[i] )
+			return false;
+
+		const BenchPropValue_t &va = a.m_Values[iProp];
+		const BenchPropValue_t &vb = b.m_Values[iProp];
+		switch ( s_Props[iProp].m_Type )
+		{
+		case BENCHPROP_INT:
+		case BENCHPROP_VARINT:
+			if ( va.m_nInt != vb.m_nInt )
+				return false;
+			break;
+		case BENCHPROP_VARINT_ARRAY:
+			if ( memcmp( va.m_Array, vb.m_Array, s_Props[iProp].m_nElements * sizeof( uint32 ) ) )
+				return false;
+			break;
+		case BENCHPROP_COORD:
+		case BENCHPROP_NOSCALE:
+			if ( va.m_fl != vb.m_fl )
+				return false;
+			break;
+		case BENCHPROP_VECTOR_COORD:
+		case BENCHPROP_VECTOR_NORMAL:
+			if ( va.m_vec != vb.m_vec )
+				return false;
+			break;
+		}
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Bulk arrays, for the raw cost of each encoding
+//-----------------------------------------------------------------------------
+#define BULK_COUNT	65536
+
+static float s_BulkCoords[BULK_COUNT];
+static Vector s_BulkVectors[BULK_COUNT];
+static Vector s_BulkNormals[BULK_COUNT];
+static uint32 s_BulkVarInts[BULK_COUNT];
+
+static float s_ReadCoords[BULK_COUNT];
+static Vector s_ReadVectors[BULK_COUNT];
+static uint32 s_ReadVarInts[BULK_COUNT];
+
+static void TimeBulk( const char *pName, unsigned char *pBuffer, unsigned char *pCompare, int nReps,
+	void (*pfnWrite)( bf_write &, bool ), void (*pfnRead)( bf_read &, bool ) )
+{
+	double flTimes[2][2];
+	int nBits[2];
+	for ( int iBatched = 0; iBatched < 2; ++iBatched )
+	{
+		unsigned char *pOut = iBatched ? pCompare : pBuffer;
+		memset( pOut, 0, BUFFER_SIZE );
+
+		double flStart = Plat_FloatTime();
+		for ( int r = 0; r < nReps; ++r )
+		{
+			bf_write buf( pOut, BUFFER_SIZE );
+			pfnWrite( buf, iBatched != 0 );
+			nBits[iBatched] = buf.GetNumBitsWritten();
+		}
+		double flWritten = Plat_FloatTime();
+		for ( int r = 0; r < nReps; ++r )
+		{
+			bf_read buf( pOut, BUFFER_SIZE );
+			pfnRead( buf, iBatched != 0 );
+		}
+		double flRead = Plat_FloatTime();
+
+		flTimes[iBatched][0] = flWritten - flStart;
+		flTimes[iBatched][1] = flRead - flWritten;
+	}
+
+	bool bMatch = nBits[0] == nBits[1] && !memcmp( pBuffer, pCompare, BitByte( nBits[0] ) );
+	double flScale = 1e9 / ( (double)BULK_COUNT * nReps );
+	printf( "  %-20s %8.1f %8.1f %8.1f %8.1f   %s\n", pName,
+		flTimes[0][0] * flScale, flTimes[1][0] * flScale, flTimes[0][1] * flScale, flTimes[1][1] * flScale,
+		bMatch ? "identical" : "MISMATCH" );
+}
+
+static void WriteCoords( bf_write &buf, bool bBatched )
+{
+	if ( bBatched )
+	{
+		buf.WriteBitCoords( s_BulkCoords, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		buf.WriteBitCoord( s_BulkCoords[i] );
+}
+
+static void ReadCoords( bf_read &buf, bool bBatched )
+{
+	if ( bBatched )
+	{
+		buf.ReadBitCoords( s_ReadCoords, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		s_ReadCoords[i] = buf.ReadBitCoord();
+}
+
+static void WriteVec3Coords( bf_write &buf, bool bBatched )
+{
+	if ( bBatched )
+	{
+		buf.WriteBitVec3Coords( s_BulkVectors, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		buf.WriteBitVec3Coord( s_BulkVectors[i] );
+}
+
+static void ReadVec3Coords( bf_read &buf, bool bBatched )
+{
+	if ( bBatched )
+	{
+		buf.ReadBitVec3Coords( s_ReadVectors, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		buf.ReadBitVec3Coord( s_ReadVectors[i] );
+}
+
+static void WriteVec3Normals( bf_write &buf, bool bBatched )
+{
+	if ( bBatched )
+	{
+		buf.WriteBitVec3Normals( s_BulkNormals, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		buf.WriteBitVec3Normal( s_BulkNormals[i] );
+}
+
+static void ReadVec3Normals( bf_read &buf, bool bBatched )
+{
+	if ( bBatched )
+	{
+		buf.ReadBitVec3Normals( s_ReadVectors, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		buf.ReadBitVec3Normal( s_ReadVectors[i] );
+}
+
+static void WriteVarInts( bf_write &buf, bool bBatched )
+{
+	// Start unaligned, so the single-value calls can't take their byte path
+	buf.WriteOneBit( 1 );
+	if ( bBatched )
+	{
+		buf.WriteVarInt32s( s_BulkVarInts, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		buf.WriteVarInt32( s_BulkVarInts[i] );
+}
+
+static void ReadVarInts( bf_read &buf, bool bBatched )
+{
+	buf.ReadOneBit();
+	if ( bBatched )
+	{
+		buf.ReadVarInt32s( s_ReadVarInts, BULK_COUNT );
+		return;
+	}
+	for ( int i = 0; i < BULK_COUNT; ++i )
+		s_ReadVarInts[i] = buf.ReadVarInt32();
+}
+
+int main( int argc, char **argv )
+{
+	int nEntities = DEFAULT_ENTITY_COUNT;
+	int nTicks = DEFAULT_TICK_COUNT;
+	int nReps = 8;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !Q_stricmp( argv[i], "-ents" ) && i + 1 < argc )
+		{
+			nEntities = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-ticks" ) && i + 1 < argc )
+		{
+			nTicks = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else if ( !Q_stricmp( argv[i], "-reps" ) && i + 1 < argc )
+		{
+			nReps = MAX( atoi( argv[i + 1] ), 1 );
+			++i;
+		}
+		else
+		{
+			Usage();
+		}
+	}
+
+	unsigned char *pBuffer = (unsigned char *)malloc( BUFFER_SIZE );
+	unsigned char *pCompare = (unsigned char *)malloc( BUFFER_SIZE );
+
+	// Snapshot deltas: every tick, every entity sends whatever changed
+	int nDeltas = nEntities * nTicks;
+	BenchDelta_t *pDeltas = new BenchDelta_t[nDeltas];
+	BenchDelta_t *pDecoded = new BenchDelta_t[2];
+	for ( int i = 0; i < nDeltas; ++i )
+	{
+		BuildDelta( pDeltas[i] );
+	}
+
+	printf( "%d entities x %d ticks, %d props per table, %d reps\n", nEntities, nTicks, NUM_PROPS, nReps );
+	printf( "  %-20s %8s %8s %8s %8s   (ms per rep)\n", "", "write", "batched", "read", "batched" );
+
+	double flTimes[2][2];
+	int nBits[2];
+	for ( int iBatched = 0; iBatched < 2; ++iBatched )
+	{
+		unsigned char *pOut = iBatched ? pCompare : pBuffer;
+		memset( pOut, 0, BUFFER_SIZE );
+
+		double flStart = Plat_FloatTime();
+		for ( int r = 0; r < nReps; ++r )
+		{
+			bf_write buf( pOut, BUFFER_SIZE );
+			for ( int i = 0; i < nDeltas; ++i )
+			{
+				WriteDelta( buf, pDeltas[i], iBatched != 0 );
+			}
+			nBits[iBatched] = buf.GetNumBitsWritten();
+		}
+		double flWritten = Plat_FloatTime();
+		for ( int r = 0; r < nReps; ++r )
+		{
+			bf_read buf( pOut, BUFFER_SIZE );
+			for ( int i = 0; i < nDeltas; ++i )
+			{
+				ReadDelta( buf, pDecoded[0], iBatched != 0 );
+			}
+		}
+		double flRead = Plat_FloatTime();
+
+		flTimes[iBatched][0] = flWritten - flStart;
+		flTimes[iBatched][1] = flRead - flWritten;
+	}
+
+	// Both readers must agree on every (quantized) value
+	bool bDecodeOk = true;
+	bf_read single( pBuffer, BUFFER_SIZE );
+	bf_read batched( pBuffer, BUFFER_SIZE );
+	for ( int i = 0; i < nDeltas && bDecodeOk; ++i )
+	{
+		ReadDelta( single, pDecoded[0], false );
+		ReadDelta( batched, pDecoded[1], true );
+		bDecodeOk = DeltasMatch( pDecoded[0], pDecoded[1] ) && pDecoded[0].m_nChanged == pDeltas[i].m_nChanged;
+	}
+
+	bool bMatch = nBits[0] == nBits[1] && !memcmp( pBuffer, pCompare, BitByte( nBits[0] ) );
+	printf( "  %-20s %8.3f %8.3f %8.3f %8.3f   %d bytes, %s, %s\n", "entity deltas",
+		flTimes[0][0] * 1000.0 / nReps, flTimes[1][0] * 1000.0 / nReps, flTimes[0][1] * 1000.0 / nReps, flTimes[1][1] * 1000.0 / nReps,
+		BitByte( nBits[0] ), bMatch ? "identical" : "MISMATCH", bDecodeOk ? "decoded ok" : "DECODE FAILED" );
+
+	for ( int i = 0; i < BULK_COUNT; ++i )
+	{
+		s_BulkCoords[i] = RandomFloat( -16384.0f, 16384.0f );
+		s_BulkVectors[i].Init( RandomFloat( -16384.0f, 16384.0f ), RandomFloat( -16384.0f, 16384.0f ), ( i & 3 ) ? RandomFloat( -512.0f, 512.0f ) : 0.0f );
+		s_BulkNormals[i].Init( RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ) );
+		s_BulkNormals[i].NormalizeInPlace();
+		s_BulkVarInts[i] = RandomInt() >> ( RandomInt() % 24 );
+	}
+
+	printf( "\n%d elements, %d reps\n", BULK_COUNT, nReps );
+	printf( "  %-20s %8s %8s %8s %8s   (ns per element)\n", "", "write", "batched", "read", "batched" );
+	TimeBulk( "bit coords", pBuffer, pCompare, nReps, WriteCoords, ReadCoords );
+	TimeBulk( "vec3 coords", pBuffer, pCompare, nReps, WriteVec3Coords, ReadVec3Coords );
+	TimeBulk( "vec3 normals", pBuffer, pCompare, nReps, WriteVec3Normals, ReadVec3Normals );
+	TimeBulk( "varint32", pBuffer, pCompare, nReps, WriteVarInts, ReadVarInts );
+
+	delete[] pDecoded;
+	delete[] pDeltas;
+	free( pCompare );
+	free( pBuffer );
+	return 0;
+}
@@ -89,6 +89,8 @@ float g_flSkySampleScale = 1.0;
 
 bool g_bLargeDispSampleRadius = false;
 
+bool g_bDispTraceBench = false;
+
 bool g_bOnlyStaticProps = false;
 bool g_bShowStaticPropNormals = false;
 
@@ -2404,6 +2406,10 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bLargeDispSampleRadius = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-disptracebench" ) )
+		{
+			g_bDispTraceBench = true;
+		}
 		else if (!Q_stricmp(argv[i],"-bounce"))
 		{
 			if ( ++i < argc )
@@ -2791,6 +2797,8 @@ void PrintUsage( int argc, char **argv )
 		"  -dump           : Write debugging .txt files.\n"
 		"  -dumpnormals    : Write normals to debug files.\n"
 		"  -dumptrace      : Write ray-tracing environment to debug files.\n"
+		"  -disptracebench : Time traces against the displacement collision trees\n"
+		"                    and exit without lighting.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -lights <file>  : Load a lights file in addition to lights.rad and the\n"
@@ -2884,6 +2892,15 @@ int RunVRAD( int argc, char **argv )
 
 	VRAD_LoadBSP( argv[i] );
 
+	if ( g_bDispTraceBench )
+	{
+		StaticDispMgr()->TraceBenchmark();
+
+		DeleteCmdLine( argc, argv );
+		CmdLib_Cleanup();
+		return 0;
+	}
+
 	if ( (! onlydetail) && (! g_bOnlyStaticProps ) )
 	{
 		RadWorld_Go();